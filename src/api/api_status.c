@@ -26,6 +26,15 @@
 #include "api.h"
 #include "tcp.h"
 #include "input.h"
+#include "atomic.h"
+#include "tvhpool.h"
+#include "htsp_server.h"
+#include "settings.h"
+#include "epg.h"
+#include "epggrab.h"
+#if ENABLE_TIMESHIFT
+#include "timeshift.h"
+#endif
 
 static int
 api_status_inputs
@@ -90,6 +99,98 @@ api_status_connections
   return 0;
 }
 
+static int
+api_status_timers
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  gtimer_stats_t st;
+
+  pthread_mutex_lock(&global_lock);
+  gtimer_get_stats(&st);
+  pthread_mutex_unlock(&global_lock);
+
+  *resp = htsmsg_create_map();
+  htsmsg_add_u32(*resp, "armed", st.gts_armed);
+  htsmsg_add_s64(*resp, "fired", st.gts_fired);
+  htsmsg_add_s64(*resp, "late_avg",
+                 st.gts_fired ? st.gts_late_us / st.gts_fired : 0);
+  htsmsg_add_s64(*resp, "late_max", st.gts_late_max);
+
+  return 0;
+}
+
+#if ENABLE_TIMESHIFT
+static int
+api_status_timeshift
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = htsmsg_create_map();
+  htsmsg_add_s64(*resp, "size",
+                 atomic_pre_add_u64(&timeshift_total_size, 0));
+  htsmsg_add_s64(*resp, "ram_size",
+                 atomic_pre_add_u64(&timeshift_total_ram_size, 0));
+  htsmsg_add_s64(*resp, "write_syscalls",
+                 atomic_pre_add_u64(&timeshift_write_syscalls, 0));
+  htsmsg_add_s64(*resp, "write_bytes",
+                 atomic_pre_add_u64(&timeshift_write_bytes, 0));
+
+  return 0;
+}
+#endif
+
+static int
+api_status_pools
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = htsmsg_create_map();
+  htsmsg_add_msg(*resp, "entries", tvhpool_stats());
+
+  return 0;
+}
+
+static int
+api_status_settings
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = hts_settings_stats();
+
+  return 0;
+}
+
+static int
+api_status_epgdb
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = epg_save_stats();
+
+  return 0;
+}
+
+static int
+api_status_epggrab
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = htsmsg_create_map();
+  pthread_mutex_lock(&global_lock);
+  htsmsg_add_msg(*resp, "entries", epggrab_ota_stats());
+  pthread_mutex_unlock(&global_lock);
+
+  return 0;
+}
+
+static int
+api_status_htsp
+  ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = htsmsg_create_map();
+  htsmsg_add_s64(*resp, "file_read_bytes",
+                 atomic_pre_add_u64(&htsp_file_read_bytes, 0));
+  htsmsg_add_s64(*resp, "file_sendfile_bytes",
+                 atomic_pre_add_u64(&htsp_file_sendfile_bytes, 0));
+
+  return 0;
+}
+
 static int
 api_connections_cancel
   ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
@@ -126,6 +227,15 @@ void api_status_init ( void )
     { "status/connections",   ACCESS_ADMIN, api_status_connections, NULL },
     { "status/subscriptions", ACCESS_ADMIN, api_status_subscriptions, NULL },
     { "status/inputs",        ACCESS_ADMIN, api_status_inputs, NULL },
+    { "status/timers",        ACCESS_ADMIN, api_status_timers, NULL },
+#if ENABLE_TIMESHIFT
+    { "status/timeshift",     ACCESS_ADMIN, api_status_timeshift, NULL },
+#endif
+    { "status/pools",         ACCESS_ADMIN, api_status_pools, NULL },
+    { "status/settings",      ACCESS_ADMIN, api_status_settings, NULL },
+    { "status/epgdb",         ACCESS_ADMIN, api_status_epgdb, NULL },
+    { "status/epggrab",       ACCESS_ADMIN, api_status_epggrab, NULL },
+    { "status/htsp",          ACCESS_ADMIN, api_status_htsp, NULL },
     { "connections/cancel",   ACCESS_ADMIN, api_connections_cancel, NULL },
     { NULL },
   };
@@ -65,3 +65,25 @@ atomic_pre_add_u64(volatile uint64_t *ptr, uint64_t incr)
   return ret;
 #endif
 }
+
+static inline int
+atomic_cas(volatile int *ptr, int old, int new)
+{
+  return __sync_val_compare_and_swap(ptr, old, new);
+}
+
+static inline uint64_t
+atomic_cas_u64(volatile uint64_t *ptr, uint64_t old, uint64_t new)
+{
+#if ENABLE_ATOMIC64
+  return __sync_val_compare_and_swap(ptr, old, new);
+#else
+  uint64_t ret;
+  pthread_mutex_lock(&atomic_lock);
+  ret = *ptr;
+  if (ret == old)
+    *ptr = new;
+  pthread_mutex_unlock(&atomic_lock);
+  return ret;
+#endif
+}
@@ -16,14 +16,20 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "tvheadend.h"
 #include "avg.h"
-#include <stdlib.h>
+#include "atomic.h"
+
+#define AVGSTAT_SLOT(clock, count) \
+  (((uint64_t)(uint32_t)(clock) << 32) | (uint32_t)(count))
+#define AVGSTAT_CLOCK(v) ((int)((v) >> 32))
+#define AVGSTAT_COUNT(v) ((int)(uint32_t)(v))
 
 void
 avgstat_init(avgstat_t *as, int depth)
 {
-  TAILQ_INIT(&as->as_queue);
-  pthread_mutex_init(&as->as_mutex, NULL);
+  assert(depth < AVGSTAT_SLOTS);
+  avgstat_flush(as);
   as->as_depth = depth;
 }
 
@@ -31,82 +37,79 @@ avgstat_init(avgstat_t *as, int depth)
 void
 avgstat_flush(avgstat_t *as)
 {
-  avgstat_entry_t *ase;
+  int i;
 
-  while((ase = TAILQ_FIRST(&as->as_queue)) != NULL) {
-    TAILQ_REMOVE(&as->as_queue, ase, ase_link);
-    free(ase);
-  }
+  for (i = 0; i < AVGSTAT_SLOTS; i++)
+    as->as_slot[i] = 0;
+  as->as_expire = 0;
 }
 
 
+/*
+ * Buckets older than the depth (relative to the newest clock seen)
+ * are ignored, the ring slot is reused once the clock wraps around
+ */
 static void
 avgstat_expire(avgstat_t *as, int now)
 {
-  avgstat_entry_t *ase;
+  int old;
 
-  while(1) {
-    ase = TAILQ_LAST(&as->as_queue, avgstat_entry_queue);
-    if(ase == NULL || ase->ase_clock > now - as->as_depth) 
+  while ((old = as->as_expire) < now)
+    if (atomic_cas(&as->as_expire, old, now) == old)
       break;
-    TAILQ_REMOVE(&as->as_queue, ase, ase_link);
-    free(ase);
-  }
 }
 
 
 void
 avgstat_add(avgstat_t *as, int count, time_t now)
 {
-  avgstat_entry_t *ase;
-
-  pthread_mutex_lock(&as->as_mutex);
-  ase = TAILQ_FIRST(&as->as_queue);
-  if(ase != NULL && ase->ase_clock == now) {
-    ase->ase_count += count;
-  } else {
-    ase = malloc(sizeof(avgstat_entry_t));
-    TAILQ_INSERT_HEAD(&as->as_queue, ase, ase_link);
-    ase->ase_clock = now;
-    ase->ase_count = count;
+  volatile uint64_t *slot = &as->as_slot[(uint32_t)now % AVGSTAT_SLOTS];
+  uint64_t old, new;
+
+  old = *slot;
+  while (1) {
+    if (AVGSTAT_CLOCK(old) == (int)now)
+      new = old + (uint32_t)count;
+    else
+      new = AVGSTAT_SLOT(now, count);
+    new = atomic_cas_u64(slot, old, new);
+    if (new == old)
+      break;
+    old = new;
   }
 
-  avgstat_expire(as, now);
-  pthread_mutex_unlock(&as->as_mutex);
+  if (AVGSTAT_CLOCK(old) != (int)now)
+    avgstat_expire(as, now);
 }
 
 
-unsigned int
-avgstat_read_and_expire(avgstat_t *as, time_t now)
+static unsigned int
+avgstat_sum(avgstat_t *as, int from)
 {
-  avgstat_entry_t *ase;
-  int r = 0;
+  uint64_t v;
+  int i, r = 0, clock;
+
+  if (from <= as->as_expire - as->as_depth)
+    from = as->as_expire - as->as_depth + 1;
+  for (i = 0; i < AVGSTAT_SLOTS; i++) {
+    v = atomic_add_u64(&as->as_slot[i], 0);
+    clock = AVGSTAT_CLOCK(v);
+    if (clock >= from)
+      r += AVGSTAT_COUNT(v);
+  }
+  return r;
+}
 
-  pthread_mutex_lock(&as->as_mutex);
 
+unsigned int
+avgstat_read_and_expire(avgstat_t *as, time_t now)
+{
   avgstat_expire(as, now);
-
-  TAILQ_FOREACH(ase, &as->as_queue, ase_link)
-    r += ase->ase_count;
-
-  pthread_mutex_unlock(&as->as_mutex);
-  return r;
+  return avgstat_sum(as, INT_MIN);
 }
 
 unsigned int
 avgstat_read(avgstat_t *as, int depth, time_t now)
 {
-  avgstat_entry_t *ase;
-  int r = 0;
-
-  pthread_mutex_lock(&as->as_mutex);
-
-  TAILQ_FOREACH(ase, &as->as_queue, ase_link) {
-    if(ase->ase_clock < now - depth)
-      break;
-    r += ase->ase_count;
-  }
-  pthread_mutex_unlock(&as->as_mutex);
-  return r;
+  return avgstat_sum(as, now - depth);
 }
-
@@ -19,27 +19,25 @@
 #ifndef AVG_H
 #define AVG_H
 
-#include <pthread.h>
-#include "queue.h"
+#include <stdint.h>
+#include <time.h>
 
 /*
- * avg stat queue
+ * avg stat ring
+ *
+ * One bucket per second, indexed by clock modulo AVGSTAT_SLOTS. The
+ * bucket clock (upper 32 bits) and count (lower 32 bits) are updated
+ * together with compare and swap, so adding takes no lock.
  */
 
-TAILQ_HEAD(avgstat_entry_queue, avgstat_entry);
+#define AVGSTAT_SLOTS 16 /* must be greater than the depth */
 
 typedef struct avgstat {
-  pthread_mutex_t as_mutex;
-  struct avgstat_entry_queue as_queue;
+  volatile uint64_t as_slot[AVGSTAT_SLOTS];
+  volatile int as_expire; /* newest clock seen by add or expire */
   int as_depth;  /* in seconds */
 } avgstat_t;
 
-typedef struct avgstat_entry {
-  TAILQ_ENTRY(avgstat_entry) ase_link;
-  int ase_clock;
-  int ase_count;
-} avgstat_entry_t;
-
 void avgstat_init(avgstat_t *as, int maxdepth);
 void avgstat_add(avgstat_t *as, int count, time_t now);
 void avgstat_flush(avgstat_t *as);
@@ -62,6 +62,7 @@ typedef struct channel
 
   /* EPG fields */
   epg_broadcast_tree_t  ch_epg_schedule;
+  epg_broadcast_list_t *ch_epg_eids; ///< dvb_eid hash (EPG_EID_HASH_SIZE)
   epg_broadcast_t      *ch_epg_now;
   epg_broadcast_t      *ch_epg_next;
   gtimer_t              ch_epg_timer;
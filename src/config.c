@@ -470,6 +470,7 @@ config_migrate_v2 ( void )
     htsmsg_add_u32(m, "autodiscovery", 0);
     hts_settings_save(m, "input/iptv/networks/%s/config", u.hex);
     htsmsg_destroy(m);
+    hts_settings_flush(); // the rename below needs the network directory
 
     /* Move muxes */
     hts_settings_buildpath(src, sizeof(src),
@@ -1308,6 +1309,7 @@ config_migrate ( int backup )
   /* Run migrations */
   for ( ; v < ARRAY_SIZE(config_migrate_table); v++) {
     tvhinfo("config", "migrating config from v%d to v%d", v, v+1);
+    hts_settings_flush(); // the steps also access the files directly
     config_migrate_table[v]();
   }
 
@@ -83,6 +83,7 @@ descrambler_init ( void )
 #if (ENABLE_CWC || ENABLE_CAPMT) && !ENABLE_DVBCSA
   ffdecsa_init();
 #endif
+  tvhcsa_pool_init();
   caclient_init();
 }
 
@@ -90,6 +91,7 @@ void
 descrambler_done ( void )
 {
   caclient_done();
+  tvhcsa_pool_done();
 }
 
 /*
@@ -61,4 +61,7 @@ int decrypt_packets(void *keys, unsigned char **cluster);
 
 void ffdecsa_init(void);
 
+// -- select a backend: "32int", "MMX", "SSE2", "AVX2" or "AVX-512"
+int ffdecsa_select(const char *name);
+
 #endif
@@ -67,6 +67,14 @@ MAKEFUNCS(64mmx);
 MAKEFUNCS(128sse2);
 #endif
 
+#ifdef CONFIG_AVX2
+MAKEFUNCS(256avx2);
+#endif
+
+#ifdef CONFIG_AVX512
+MAKEFUNCS(512avx512);
+#endif
+
 static csafuncs_t current;
 
 
@@ -133,6 +141,23 @@ ffdecsa_init(void)
 {
   current = funcs_32int;
 
+#if defined(__i386__) || defined(__x86_64__)
+#ifdef CONFIG_AVX512
+  if (__builtin_cpu_supports("avx512f")) {
+    current = funcs_512avx512;
+    tvhlog(LOG_INFO, "CSA", "Using AVX-512 512bit parallel descrambling");
+    return;
+  }
+#endif
+
+#ifdef CONFIG_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    current = funcs_256avx2;
+    tvhlog(LOG_INFO, "CSA", "Using AVX2 256bit parallel descrambling");
+    return;
+  }
+#endif
+#endif
 
 #if defined(__i386__) || defined(__x86_64__)
 
@@ -194,6 +219,47 @@ ffdecsa_init(void)
   tvhlog(LOG_INFO, "CSA", "Using 32bit parallel descrambling");
 }
 
+/*
+ * Select a backend by name (used by the benchmark), fails when it
+ * is not built or not supported by this CPU
+ */
+int
+ffdecsa_select(const char *name)
+{
+  if (!strcmp(name, "32int")) {
+    current = funcs_32int;
+    return 0;
+  }
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+#ifdef CONFIG_MMX
+  if (!strcmp(name, "MMX") && __builtin_cpu_supports("mmx")) {
+    current = funcs_64mmx;
+    return 0;
+  }
+#endif
+#ifdef CONFIG_SSE2
+  if (!strcmp(name, "SSE2") && __builtin_cpu_supports("sse2")) {
+    current = funcs_128sse2;
+    return 0;
+  }
+#endif
+#ifdef CONFIG_AVX2
+  if (!strcmp(name, "AVX2") && __builtin_cpu_supports("avx2")) {
+    current = funcs_256avx2;
+    return 0;
+  }
+#endif
+#ifdef CONFIG_AVX512
+  if (!strcmp(name, "AVX-512") && __builtin_cpu_supports("avx512f")) {
+    current = funcs_512avx512;
+    return 0;
+  }
+#endif
+#endif
+  return -1;
+}
+
 
 int
 get_internal_parallelism(void)
@@ -432,6 +432,37 @@ static inline void trasp64_128_88cw(unsigned char *data){
   }
 #undef halfrow
 }
+
+//64-256/512------------------------------------------------------
+#if GROUP_PARALLELISM>=256
+/* 64 rows of GROUP_PARALLELISM bits: every 64 bit column is transposed
+   on its own, like the 128 bit versions above do for their two halves */
+#define WORDS_PER_ROW (GROUP_PARALLELISM/64)
+static inline void trasp64_wide_88ccw(unsigned char *data){
+#define row ((unsigned long long int *)data)
+  unsigned long long int col[64];
+  int i,k;
+  for(k=0;k<WORDS_PER_ROW;k++){
+    for(i=0;i<64;i++) col[i]=row[WORDS_PER_ROW*i+k];
+    trasp64_64_88ccw((unsigned char *)col);
+    for(i=0;i<64;i++) row[WORDS_PER_ROW*i+k]=col[i];
+  }
+#undef row
+}
+
+static inline void trasp64_wide_88cw(unsigned char *data){
+#define row ((unsigned long long int *)data)
+  unsigned long long int col[64];
+  int i,k;
+  for(k=0;k<WORDS_PER_ROW;k++){
+    for(i=0;i<64;i++) col[i]=row[WORDS_PER_ROW*i+k];
+    trasp64_64_88cw((unsigned char *)col);
+    for(i=0;i<64;i++) row[WORDS_PER_ROW*i+k]=col[i];
+  }
+#undef row
+}
+#undef WORDS_PER_ROW
+#endif
 #endif
 
 
@@ -489,6 +520,9 @@ trasp64_64_88ccw(sb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88ccw(sb);
 #endif
+#if GROUP_PARALLELISM>=256
+trasp64_wide_88ccw(sb);
+#endif
 DBG(dump_mem("stream_postrot",sb,GROUP_PARALLELISM*8,BYPG));
 
 for(j=0;j<64;j++){
@@ -888,6 +922,9 @@ trasp64_64_88cw(cb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88cw(cb);
 #endif
+#if GROUP_PARALLELISM>=256
+trasp64_wide_88cw(cb);
+#endif
 
 for(j=0;j<64;j++){
   DBG(fprintf(stderr,"postcall postrot cb[%2i]=",j));
@@ -19,10 +19,13 @@
 #include "tvhcsa.h"
 #include "input.h"
 #include "input/mpegts/tsdemux.h"
+#include "atomic.h"
+#include "htsmsg.h"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <time.h>
 
 static void
 tvhcsa_aes_flush
@@ -42,51 +45,261 @@ tvhcsa_aes_descramble
   ts_recv_packet2(s, tsb, len);
 }
 
+/*
+ * Descrambler worker pool
+ */
+
+#define TVHCSA_POOL_MAX  8   /* worker threads */
+#define TVHCSA_JOBS      4   /* clusters in flight per service */
+
+typedef struct tvhcsa_job {
+  TAILQ_ENTRY(tvhcsa_job) cj_link;      /* tvhcsa_pool_queue */
+  TAILQ_ENTRY(tvhcsa_job) cj_csa_link;  /* csa_jobs or csa_jobs_free */
+  tvhcsa_t *cj_csa;
+  uint8_t  *cj_tsbcluster;
+  int       cj_fill;
+  volatile int cj_done;
+  int64_t   cj_queued;
+  int64_t   cj_latency;
+#if ENABLE_DVBCSA
+  struct dvbcsa_bs_batch_s *cj_tsbbatch_even;
+  struct dvbcsa_bs_batch_s *cj_tsbbatch_odd;
+  int cj_fill_even;
+  int cj_fill_odd;
+#endif
+} tvhcsa_job_t;
+
+static pthread_mutex_t tvhcsa_pool_lock;
+static pthread_cond_t  tvhcsa_pool_cond;
+static pthread_cond_t  tvhcsa_pool_done_cond;
+static TAILQ_HEAD(, tvhcsa_job) tvhcsa_pool_queue;
+static pthread_t       tvhcsa_pool_threads[TVHCSA_POOL_MAX];
+static int             tvhcsa_pool_count;
+static int             tvhcsa_pool_running;
+
+static inline int64_t
+tvhcsa_clock(void)
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  return tp.tv_sec * 1000000LL + (tp.tv_nsec / 1000);
+}
+
+static uint8_t *
+tvhcsa_cluster_alloc ( int cluster_size )
+{
+  uint8_t *tsb;
+
+  /* Note: the optimized routines might read memory after last TS packet */
+  /*       allocate safe memory and fill it with zeros */
+  tsb = malloc((cluster_size + 1) * 188);
+  memset(tsb + cluster_size * 188, 0, 188);
+  return tsb;
+}
+
 static void
-tvhcsa_des_flush
-  ( tvhcsa_t *csa, struct mpegts_service *s )
+tvhcsa_des_decrypt
+  ( tvhcsa_t *csa, tvhcsa_job_t *cj )
 {
 #if ENABLE_DVBCSA
 
-  if(csa->csa_fill_even) {
-    csa->csa_tsbbatch_even[csa->csa_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
-    csa->csa_fill_even = 0;
+  if(cj->cj_fill_even) {
+    cj->cj_tsbbatch_even[cj->cj_fill_even].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_even, cj->cj_tsbbatch_even, 184);
+    cj->cj_fill_even = 0;
   }
-  if(csa->csa_fill_odd) {
-    csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
-    csa->csa_fill_odd = 0;
+  if(cj->cj_fill_odd) {
+    cj->cj_tsbbatch_odd[cj->cj_fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_odd, cj->cj_tsbbatch_odd, 184);
+    cj->cj_fill_odd = 0;
   }
 
-  ts_recv_packet2(s, csa->csa_tsbcluster, csa->csa_fill * 188);
-
-  csa->csa_fill = 0;
-
 #else
 
-  int r, l;
   unsigned char *vec[3];
 
-  vec[0] = csa->csa_tsbcluster;
-  vec[1] = csa->csa_tsbcluster + csa->csa_fill * 188;
+  vec[0] = cj->cj_tsbcluster;
+  vec[1] = cj->cj_tsbcluster + cj->cj_fill * 188;
   vec[2] = NULL;
 
-  r = decrypt_packets(csa->csa_keys, vec);
-  if(r > 0) {
-    ts_recv_packet2(s, csa->csa_tsbcluster, r * 188);
+  /* decrypt_packets() handles one key parity per call */
+  while(vec[0] != NULL)
+    if(decrypt_packets(csa->csa_keys, vec) <= 0)
+      break;
 
-    l = csa->csa_fill - r;
-    assert(l >= 0);
+#endif
+}
 
-    if(l > 0)
-      memmove(csa->csa_tsbcluster, csa->csa_tsbcluster + r * 188, l * 188);
-    csa->csa_fill = l;
-  } else {
-    csa->csa_fill = 0;
+static void *
+tvhcsa_pool_thread ( void *aux )
+{
+  tvhcsa_job_t *cj;
+
+  pthread_mutex_lock(&tvhcsa_pool_lock);
+  while(1) {
+    cj = TAILQ_FIRST(&tvhcsa_pool_queue);
+    if(cj == NULL) {
+      if(!tvhcsa_pool_running)
+        break;
+      pthread_cond_wait(&tvhcsa_pool_cond, &tvhcsa_pool_lock);
+      continue;
+    }
+    TAILQ_REMOVE(&tvhcsa_pool_queue, cj, cj_link);
+    pthread_mutex_unlock(&tvhcsa_pool_lock);
+
+    tvhcsa_des_decrypt(cj->cj_csa, cj);
+
+    pthread_mutex_lock(&tvhcsa_pool_lock);
+    cj->cj_latency = tvhcsa_clock() - cj->cj_queued;
+    atomic_add(&cj->cj_done, 1);
+    pthread_cond_broadcast(&tvhcsa_pool_done_cond);
   }
+  pthread_mutex_unlock(&tvhcsa_pool_lock);
+  return NULL;
+}
 
+void
+tvhcsa_pool_init ( void )
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+
+  pthread_mutex_init(&tvhcsa_pool_lock, NULL);
+  pthread_cond_init(&tvhcsa_pool_cond, NULL);
+  pthread_cond_init(&tvhcsa_pool_done_cond, NULL);
+  TAILQ_INIT(&tvhcsa_pool_queue);
+
+  /* Single core - descramble on the input thread */
+  if(cpus <= 1)
+    return;
+  if(cpus > TVHCSA_POOL_MAX)
+    cpus = TVHCSA_POOL_MAX;
+
+  tvhcsa_pool_running = 1;
+  for(i = 0; i < cpus; i++)
+    tvhthread_create(&tvhcsa_pool_threads[i], NULL, tvhcsa_pool_thread, NULL);
+  tvhcsa_pool_count = cpus;
+  tvhlog(LOG_INFO, "CSA", "Using %d descrambler threads", tvhcsa_pool_count);
+}
+
+void
+tvhcsa_pool_done ( void )
+{
+  int i, count = tvhcsa_pool_count;
+
+  pthread_mutex_lock(&tvhcsa_pool_lock);
+  tvhcsa_pool_running = 0;
+  pthread_cond_broadcast(&tvhcsa_pool_cond);
+  pthread_mutex_unlock(&tvhcsa_pool_lock);
+  for(i = 0; i < count; i++)
+    pthread_join(tvhcsa_pool_threads[i], NULL);
+  /* the workers drain the queue before they exit */
+  tvhcsa_pool_count = 0;
+}
+
+static void
+tvhcsa_job_wait ( tvhcsa_job_t *cj )
+{
+  pthread_mutex_lock(&tvhcsa_pool_lock);
+  while(!cj->cj_done)
+    pthread_cond_wait(&tvhcsa_pool_done_cond, &tvhcsa_pool_lock);
+  pthread_mutex_unlock(&tvhcsa_pool_lock);
+}
+
+/*
+ * Pass decrypted clusters to the demuxer in submission order. With
+ * 'wait' set, block until all clusters in flight are done.
+ */
+static void
+tvhcsa_des_deliver
+  ( tvhcsa_t *csa, struct mpegts_service *s, int wait )
+{
+  tvhcsa_job_t *cj;
+
+  while((cj = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    if(!atomic_add(&cj->cj_done, 0)) {
+      if(!wait)
+        break;
+      tvhcsa_job_wait(cj);
+      csa->csa_stat_waits++;
+    }
+    TAILQ_REMOVE(&csa->csa_jobs, cj, cj_csa_link);
+    csa->csa_stat_latency += cj->cj_latency;
+    if(cj->cj_latency > csa->csa_stat_latency_max)
+      csa->csa_stat_latency_max = cj->cj_latency;
+    if(s)
+      ts_recv_packet2(s, cj->cj_tsbcluster, cj->cj_fill * 188);
+    TAILQ_INSERT_TAIL(&csa->csa_jobs_free, cj, cj_csa_link);
+  }
+}
+
+static void
+tvhcsa_des_submit
+  ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  tvhcsa_job_t *cj;
+  uint8_t *tsb;
+
+  /* Too many clusters in flight, wait for the oldest one */
+  if((cj = TAILQ_FIRST(&csa->csa_jobs_free)) == NULL) {
+    cj = TAILQ_FIRST(&csa->csa_jobs);
+    tvhcsa_job_wait(cj);
+    csa->csa_stat_waits++;
+    tvhcsa_des_deliver(csa, s, 0);
+    cj = TAILQ_FIRST(&csa->csa_jobs_free);
+  }
+  TAILQ_REMOVE(&csa->csa_jobs_free, cj, cj_csa_link);
+
+  /* The job takes over the filled cluster */
+  tsb = cj->cj_tsbcluster;
+  cj->cj_tsbcluster = csa->csa_tsbcluster;
+  csa->csa_tsbcluster = tsb;
+  cj->cj_fill = csa->csa_fill;
+  csa->csa_fill = 0;
+#if ENABLE_DVBCSA
+  {
+    struct dvbcsa_bs_batch_s *b;
+    b = cj->cj_tsbbatch_even;
+    cj->cj_tsbbatch_even = csa->csa_tsbbatch_even;
+    csa->csa_tsbbatch_even = b;
+    b = cj->cj_tsbbatch_odd;
+    cj->cj_tsbbatch_odd = csa->csa_tsbbatch_odd;
+    csa->csa_tsbbatch_odd = b;
+    cj->cj_fill_even = csa->csa_fill_even;
+    cj->cj_fill_odd = csa->csa_fill_odd;
+    csa->csa_fill_even = csa->csa_fill_odd = 0;
+  }
 #endif
+
+  csa->csa_stat_batches++;
+  csa->csa_stat_packets += cj->cj_fill;
+
+  cj->cj_done = 0;
+  cj->cj_latency = 0;
+  TAILQ_INSERT_TAIL(&csa->csa_jobs, cj, cj_csa_link);
+
+  if(tvhcsa_pool_count == 0) {
+    tvhcsa_des_decrypt(csa, cj);
+    cj->cj_done = 1;
+    tvhcsa_des_deliver(csa, s, 0);
+    return;
+  }
+
+  cj->cj_queued = tvhcsa_clock();
+  pthread_mutex_lock(&tvhcsa_pool_lock);
+  TAILQ_INSERT_TAIL(&tvhcsa_pool_queue, cj, cj_link);
+  pthread_cond_signal(&tvhcsa_pool_cond);
+  pthread_mutex_unlock(&tvhcsa_pool_lock);
+}
+
+static void
+tvhcsa_des_flush
+  ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  if(csa->csa_fill)
+    tvhcsa_des_submit(csa, s);
+  tvhcsa_des_deliver(csa, s, 1);
 }
 
 static void
@@ -97,6 +310,9 @@ tvhcsa_des_descramble
 
   assert(csa->csa_fill >= 0 && csa->csa_fill < csa->csa_cluster_size);
 
+  if(TAILQ_FIRST(&csa->csa_jobs))
+    tvhcsa_des_deliver(csa, s, 0);
+
 #if ENABLE_DVBCSA
   uint8_t *pkt;
   int xc0;
@@ -149,7 +365,7 @@ tvhcsa_des_descramble
    } while(0);
 
    if(csa->csa_fill == csa->csa_cluster_size)
-     tvhcsa_des_flush(csa, s);
+     tvhcsa_des_submit(csa, s);
 
   }
 
@@ -161,13 +377,49 @@ tvhcsa_des_descramble
     csa->csa_fill++;
 
     if(csa->csa_fill == csa->csa_cluster_size)
-      tvhcsa_des_flush(csa, s);
+      tvhcsa_des_submit(csa, s);
 
   }
 
 #endif
 }
 
+/*
+ * The cluster size follows the batch width of the CSA implementation
+ * selected at startup, so it is only known once the type is set.
+ */
+static void
+tvhcsa_des_alloc ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *cj;
+  int i;
+
+#if ENABLE_DVBCSA
+  csa->csa_cluster_size  = dvbcsa_bs_batch_size();
+#else
+  csa->csa_cluster_size  = get_suggested_cluster_size();
+#endif
+  csa->csa_tsbcluster    = tvhcsa_cluster_alloc(csa->csa_cluster_size);
+#if ENABLE_DVBCSA
+  csa->csa_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
+                                   sizeof(struct dvbcsa_bs_batch_s));
+  csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
+                                   sizeof(struct dvbcsa_bs_batch_s));
+#endif
+  for (i = 0; i < TVHCSA_JOBS; i++) {
+    cj = calloc(1, sizeof(*cj));
+    cj->cj_csa = csa;
+    cj->cj_tsbcluster = tvhcsa_cluster_alloc(csa->csa_cluster_size);
+#if ENABLE_DVBCSA
+    cj->cj_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+    cj->cj_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+#endif
+    TAILQ_INSERT_TAIL(&csa->csa_jobs_free, cj, cj_csa_link);
+  }
+}
+
 int
 tvhcsa_set_type( tvhcsa_t *csa, int type )
 {
@@ -177,6 +429,7 @@ tvhcsa_set_type( tvhcsa_t *csa, int type )
     return -1;
   switch (type) {
   case DESCRAMBLER_DES:
+    tvhcsa_des_alloc(csa);
     csa->csa_descramble = tvhcsa_des_descramble;
     csa->csa_flush      = tvhcsa_des_flush;
     csa->csa_keylen     = 8;
@@ -236,20 +489,15 @@ tvhcsa_init ( tvhcsa_t *csa )
 {
   csa->csa_type          = 0;
   csa->csa_keylen        = 0;
+  csa->csa_cluster_size  = 0;
+  csa->csa_tsbcluster    = NULL;
 #if ENABLE_DVBCSA
-  csa->csa_cluster_size  = dvbcsa_bs_batch_size();
-#else
-  csa->csa_cluster_size  = get_suggested_cluster_size();
+  csa->csa_tsbbatch_even = NULL;
+  csa->csa_tsbbatch_odd  = NULL;
 #endif
-  /* Note: the optimized routines might read memory after last TS packet */
-  /*       allocate safe memory and fill it with zeros */
-  csa->csa_tsbcluster    = malloc((csa->csa_cluster_size + 1) * 188);
-  memset(csa->csa_tsbcluster + csa->csa_cluster_size * 188, 0, 188);
+  TAILQ_INIT(&csa->csa_jobs);
+  TAILQ_INIT(&csa->csa_jobs_free);
 #if ENABLE_DVBCSA
-  csa->csa_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-  csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
   csa->csa_key_even      = dvbcsa_bs_key_alloc();
   csa->csa_key_odd       = dvbcsa_bs_key_alloc();
 #else
@@ -261,6 +509,19 @@ tvhcsa_init ( tvhcsa_t *csa )
 void
 tvhcsa_destroy ( tvhcsa_t *csa )
 {
+  tvhcsa_job_t *cj;
+
+  /* the workers might still use the keys and buffers */
+  tvhcsa_des_deliver(csa, NULL, 1);
+  while ((cj = TAILQ_FIRST(&csa->csa_jobs_free)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_jobs_free, cj, cj_csa_link);
+#if ENABLE_DVBCSA
+    free(cj->cj_tsbbatch_odd);
+    free(cj->cj_tsbbatch_even);
+#endif
+    free(cj->cj_tsbcluster);
+    free(cj);
+  }
 #if ENABLE_DVBCSA
   dvbcsa_bs_key_free(csa->csa_key_odd);
   dvbcsa_bs_key_free(csa->csa_key_even);
@@ -272,3 +533,18 @@ tvhcsa_destroy ( tvhcsa_t *csa )
   aes_free_key_struct(csa->csa_aes_keys);
   free(csa->csa_tsbcluster);
 }
+
+void
+tvhcsa_add_stats ( tvhcsa_t *csa, htsmsg_t *m )
+{
+  if (csa->csa_stat_batches == 0)
+    return;
+  htsmsg_add_s64(m, "descramble_batches", csa->csa_stat_batches);
+  htsmsg_add_u32(m, "descramble_fill",
+                 (csa->csa_stat_packets * 100) /
+                 (csa->csa_stat_batches * csa->csa_cluster_size));
+  htsmsg_add_s64(m, "descramble_latency",
+                 csa->csa_stat_latency / csa->csa_stat_batches);
+  htsmsg_add_s64(m, "descramble_latency_max", csa->csa_stat_latency_max);
+  htsmsg_add_s64(m, "descramble_waits", csa->csa_stat_waits);
+}
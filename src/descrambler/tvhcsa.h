@@ -21,9 +21,12 @@
 
 struct mpegts_service;
 struct elementary_stream;
+struct tvhcsa_job;
+struct htsmsg;
 
 #include <stdint.h>
 #include "build.h"
+#include "queue.h"
 #if ENABLE_DVBCSA
 #include <dvbcsa/dvbcsa.h>
 #else
@@ -50,6 +53,19 @@ typedef struct tvhcsa
   uint8_t *csa_tsbcluster;
   int      csa_fill;
 
+  /*
+   * Full clusters are handed to the descrambler worker pool and
+   * delivered back to ts_recv_packet2() in submission order
+   */
+  TAILQ_HEAD(, tvhcsa_job) csa_jobs;
+  TAILQ_HEAD(, tvhcsa_job) csa_jobs_free;
+
+  uint64_t csa_stat_batches;
+  uint64_t csa_stat_packets;
+  uint64_t csa_stat_latency;
+  int64_t  csa_stat_latency_max;
+  uint64_t csa_stat_waits;
+
 #if ENABLE_DVBCSA
   struct dvbcsa_bs_batch_s *csa_tsbbatch_even;
   struct dvbcsa_bs_batch_s *csa_tsbbatch_odd;
@@ -75,6 +91,11 @@ void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd );
 void tvhcsa_init    ( tvhcsa_t *csa );
 void tvhcsa_destroy ( tvhcsa_t *csa );
 
+void tvhcsa_add_stats ( tvhcsa_t *csa, struct htsmsg *m );
+
+void tvhcsa_pool_init ( void );
+void tvhcsa_pool_done ( void );
+
 #else
 
 static inline int tvhcsa_set_type( tvhcsa_t *csa, int type ) { return -1; }
@@ -85,6 +106,11 @@ static inline void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd ) { };
 static inline void tvhcsa_init ( tvhcsa_t *csa ) { };
 static inline void tvhcsa_destroy ( tvhcsa_t *csa ) { };
 
+static inline void tvhcsa_add_stats ( tvhcsa_t *csa, struct htsmsg *m ) { };
+
+static inline void tvhcsa_pool_init ( void ) { };
+static inline void tvhcsa_pool_done ( void ) { };
+
 #endif
 
 #endif /* __TVH_CSA_H__ */
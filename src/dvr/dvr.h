@@ -134,6 +134,9 @@ typedef struct dvr_entry {
    */
 
   LIST_ENTRY(dvr_entry) de_global_link;
+  LIST_ENTRY(dvr_entry) de_id_link;     /* Short id hash */
+  LIST_ENTRY(dvr_entry) de_bcast_link;  /* Broadcast hash */
+  int de_indexed;                       /* In dvrentries and the hashes */
   
   channel_t *de_channel;
   LIST_ENTRY(dvr_entry) de_channel_link;
@@ -275,6 +278,7 @@ typedef struct dvr_autorec_entry {
 
   char *dae_title;
   regex_t dae_title_preg;
+  char *dae_title_lit;  /* Literal every match contains (prefilter) */
   int dae_fulltext;
   
   uint32_t dae_content_type;
@@ -307,6 +311,15 @@ typedef struct dvr_autorec_entry {
   time_t dae_stop_extra;
   
   int dae_record;
+
+  /* Matching statistics */
+  uint32_t dae_stat_eval;   /* Events checked */
+  uint32_t dae_stat_regex;  /* Regular expression runs */
+  uint32_t dae_stat_match;  /* Events matched */
+
+  /* Inverted index (see dvr_autorec_check_event) */
+  int dae_index;            /* Dimension the entry is filed under */
+  int dae_index_seq;        /* Position in autorec_entries */
   
 } dvr_autorec_entry_t;
 
@@ -574,6 +587,8 @@ void dvr_autorec_done(void);
 
 void dvr_autorec_update(void);
 
+void dvr_autorec_index_invalidate(void);
+
 static inline int dvr_autorec_entry_verify(dvr_autorec_entry_t *dae, access_t *a)
 {
   if (strcmp(dae->dae_owner ?: "", a->aa_username ?: ""))
@@ -16,6 +16,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <pthread.h>
 #include <ctype.h>
 #include <assert.h>
@@ -57,12 +58,121 @@ dvr_autorec_purge_spawns(dvr_autorec_entry_t *dae, int del)
   }
 }
 
+/**
+ * Find the longest literal which every match of an extended regular
+ * expression must contain. Only plain ASCII is used, so the literal
+ * can be tested with strcasestr() like REG_ICASE would.
+ */
+static inline int
+autorec_literal_char(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || strchr(" -_,:;'\"!&/=%@#~<>", c);
+}
+
+static char *
+autorec_regex_literal(const char *re)
+{
+  const char *s, *best = NULL, *run = NULL;
+  int depth = 0, len, best_len = 0;
+  char c;
+
+  for (s = re; ; s++) {
+    c = *s;
+    if (run) {
+      len = s - run;
+      if (c == '?' || c == '*' || c == '{')
+        len--; /* the last character is optional */
+      if (len > best_len) {
+        best = run;
+        best_len = len;
+      }
+    }
+    if (c == '\0')
+      break;
+    if (depth == 0 && autorec_literal_char(c)) {
+      if (!run) run = s;
+      continue;
+    }
+    run = NULL;
+    switch (c) {
+      case '|':
+        if (depth == 0)
+          return NULL;
+        break;
+      case '(':
+        depth++;
+        break;
+      case ')':
+        if (depth) depth--;
+        break;
+      case '[':
+        s++;
+        if (*s == '^') s++;
+        if (*s == ']') s++;
+        while (*s && *s != ']') s++;
+        if (!*s) return NULL;
+        break;
+      case '{':
+        while (*s && *s != '}') s++;
+        if (!*s) return NULL;
+        break;
+      case '\\':
+        if (!s[1]) return NULL;
+        s++;
+        break;
+    }
+  }
+  if (best_len < 2)
+    return NULL;
+  return strndup(best, best_len);
+}
+
+/**
+ * Event properties shared by all rules, computed on first use
+ */
+typedef struct autorec_event {
+  epg_broadcast_t *e;
+  int              local;  /* tm and te are valid */
+  struct tm        tm;     /* Local start time */
+  time_t           te;
+} autorec_event_t;
+
+static inline void
+autorec_event_local(autorec_event_t *ev)
+{
+  if (!ev->local) {
+    localtime_r(&ev->e->start, &ev->tm);
+    ev->te = mktime(&ev->tm);
+    ev->local = 1;
+  }
+}
+
+static int
+autorec_regexec(dvr_autorec_entry_t *dae, lang_str_t *str)
+{
+  lang_str_ele_t *ls;
+
+  if (!str) return 0;
+  RB_FOREACH(ls, str, link) {
+    if (dae->dae_title_lit && !strcasestr(ls->str, dae->dae_title_lit))
+      continue;
+    dae->dae_stat_regex++;
+    if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0))
+      return 1;
+  }
+  return 0;
+}
+
 /**
  * return 1 if the event 'e' is matched by the autorec rule 'dae'
+ *
+ * The cheap tests run first, the title regex only for the survivors
  */
 static int
-autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
+autorec_cmp(dvr_autorec_entry_t *dae, autorec_event_t *ev)
 {
+  epg_broadcast_t *e = ev->e;
   channel_tag_mapping_t *ctm;
   dvr_config_t *cfg;
   double duration;
@@ -84,6 +194,8 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
      dae->dae_serieslink == NULL)
     return 0; // Avoid super wildcard match
 
+  dae->dae_stat_eval++;
+
   // Note: we always test season first, though it will only be set
   //       if configured
   if(dae->dae_serieslink) {
@@ -94,29 +206,6 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
     if(dae->dae_brand)
       if (!e->episode->brand || dae->dae_brand != e->episode->brand) return 0;
   }
-  if(dae->dae_title != NULL && dae->dae_title[0] != '\0') {
-    lang_str_ele_t *ls;
-    if (!dae->dae_fulltext) {
-      if(!e->episode->title) return 0;
-      RB_FOREACH(ls, e->episode->title, link)
-        if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
-    } else {
-      ls = NULL;
-      if (e->episode->title)
-        RB_FOREACH(ls, e->episode->title, link)
-          if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
-      if (!ls && e->episode->subtitle)
-        RB_FOREACH(ls, e->episode->subtitle, link)
-          if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
-      if (!ls && e->summary)
-        RB_FOREACH(ls, e->summary, link)
-          if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
-      if (!ls && e->description)
-        RB_FOREACH(ls, e->description, link)
-          if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
-    }
-    if (!ls) return 0;
-  }
 
   // Note: ignore channel test if we allow quality unlocking 
   if ((cfg = dae->dae_config) == NULL)
@@ -131,8 +220,8 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
     }
 
   if(dae->dae_channel_tag != NULL) {
-    LIST_FOREACH(ctm, &dae->dae_channel_tag->ct_ctms, ctm_tag_link)
-      if(ctm->ctm_channel == e->channel)
+    LIST_FOREACH(ctm, &e->channel->ch_ctms, ctm_channel_link)
+      if(ctm->ctm_tag == dae->dae_channel_tag)
 	break;
     if(ctm == NULL)
       return 0;
@@ -146,16 +235,32 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
       return 0;
   }
 
+  duration = difftime(e->stop,e->start);
+
+  if(dae->dae_minduration > 0) {
+    if(duration < dae->dae_minduration) return 0;
+  }
+
+  if(dae->dae_maxduration > 0) {
+    if(duration > dae->dae_maxduration) return 0;
+  }
+
+  if(dae->dae_weekdays != 0x7f) {
+    autorec_event_local(ev);
+    if(!((1 << ((ev->tm.tm_wday ?: 7) - 1)) & dae->dae_weekdays))
+      return 0;
+  }
+
   if(dae->dae_start >= 0 && dae->dae_start_window >= 0 &&
      dae->dae_start < 24*60 && dae->dae_start_window < 24*60) {
-    struct tm a_time, ev_time;
+    struct tm a_time;
     time_t ta, te, tad;
-    localtime_r(&e->start, &a_time);
-    ev_time = a_time;
+    autorec_event_local(ev);
+    a_time = ev->tm;
     a_time.tm_min = dae->dae_start % 60;
     a_time.tm_hour = dae->dae_start / 60;
     ta = mktime(&a_time);
-    te = mktime(&ev_time);
+    te = ev->te;
     if(dae->dae_start > dae->dae_start_window) {
       ta -= 24 * 3600; /* 24 hours */
       tad = ((24 * 60) - dae->dae_start + dae->dae_start_window) * 60;
@@ -171,25 +276,253 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
     }
   }
 
-  duration = difftime(e->stop,e->start);
+  if(dae->dae_title != NULL && dae->dae_title[0] != '\0') {
+    if (!dae->dae_fulltext) {
+      if (!autorec_regexec(dae, e->episode->title)) return 0;
+    } else {
+      if (!autorec_regexec(dae, e->episode->title) &&
+          !autorec_regexec(dae, e->episode->subtitle) &&
+          !autorec_regexec(dae, e->summary) &&
+          !autorec_regexec(dae, e->description))
+        return 0;
+    }
+  }
 
-  if(dae->dae_minduration > 0) {
-    if(duration < dae->dae_minduration) return 0;
+  dae->dae_stat_match++;
+  return 1;
+}
+
+/**
+ * Inverted index of the entries
+ *
+ * Every entry is filed under one dimension only, the first of channel,
+ * channel tag, title literal, genre and weekday/start time which limits
+ * the events it can match (entries without any limit are always tried).
+ * dvr_autorec_check_event() evaluates only the entries filed under the
+ * keys of the event. The index is rebuilt by the first check after any
+ * entry (or DVR config) change.
+ */
+#define AUTOREC_INDEX_NONE    0 /* never matches */
+#define AUTOREC_INDEX_CHANNEL 1 /* ch_autorecs of the channel */
+#define AUTOREC_INDEX_TAG     2 /* ct_autorecs of the tag */
+#define AUTOREC_INDEX_TITLE   3 /* one trigram of the title literal */
+#define AUTOREC_INDEX_GENRE   4 /* content type */
+#define AUTOREC_INDEX_TIME    5 /* local start hours of the week */
+#define AUTOREC_INDEX_ALL     6
+
+#define AUTOREC_TITLE_HASH    4096
+#define AUTOREC_TIME_SLOTS    (7 * 24)
+
+typedef struct autorec_posting {
+  dvr_autorec_entry_t **dae;
+  int                   count;
+  int                   size;
+  uint32_t              gen;      /* Already tried for this event */
+} autorec_posting_t;
+
+static struct {
+  int                   valid;
+  int                   fulltext; /* Fulltext entries in the title postings */
+  int                   timed;    /* Entries in the time postings */
+  uint32_t              gen;
+  autorec_posting_t     title[AUTOREC_TITLE_HASH];
+  autorec_posting_t     genre[256];
+  autorec_posting_t     time[AUTOREC_TIME_SLOTS];
+  autorec_posting_t     all;
+  autorec_posting_t     matches;  /* Of the event being checked */
+} autorec_index;
+
+void
+dvr_autorec_index_invalidate(void)
+{
+  autorec_index.valid = 0;
+}
+
+/* Empty (or release) all postings */
+static void
+autorec_index_reset(int release)
+{
+  struct { autorec_posting_t *p; int n; } l[] = {
+    { autorec_index.title, AUTOREC_TITLE_HASH },
+    { autorec_index.genre, ARRAY_SIZE(autorec_index.genre) },
+    { autorec_index.time,  AUTOREC_TIME_SLOTS },
+    { &autorec_index.all,  1 },
+    { &autorec_index.matches, 1 },
+  };
+  autorec_posting_t *p;
+  int i, j;
+
+  for (i = 0; i < ARRAY_SIZE(l); i++)
+    for (j = 0, p = l[i].p; j < l[i].n; j++, p++) {
+      p->count = 0;
+      p->gen   = 0;
+      if (release) {
+        free(p->dae);
+        p->dae  = NULL;
+        p->size = 0;
+      }
+    }
+  autorec_index.gen = 0;
+}
+
+static void
+autorec_posting_add(autorec_posting_t *p, dvr_autorec_entry_t *dae)
+{
+  if (p->count == p->size) {
+    p->size = p->size ? p->size * 2 : 4;
+    p->dae  = realloc(p->dae, p->size * sizeof(*p->dae));
   }
+  p->dae[p->count++] = dae;
+}
 
-  if(dae->dae_maxduration > 0) {
-    if(duration > dae->dae_maxduration) return 0;
+/* Like strcasestr(), the literal is plain ASCII */
+static inline uint32_t
+autorec_trigram(const char *s)
+{
+  uint32_t h = 0;
+  int i;
+  char c;
+
+  for (i = 0; i < 3; i++) {
+    c = s[i];
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h = h * 31 + (uint8_t)c;
   }
+  return h & (AUTOREC_TITLE_HASH - 1);
+}
 
-  if(dae->dae_weekdays != 0x7f) {
-    struct tm tm;
-    localtime_r(&e->start, &tm);
-    if(!((1 << ((tm.tm_wday ?: 7) - 1)) & dae->dae_weekdays))
-      return 0;
+/* File under the least used trigram of the title literal */
+static int
+autorec_index_title(dvr_autorec_entry_t *dae)
+{
+  const char *lit = dae->dae_title_lit;
+  autorec_posting_t *p, *best = NULL;
+  size_t i, len;
+
+  if (!lit || (len = strlen(lit)) < 3)
+    return 0;
+  for (i = 0; i + 3 <= len; i++) {
+    p = &autorec_index.title[autorec_trigram(lit + i)];
+    if (!best || p->count < best->count)
+      best = p;
   }
+  autorec_posting_add(best, dae);
+  if (dae->dae_fulltext)
+    autorec_index.fulltext = 1;
   return 1;
 }
 
+/*
+ * File under the start hours of the allowed weekdays, with an hour
+ * around the window for the DST changes (the window is checked with
+ * mktime() on the event day)
+ */
+static int
+autorec_index_time(dvr_autorec_entry_t *dae)
+{
+  uint8_t slots[AUTOREC_TIME_SLOTS];
+  int d, h, i, s = 0, e = 23, window, wrap = 0;
+
+  window = dae->dae_start >= 0 && dae->dae_start_window >= 0 &&
+           dae->dae_start < 24*60 && dae->dae_start_window < 24*60;
+  if (dae->dae_weekdays == 0x7f && !window)
+    return 0;
+  if (window) {
+    s = dae->dae_start / 60;
+    e = dae->dae_start_window / 60;
+    wrap = dae->dae_start > dae->dae_start_window;
+  }
+  memset(slots, 0, sizeof(slots));
+  for (d = 0; d < 7; d++) {
+    if (!(dae->dae_weekdays & (1 << d)))
+      continue;
+    for (h = 0; h < 24; h++) {
+      if (!wrap ? (h < s || h > e) : (h > e && h < s))
+        continue;
+      for (i = window ? -1 : 0; i <= (window ? 1 : 0); i++)
+        slots[(d * 24 + h + i + AUTOREC_TIME_SLOTS) % AUTOREC_TIME_SLOTS] = 1;
+    }
+  }
+  for (i = 0; i < AUTOREC_TIME_SLOTS; i++)
+    if (slots[i])
+      autorec_posting_add(&autorec_index.time[i], dae);
+  autorec_index.timed = 1;
+  return 1;
+}
+
+static void
+autorec_index_build(void)
+{
+  dvr_autorec_entry_t *dae;
+  dvr_config_t *cfg;
+  int seq = 0;
+
+  autorec_index_reset(0);
+  autorec_index.fulltext = autorec_index.timed = 0;
+
+  TAILQ_FOREACH(dae, &autorec_entries, dae_link) {
+    dae->dae_index_seq = seq++;
+    cfg = dae->dae_config;
+    if (!dae->dae_enabled || !dae->dae_weekdays || !cfg) {
+      dae->dae_index = AUTOREC_INDEX_NONE;
+    } else if (dae->dae_channel && cfg->dvr_sl_quality_lock) {
+      dae->dae_index = AUTOREC_INDEX_CHANNEL;
+    } else if (dae->dae_channel_tag) {
+      dae->dae_index = AUTOREC_INDEX_TAG;
+    } else if (autorec_index_title(dae)) {
+      dae->dae_index = AUTOREC_INDEX_TITLE;
+    } else if (dae->dae_content_type > 0 && dae->dae_content_type < 256) {
+      dae->dae_index = AUTOREC_INDEX_GENRE;
+      autorec_posting_add(&autorec_index.genre[dae->dae_content_type], dae);
+    } else if (autorec_index_time(dae)) {
+      dae->dae_index = AUTOREC_INDEX_TIME;
+    } else {
+      dae->dae_index = AUTOREC_INDEX_ALL;
+      autorec_posting_add(&autorec_index.all, dae);
+    }
+  }
+  autorec_index.valid = 1;
+}
+
+static inline void
+autorec_index_try(dvr_autorec_entry_t *dae, autorec_event_t *ev)
+{
+  if (autorec_cmp(dae, ev))
+    autorec_posting_add(&autorec_index.matches, dae);
+}
+
+static void
+autorec_index_posting(autorec_posting_t *p, autorec_event_t *ev)
+{
+  int i;
+
+  if (p->gen == autorec_index.gen)
+    return;
+  p->gen = autorec_index.gen;
+  for (i = 0; i < p->count; i++)
+    autorec_index_try(p->dae[i], ev);
+}
+
+static void
+autorec_index_text(lang_str_t *str, autorec_event_t *ev)
+{
+  lang_str_ele_t *ls;
+  const char *s;
+
+  if (!str) return;
+  RB_FOREACH(ls, str, link)
+    for (s = ls->str; s[0] && s[1] && s[2]; s++)
+      autorec_index_posting(&autorec_index.title[autorec_trigram(s)], ev);
+}
+
+static int
+autorec_index_seq_cmp(const void *a, const void *b)
+{
+  return (*(dvr_autorec_entry_t **)a)->dae_index_seq -
+         (*(dvr_autorec_entry_t **)b)->dae_index_seq;
+}
+
 /**
  *
  */
@@ -218,6 +551,7 @@ dvr_autorec_create(const char *uuid, htsmsg_t *conf)
 
   idnode_load(&dae->dae_id, conf);
 
+  dvr_autorec_index_invalidate();
   htsp_autorec_entry_add(dae);
 
   return dae;
@@ -325,6 +659,7 @@ autorec_entry_destroy(dvr_autorec_entry_t *dae, int delconf)
   htsp_autorec_entry_delete(dae);
 
   TAILQ_REMOVE(&autorec_entries, dae, dae_link);
+  dvr_autorec_index_invalidate();
   idnode_unlink(&dae->dae_id);
 
   if(dae->dae_config)
@@ -338,6 +673,7 @@ autorec_entry_destroy(dvr_autorec_entry_t *dae, int delconf)
 
   if(dae->dae_title != NULL) {
     free(dae->dae_title);
+    free(dae->dae_title_lit);
     regfree(&dae->dae_title_preg);
   }
 
@@ -468,12 +804,16 @@ dvr_autorec_entry_class_title_set(void *o, const void *v)
     if (dae->dae_title) {
        regfree(&dae->dae_title_preg);
        free(dae->dae_title);
+       free(dae->dae_title_lit);
        dae->dae_title = NULL;
+       dae->dae_title_lit = NULL;
     }
     if (title[0] != '\0' &&
         !regcomp(&dae->dae_title_preg, title,
-                 REG_ICASE | REG_EXTENDED | REG_NOSUB))
+                 REG_ICASE | REG_EXTENDED | REG_NOSUB)) {
       dae->dae_title = strdup(title);
+      dae->dae_title_lit = autorec_regex_literal(title);
+    }
     return 1;
   }
   return 0;
@@ -1080,6 +1420,27 @@ const idclass_t dvr_autorec_entry_class = {
       .name     = "Comment",
       .off      = offsetof(dvr_autorec_entry_t, dae_comment),
     },
+    {
+      .type     = PT_U32,
+      .id       = "stat_eval",
+      .name     = "Events Checked",
+      .off      = offsetof(dvr_autorec_entry_t, dae_stat_eval),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_ADVANCED,
+    },
+    {
+      .type     = PT_U32,
+      .id       = "stat_regex",
+      .name     = "Title Regex Runs",
+      .off      = offsetof(dvr_autorec_entry_t, dae_stat_regex),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_ADVANCED,
+    },
+    {
+      .type     = PT_U32,
+      .id       = "stat_match",
+      .name     = "Events Matched",
+      .off      = offsetof(dvr_autorec_entry_t, dae_stat_match),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_ADVANCED,
+    },
     {}
   }
 };
@@ -1114,6 +1475,7 @@ dvr_autorec_done(void)
   pthread_mutex_lock(&global_lock);
   while ((dae = TAILQ_FIRST(&autorec_entries)) != NULL)
     autorec_entry_destroy(dae, 0);
+  autorec_index_reset(1);
   pthread_mutex_unlock(&global_lock);
 }
 
@@ -1126,17 +1488,70 @@ dvr_autorec_update(void)
   }
 }
 
+/*
+ * Collect the entries matching the event in autorec_index.matches, in
+ * the entry order (the first one owns the recording)
+ */
+static void
+autorec_index_match(epg_broadcast_t *e)
+{
+  dvr_autorec_entry_t *dae;
+  channel_tag_mapping_t *ctm;
+  autorec_posting_t *m = &autorec_index.matches;
+  epg_genre_t *g;
+  autorec_event_t ev = { .e = e };
+
+  m->count = 0;
+  if (!e->channel || !e->episode)
+    return;
+  if (!autorec_index.valid)
+    autorec_index_build();
+  if (++autorec_index.gen == 0) {
+    autorec_index_reset(0);
+    autorec_index_build();
+    autorec_index.gen = 1;
+  }
+
+  LIST_FOREACH(dae, &e->channel->ch_autorecs, dae_channel_link)
+    if (dae->dae_index == AUTOREC_INDEX_CHANNEL)
+      autorec_index_try(dae, &ev);
+  LIST_FOREACH(ctm, &e->channel->ch_ctms, ctm_channel_link)
+    LIST_FOREACH(dae, &ctm->ctm_tag->ct_autorecs, dae_channel_tag_link)
+      if (dae->dae_index == AUTOREC_INDEX_TAG)
+        autorec_index_try(dae, &ev);
+  autorec_index_text(e->episode->title, &ev);
+  if (autorec_index.fulltext) {
+    autorec_index_text(e->episode->subtitle, &ev);
+    autorec_index_text(e->summary, &ev);
+    autorec_index_text(e->description, &ev);
+  }
+  LIST_FOREACH(g, &e->episode->genre, link) {
+    autorec_index_posting(&autorec_index.genre[g->code], &ev);
+    autorec_index_posting(&autorec_index.genre[g->code & 0xf0], &ev);
+  }
+  if (autorec_index.timed) {
+    autorec_event_local(&ev);
+    autorec_index_posting(&autorec_index.time[((ev.tm.tm_wday ?: 7) - 1) * 24 +
+                                              ev.tm.tm_hour], &ev);
+  }
+  autorec_index_posting(&autorec_index.all, &ev);
+
+  if (m->count > 1)
+    qsort(m->dae, m->count, sizeof(*m->dae), autorec_index_seq_cmp);
+}
+
 /**
  *
  */
 void
 dvr_autorec_check_event(epg_broadcast_t *e)
 {
-  dvr_autorec_entry_t *dae;
+  autorec_posting_t *m = &autorec_index.matches;
+  int i;
 
-  TAILQ_FOREACH(dae, &autorec_entries, dae_link)
-    if(autorec_cmp(dae, e))
-      dvr_entry_create_by_autorec(e, dae);
+  autorec_index_match(e);
+  for (i = 0; i < m->count; i++)
+    dvr_entry_create_by_autorec(e, m->dae[i]);
   // Note: no longer updating event here as it will be done from EPG
   //       anyway
 }
@@ -1162,21 +1577,42 @@ void dvr_autorec_check_serieslink(epg_serieslink_t *s)
 /**
  *
  */
+static void
+dvr_autorec_changed_channel(dvr_autorec_entry_t *dae, channel_t *ch)
+{
+  epg_broadcast_t *e;
+  autorec_event_t ev;
+
+  if (!ch->ch_enabled) return;
+  RB_FOREACH(e, &ch->ch_epg_schedule, sched_link) {
+    memset(&ev, 0, sizeof(ev));
+    ev.e = e;
+    if(autorec_cmp(dae, &ev))
+      dvr_entry_create_by_autorec(e, dae);
+  }
+}
+
 void
 dvr_autorec_changed(dvr_autorec_entry_t *dae, int purge)
 {
   channel_t *ch;
-  epg_broadcast_t *e;
+  channel_tag_mapping_t *ctm;
+  dvr_config_t *cfg = dae->dae_config;
 
   if (purge)
     dvr_autorec_purge_spawns(dae, 1);
 
-  CHANNEL_FOREACH(ch) {
-    if (!ch->ch_enabled) continue;
-    RB_FOREACH(e, &ch->ch_epg_schedule, sched_link) {
-      if(autorec_cmp(dae, e))
-        dvr_entry_create_by_autorec(e, dae);
-    }
+  dvr_autorec_index_invalidate();
+
+  /* Only walk the schedules the rule can match */
+  if (dae->dae_channel && cfg && cfg->dvr_sl_quality_lock) {
+    dvr_autorec_changed_channel(dae, dae->dae_channel);
+  } else if (dae->dae_channel_tag) {
+    LIST_FOREACH(ctm, &dae->dae_channel_tag->ct_ctms, ctm_tag_link)
+      dvr_autorec_changed_channel(dae, ctm->ctm_channel);
+  } else {
+    CHANNEL_FOREACH(ch)
+      dvr_autorec_changed_channel(dae, ch);
   }
 
   htsp_autorec_entry_update(dae);
@@ -1206,6 +1642,7 @@ autorec_destroy_by_channel_tag(channel_tag_t *ct, int delconf)
   while((dae = LIST_FIRST(&ct->ct_autorecs)) != NULL) {
     LIST_REMOVE(dae, dae_channel_tag_link);
     dae->dae_channel_tag = NULL;
+    dvr_autorec_index_invalidate();
     idnode_notify_simple(&dae->dae_id);
     if (delconf)
       dvr_autorec_save(dae);
@@ -1241,6 +1678,7 @@ autorec_destroy_by_config(dvr_config_t *kcfg, int delconf)
     if (cfg)
       LIST_INSERT_HEAD(&cfg->dvr_autorec_entries, dae, dae_config_link);
     dae->dae_config = cfg;
+    dvr_autorec_index_invalidate();
     if (delconf)
       dvr_autorec_save(dae);
   }
@@ -35,6 +35,11 @@
 
 struct dvr_entry_list dvrentries;
 
+/* Entry lookup by short id and by broadcast */
+#define DVR_ENTRY_HASH_SIZE 8192
+static struct dvr_entry_list dvr_id_hash[DVR_ENTRY_HASH_SIZE];
+static struct dvr_entry_list dvr_bcast_hash[DVR_ENTRY_HASH_SIZE];
+
 #if ENABLE_DBUS_1
 static gtimer_t dvr_dbus_timer;
 #endif
@@ -331,6 +336,59 @@ dvr_entry_set_timer(dvr_entry_t *de)
 }
 
 
+/**
+ * Entry indices
+ */
+static void
+dvr_entry_index(dvr_entry_t *de)
+{
+  de->de_indexed = 1;
+  LIST_INSERT_HEAD(&dvr_id_hash[idnode_get_short_uuid(&de->de_id) %
+                                DVR_ENTRY_HASH_SIZE], de, de_id_link);
+  if (de->de_bcast)
+    LIST_INSERT_HEAD(&dvr_bcast_hash[de->de_bcast->id % DVR_ENTRY_HASH_SIZE],
+                     de, de_bcast_link);
+}
+
+static void
+dvr_entry_unindex(dvr_entry_t *de)
+{
+  if (!de->de_indexed)
+    return;
+  LIST_REMOVE(de, de_id_link);
+  if (de->de_bcast)
+    LIST_REMOVE(de, de_bcast_link);
+  de->de_indexed = 0;
+}
+
+/**
+ * Change the linked broadcast (the caller handles the references)
+ */
+static void
+dvr_entry_set_bcast(dvr_entry_t *de, epg_broadcast_t *e)
+{
+  if (de->de_indexed && de->de_bcast)
+    LIST_REMOVE(de, de_bcast_link);
+  de->de_bcast = e;
+  if (de->de_indexed && e)
+    LIST_INSERT_HEAD(&dvr_bcast_hash[e->id % DVR_ENTRY_HASH_SIZE],
+                     de, de_bcast_link);
+}
+
+/**
+ * Any entry linked to the broadcast
+ */
+static dvr_entry_t *
+dvr_entry_find_by_bcast(epg_broadcast_t *e)
+{
+  dvr_entry_t *de;
+
+  LIST_FOREACH(de, &dvr_bcast_hash[e->id % DVR_ENTRY_HASH_SIZE], de_bcast_link)
+    if (de->de_bcast == e)
+      return de;
+  return NULL;
+}
+
 /**
  * Get episode name
  */
@@ -437,6 +495,7 @@ dvr_entry_create(const char *uuid, htsmsg_t *conf)
   de->de_refcnt = 1;
 
   LIST_INSERT_HEAD(&dvrentries, de, de_global_link);
+  dvr_entry_index(de);
 
   if (de->de_channel) {
     LIST_FOREACH(de2, &de->de_channel->ch_dvrs, de_channel_link)
@@ -698,6 +757,27 @@ static dvr_entry_t* _dvr_duplicate_event(dvr_entry_t* de)
   return NULL;
 }
 
+/**
+ * Any entry for the broadcast or for another broadcast of its episode
+ */
+static dvr_entry_t *
+dvr_entry_find_identical(epg_broadcast_t *e)
+{
+  dvr_entry_t *de;
+  epg_broadcast_t *ebc;
+
+  if (e->episode) {
+    LIST_FOREACH(ebc, &e->episode->broadcasts, ep_link)
+      if ((de = dvr_entry_find_by_bcast(ebc)) != NULL)
+        return de;
+  } else {
+    LIST_FOREACH(de, &dvrentries, de_global_link)
+      if (de->de_bcast == e || (de->de_bcast && de->de_bcast->episode == e->episode))
+        return de;
+  }
+  return NULL;
+}
+
 /**
  *
  */
@@ -708,11 +788,8 @@ dvr_entry_create_by_autorec(epg_broadcast_t *e, dvr_autorec_entry_t *dae)
 
   /* Identical duplicate detection
      NOTE: Semantic duplicate detection is deferred to the start time of recording and then done using _dvr_duplicate_event by dvr_timer_start_recording. */
-  dvr_entry_t* de;
-  LIST_FOREACH(de, &dvrentries, de_global_link) {
-    if (de->de_bcast == e || (de->de_bcast && de->de_bcast->episode == e->episode))
-      return;
-  }
+  if (dvr_entry_find_identical(e))
+    return;
 
   snprintf(buf, sizeof(buf), "Auto recording%s%s",
            dae->dae_creator ? " by: " : "",
@@ -787,6 +864,7 @@ dvr_entry_destroy(dvr_entry_t *de, int delconf)
   if (de->de_channel)
     LIST_REMOVE(de, de_channel_link);
   LIST_REMOVE(de, de_global_link);
+  dvr_entry_unindex(de);
   de->de_channel = NULL;
 
   dvr_entry_dec_ref(de);
@@ -919,7 +997,7 @@ static dvr_entry_t *_dvr_entry_update
   if (e && (de->de_bcast != e)) {
     if (de->de_bcast)
       de->de_bcast->putref(de->de_bcast);
-    de->de_bcast = e;
+    dvr_entry_set_bcast(de, e);
     e->getref(e);
     save = 1;
 
@@ -990,7 +1068,7 @@ dvr_event_replaced(epg_broadcast_t *e, epg_broadcast_t *new_e)
 
     /* Unlink the broadcast */
     e->putref(e);
-    de->de_bcast = NULL;
+    dvr_entry_set_bcast(de, NULL);
 
     /* If this was created by autorec - just remove it, it'll get recreated */
     if (de->de_autorec) {
@@ -1007,7 +1085,7 @@ dvr_event_replaced(epg_broadcast_t *e, epg_broadcast_t *new_e)
                    channel_get_name(e->channel),
                    e->start, e->stop);
           e->getref(e);
-          de->de_bcast = e;
+          dvr_entry_set_bcast(de, e);
           _dvr_entry_update(de, e, NULL, NULL, NULL, NULL, 0, 0, 0, 0, DVR_PRIO_NOTSET, 0);
           break;
         }
@@ -1022,11 +1100,10 @@ void dvr_event_updated ( epg_broadcast_t *e )
   de = dvr_entry_find_by_event(e);
   if (de)
     _dvr_entry_update(de, e, NULL, NULL, NULL, NULL, 0, 0, 0, 0, DVR_PRIO_NOTSET, 0);
-  else {
-    LIST_FOREACH(de, &dvrentries, de_global_link) {
+  else if (e->channel) {
+    LIST_FOREACH(de, &e->channel->ch_dvrs, de_channel_link) {
       if (de->de_sched_state != DVR_SCHEDULED) continue;
       if (de->de_bcast) continue;
-      if (de->de_channel != e->channel) continue;
       if (dvr_entry_fuzzy_match(de, e)) {
         tvhtrace("dvr",
                  "dvr entry %s link to event %s on %s @ %"PRItime_t
@@ -1036,7 +1113,7 @@ void dvr_event_updated ( epg_broadcast_t *e )
                  channel_get_name(e->channel),
                  e->start, e->stop);
         e->getref(e);
-        de->de_bcast = e;
+        dvr_entry_set_bcast(de, e);
         _dvr_entry_update(de, e, NULL, NULL, NULL, NULL, 0, 0, 0, 0, DVR_PRIO_NOTSET, 0);
         break;
       }
@@ -1126,7 +1203,7 @@ dvr_entry_t *
 dvr_entry_find_by_id(int id)
 {
   dvr_entry_t *de;
-  LIST_FOREACH(de, &dvrentries, de_global_link)
+  LIST_FOREACH(de, &dvr_id_hash[(uint32_t)id % DVR_ENTRY_HASH_SIZE], de_id_link)
     if(idnode_get_short_uuid(&de->de_id) == id)
       break;
   return de;  
@@ -1143,8 +1220,8 @@ dvr_entry_find_by_event(epg_broadcast_t *e)
 
   if(!e->channel) return NULL;
 
-  LIST_FOREACH(de, &e->channel->ch_dvrs, de_channel_link)
-    if(de->de_bcast == e) return de;
+  LIST_FOREACH(de, &dvr_bcast_hash[e->id % DVR_ENTRY_HASH_SIZE], de_bcast_link)
+    if(de->de_bcast == e && de->de_channel == e->channel) return de;
   return NULL;
 }
 
@@ -1566,13 +1643,13 @@ dvr_entry_class_broadcast_set(void *o, const void *v)
   if (bcast == NULL) {
     if (de->de_bcast) {
       de->de_bcast->putref((epg_object_t*)de->de_bcast);
-      de->de_bcast = NULL;
+      dvr_entry_set_bcast(de, NULL);
       return 1;
     }
   } else if (de->de_bcast != bcast) {
     if (de->de_bcast)
       de->de_bcast->putref((epg_object_t*)de->de_bcast);
-    de->de_bcast = bcast;
+    dvr_entry_set_bcast(de, bcast);
     de->de_bcast->getref((epg_object_t*)bcast);
     return 1;
   }
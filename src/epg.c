@@ -262,20 +262,23 @@ static htsmsg_t * _epg_object_serialize ( void *o )
   return m;
 }
 
-static epg_object_t *_epg_object_deserialize ( htsmsg_t *m, epg_object_t *eo )
-{
-  int64_t s64;
-  uint32_t u32;
-  const char *s;
-  if (htsmsg_get_u32(m, "id",   &eo->id)) return NULL;
-  if (htsmsg_get_u32(m, "type", &u32))    return NULL;
-  if (u32 != eo->type)                    return NULL;
-  eo->uri = (char*)htsmsg_get_str(m, "uri");
-  if ((s = htsmsg_get_str(m, "grabber")))
-    eo->grabber = epggrab_module_find_by_id(s);
-  if (!htsmsg_get_s64(m, "updated", &s64)) {
+static epg_object_t *_epg_object_load
+  ( const epg_object_rec_t *r, epg_object_t *eo )
+{
+  epg_object_t temp;
+  if (r->type != eo->type) return NULL;
+  temp.id = r->id;
+  if (r->id && RB_FIND(epg_id_tree(&temp), &temp, id_link, _id_cmp)) {
+    tvhwarn("epg", "duplicate EPG ID %u, record ignored", r->id);
+    return NULL;
+  }
+  eo->id  = r->id;
+  eo->uri = (char*)r->uri;
+  if (r->grabber)
+    eo->grabber = epggrab_module_find_by_id(r->grabber);
+  if (r->updated) {
     _epg_object_set_updated(eo);
-    eo->updated = s64;
+    eo->updated = r->updated;
   }
   tvhtrace("epg", "eo [%p, %u, %d, %s] deserialize",
            eo, eo->id, eo->type, eo->uri);
@@ -380,26 +383,332 @@ htsmsg_t *epg_object_serialize ( epg_object_t *eo )
   }
 }
 
-epg_object_t *epg_object_deserialize ( htsmsg_t *msg, int create, int *save )
+epg_object_t *epg_object_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
-  uint32_t type;
-  if (!msg) return NULL;
-  type = htsmsg_get_u32_or_default(msg, "type", 0);
-  switch (type) {
+  switch (r->type) {
     case EPG_BRAND:
-      return (epg_object_t*)epg_brand_deserialize(msg, create, save);
+      return (epg_object_t*)epg_brand_load(r, create, save);
     case EPG_SEASON:
-      return (epg_object_t*)epg_season_deserialize(msg, create, save);
+      return (epg_object_t*)epg_season_load(r, create, save);
     case EPG_EPISODE:
-      return (epg_object_t*)epg_episode_deserialize(msg, create, save);
+      return (epg_object_t*)epg_episode_load(r, create, save);
     case EPG_BROADCAST:
-      return (epg_object_t*)epg_broadcast_deserialize(msg, create, save);
+      return (epg_object_t*)epg_broadcast_load(r, create, save);
     case EPG_SERIESLINK:
-      return (epg_object_t*)epg_serieslink_deserialize(msg, create, save);
+      return (epg_object_t*)epg_serieslink_load(r, create, save);
+    default:
+      break;
   }
   return NULL;
 }
 
+epg_object_t *epg_object_deserialize ( htsmsg_t *msg, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_object_t *eo = NULL;
+  if (!msg) return NULL;
+  if (!epg_object_rec_from_msg(msg, &r))
+    eo = epg_object_load(&r, create, save);
+  epg_object_rec_free(&r);
+  return eo;
+}
+
+/* **************************************************************************
+ * Flat records
+ * *************************************************************************/
+
+static void _epg_rec_text
+  ( htsmsg_t *m, const char *n, epg_object_rec_t *r, epg_text_rec_t t )
+{
+  htsmsg_t *a;
+  htsmsg_field_t *f;
+  const char *str;
+  int i = 0;
+
+  if ((a = htsmsg_get_map(m, n))) {
+    HTSMSG_FOREACH(f, a)
+      i++;
+    r->text[t] = calloc(i ?: 1, sizeof(epg_lang_rec_t));
+    i = 0;
+    HTSMSG_FOREACH(f, a)
+      if ((str = htsmsg_field_get_string(f))) {
+        r->text[t][i].lang  = f->hmf_name;
+        r->text[t][i++].str = str;
+      }
+  } else if ((str = htsmsg_get_str(m, n))) {
+    r->text[t] = calloc(1, sizeof(epg_lang_rec_t));
+    r->text[t][i++].str = str;
+  }
+  r->text_count[t] = i;
+}
+
+int epg_object_rec_from_msg ( htsmsg_t *m, epg_object_rec_t *r )
+{
+  htsmsg_t *sub;
+  htsmsg_field_t *f;
+  uint8_t *genre;
+  uint32_t u32;
+  int64_t s64;
+
+  memset(r, 0, sizeof(*r));
+  if (htsmsg_get_u32(m, "id", &r->id)) return -1;
+  if (htsmsg_get_u32(m, "type", &u32)) return -1;
+  r->type    = u32;
+  r->uri     = htsmsg_get_str(m, "uri");
+  r->grabber = htsmsg_get_str(m, "grabber");
+  if (!htsmsg_get_s64(m, "updated", &s64))
+    r->updated = s64;
+
+  _epg_rec_text(m, "title", r, EPG_REC_TITLE);
+  _epg_rec_text(m, "subtitle", r, EPG_REC_SUBTITLE);
+  _epg_rec_text(m, "summary", r, EPG_REC_SUMMARY);
+  _epg_rec_text(m, "description", r, EPG_REC_DESCRIPTION);
+
+  r->brand      = htsmsg_get_str(m, "brand");
+  r->season     = htsmsg_get_str(m, "season");
+  r->episode    = htsmsg_get_str(m, "episode");
+  r->serieslink = htsmsg_get_str(m, "serieslink");
+  r->channel    = htsmsg_get_str(m, "channel");
+  r->image      = htsmsg_get_str(m, "image");
+
+  r->number = htsmsg_get_u32_or_default(m, "number", 0);
+  r->count  = htsmsg_get_u32_or_default(m, r->type == EPG_BRAND ?
+                                           "season-count" : "episode-count", 0);
+  if ((sub = htsmsg_get_map(m, "epnum"))) {
+    r->epnum.e_num = htsmsg_get_u32_or_default(sub, "e_num", 0);
+    r->epnum.e_cnt = htsmsg_get_u32_or_default(sub, "e_cnt", 0);
+    r->epnum.s_num = htsmsg_get_u32_or_default(sub, "s_num", 0);
+    r->epnum.s_cnt = htsmsg_get_u32_or_default(sub, "s_cnt", 0);
+    r->epnum.p_num = htsmsg_get_u32_or_default(sub, "p_num", 0);
+    r->epnum.p_cnt = htsmsg_get_u32_or_default(sub, "p_cnt", 0);
+    r->epnum.text  = (char*)htsmsg_get_str(sub, "text");
+  }
+  if ((sub = htsmsg_get_list(m, "genre"))) {
+    HTSMSG_FOREACH(f, sub)
+      r->genre_count++;
+    r->genre = genre = calloc(r->genre_count ?: 1, 1);
+    u32 = 0;
+    HTSMSG_FOREACH(f, sub)
+      genre[u32++] = (uint8_t)f->hmf_s64;
+  }
+  r->is_bw       = htsmsg_get_u32_or_default(m, "is_bw", 0);
+  r->star_rating = htsmsg_get_u32_or_default(m, "star_rating", 0);
+  r->age_rating  = htsmsg_get_u32_or_default(m, "age_rating", 0);
+  if (!htsmsg_get_s64(m, "first_aired", &s64))
+    r->first_aired = s64;
+
+  if (!htsmsg_get_s64(m, "start", &s64))
+    r->start = s64;
+  if (!htsmsg_get_s64(m, "stop", &s64))
+    r->stop = s64;
+  r->dvb_eid       = htsmsg_get_u32_or_default(m, "dvb_eid", 0);
+  r->lines         = htsmsg_get_u32_or_default(m, "lines", 0);
+  r->aspect        = htsmsg_get_u32_or_default(m, "aspect", 0);
+  r->is_widescreen = htsmsg_get_u32_or_default(m, "is_widescreen", 0);
+  r->is_hd         = htsmsg_get_u32_or_default(m, "is_hd", 0);
+  r->is_deafsigned = htsmsg_get_u32_or_default(m, "is_deafsigned", 0);
+  r->is_subtitled  = htsmsg_get_u32_or_default(m, "is_subtitled", 0);
+  r->is_audio_desc = htsmsg_get_u32_or_default(m, "is_audio_desc", 0);
+  r->is_new        = htsmsg_get_u32_or_default(m, "is_new", 0);
+  r->is_repeat     = htsmsg_get_u32_or_default(m, "is_repeat", 0);
+  return 0;
+}
+
+void epg_object_rec_free ( epg_object_rec_t *r )
+{
+  int i;
+  for (i = 0; i < EPG_REC_TEXT_MAX; i++)
+    free(r->text[i]);
+  free((uint8_t *)r->genre);
+}
+
+/*
+ * Record buffer (the copies mirror the *_serialize() functions)
+ */
+#define EPG_REC_CHUNK (256*1024)
+
+typedef struct epg_rec_chunk
+{
+  struct epg_rec_chunk *next;
+  size_t                used;
+  size_t                size;
+  uint8_t               data[0];
+} epg_rec_chunk_t;
+
+static void *_epg_rec_alloc ( epg_rec_buf_t *rb, size_t len )
+{
+  epg_rec_chunk_t *c = rb->data;
+  void *p;
+  len = (len + 7) & ~7;
+  if (c == NULL || c->used + len > c->size) {
+    size_t size = MAX(len, EPG_REC_CHUNK);
+    c = malloc(sizeof(*c) + size);
+    c->next = rb->data;
+    c->used = 0;
+    c->size = size;
+    rb->data = c;
+  }
+  p = c->data + c->used;
+  c->used += len;
+  return p;
+}
+
+static const char *_epg_rec_strdup ( epg_rec_buf_t *rb, const char *str )
+{
+  size_t len;
+  if (!str) return NULL;
+  len = strlen(str) + 1;
+  return memcpy(_epg_rec_alloc(rb, len), str, len);
+}
+
+static void _epg_rec_copy_text
+  ( epg_rec_buf_t *rb, epg_object_rec_t *r, epg_text_rec_t t, lang_str_t *ls )
+{
+  lang_str_ele_t *e;
+  int i = 0;
+  if (!ls) return;
+  RB_FOREACH(e, ls, link)
+    i++;
+  r->text[t] = _epg_rec_alloc(rb, i * sizeof(epg_lang_rec_t));
+  i = 0;
+  RB_FOREACH(e, ls, link) {
+    r->text[t][i].lang  = e->lang; // static language code
+    r->text[t][i++].str = _epg_rec_strdup(rb, e->str);
+  }
+  r->text_count[t] = i;
+}
+
+int epg_object_rec_copy ( epg_object_t *eo, epg_rec_buf_t *rb )
+{
+  epg_object_rec_t *r;
+  epg_brand_t *eb;
+  epg_season_t *es;
+  epg_episode_t *ee;
+  epg_broadcast_t *ebc;
+  epg_genre_t *eg;
+  uint8_t *genre;
+  int i;
+
+  lock_assert(&global_lock);
+
+  if (!eo || !eo->id || !eo->type) return -1;
+  ebc = eo->type == EPG_BROADCAST ? (epg_broadcast_t*)eo : NULL;
+  if (ebc) {
+    if (!ebc->episode || !ebc->episode->uri) return -1;
+  } else if (!eo->uri) {
+    return -1;
+  }
+
+  if (rb->count >= rb->size) {
+    rb->size = MAX(rb->size * 2, 1024);
+    rb->recs = realloc(rb->recs, rb->size * sizeof(epg_object_rec_t));
+  }
+  r = rb->recs + rb->count++;
+  memset(r, 0, sizeof(*r));
+  r->type    = eo->type;
+  r->id      = eo->id;
+  r->uri     = _epg_rec_strdup(rb, eo->uri);
+  if (eo->grabber)
+    r->grabber = _epg_rec_strdup(rb, eo->grabber->id);
+  r->updated = eo->updated;
+
+  switch (eo->type) {
+    case EPG_BRAND:
+      eb = (epg_brand_t*)eo;
+      _epg_rec_copy_text(rb, r, EPG_REC_TITLE, eb->title);
+      _epg_rec_copy_text(rb, r, EPG_REC_SUMMARY, eb->summary);
+      r->count = eb->season_count;
+      r->image = _epg_rec_strdup(rb, eb->image);
+      break;
+    case EPG_SEASON:
+      es = (epg_season_t*)eo;
+      _epg_rec_copy_text(rb, r, EPG_REC_SUMMARY, es->summary);
+      r->number = es->number;
+      r->count  = es->episode_count;
+      if (es->brand)
+        r->brand = _epg_rec_strdup(rb, es->brand->uri);
+      r->image  = _epg_rec_strdup(rb, es->image);
+      break;
+    case EPG_EPISODE:
+      ee = (epg_episode_t*)eo;
+      _epg_rec_copy_text(rb, r, EPG_REC_TITLE, ee->title);
+      _epg_rec_copy_text(rb, r, EPG_REC_SUBTITLE, ee->subtitle);
+      _epg_rec_copy_text(rb, r, EPG_REC_SUMMARY, ee->summary);
+      _epg_rec_copy_text(rb, r, EPG_REC_DESCRIPTION, ee->description);
+      r->epnum      = ee->epnum;
+      r->epnum.text = (char*)_epg_rec_strdup(rb, ee->epnum.text);
+      i = 0;
+      LIST_FOREACH(eg, &ee->genre, link)
+        i++;
+      r->genre = genre = _epg_rec_alloc(rb, i);
+      r->genre_count = i;
+      i = 0;
+      LIST_FOREACH(eg, &ee->genre, link)
+        genre[i++] = eg->code;
+      if (ee->brand)
+        r->brand = _epg_rec_strdup(rb, ee->brand->uri);
+      if (ee->season)
+        r->season = _epg_rec_strdup(rb, ee->season->uri);
+      r->is_bw       = !!ee->is_bw;
+      r->star_rating = ee->star_rating;
+      r->age_rating  = ee->age_rating;
+      r->first_aired = ee->first_aired;
+      r->image       = _epg_rec_strdup(rb, ee->image);
+      break;
+    case EPG_BROADCAST:
+      r->start   = ebc->start;
+      r->stop    = ebc->stop;
+      r->episode = _epg_rec_strdup(rb, ebc->episode->uri);
+      if (ebc->channel)
+        r->channel = _epg_rec_strdup(rb, channel_get_uuid(ebc->channel));
+      r->dvb_eid       = ebc->dvb_eid;
+      r->lines         = ebc->lines;
+      r->aspect        = ebc->aspect;
+      r->is_widescreen = !!ebc->is_widescreen;
+      r->is_hd         = !!ebc->is_hd;
+      r->is_deafsigned = !!ebc->is_deafsigned;
+      r->is_subtitled  = !!ebc->is_subtitled;
+      r->is_audio_desc = !!ebc->is_audio_desc;
+      r->is_new        = !!ebc->is_new;
+      r->is_repeat     = !!ebc->is_repeat;
+      _epg_rec_copy_text(rb, r, EPG_REC_SUMMARY, ebc->summary);
+      _epg_rec_copy_text(rb, r, EPG_REC_DESCRIPTION, ebc->description);
+      if (ebc->serieslink)
+        r->serieslink = _epg_rec_strdup(rb, ebc->serieslink->uri);
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+void epg_rec_buf_free ( epg_rec_buf_t *rb )
+{
+  epg_rec_chunk_t *c;
+  while ((c = rb->data)) {
+    rb->data = c->next;
+    free(c);
+  }
+  free(rb->recs);
+  memset(rb, 0, sizeof(*rb));
+}
+
+static lang_str_t *_epg_rec_lang_str
+  ( const epg_object_rec_t *r, epg_text_rec_t t )
+{
+  lang_str_t *ls;
+  int i;
+  if (!r->text_count[t]) return NULL;
+  ls = lang_str_create();
+  for (i = 0; i < r->text_count[t]; i++)
+    lang_str_add(ls, r->text[t][i].str, r->text[t][i].lang, 0);
+  return ls;
+}
+
+#define EPG_REC_TEXT_FOREACH(e, r, t) \
+  for ((e) = (r)->text[t]; (e) && (e) < (r)->text[t] + (r)->text_count[t]; (e)++)
+
 /* **************************************************************************
  * Brand
  * *************************************************************************/
@@ -535,37 +844,39 @@ htsmsg_t *epg_brand_serialize ( epg_brand_t *brand )
   return m;
 }
 
-epg_brand_t *epg_brand_deserialize ( htsmsg_t *m, int create, int *save )
+epg_brand_t *epg_brand_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
   epg_object_t **skel = _epg_brand_skel();
   epg_brand_t *eb;
-  uint32_t u32;
-  const char *str;
-  lang_str_t *ls;
-  lang_str_ele_t *e;
+  const epg_lang_rec_t *e;
 
-  if ( !_epg_object_deserialize(m, *skel) ) return NULL;
+  if ( !_epg_object_load(r, *skel) ) return NULL;
   if ( !(eb = epg_brand_find_by_uri((*skel)->uri, create, save)) ) return NULL;
   
-  if ((ls = lang_str_deserialize(m, "title"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_brand_set_title(eb, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ((ls = lang_str_deserialize(m, "summary"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_brand_set_summary(eb, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ( !htsmsg_get_u32(m, "season-count", &u32) )
-    *save |= epg_brand_set_season_count(eb, u32, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_TITLE)
+    *save |= epg_brand_set_title(eb, e->str, e->lang, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_SUMMARY)
+    *save |= epg_brand_set_summary(eb, e->str, e->lang, NULL);
+  if ( r->count )
+    *save |= epg_brand_set_season_count(eb, r->count, NULL);
 
-  if ( (str = htsmsg_get_str(m, "image")) )
-    *save |= epg_brand_set_image(eb, str, NULL);
+  if ( r->image )
+    *save |= epg_brand_set_image(eb, r->image, NULL);
 
   return eb;
 }
 
+epg_brand_t *epg_brand_deserialize ( htsmsg_t *m, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_brand_t *eb = NULL;
+  if (!epg_object_rec_from_msg(m, &r))
+    eb = epg_brand_load(&r, create, save);
+  epg_object_rec_free(&r);
+  return eb;
+}
+
 htsmsg_t *epg_brand_list ( void )
 {
   epg_object_t *eo;
@@ -723,40 +1034,44 @@ htsmsg_t *epg_season_serialize ( epg_season_t *season )
   return m;
 }
 
-epg_season_t *epg_season_deserialize ( htsmsg_t *m, int create, int *save )
+epg_season_t *epg_season_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
   epg_object_t **skel = _epg_season_skel();
   epg_season_t *es;
   epg_brand_t *eb;
-  uint32_t u32;
-  const char *str;
-  lang_str_t *ls;
-  lang_str_ele_t *e;
+  const epg_lang_rec_t *e;
 
-  if ( !_epg_object_deserialize(m, *skel) ) return NULL;
+  if ( !_epg_object_load(r, *skel) ) return NULL;
   if ( !(es = epg_season_find_by_uri((*skel)->uri, create, save)) ) return NULL;
   
-  if ((ls = lang_str_deserialize(m, "summary"))) {
-    RB_FOREACH(e, ls, link) {
-      *save |= epg_season_set_summary(es, e->str, e->lang, NULL);
-    }
-    lang_str_destroy(ls);
-  }
-  if ( !htsmsg_get_u32(m, "number", &u32) )
-    *save |= epg_season_set_number(es, u32, NULL);
-  if ( !htsmsg_get_u32(m, "episode-count", &u32) )
-    *save |= epg_season_set_episode_count(es, u32, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_SUMMARY)
+    *save |= epg_season_set_summary(es, e->str, e->lang, NULL);
+  if ( r->number )
+    *save |= epg_season_set_number(es, r->number, NULL);
+  if ( r->count )
+    *save |= epg_season_set_episode_count(es, r->count, NULL);
   
-  if ( (str = htsmsg_get_str(m, "brand")) )
-    if ( (eb = epg_brand_find_by_uri(str, 0, NULL)) )
+  if ( r->brand )
+    if ( (eb = epg_brand_find_by_uri(r->brand, 0, NULL)) )
       *save |= epg_season_set_brand(es, eb, NULL);
 
-  if ( (str = htsmsg_get_str(m, "image")) )
-    *save |= epg_season_set_image(es, str, NULL);
+  if ( r->image )
+    *save |= epg_season_set_image(es, r->image, NULL);
 
   return es;
 }
 
+epg_season_t *epg_season_deserialize ( htsmsg_t *m, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_season_t *es = NULL;
+  if (!epg_object_rec_from_msg(m, &r))
+    es = epg_season_load(&r, create, save);
+  epg_object_rec_free(&r);
+  return es;
+}
+
 const char *epg_season_get_summary
   ( const epg_season_t *s, const char *lang )
 {
@@ -790,31 +1105,6 @@ static htsmsg_t *epg_episode_num_serialize ( epg_episode_num_t *num )
   return m;
 }
 
-static void epg_episode_num_deserialize 
-  ( htsmsg_t *m, epg_episode_num_t *num )
-{
-  const char *str;
-  uint32_t u32;
-  assert(m && num);
-
-  memset(num, 0, sizeof(epg_episode_num_t));
-
-  if (!htsmsg_get_u32(m, "e_num", &u32))
-    num->e_num = u32;
-  if (!htsmsg_get_u32(m, "e_cnt", &u32))
-    num->e_cnt = u32;
-  if (!htsmsg_get_u32(m, "s_num", &u32))
-    num->s_num = u32;
-  if (!htsmsg_get_u32(m, "s_cnt", &u32))
-    num->s_cnt = u32;
-  if (!htsmsg_get_u32(m, "p_num", &u32))
-    num->p_num = u32;
-  if (!htsmsg_get_u32(m, "p_cnt", &u32))
-    num->p_cnt = u32;
-  if ((str = htsmsg_get_str(m, "text")))
-    num->text = strdup(str);
-}
-
 static void _epg_episode_destroy ( void *eo )
 {
   epg_genre_t *g;
@@ -1195,83 +1485,74 @@ htsmsg_t *epg_episode_serialize ( epg_episode_t *episode )
   return m;
 }
 
-epg_episode_t *epg_episode_deserialize ( htsmsg_t *m, int create, int *save )
+epg_episode_t *epg_episode_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
   epg_object_t **skel = _epg_episode_skel();
   epg_episode_t *ee;
   epg_season_t *es;
   epg_brand_t *eb;
-  const char *str;
   epg_episode_num_t num;
-  htsmsg_t *sub;
-  htsmsg_field_t *f;
-  uint32_t u32;
-  int64_t s64;
-  lang_str_t *ls;
-  lang_str_ele_t *e;
+  const epg_lang_rec_t *e;
+  int i;
   
-  if ( !_epg_object_deserialize(m, *skel) ) return NULL;
+  if ( !_epg_object_load(r, *skel) ) return NULL;
   if ( !(ee = epg_episode_find_by_uri((*skel)->uri, create, save)) )
     return NULL;
   
-  if ((ls = lang_str_deserialize(m, "title"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_episode_set_title(ee, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ((ls = lang_str_deserialize(m, "subtitle"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_episode_set_subtitle(ee, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ((ls = lang_str_deserialize(m, "summary"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_episode_set_summary(ee, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ((ls = lang_str_deserialize(m, "description"))) {
-    RB_FOREACH(e, ls, link)
-      *save |= epg_episode_set_description(ee, e->str, e->lang, NULL);
-    lang_str_destroy(ls);
-  }
-  if ( (sub = htsmsg_get_map(m, "epnum")) ) {
-    epg_episode_num_deserialize(sub, &num);
-    *save |= epg_episode_set_epnum(ee, &num, NULL);
-    if (num.text) free(num.text);
-  }
-  if ( (sub = htsmsg_get_list(m, "genre")) ) {
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_TITLE)
+    *save |= epg_episode_set_title(ee, e->str, e->lang, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_SUBTITLE)
+    *save |= epg_episode_set_subtitle(ee, e->str, e->lang, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_SUMMARY)
+    *save |= epg_episode_set_summary(ee, e->str, e->lang, NULL);
+  EPG_REC_TEXT_FOREACH(e, r, EPG_REC_DESCRIPTION)
+    *save |= epg_episode_set_description(ee, e->str, e->lang, NULL);
+  num = r->epnum;
+  *save |= epg_episode_set_epnum(ee, &num, NULL);
+  if ( r->genre_count ) {
     epg_genre_list_t *egl = calloc(1, sizeof(epg_genre_list_t));
-    HTSMSG_FOREACH(f, sub) {
+    for (i = 0; i < r->genre_count; i++) {
       epg_genre_t genre;
-      genre.code = (uint8_t)f->hmf_s64;
+      genre.code = r->genre[i];
       epg_genre_list_add(egl, &genre);
     }
     *save |= epg_episode_set_genre(ee, egl, NULL);
     epg_genre_list_destroy(egl);
   }
   
-  if ( (str = htsmsg_get_str(m, "season")) )
-    if ( (es = epg_season_find_by_uri(str, 0, NULL)) )
+  if ( r->season )
+    if ( (es = epg_season_find_by_uri(r->season, 0, NULL)) )
       *save |= epg_episode_set_season(ee, es, NULL);
-  if ( (str = htsmsg_get_str(m, "brand")) )
-    if ( (eb = epg_brand_find_by_uri(str, 0, NULL)) )
+  if ( r->brand )
+    if ( (eb = epg_brand_find_by_uri(r->brand, 0, NULL)) )
       *save |= epg_episode_set_brand(ee, eb, NULL);
   
-  if (!htsmsg_get_u32(m, "is_bw", &u32))
-    *save |= epg_episode_set_is_bw(ee, u32, NULL);
+  if (r->is_bw)
+    *save |= epg_episode_set_is_bw(ee, r->is_bw, NULL);
 
-  if (!htsmsg_get_u32(m, "star_rating", &u32))
-    *save |= epg_episode_set_star_rating(ee, u32, NULL);
+  if (r->star_rating)
+    *save |= epg_episode_set_star_rating(ee, r->star_rating, NULL);
 
-  if (!htsmsg_get_u32(m, "age_rating", &u32))
-    *save |= epg_episode_set_age_rating(ee, u32, NULL);
+  if (r->age_rating)
+    *save |= epg_episode_set_age_rating(ee, r->age_rating, NULL);
 
-  if (!htsmsg_get_s64(m, "first_aired", &s64))
-    *save |= epg_episode_set_first_aired(ee, (time_t)s64, NULL);
+  if (r->first_aired)
+    *save |= epg_episode_set_first_aired(ee, (time_t)r->first_aired, NULL);
+
+  if ( r->image )
+    *save |= epg_episode_set_image(ee, r->image, NULL);
 
-  if ( (str = htsmsg_get_str(m, "image")) )
-    *save |= epg_episode_set_image(ee, str, NULL);
+  return ee;
+}
 
+epg_episode_t *epg_episode_deserialize ( htsmsg_t *m, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_episode_t *ee = NULL;
+  if (!epg_object_rec_from_msg(m, &r))
+    ee = epg_episode_load(&r, create, save);
+  epg_object_rec_free(&r);
   return ee;
 }
 
@@ -1373,27 +1654,57 @@ htsmsg_t *epg_serieslink_serialize ( epg_serieslink_t *esl )
   return m;
 }
 
-epg_serieslink_t *epg_serieslink_deserialize 
-  ( htsmsg_t *m, int create, int *save )
+epg_serieslink_t *epg_serieslink_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
   epg_object_t **skel = _epg_serieslink_skel();
   epg_serieslink_t *esl;
 
-  if ( !_epg_object_deserialize(m, *skel) ) return NULL;
+  if ( !_epg_object_load(r, *skel) ) return NULL;
   if ( !(esl = epg_serieslink_find_by_uri((*skel)->uri, create, save)) ) 
     return NULL;
   
   return esl;
 }
 
+epg_serieslink_t *epg_serieslink_deserialize 
+  ( htsmsg_t *m, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_serieslink_t *esl = NULL;
+  if (!epg_object_rec_from_msg(m, &r))
+    esl = epg_serieslink_load(&r, create, save);
+  epg_object_rec_free(&r);
+  return esl;
+}
+
 /* **************************************************************************
  * Channel
  * *************************************************************************/
 
+/*
+ * Event id index (broadcasts with a zero id are not indexed)
+ */
+static void _epg_channel_add_eid ( channel_t *ch, epg_broadcast_t *ebc )
+{
+  if (!ebc->dvb_eid) return;
+  if (!ch->ch_epg_eids)
+    ch->ch_epg_eids = calloc(EPG_EID_HASH_SIZE, sizeof(epg_broadcast_list_t));
+  LIST_INSERT_HEAD(&ch->ch_epg_eids[ebc->dvb_eid % EPG_EID_HASH_SIZE],
+                   ebc, eid_link);
+}
+
+static void _epg_channel_rem_eid ( epg_broadcast_t *ebc )
+{
+  if (ebc->dvb_eid)
+    LIST_REMOVE(ebc, eid_link);
+}
+
 static void _epg_channel_rem_broadcast 
   ( channel_t *ch, epg_broadcast_t *ebc, epg_broadcast_t *new )
 {
   if (new) dvr_event_replaced(ebc, new);
+  _epg_channel_rem_eid(ebc);
   RB_REMOVE(&ch->ch_epg_schedule, ebc, sched_link);
   if (ch->ch_epg_now  == ebc) ch->ch_epg_now  = NULL;
   if (ch->ch_epg_next == ebc) ch->ch_epg_next = NULL;
@@ -1486,13 +1797,18 @@ static epg_broadcast_t *_epg_channel_add_broadcast
       _epg_object_create(ret);
       // Note: sets updated
       _epg_object_getref(ret);
+      _epg_channel_add_eid(ch, ret);
       tvhtrace("epg", "added event %u (%s) on %s @ %"PRItime_t " to %"PRItime_t,
                ret->id, epg_broadcast_get_title(ret, NULL),
                channel_get_name(ch), ret->start, ret->stop);
 
     /* Existing */
     } else {
-      *save |= _epg_object_set_u16(ret, &ret->dvb_eid, (*bcast)->dvb_eid, NULL);
+      if (ret->dvb_eid != (*bcast)->dvb_eid) {
+        _epg_channel_rem_eid(ret);
+        *save |= _epg_object_set_u16(ret, &ret->dvb_eid, (*bcast)->dvb_eid, NULL);
+        _epg_channel_add_eid(ch, ret);
+      }
 
       /* No time change */
       if ( ret->stop == (*bcast)->stop ) {
@@ -1549,6 +1865,8 @@ void epg_channel_unlink ( channel_t *ch )
   while ( (ebc = RB_FIRST(&ch->ch_epg_schedule)) ) {
     _epg_channel_rem_broadcast(ch, ebc, NULL);
   }
+  free(ch->ch_epg_eids);
+  ch->ch_epg_eids = NULL;
   gtimer_disarm(&ch->ch_epg_timer);
 }
 
@@ -1615,11 +1933,19 @@ epg_broadcast_t *epg_broadcast_find_by_id ( uint32_t id )
 
 epg_broadcast_t *epg_broadcast_find_by_eid ( channel_t *ch, uint16_t eid )
 {
-  epg_broadcast_t *e;
-  RB_FOREACH(e, &ch->ch_epg_schedule, sched_link) {
-    if (e->dvb_eid == eid) return e;
+  epg_broadcast_t *e, *ret = NULL;
+  if (!eid) {
+    RB_FOREACH(e, &ch->ch_epg_schedule, sched_link) {
+      if (e->dvb_eid == eid) return e;
+    }
+    return NULL;
   }
-  return NULL;
+  if (!ch->ch_epg_eids) return NULL;
+  /* Earliest match, as in schedule order */
+  LIST_FOREACH(e, &ch->ch_epg_eids[eid % EPG_EID_HASH_SIZE], eid_link)
+    if (e->dvb_eid == eid && (!ret || e->start < ret->start))
+      ret = e;
+  return ret;
 }
 
 int epg_broadcast_set_episode 
@@ -1834,39 +2160,34 @@ htsmsg_t *epg_broadcast_serialize ( epg_broadcast_t *broadcast )
   return m;
 }
 
-epg_broadcast_t *epg_broadcast_deserialize
-  ( htsmsg_t *m, int create, int *save )
+epg_broadcast_t *epg_broadcast_load
+  ( const epg_object_rec_t *r, int create, int *save )
 {
   channel_t *ch = NULL;
   epg_broadcast_t *ebc, **skel = _epg_broadcast_skel();
   epg_episode_t *ee;
   epg_serieslink_t *esl;
   lang_str_t *ls;
-  const char *str;
-  uint32_t eid, u32;
-  int64_t start, stop;
 
-  if ( htsmsg_get_s64(m, "start", &start) ) return NULL;
-  if ( htsmsg_get_s64(m, "stop", &stop)   ) return NULL;
-  if ( !start || !stop ) return NULL;
-  if ( stop <= start ) return NULL;
-  if ( stop <= dispatch_clock ) return NULL;
-  if ( !(str = htsmsg_get_str(m, "episode")) ) return NULL;
-  if ( !(ee  = epg_episode_find_by_uri(str, 0, NULL)) ) return NULL;
+  if ( !r->start || !r->stop ) return NULL;
+  if ( r->stop <= r->start ) return NULL;
+  if ( r->stop <= dispatch_clock ) return NULL;
+  if ( !r->episode ) return NULL;
+  if ( !(ee  = epg_episode_find_by_uri(r->episode, 0, NULL)) ) return NULL;
 
   /* Set properties */
-  _epg_object_deserialize(m, (epg_object_t*)*skel);
-  (*skel)->start   = start;
-  (*skel)->stop    = stop;
+  if ( !_epg_object_load(r, (epg_object_t*)*skel) ) return NULL;
+  (*skel)->start   = r->start;
+  (*skel)->stop    = r->stop;
 
   /* Get DVB id */
-  if ( !htsmsg_get_u32(m, "dvb_eid", &eid) ) {
-    (*skel)->dvb_eid = eid;
+  if ( r->dvb_eid ) {
+    (*skel)->dvb_eid = r->dvb_eid;
   }
 
   /* Get channel */
-  if ((str = htsmsg_get_str(m, "channel")))
-    ch = channel_find(str);
+  if (r->channel)
+    ch = channel_find(r->channel);
   if (!ch) return NULL;
 
   /* Create */
@@ -1874,38 +2195,38 @@ epg_broadcast_t *epg_broadcast_deserialize
   if (!ebc) return NULL;
 
   /* Get metadata */
-  if (!htsmsg_get_u32(m, "is_widescreen", &u32))
-    *save |= epg_broadcast_set_is_widescreen(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_hd", &u32))
-    *save |= epg_broadcast_set_is_hd(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "lines", &u32))
-    *save |= epg_broadcast_set_lines(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "aspect", &u32))
-    *save |= epg_broadcast_set_aspect(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_deafsigned", &u32))
-    *save |= epg_broadcast_set_is_deafsigned(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_subtitled", &u32))
-    *save |= epg_broadcast_set_is_subtitled(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_audio_desc", &u32))
-    *save |= epg_broadcast_set_is_audio_desc(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_new", &u32))
-    *save |= epg_broadcast_set_is_new(ebc, u32, NULL);
-  if (!htsmsg_get_u32(m, "is_repeat", &u32))
-    *save |= epg_broadcast_set_is_repeat(ebc, u32, NULL);
-
-  if ((ls = lang_str_deserialize(m, "summary"))) {
+  if (r->is_widescreen)
+    *save |= epg_broadcast_set_is_widescreen(ebc, r->is_widescreen, NULL);
+  if (r->is_hd)
+    *save |= epg_broadcast_set_is_hd(ebc, r->is_hd, NULL);
+  if (r->lines)
+    *save |= epg_broadcast_set_lines(ebc, r->lines, NULL);
+  if (r->aspect)
+    *save |= epg_broadcast_set_aspect(ebc, r->aspect, NULL);
+  if (r->is_deafsigned)
+    *save |= epg_broadcast_set_is_deafsigned(ebc, r->is_deafsigned, NULL);
+  if (r->is_subtitled)
+    *save |= epg_broadcast_set_is_subtitled(ebc, r->is_subtitled, NULL);
+  if (r->is_audio_desc)
+    *save |= epg_broadcast_set_is_audio_desc(ebc, r->is_audio_desc, NULL);
+  if (r->is_new)
+    *save |= epg_broadcast_set_is_new(ebc, r->is_new, NULL);
+  if (r->is_repeat)
+    *save |= epg_broadcast_set_is_repeat(ebc, r->is_repeat, NULL);
+
+  if ((ls = _epg_rec_lang_str(r, EPG_REC_SUMMARY))) {
     *save |= epg_broadcast_set_summary2(ebc, ls, NULL);
     lang_str_destroy(ls);
   }
 
-  if ((ls = lang_str_deserialize(m, "description"))) {
+  if ((ls = _epg_rec_lang_str(r, EPG_REC_DESCRIPTION))) {
     *save |= epg_broadcast_set_description2(ebc, ls, NULL);
     lang_str_destroy(ls);
   }
 
   /* Series link */
-  if ((str = htsmsg_get_str(m, "serieslink")))
-    if ((esl = epg_serieslink_find_by_uri(str, 1, save)))
+  if (r->serieslink)
+    if ((esl = epg_serieslink_find_by_uri(r->serieslink, 1, save)))
       *save |= epg_broadcast_set_serieslink(ebc, esl, NULL);
 
   /* Set the episode */
@@ -1914,6 +2235,17 @@ epg_broadcast_t *epg_broadcast_deserialize
   return ebc;
 }
 
+epg_broadcast_t *epg_broadcast_deserialize
+  ( htsmsg_t *m, int create, int *save )
+{
+  epg_object_rec_t r;
+  epg_broadcast_t *ebc = NULL;
+  if (!epg_object_rec_from_msg(m, &r))
+    ebc = epg_broadcast_load(&r, create, save);
+  epg_object_rec_free(&r);
+  return ebc;
+}
+
 /* **************************************************************************
  * Genre
  * *************************************************************************/
@@ -2645,6 +2977,11 @@ void epg_query_free(epg_query_t *eq)
  * Miscellaneous
  * *************************************************************************/
 
+uint32_t epg_config_last_id ( void )
+{
+  return _epg_object_idx;
+}
+
 htsmsg_t *epg_config_serialize( void )
 {
   htsmsg_t *m = htsmsg_create_map();
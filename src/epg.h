@@ -41,6 +41,8 @@ typedef LIST_HEAD(,epg_season)     epg_season_list_t;
 typedef LIST_HEAD(,epg_episode)    epg_episode_list_t;
 typedef LIST_HEAD(,epg_broadcast)  epg_broadcast_list_t;
 typedef RB_HEAD  (,epg_broadcast)  epg_broadcast_tree_t;
+
+#define EPG_EID_HASH_SIZE 64 ///< Per channel event id buckets
 typedef LIST_HEAD(,epg_genre)      epg_genre_list_t;
 
 /*
@@ -439,6 +441,7 @@ struct epg_broadcast
   lang_str_t                *description;      ///< Description
 
   RB_ENTRY(epg_broadcast)    sched_link;       ///< Schedule link
+  LIST_ENTRY(epg_broadcast)  eid_link;         ///< Channel event id hash link
   LIST_ENTRY(epg_broadcast)  ep_link;          ///< Episode link
   epg_episode_t             *episode;          ///< Episode shown
   LIST_ENTRY(epg_broadcast)  sl_link;          ///< SeriesLink link
@@ -531,9 +534,99 @@ void epg_channel_unlink ( struct channel *ch );
 /* ************************************************************************
  * Global config
  * ***********************************************************************/
+uint32_t         epg_config_last_id   ( void );
 htsmsg_t        *epg_config_serialize ( void );
 int              epg_config_deserialize ( htsmsg_t *m );
 
+/* ************************************************************************
+ * Flat records - decoded object data (database load) and object copies
+ * (database save)
+ *
+ * The strings are not owned by the record, unset fields are zero.
+ * ***********************************************************************/
+
+typedef struct epg_lang_rec
+{
+  const char *lang;                ///< NULL = default language
+  const char *str;
+} epg_lang_rec_t;
+
+typedef enum epg_text_rec
+{
+  EPG_REC_TITLE,
+  EPG_REC_SUBTITLE,
+  EPG_REC_SUMMARY,
+  EPG_REC_DESCRIPTION,
+  EPG_REC_TEXT_MAX
+} epg_text_rec_t;
+
+typedef struct epg_object_rec
+{
+  epg_object_type_t  type;
+  uint32_t           id;
+  const char        *uri;
+  const char        *grabber;
+  int64_t            updated;
+
+  epg_lang_rec_t    *text[EPG_REC_TEXT_MAX];
+  int                text_count[EPG_REC_TEXT_MAX];
+
+  const char        *brand;        ///< Brand URI
+  const char        *season;       ///< Season URI
+  const char        *episode;      ///< Episode URI
+  const char        *serieslink;   ///< Series link URI
+  const char        *channel;      ///< Channel UUID
+  const char        *image;
+
+  uint32_t           number;       ///< Season number
+  uint32_t           count;        ///< Brand season / season episode count
+  epg_episode_num_t  epnum;
+  const uint8_t     *genre;
+  int                genre_count;
+  uint8_t            is_bw;
+  uint8_t            star_rating;
+  uint8_t            age_rating;
+  int64_t            first_aired;
+
+  int64_t            start;
+  int64_t            stop;
+  uint16_t           dvb_eid;
+  uint16_t           lines;
+  uint16_t           aspect;
+  uint8_t            is_widescreen;
+  uint8_t            is_hd;
+  uint8_t            is_deafsigned;
+  uint8_t            is_subtitled;
+  uint8_t            is_audio_desc;
+  uint8_t            is_new;
+  uint8_t            is_repeat;
+} epg_object_rec_t;
+
+/* Convert a serialized object (the record references the message) */
+int   epg_object_rec_from_msg ( htsmsg_t *m, epg_object_rec_t *r );
+void  epg_object_rec_free     ( epg_object_rec_t *r );
+
+/* Record buffer, the records own copies of the object data (database save) */
+typedef struct epg_rec_buf
+{
+  epg_object_rec_t     *recs;
+  int                   count;
+  int                   size;
+  struct epg_rec_chunk *data;      ///< Copied strings, texts and genres
+} epg_rec_buf_t;
+
+/* Append a copy of the object (-1 if it isn't saved), global_lock held */
+int   epg_object_rec_copy ( epg_object_t *eo, epg_rec_buf_t *rb );
+void  epg_rec_buf_free    ( epg_rec_buf_t *rb );
+
+/* Create/update objects from the records */
+epg_object_t     *epg_object_load     ( const epg_object_rec_t *r, int create, int *save );
+epg_brand_t      *epg_brand_load      ( const epg_object_rec_t *r, int create, int *save );
+epg_season_t     *epg_season_load     ( const epg_object_rec_t *r, int create, int *save );
+epg_episode_t    *epg_episode_load    ( const epg_object_rec_t *r, int create, int *save );
+epg_serieslink_t *epg_serieslink_load ( const epg_object_rec_t *r, int create, int *save );
+epg_broadcast_t  *epg_broadcast_load  ( const epg_object_rec_t *r, int create, int *save );
+
 /* ************************************************************************
  * Querying
  * ***********************************************************************/
@@ -623,6 +716,7 @@ void epg_done    (void);
 void epg_skel_done (void);
 void epg_save    (void);
 void epg_save_callback (void *p);
+htsmsg_t *epg_save_stats (void);
 void epg_updated (void);
 
 #endif /* EPG_H */
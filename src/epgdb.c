@@ -17,9 +17,12 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <libgen.h>
 #include <pthread.h>
 
 #include "tvheadend.h"
@@ -30,7 +33,98 @@
 #include "epg.h"
 #include "epggrab.h"
 
-#define EPG_DB_VERSION 2
+#define EPG_DB_VERSION 3
+
+/*
+ * v3 database layout
+ *
+ *   magic   "TVHEPG\0\3"
+ *   blocks  u32 length (big endian), u8 kind, payload
+ *
+ *   STRINGS varint count, count * (varint length, bytes, NUL)
+ *   CONFIG  varint last_id
+ *   OBJECTS u8 type, varint channel, varint count, count * record
+ *
+ * A record is a list of (varint tag, value) terminated by a zero tag,
+ * the low two tag bits give the value kind so unknown fields can be
+ * skipped. Strings are stored once and referenced by index + 1, all
+ * broadcasts of a block belong to the block channel.
+ */
+#define EPGDB_MAGIC       "TVHEPG\0\3"
+#define EPGDB_MAGIC_LEN   8
+#define EPGDB_BLOCK_RECS  2048
+#define EPGDB_THREADS_MAX 8
+
+enum {
+  EPGDB_BLK_STRINGS = 1,
+  EPGDB_BLK_CONFIG,
+  EPGDB_BLK_OBJECTS
+};
+
+enum {
+  EPGDB_K_UINT,
+  EPGDB_K_STR,
+  EPGDB_K_LANG,
+  EPGDB_K_BYTES
+};
+
+#define EPGDB_TAG(id, kind) (((id) << 2) | (kind))
+
+enum {
+  EPGDB_T_END,
+  EPGDB_T_ID          = EPGDB_TAG(1,  EPGDB_K_UINT),
+  EPGDB_T_URI         = EPGDB_TAG(2,  EPGDB_K_STR),
+  EPGDB_T_GRABBER     = EPGDB_TAG(3,  EPGDB_K_STR),
+  EPGDB_T_UPDATED     = EPGDB_TAG(4,  EPGDB_K_UINT),
+  EPGDB_T_TITLE       = EPGDB_TAG(5,  EPGDB_K_LANG),
+  EPGDB_T_SUBTITLE    = EPGDB_TAG(6,  EPGDB_K_LANG),
+  EPGDB_T_SUMMARY     = EPGDB_TAG(7,  EPGDB_K_LANG),
+  EPGDB_T_DESCRIPTION = EPGDB_TAG(8,  EPGDB_K_LANG),
+  EPGDB_T_BRAND       = EPGDB_TAG(9,  EPGDB_K_STR),
+  EPGDB_T_SEASON      = EPGDB_TAG(10, EPGDB_K_STR),
+  EPGDB_T_EPISODE     = EPGDB_TAG(11, EPGDB_K_STR),
+  EPGDB_T_SERIESLINK  = EPGDB_TAG(12, EPGDB_K_STR),
+  EPGDB_T_IMAGE       = EPGDB_TAG(13, EPGDB_K_STR),
+  EPGDB_T_NUMBER      = EPGDB_TAG(14, EPGDB_K_UINT),
+  EPGDB_T_COUNT       = EPGDB_TAG(15, EPGDB_K_UINT),
+  EPGDB_T_E_NUM       = EPGDB_TAG(16, EPGDB_K_UINT),
+  EPGDB_T_E_CNT       = EPGDB_TAG(17, EPGDB_K_UINT),
+  EPGDB_T_S_NUM       = EPGDB_TAG(18, EPGDB_K_UINT),
+  EPGDB_T_S_CNT       = EPGDB_TAG(19, EPGDB_K_UINT),
+  EPGDB_T_P_NUM       = EPGDB_TAG(20, EPGDB_K_UINT),
+  EPGDB_T_P_CNT       = EPGDB_TAG(21, EPGDB_K_UINT),
+  EPGDB_T_EPTEXT      = EPGDB_TAG(22, EPGDB_K_STR),
+  EPGDB_T_GENRE       = EPGDB_TAG(23, EPGDB_K_BYTES),
+  EPGDB_T_IS_BW       = EPGDB_TAG(24, EPGDB_K_UINT),
+  EPGDB_T_STAR_RATING = EPGDB_TAG(25, EPGDB_K_UINT),
+  EPGDB_T_AGE_RATING  = EPGDB_TAG(26, EPGDB_K_UINT),
+  EPGDB_T_FIRST_AIRED = EPGDB_TAG(27, EPGDB_K_UINT),
+  EPGDB_T_START       = EPGDB_TAG(28, EPGDB_K_UINT),
+  EPGDB_T_STOP        = EPGDB_TAG(29, EPGDB_K_UINT),
+  EPGDB_T_DVB_EID     = EPGDB_TAG(30, EPGDB_K_UINT),
+  EPGDB_T_LINES       = EPGDB_TAG(31, EPGDB_K_UINT),
+  EPGDB_T_ASPECT      = EPGDB_TAG(32, EPGDB_K_UINT),
+  EPGDB_T_FLAGS       = EPGDB_TAG(33, EPGDB_K_UINT),
+};
+
+/* Broadcast flags */
+#define EPGDB_F_WIDESCREEN  (1<<0)
+#define EPGDB_F_HD          (1<<1)
+#define EPGDB_F_DEAFSIGNED  (1<<2)
+#define EPGDB_F_SUBTITLED   (1<<3)
+#define EPGDB_F_AUDIO_DESC  (1<<4)
+#define EPGDB_F_NEW         (1<<5)
+#define EPGDB_F_REPEAT      (1<<6)
+
+static inline uint64_t _epgdb_zigzag ( int64_t s )
+{
+  return ((uint64_t)s << 1) ^ (uint64_t)(s >> 63);
+}
+
+static inline int64_t _epgdb_unzigzag ( uint64_t u )
+{
+  return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
 
 extern epg_object_tree_t epg_brands;
 extern epg_object_tree_t epg_seasons;
@@ -142,6 +236,426 @@ _epgdb_v2_process( char **sect, htsmsg_t *m, epggrab_stats_t *stats )
   }
 }
 
+/*
+ * Load v2 data (binary htsmsg stream)
+ */
+static void
+_epgdb_v2_load ( uint8_t *rp, size_t remain, epggrab_stats_t *stats )
+{
+  char *sect = NULL;
+
+  while ( remain > 4 ) {
+
+    /* Get message length */
+    uint32_t msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    remain    -= 4;
+    rp        += 4;
+
+    /* Safety check */
+    if ((int64_t)msglen > remain) {
+      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+      break;
+    }
+    
+    /* Extract message */
+    htsmsg_t *m = htsmsg_binary_deserialize(rp, msglen, NULL);
+
+    /* Next */
+    rp     += msglen;
+    remain -= msglen;
+
+    /* Skip */
+    if (!m) continue;
+
+    /* Process */
+    _epgdb_v2_process(&sect, m, stats);
+
+    /* Cleanup */
+    htsmsg_destroy(m);
+  }
+
+  free(sect);
+}
+
+/*
+ * Load v3 data
+ *
+ * The object blocks are decoded into flat records by worker threads,
+ * the records are applied in the file order by the calling thread.
+ */
+typedef struct epgdb_langs {
+  struct epgdb_langs *next;
+  int                 used;
+  int                 size;
+  epg_lang_rec_t      recs[];
+} epgdb_langs_t;
+
+typedef struct epgdb_block {
+  const uint8_t     *data;
+  uint32_t           len;
+  int                state;     ///< 0 = queued, 1 = decoded, -1 = failed
+  epg_object_rec_t  *recs;
+  uint32_t           count;
+  epgdb_langs_t     *langs;
+} epgdb_block_t;
+
+typedef struct epgdb_loader {
+  const char      **strs;
+  uint32_t          nstrs;
+  epgdb_block_t    *blocks;
+  int               nblocks;
+  int               next;       ///< Next block to decode
+  int               applied;    ///< Blocks applied by the main thread
+  int               window;     ///< Decoded blocks kept ahead of apply
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+} epgdb_loader_t;
+
+static int
+_epgdb_get_varint ( const uint8_t **p, const uint8_t *end, uint64_t *u )
+{
+  const uint8_t *rp = *p;
+  uint64_t r = 0;
+  int shift = 0;
+
+  while (rp < end && shift < 64) {
+    if (shift == 63 && *rp > 1)
+      return -1; // more than 64 bits
+    r |= (uint64_t)(*rp & 0x7f) << shift;
+    if (!(*rp++ & 0x80)) {
+      *p = rp;
+      *u = r;
+      return 0;
+    }
+    shift += 7;
+  }
+  return -1;
+}
+
+static int
+_epgdb_get_str
+  ( epgdb_loader_t *l, const uint8_t **p, const uint8_t *end, const char **s )
+{
+  uint64_t u;
+  if (_epgdb_get_varint(p, end, &u) || u > l->nstrs)
+    return -1;
+  *s = u ? l->strs[u - 1] : NULL;
+  return 0;
+}
+
+static epg_lang_rec_t *
+_epgdb_langs_alloc ( epgdb_block_t *b, int n )
+{
+  epgdb_langs_t *ls = b->langs;
+  epg_lang_rec_t *r;
+
+  if (ls == NULL || ls->used + n > ls->size) {
+    int size = MAX(n, 1024);
+    ls = malloc(sizeof(*ls) + size * sizeof(epg_lang_rec_t));
+    ls->next = b->langs;
+    ls->used = 0;
+    ls->size = size;
+    b->langs = ls;
+  }
+  r = ls->recs + ls->used;
+  ls->used += n;
+  return r;
+}
+
+static int
+_epgdb_v3_decode_rec
+  ( epgdb_loader_t *l, epgdb_block_t *b, const uint8_t **p,
+    const uint8_t *end, epg_object_rec_t *r )
+{
+  uint64_t tag, u = 0;
+  const char *str = NULL;
+  epg_lang_rec_t *ls = NULL;
+  int i;
+
+  while (1) {
+    if (_epgdb_get_varint(p, end, &tag))
+      return -1;
+    if (tag == EPGDB_T_END)
+      return 0;
+    switch (tag & 3) {
+      case EPGDB_K_UINT:
+        if (_epgdb_get_varint(p, end, &u))
+          return -1;
+        break;
+      case EPGDB_K_STR:
+        if (_epgdb_get_str(l, p, end, &str))
+          return -1;
+        break;
+      case EPGDB_K_LANG:
+        if (_epgdb_get_varint(p, end, &u) || u > (uint64_t)(end - *p) / 2)
+          return -1;
+        ls = _epgdb_langs_alloc(b, u);
+        for (i = 0; i < u; i++)
+          if (_epgdb_get_str(l, p, end, &ls[i].lang) ||
+              _epgdb_get_str(l, p, end, &ls[i].str))
+            return -1;
+        break;
+      default:
+        if (_epgdb_get_varint(p, end, &u) || u > (uint64_t)(end - *p))
+          return -1;
+        str = (const char *)*p;
+        *p += u;
+        break;
+    }
+    switch (tag) {
+      case EPGDB_T_ID:          r->id = u; break;
+      case EPGDB_T_URI:         r->uri = str; break;
+      case EPGDB_T_GRABBER:     r->grabber = str; break;
+      case EPGDB_T_UPDATED:     r->updated = _epgdb_unzigzag(u); break;
+      case EPGDB_T_TITLE:
+      case EPGDB_T_SUBTITLE:
+      case EPGDB_T_SUMMARY:
+      case EPGDB_T_DESCRIPTION:
+        i = EPG_REC_TITLE + ((tag >> 2) - (EPGDB_T_TITLE >> 2));
+        r->text[i] = ls;
+        r->text_count[i] = u;
+        break;
+      case EPGDB_T_BRAND:       r->brand = str; break;
+      case EPGDB_T_SEASON:      r->season = str; break;
+      case EPGDB_T_EPISODE:     r->episode = str; break;
+      case EPGDB_T_SERIESLINK:  r->serieslink = str; break;
+      case EPGDB_T_IMAGE:       r->image = str; break;
+      case EPGDB_T_NUMBER:      r->number = u; break;
+      case EPGDB_T_COUNT:       r->count = u; break;
+      case EPGDB_T_E_NUM:       r->epnum.e_num = u; break;
+      case EPGDB_T_E_CNT:       r->epnum.e_cnt = u; break;
+      case EPGDB_T_S_NUM:       r->epnum.s_num = u; break;
+      case EPGDB_T_S_CNT:       r->epnum.s_cnt = u; break;
+      case EPGDB_T_P_NUM:       r->epnum.p_num = u; break;
+      case EPGDB_T_P_CNT:       r->epnum.p_cnt = u; break;
+      case EPGDB_T_EPTEXT:      r->epnum.text = (char *)str; break;
+      case EPGDB_T_GENRE:
+        r->genre = (const uint8_t *)str;
+        r->genre_count = u;
+        break;
+      case EPGDB_T_IS_BW:       r->is_bw = u; break;
+      case EPGDB_T_STAR_RATING: r->star_rating = u; break;
+      case EPGDB_T_AGE_RATING:  r->age_rating = u; break;
+      case EPGDB_T_FIRST_AIRED: r->first_aired = _epgdb_unzigzag(u); break;
+      case EPGDB_T_START:       r->start = _epgdb_unzigzag(u); break;
+      case EPGDB_T_STOP:        r->stop = _epgdb_unzigzag(u); break;
+      case EPGDB_T_DVB_EID:     r->dvb_eid = u; break;
+      case EPGDB_T_LINES:       r->lines = u; break;
+      case EPGDB_T_ASPECT:      r->aspect = u; break;
+      case EPGDB_T_FLAGS:
+        r->is_widescreen = !!(u & EPGDB_F_WIDESCREEN);
+        r->is_hd         = !!(u & EPGDB_F_HD);
+        r->is_deafsigned = !!(u & EPGDB_F_DEAFSIGNED);
+        r->is_subtitled  = !!(u & EPGDB_F_SUBTITLED);
+        r->is_audio_desc = !!(u & EPGDB_F_AUDIO_DESC);
+        r->is_new        = !!(u & EPGDB_F_NEW);
+        r->is_repeat     = !!(u & EPGDB_F_REPEAT);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static int
+_epgdb_v3_decode_block ( epgdb_loader_t *l, epgdb_block_t *b )
+{
+  const uint8_t *p = b->data + 1, *end = b->data + b->len;
+  const char *channel;
+  uint64_t u;
+  uint32_t i;
+  int type;
+
+  if (p >= end) return -1;
+  type = *p++;
+  if (type <= EPG_UNDEF || type > EPG_TYPEMAX) return -1;
+  if (_epgdb_get_str(l, &p, end, &channel)) return -1;
+  if (_epgdb_get_varint(&p, end, &u) || u > (uint64_t)(end - p)) return -1;
+  b->recs = calloc(u ?: 1, sizeof(epg_object_rec_t));
+  for (i = 0; i < u; i++) {
+    b->recs[i].type    = type;
+    b->recs[i].channel = channel;
+    if (_epgdb_v3_decode_rec(l, b, &p, end, &b->recs[i]))
+      return -1;
+    b->count++;
+  }
+  return 0;
+}
+
+static void *
+_epgdb_v3_thread ( void *aux )
+{
+  epgdb_loader_t *l = aux;
+  epgdb_block_t *b, d;
+  int state;
+
+  pthread_mutex_lock(&l->lock);
+  while (l->next < l->nblocks) {
+    if (l->next >= l->applied + l->window) {
+      pthread_cond_wait(&l->cond, &l->lock);
+      continue;
+    }
+    b = &l->blocks[l->next++];
+    d = *b;
+    pthread_mutex_unlock(&l->lock);
+    /* Decode into a copy, the block is published under the lock */
+    state = _epgdb_v3_decode_block(l, &d) ? -1 : 1;
+    pthread_mutex_lock(&l->lock);
+    b->recs  = d.recs;
+    b->count = d.count;
+    b->langs = d.langs;
+    b->state = state;
+    pthread_cond_broadcast(&l->cond);
+  }
+  pthread_mutex_unlock(&l->lock);
+  return NULL;
+}
+
+static void
+_epgdb_v3_apply ( epgdb_block_t *b, epggrab_stats_t *stats )
+{
+  epg_object_rec_t *r;
+  epgdb_langs_t *ls;
+  int save = 0;
+
+  for (r = b->recs; r < b->recs + b->count; r++) {
+    if (!epg_object_load(r, 1, &save))
+      continue;
+    switch (r->type) {
+      case EPG_BRAND:      stats->brands.total++;     break;
+      case EPG_SEASON:     stats->seasons.total++;    break;
+      case EPG_EPISODE:    stats->episodes.total++;   break;
+      case EPG_SERIESLINK: stats->seasons.total++;    break;
+      case EPG_BROADCAST:  stats->broadcasts.total++; break;
+      default: break;
+    }
+  }
+  free(b->recs);
+  b->recs = NULL;
+  while ((ls = b->langs) != NULL) {
+    b->langs = ls->next;
+    free(ls);
+  }
+}
+
+static int
+_epgdb_v3_strings ( epgdb_loader_t *l, const uint8_t *p, const uint8_t *end )
+{
+  uint64_t u, len;
+  uint32_t i;
+
+  if (_epgdb_get_varint(&p, end, &u) || u > (uint64_t)(end - p))
+    return -1;
+  l->strs = malloc((u ?: 1) * sizeof(char *));
+  for (i = 0; i < u; i++) {
+    if (_epgdb_get_varint(&p, end, &len) || len >= (uint64_t)(end - p) ||
+        p[len] != '\0')
+      return -1;
+    l->strs[i] = (const char *)p;
+    p += len + 1;
+  }
+  l->nstrs = u;
+  return 0;
+}
+
+static void
+_epgdb_v3_load ( const uint8_t *rp, size_t remain, epggrab_stats_t *stats )
+{
+  epgdb_loader_t l;
+  epgdb_block_t *b;
+  pthread_t tids[EPGDB_THREADS_MAX];
+  const uint8_t *strs = NULL, *p;
+  uint32_t len, strs_len = 0;
+  uint64_t u;
+  htsmsg_t *m;
+  int i, nthreads, size = 0;
+
+  memset(&l, 0, sizeof(l));
+  if (remain < EPGDB_MAGIC_LEN || memcmp(rp, EPGDB_MAGIC, EPGDB_MAGIC_LEN)) {
+    tvhlog(LOG_ERR, "epgdb", "unknown database format");
+    return;
+  }
+  rp     += EPGDB_MAGIC_LEN;
+  remain -= EPGDB_MAGIC_LEN;
+
+  /* Index the blocks */
+  while (remain > 4) {
+    len = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    if (len == 0 || len > remain - 4) {
+      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+      break;
+    }
+    p = rp + 4;
+    switch (*p) {
+      case EPGDB_BLK_STRINGS:
+        strs     = p + 1;
+        strs_len = len - 1;
+        break;
+      case EPGDB_BLK_CONFIG:
+        p++;
+        if (!_epgdb_get_varint(&p, rp + 4 + len, &u)) {
+          m = htsmsg_create_map();
+          htsmsg_add_u32(m, "last_id", u);
+          if (epg_config_deserialize(m)) stats->config.total++;
+          htsmsg_destroy(m);
+        }
+        break;
+      case EPGDB_BLK_OBJECTS:
+        if (l.nblocks == size) {
+          size = MAX(64, size * 2);
+          l.blocks = realloc(l.blocks, size * sizeof(epgdb_block_t));
+        }
+        b = &l.blocks[l.nblocks++];
+        memset(b, 0, sizeof(*b));
+        b->data = p;
+        b->len  = len;
+        break;
+      default:
+        break;
+    }
+    rp     += 4 + len;
+    remain -= 4 + len;
+  }
+
+  if (strs == NULL || _epgdb_v3_strings(&l, strs, strs + strs_len)) {
+    tvhlog(LOG_ERR, "epgdb", "corruption detected, string table missing");
+    free(l.strs);
+    free(l.blocks);
+    return;
+  }
+
+  /* Decode and apply */
+  nthreads = MIN(MAX(sysconf(_SC_NPROCESSORS_ONLN), 1), EPGDB_THREADS_MAX);
+  nthreads = MIN(nthreads, l.nblocks);
+  l.window = 4 * nthreads;
+  pthread_mutex_init(&l.lock, NULL);
+  pthread_cond_init(&l.cond, NULL);
+  for (i = 0; i < nthreads; i++)
+    tvhthread_create(&tids[i], NULL, _epgdb_v3_thread, &l);
+
+  for (i = 0; i < l.nblocks; i++) {
+    b = &l.blocks[i];
+    pthread_mutex_lock(&l.lock);
+    while (b->state == 0)
+      pthread_cond_wait(&l.cond, &l.lock);
+    pthread_mutex_unlock(&l.lock);
+    if (b->state < 0)
+      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+    _epgdb_v3_apply(b, stats);
+    pthread_mutex_lock(&l.lock);
+    l.applied++;
+    pthread_cond_broadcast(&l.cond);
+    pthread_mutex_unlock(&l.lock);
+  }
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join(tids[i], NULL);
+  pthread_cond_destroy(&l.cond);
+  pthread_mutex_destroy(&l.lock);
+  free(l.strs);
+  free(l.blocks);
+}
+
 /*
  * Load data
  */
@@ -149,11 +663,10 @@ void epg_init ( void )
 {
   int fd = -1;
   struct stat st;
-  size_t remain;
-  uint8_t *mem, *rp;
+  uint8_t *mem;
   epggrab_stats_t stats;
   int ver = EPG_DB_VERSION;
-  char *sect = NULL;
+  int64_t mono = getmonoclock();
 
   /* Find the right file (and version) */
   while (fd < 0 && ver > 0) {
@@ -177,8 +690,7 @@ void epg_init ( void )
     tvhlog(LOG_DEBUG, "epgdb", "database is empty");
     return;
   }
-  remain   = st.st_size;
-  rp = mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
   if ( mem == MAP_FAILED ) {
     tvhlog(LOG_ERR, "epgdb", "failed to mmap database");
     return;
@@ -186,44 +698,17 @@ void epg_init ( void )
 
   /* Process */
   memset(&stats, 0, sizeof(stats));
-  while ( remain > 4 ) {
-
-    /* Get message length */
-    uint32_t msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
-    remain    -= 4;
-    rp        += 4;
-
-    /* Safety check */
-    if ((int64_t)msglen > remain) {
-      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+  switch (ver) {
+    case 3:
+      _epgdb_v3_load(mem, st.st_size, &stats);
+      break;
+    case 2:
+      _epgdb_v2_load(mem, st.st_size, &stats);
+      break;
+    default:
       break;
-    }
-    
-    /* Extract message */
-    htsmsg_t *m = htsmsg_binary_deserialize(rp, msglen, NULL);
-
-    /* Next */
-    rp     += msglen;
-    remain -= msglen;
-
-    /* Skip */
-    if (!m) continue;
-
-    /* Process */
-    switch (ver) {
-      case 2:
-        _epgdb_v2_process(&sect, m, &stats);
-        break;
-      default:
-        break;
-    }
-
-    /* Cleanup */
-    htsmsg_destroy(m);
   }
 
-  free(sect);
-
   if (!stats.config.total) {
     htsmsg_t *m = htsmsg_create_map();
     /* it's not correct, but at least something */
@@ -240,16 +725,22 @@ void epg_init ( void )
   tvhlog(LOG_INFO, "epgdb", "  seasons    %d", stats.seasons.total);
   tvhlog(LOG_INFO, "epgdb", "  episodes   %d", stats.episodes.total);
   tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", stats.broadcasts.total);
+  tvhlog(LOG_INFO, "epgdb", "  load time  %"PRId64" ms",
+         (getmonoclock() - mono) / 1000);
 
   /* Close file */
   munmap(mem, st.st_size);
   close(fd);
 }
 
+static void _epgdb_save_done ( void );
+
 void epg_done ( void )
 {
   channel_t *ch;
 
+  _epgdb_save_done();
+
   pthread_mutex_lock(&global_lock);
   CHANNEL_FOREACH(ch)
     epg_channel_unlink(ch);
@@ -259,31 +750,434 @@ void epg_done ( void )
 
 /* **************************************************************************
  * Save
+ *
+ * The objects are copied to flat records under global_lock (snapshot),
+ * the binary encoding and the disk write run in the save thread.
  * *************************************************************************/
 
-static int _epg_write ( int fd, htsmsg_t *m )
+#define EPGDB_WRITE_BUF (1024*1024)
+
+typedef struct epgdb_snapshot {
+  epg_rec_buf_t    recs;
+  uint32_t         last_id;
+  epggrab_stats_t  stats;
+  int64_t          lock_time;   ///< Snapshot time under global_lock (us)
+  char             path[PATH_MAX];
+} epgdb_snapshot_t;
+
+static pthread_mutex_t   epgdb_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    epgdb_save_cond;
+static pthread_t         epgdb_save_tid;
+static int               epgdb_save_running;
+static epgdb_snapshot_t *epgdb_save_pending;
+
+/* Stats (us), protected by epgdb_save_mutex */
+static int64_t           epgdb_saves;
+static int64_t           epgdb_save_errors;
+static int64_t           epgdb_lock_time;
+static int64_t           epgdb_lock_time_max;
+static int64_t           epgdb_save_time;
+static int64_t           epgdb_save_time_max;
+
+static void _epgdb_snapshot_free ( epgdb_snapshot_t *snap )
 {
-  int ret = 1;
-  size_t msglen;
-  void *msgdata;
-  if (m) {
-    int r = htsmsg_binary_serialize(m, &msgdata, &msglen, 0x10000);
-    htsmsg_destroy(m);
-    if (!r) {
-      ret = tvh_write(fd, msgdata, msglen);
-      free(msgdata);
+  epg_rec_buf_free(&snap->recs);
+  free(snap);
+}
+
+/*
+ * v3 writer
+ */
+typedef struct epgdb_writer {
+  int          fd;
+  int          err;
+  uint8_t     *buf;
+  size_t       used;
+
+  /* String table */
+  const char **str_keys;
+  uint32_t    *str_ids;
+  uint32_t     str_mask;
+  uint32_t     str_count;
+  sbuf_t       str_data;
+
+  /* Current object block */
+  sbuf_t       blk;
+  int          blk_type;
+  const char  *blk_channel;
+  uint32_t     blk_count;
+} epgdb_writer_t;
+
+static void
+_epgdb_out ( epgdb_writer_t *w, const void *data, size_t len )
+{
+  if (w->err)
+    return;
+  if (w->used + len > EPGDB_WRITE_BUF) {
+    if (w->used && tvh_write(w->fd, w->buf, w->used)) {
+      w->err = 1;
+      return;
     }
+    w->used = 0;
+  }
+  if (len > EPGDB_WRITE_BUF) {
+    if (tvh_write(w->fd, data, len))
+      w->err = 1;
   } else {
-    ret = 0;
+    memcpy(w->buf + w->used, data, len);
+    w->used += len;
   }
-  return ret;
 }
 
-static int _epg_write_sect ( int fd, const char *sect )
+static int
+_epgdb_varint ( uint8_t *b, uint64_t u )
 {
-  htsmsg_t *m = htsmsg_create_map();
-  htsmsg_add_str(m, "__section__", sect);
-  return _epg_write(fd, m);
+  int i = 0;
+  while (u >= 0x80) {
+    b[i++] = (u & 0x7f) | 0x80;
+    u >>= 7;
+  }
+  b[i++] = u;
+  return i;
+}
+
+/* sbuf grows linearly, keep the many small appends amortized */
+static inline void
+_epgdb_append ( sbuf_t *sb, const void *data, int len )
+{
+  if (sb->sb_ptr + len > sb->sb_size)
+    sbuf_alloc(sb, MAX(len, sb->sb_size));
+  sbuf_append(sb, data, len);
+}
+
+static void
+_epgdb_put_varint ( sbuf_t *sb, uint64_t u )
+{
+  uint8_t b[10];
+  _epgdb_append(sb, b, _epgdb_varint(b, u));
+}
+
+static void
+_epgdb_out_block
+  ( epgdb_writer_t *w, int kind, const uint8_t *hdr, int hdrlen,
+    const void *data, size_t datalen )
+{
+  uint32_t len = 1 + hdrlen + datalen;
+  uint8_t b[5] = { len >> 24, len >> 16, len >> 8, len, kind };
+
+  _epgdb_out(w, b, sizeof(b));
+  _epgdb_out(w, hdr, hdrlen);
+  if (datalen)
+    _epgdb_out(w, data, datalen);
+}
+
+static inline uint32_t
+_epgdb_strhash ( const char *s )
+{
+  uint32_t h = 2166136261u;
+  while (*s)
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h;
+}
+
+static void
+_epgdb_strtab_grow ( epgdb_writer_t *w )
+{
+  const char **keys = w->str_keys;
+  uint32_t *ids = w->str_ids, mask = w->str_mask, i, j;
+
+  w->str_mask = mask ? (mask << 1) | 1 : 0xffff;
+  w->str_keys = calloc(w->str_mask + 1, sizeof(char *));
+  w->str_ids  = malloc((w->str_mask + 1) * sizeof(uint32_t));
+  for (i = 0; mask && i <= mask; i++) {
+    if (keys[i] == NULL)
+      continue;
+    for (j = _epgdb_strhash(keys[i]) & w->str_mask; w->str_keys[j];
+         j = (j + 1) & w->str_mask);
+    w->str_keys[j] = keys[i];
+    w->str_ids[j]  = ids[i];
+  }
+  free(keys);
+  free(ids);
+}
+
+/*
+ * Get the string reference (adds new strings to the table)
+ */
+static uint32_t
+_epgdb_intern ( epgdb_writer_t *w, const char *str )
+{
+  uint32_t i;
+  size_t len;
+
+  if (str == NULL)
+    return 0;
+  if ((w->str_count + 1) * 2 > w->str_mask + 1)
+    _epgdb_strtab_grow(w);
+  for (i = _epgdb_strhash(str) & w->str_mask; w->str_keys[i];
+       i = (i + 1) & w->str_mask)
+    if (!strcmp(w->str_keys[i], str))
+      return w->str_ids[i];
+  w->str_keys[i] = str;
+  w->str_ids[i]  = ++w->str_count;
+  len = strlen(str);
+  _epgdb_put_varint(&w->str_data, len);
+  _epgdb_append(&w->str_data, str, len + 1);
+  return w->str_count;
+}
+
+static inline void
+_epgdb_put_uint ( epgdb_writer_t *w, int tag, uint64_t u )
+{
+  if (u) {
+    _epgdb_put_varint(&w->blk, tag);
+    _epgdb_put_varint(&w->blk, u);
+  }
+}
+
+static inline void
+_epgdb_put_str ( epgdb_writer_t *w, int tag, const char *str )
+{
+  if (str) {
+    _epgdb_put_varint(&w->blk, tag);
+    _epgdb_put_varint(&w->blk, _epgdb_intern(w, str));
+  }
+}
+
+static void
+_epgdb_put_lang
+  ( epgdb_writer_t *w, int tag, const epg_object_rec_t *r, epg_text_rec_t t )
+{
+  int i;
+
+  if (!r->text_count[t])
+    return;
+  _epgdb_put_varint(&w->blk, tag);
+  _epgdb_put_varint(&w->blk, r->text_count[t]);
+  for (i = 0; i < r->text_count[t]; i++) {
+    _epgdb_put_varint(&w->blk, _epgdb_intern(w, r->text[t][i].lang));
+    _epgdb_put_varint(&w->blk, _epgdb_intern(w, r->text[t][i].str));
+  }
+}
+
+static void
+_epgdb_put_rec ( epgdb_writer_t *w, const epg_object_rec_t *r )
+{
+  uint32_t flags = 0;
+
+  _epgdb_put_uint(w, EPGDB_T_ID, r->id);
+  _epgdb_put_str(w, EPGDB_T_URI, r->uri);
+  _epgdb_put_str(w, EPGDB_T_GRABBER, r->grabber);
+  _epgdb_put_uint(w, EPGDB_T_UPDATED, _epgdb_zigzag(r->updated));
+  _epgdb_put_lang(w, EPGDB_T_TITLE, r, EPG_REC_TITLE);
+  _epgdb_put_lang(w, EPGDB_T_SUBTITLE, r, EPG_REC_SUBTITLE);
+  _epgdb_put_lang(w, EPGDB_T_SUMMARY, r, EPG_REC_SUMMARY);
+  _epgdb_put_lang(w, EPGDB_T_DESCRIPTION, r, EPG_REC_DESCRIPTION);
+  _epgdb_put_str(w, EPGDB_T_BRAND, r->brand);
+  _epgdb_put_str(w, EPGDB_T_SEASON, r->season);
+  _epgdb_put_str(w, EPGDB_T_EPISODE, r->episode);
+  _epgdb_put_str(w, EPGDB_T_SERIESLINK, r->serieslink);
+  _epgdb_put_str(w, EPGDB_T_IMAGE, r->image);
+  _epgdb_put_uint(w, EPGDB_T_NUMBER, r->number);
+  _epgdb_put_uint(w, EPGDB_T_COUNT, r->count);
+  _epgdb_put_uint(w, EPGDB_T_E_NUM, r->epnum.e_num);
+  _epgdb_put_uint(w, EPGDB_T_E_CNT, r->epnum.e_cnt);
+  _epgdb_put_uint(w, EPGDB_T_S_NUM, r->epnum.s_num);
+  _epgdb_put_uint(w, EPGDB_T_S_CNT, r->epnum.s_cnt);
+  _epgdb_put_uint(w, EPGDB_T_P_NUM, r->epnum.p_num);
+  _epgdb_put_uint(w, EPGDB_T_P_CNT, r->epnum.p_cnt);
+  _epgdb_put_str(w, EPGDB_T_EPTEXT, r->epnum.text);
+  if (r->genre_count) {
+    _epgdb_put_varint(&w->blk, EPGDB_T_GENRE);
+    _epgdb_put_varint(&w->blk, r->genre_count);
+    _epgdb_append(&w->blk, r->genre, r->genre_count);
+  }
+  _epgdb_put_uint(w, EPGDB_T_IS_BW, r->is_bw);
+  _epgdb_put_uint(w, EPGDB_T_STAR_RATING, r->star_rating);
+  _epgdb_put_uint(w, EPGDB_T_AGE_RATING, r->age_rating);
+  _epgdb_put_uint(w, EPGDB_T_FIRST_AIRED, _epgdb_zigzag(r->first_aired));
+  _epgdb_put_uint(w, EPGDB_T_START, _epgdb_zigzag(r->start));
+  _epgdb_put_uint(w, EPGDB_T_STOP, _epgdb_zigzag(r->stop));
+  _epgdb_put_uint(w, EPGDB_T_DVB_EID, r->dvb_eid);
+  _epgdb_put_uint(w, EPGDB_T_LINES, r->lines);
+  _epgdb_put_uint(w, EPGDB_T_ASPECT, r->aspect);
+  if (r->is_widescreen) flags |= EPGDB_F_WIDESCREEN;
+  if (r->is_hd)         flags |= EPGDB_F_HD;
+  if (r->is_deafsigned) flags |= EPGDB_F_DEAFSIGNED;
+  if (r->is_subtitled)  flags |= EPGDB_F_SUBTITLED;
+  if (r->is_audio_desc) flags |= EPGDB_F_AUDIO_DESC;
+  if (r->is_new)        flags |= EPGDB_F_NEW;
+  if (r->is_repeat)     flags |= EPGDB_F_REPEAT;
+  _epgdb_put_uint(w, EPGDB_T_FLAGS, flags);
+  _epgdb_put_varint(&w->blk, EPGDB_T_END);
+}
+
+static void
+_epgdb_flush_objects ( epgdb_writer_t *w )
+{
+  uint8_t hdr[21];
+  int l = 0;
+
+  if (!w->blk_count)
+    return;
+  hdr[l++] = w->blk_type;
+  l += _epgdb_varint(hdr + l, _epgdb_intern(w, w->blk_channel));
+  l += _epgdb_varint(hdr + l, w->blk_count);
+  _epgdb_out_block(w, EPGDB_BLK_OBJECTS, hdr, l, w->blk.sb_data, w->blk.sb_ptr);
+  sbuf_reset(&w->blk, EPGDB_WRITE_BUF);
+  w->blk_count = 0;
+}
+
+static void
+_epgdb_write_object ( epgdb_writer_t *w, const epg_object_rec_t *r )
+{
+  if (w->blk_count >= EPGDB_BLOCK_RECS || w->blk_type != r->type ||
+      strcmp(w->blk_channel ?: "", r->channel ?: ""))
+    _epgdb_flush_objects(w);
+  w->blk_type    = r->type;
+  w->blk_channel = r->channel; // stored in the block header
+  w->blk_count++;
+  _epgdb_put_rec(w, r);
+}
+
+static int _epgdb_write ( int fd, epgdb_snapshot_t *snap )
+{
+  epgdb_writer_t w;
+  const epg_object_rec_t *r;
+  uint8_t hdr[10];
+
+  memset(&w, 0, sizeof(w));
+  w.fd  = fd;
+  w.buf = malloc(EPGDB_WRITE_BUF);
+  sbuf_init(&w.blk);
+  sbuf_init(&w.str_data);
+  _epgdb_strtab_grow(&w);
+
+  _epgdb_out(&w, EPGDB_MAGIC, EPGDB_MAGIC_LEN);
+  _epgdb_out_block(&w, EPGDB_BLK_CONFIG, hdr,
+                   _epgdb_varint(hdr, snap->last_id), NULL, 0);
+  for (r = snap->recs.recs; r < snap->recs.recs + snap->recs.count; r++) {
+    _epgdb_write_object(&w, r);
+    if (w.err)
+      break;
+  }
+  _epgdb_flush_objects(&w);
+
+  /* String table (read first by the loader) */
+  _epgdb_out_block(&w, EPGDB_BLK_STRINGS, hdr,
+                   _epgdb_varint(hdr, w.str_count),
+                   w.str_data.sb_data, w.str_data.sb_ptr);
+  if (!w.err && w.used && tvh_write(fd, w.buf, w.used))
+    w.err = 1;
+
+  sbuf_free(&w.blk);
+  sbuf_free(&w.str_data);
+  free(w.str_keys);
+  free(w.str_ids);
+  free(w.buf);
+  return w.err;
+}
+
+static int _epgdb_snapshot_write ( epgdb_snapshot_t *snap )
+{
+  char tmppath[PATH_MAX + 4]; /* snap->path + ".tmp" */
+  char dir[PATH_MAX];
+  int64_t mono = getmonoclock();
+  int fd, err;
+
+  if (hts_settings_makedirs(snap->path))
+    return -1;
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", snap->path);
+  fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_WRONLY, 0700);
+  if (fd < 0) {
+    tvhlog(LOG_ERR, "epgdb", "unable to create \"%s\" - %s",
+           tmppath, strerror(errno));
+    return -1;
+  }
+
+  err = _epgdb_write(fd, snap);
+
+  /* Make the data durable before the rename */
+#if defined(PLATFORM_LINUX)
+  if (!err && fdatasync(fd))
+#else
+  if (!err && fsync(fd))
+#endif
+    err = 1;
+  if (close(fd))
+    err = 1;
+
+  if (err || rename(tmppath, snap->path)) {
+    tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
+    unlink(tmppath);
+    return -1;
+  }
+
+  /* And the rename itself */
+  strcpy(dir, snap->path);
+  dirname(dir);
+  if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+
+  /* Stats */
+  tvhlog(LOG_INFO, "epgdb", "saved");
+  tvhlog(LOG_INFO, "epgdb", "  brands     %d", snap->stats.brands.total);
+  tvhlog(LOG_INFO, "epgdb", "  seasons    %d", snap->stats.seasons.total);
+  tvhlog(LOG_INFO, "epgdb", "  episodes   %d", snap->stats.episodes.total);
+  tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", snap->stats.broadcasts.total);
+  tvhlog(LOG_INFO, "epgdb", "  lock held  %"PRId64" ms, write %"PRId64" ms",
+         snap->lock_time / 1000, (getmonoclock() - mono) / 1000);
+  return 0;
+}
+
+static void *_epgdb_save_thread ( void *aux )
+{
+  epgdb_snapshot_t *snap;
+  int64_t mono;
+  int err;
+
+  pthread_mutex_lock(&epgdb_save_mutex);
+  while (epgdb_save_running || epgdb_save_pending) {
+    if ((snap = epgdb_save_pending) == NULL) {
+      pthread_cond_wait(&epgdb_save_cond, &epgdb_save_mutex);
+      continue;
+    }
+    epgdb_save_pending = NULL;
+    pthread_mutex_unlock(&epgdb_save_mutex);
+    mono = getmonoclock();
+    err  = _epgdb_snapshot_write(snap);
+    mono = getmonoclock() - mono;
+    _epgdb_snapshot_free(snap);
+    pthread_mutex_lock(&epgdb_save_mutex);
+    if (err) {
+      epgdb_save_errors++;
+    } else {
+      epgdb_saves++;
+      epgdb_save_time = mono;
+      if (mono > epgdb_save_time_max)
+        epgdb_save_time_max = mono;
+    }
+  }
+  pthread_mutex_unlock(&epgdb_save_mutex);
+  return NULL;
+}
+
+/*
+ * Write the queued snapshot and stop the save thread
+ */
+static void _epgdb_save_done ( void )
+{
+  pthread_mutex_lock(&epgdb_save_mutex);
+  if (!epgdb_save_running) {
+    pthread_mutex_unlock(&epgdb_save_mutex);
+    return;
+  }
+  epgdb_save_running = 0;
+  pthread_cond_broadcast(&epgdb_save_cond);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+  pthread_join(epgdb_save_tid, NULL);
 }
 
 void epg_save_callback ( void *p )
@@ -293,63 +1187,77 @@ void epg_save_callback ( void *p )
 
 void epg_save ( void )
 {
-  int fd;
+  epgdb_snapshot_t *snap;
   epg_object_t *eo;
   epg_broadcast_t *ebc;
   channel_t *ch;
-  epggrab_stats_t stats;
+  int64_t mono = getmonoclock();
   extern gtimer_t epggrab_save_timer;
 
   if (epggrab_epgdb_periodicsave)
     gtimer_arm(&epggrab_save_timer, epg_save_callback, NULL, epggrab_epgdb_periodicsave);
-  
-  fd = hts_settings_open_file(1, "epgdb.v%d", EPG_DB_VERSION);
-  if (fd < 0)
+
+  snap = calloc(1, sizeof(*snap));
+  if (hts_settings_buildpath(snap->path, sizeof(snap->path),
+                             "epgdb.v%d", EPG_DB_VERSION)) {
+    free(snap);
     return;
+  }
 
-  memset(&stats, 0, sizeof(stats));
-  if ( _epg_write_sect(fd, "config") ) goto error;
-  if (_epg_write(fd, epg_config_serialize())) goto error;
-  if ( _epg_write_sect(fd, "brands") ) goto error;
+  /* Snapshot */
+  snap->last_id = epg_config_last_id();
   RB_FOREACH(eo,  &epg_brands, uri_link) {
-    if (_epg_write(fd, epg_brand_serialize((epg_brand_t*)eo))) goto error;
-    stats.brands.total++;
+    epg_object_rec_copy(eo, &snap->recs);
+    snap->stats.brands.total++;
   }
-  if ( _epg_write_sect(fd, "seasons") ) goto error;
   RB_FOREACH(eo,  &epg_seasons, uri_link) {
-    if (_epg_write(fd, epg_season_serialize((epg_season_t*)eo))) goto error;
-    stats.seasons.total++;
+    epg_object_rec_copy(eo, &snap->recs);
+    snap->stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "episodes") ) goto error;
   RB_FOREACH(eo,  &epg_episodes, uri_link) {
-    if (_epg_write(fd, epg_episode_serialize((epg_episode_t*)eo))) goto error;
-    stats.episodes.total++;
+    epg_object_rec_copy(eo, &snap->recs);
+    snap->stats.episodes.total++;
   }
-  if ( _epg_write_sect(fd, "serieslinks") ) goto error;
   RB_FOREACH(eo, &epg_serieslinks, uri_link) {
-    if (_epg_write(fd, epg_serieslink_serialize((epg_serieslink_t*)eo))) goto error;
-    stats.seasons.total++;
+    epg_object_rec_copy(eo, &snap->recs);
+    snap->stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "broadcasts") ) goto error;
   CHANNEL_FOREACH(ch) {
     RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-      if (_epg_write(fd, epg_broadcast_serialize(ebc))) goto error;
-      stats.broadcasts.total++;
+      epg_object_rec_copy((epg_object_t*)ebc, &snap->recs);
+      snap->stats.broadcasts.total++;
     }
   }
-  close(fd);
+  snap->lock_time = getmonoclock() - mono;
 
-  /* Stats */
-  tvhlog(LOG_INFO, "epgdb", "saved");
-  tvhlog(LOG_INFO, "epgdb", "  brands     %d", stats.brands.total);
-  tvhlog(LOG_INFO, "epgdb", "  seasons    %d", stats.seasons.total);
-  tvhlog(LOG_INFO, "epgdb", "  episodes   %d", stats.episodes.total);
-  tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", stats.broadcasts.total);
+  /* Queue (a newer snapshot replaces one not yet written) */
+  pthread_mutex_lock(&epgdb_save_mutex);
+  if (!epgdb_save_running) {
+    epgdb_save_running = 1;
+    pthread_cond_init(&epgdb_save_cond, NULL);
+    tvhthread_create(&epgdb_save_tid, NULL, _epgdb_save_thread, NULL);
+  }
+  if (epgdb_save_pending)
+    _epgdb_snapshot_free(epgdb_save_pending);
+  epgdb_save_pending = snap;
+  epgdb_lock_time = snap->lock_time;
+  if (snap->lock_time > epgdb_lock_time_max)
+    epgdb_lock_time_max = snap->lock_time;
+  pthread_cond_broadcast(&epgdb_save_cond);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+}
 
-  return;
+htsmsg_t *epg_save_stats ( void )
+{
+  htsmsg_t *m = htsmsg_create_map();
 
-error:
-  tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
-  hts_settings_remove("epgdb.v%d", EPG_DB_VERSION);
-  close(fd);
+  pthread_mutex_lock(&epgdb_save_mutex);
+  htsmsg_add_s64(m, "saves", epgdb_saves);
+  htsmsg_add_s64(m, "errors", epgdb_save_errors);
+  htsmsg_add_s64(m, "lock_time", epgdb_lock_time);
+  htsmsg_add_s64(m, "lock_time_max", epgdb_lock_time_max);
+  htsmsg_add_s64(m, "save_time", epgdb_save_time);
+  htsmsg_add_s64(m, "save_time_max", epgdb_save_time_max);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+  return m;
 }
@@ -234,9 +234,23 @@ struct epggrab_ota_map
   uint8_t                             om_first;
   uint8_t                             om_forced;
   uint64_t                            om_tune_count;
+  uint32_t                            om_sections;     ///< Sections parsed this grab
+  uint32_t                            om_events;       ///< Events parsed this grab
+  int64_t                             om_parse_time;   ///< Time spent parsing (us)
   RB_HEAD(,epggrab_ota_svc_link)      om_svcs;         ///< Muxes we carry data for
 };
 
+/*
+ * Over the air grabber stats (protected by global_lock)
+ */
+typedef struct epggrab_ota_stats
+{
+  uint64_t sections;         ///< Sections parsed
+  uint64_t events;           ///< Events parsed
+  int64_t  parse_time;       ///< Time spent parsing (us)
+  int64_t  parse_time_last;  ///< Time spent parsing, last complete grab (us)
+} epggrab_ota_stats_t;
+
 /*
  * Over the air grabber
  */
@@ -244,6 +258,8 @@ struct epggrab_module_ota
 {
   epggrab_module_t               ;      ///< Parent object
 
+  epggrab_ota_stats_t            stats; ///< Parse stats
+
   //TAILQ_HEAD(, epggrab_ota_mux)  muxes; ///< List of related muxes
 
   /* Transponder tuning */
@@ -326,6 +342,11 @@ void epggrab_resched     ( void );
  */
 void epggrab_ota_queue_mux( struct mpegts_mux *mm );
 
+/*
+ * OTA parse stats (per module)
+ */
+htsmsg_t *epggrab_ota_stats ( void );
+
 #endif /* __EPGGRAB_H__ */
 
 /* **************************************************************************
@@ -426,8 +426,10 @@ static int _eit_process_event
   if ( len < dllen ) return -1;
   ret  = 12 + dllen;
 
-  /* Find broadcast */
-  ebc  = epg_broadcast_find_by_time(ch, start, stop, eid, 1, &save2);
+  /* Find broadcast (unchanged events are found by the event id index) */
+  ebc  = eid ? epg_broadcast_find_by_eid(ch, eid) : NULL;
+  if (!ebc || ebc->start != start || ebc->stop != stop || stop <= dispatch_clock)
+    ebc = epg_broadcast_find_by_time(ch, start, stop, eid, 1, &save2);
   tvhtrace("eit", "svc='%s', ch='%s', eid=%5d, start=%"PRItime_t","
                   " stop=%"PRItime_t", ebc=%p",
            svc->s_dvb_svcname ?: "(null)", ch ? channel_get_name(ch) : "(null)",
@@ -556,7 +558,8 @@ _eit_callback
   (mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid)
 {
   int r;
-  int sect, last, ver, save, resched;
+  int sect, last, ver, save, resched, events = 0;
+  int64_t mono;
   uint8_t  seg;
   uint16_t onid, tsid, sid;
   uint32_t extraid;
@@ -643,6 +646,7 @@ _eit_callback
   save = resched = 0;
   len -= 11;
   ptr += 11;
+  mono = getmonoclock();
   while (len) {
     int r;
     if ((r = _eit_process_event(mod, tableid, svc, ptr, len,
@@ -651,7 +655,9 @@ _eit_callback
       break;
     len -= r;
     ptr += r;
+    events++;
   }
+  epggrab_ota_parsed(map, events, getmonoclock() - mono);
 
   /* Update EPG */
   if (resched) epggrab_resched();
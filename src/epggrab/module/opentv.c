@@ -300,13 +300,13 @@ static void *_opentv_apply_pattern_list(char *buf, size_t size_buf, const char *
   return NULL;
 }
 
-/* Parse an event section */
+/* Parse an event section (returns the number of events) */
 static int
 opentv_parse_event_section
   ( opentv_status_t *sta, int cid, int mjd,
     const uint8_t *buf, int len )
 {
-  int i, r, save = 0;
+  int i, r, save = 0, events = 0;
   opentv_module_t  *mod = sta->os_mod;
   epggrab_module_t *src = (epggrab_module_t*)mod;
   epggrab_channel_t *ec;
@@ -332,6 +332,7 @@ opentv_parse_event_section
     r = _opentv_parse_event(mod, sta, buf+i, len-i, cid, mjd, &ev);
     if (r < 0) break;
     i += r;
+    events++;
 
     /*
      * Broadcast
@@ -439,7 +440,7 @@ done:
 
   /* Update EPG */
   if (save) epg_updated();
-  return 0;
+  return events;
 }
 
 /* ************************************************************************
@@ -523,6 +524,7 @@ opentv_table_callback
 {
   int r = 1, cid, mjd;
   int sect, last, ver;
+  int64_t mono;
   mpegts_psi_table_state_t *st;
   opentv_status_t *sta = mt->mt_opaque;
   opentv_module_t *mod = sta->os_mod;
@@ -543,7 +545,9 @@ opentv_table_callback
   if (r != 1) goto done;
 
   /* Process */
+  mono = getmonoclock();
   r = opentv_parse_event_section(sta, cid, mjd, buf, len);
+  epggrab_ota_parsed(sta->os_map, r, getmonoclock() - mono);
 
   /* End */
   r = dvb_table_end((mpegts_psi_table_t *)mt, st, sect);
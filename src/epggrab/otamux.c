@@ -257,6 +257,8 @@ epggrab_ota_start ( epggrab_ota_mux_t *om, mpegts_mux_t *mm )
   LIST_FOREACH(map, &om->om_modules, om_link) {
     map->om_first    = 1;
     map->om_forced   = 0;
+    map->om_sections = map->om_events = 0;
+    map->om_parse_time = 0;
     if (modname && !strcmp(modname, map->om_module->id))
       map->om_forced = 1;
     map->om_complete = 0;
@@ -362,6 +364,47 @@ epggrab_ota_register
   return ota;
 }
 
+void
+epggrab_ota_parsed
+  ( epggrab_ota_map_t *map, int events, int64_t parse_time )
+{
+  epggrab_ota_stats_t *st = &map->om_module->stats;
+
+  lock_assert(&global_lock);
+
+  map->om_sections++;
+  map->om_events     += events;
+  map->om_parse_time += parse_time;
+  st->sections++;
+  st->events         += events;
+  st->parse_time     += parse_time;
+}
+
+htsmsg_t *
+epggrab_ota_stats ( void )
+{
+  epggrab_module_t *m;
+  epggrab_ota_stats_t *st;
+  htsmsg_t *l = htsmsg_create_list(), *e;
+
+  lock_assert(&global_lock);
+
+  LIST_FOREACH(m, &epggrab_modules, link) {
+    if (m->type != EPGGRAB_OTA)
+      continue;
+    st = &((epggrab_module_ota_t *)m)->stats;
+    e  = htsmsg_create_map();
+    htsmsg_add_str(e, "id", m->id);
+    htsmsg_add_str(e, "name", m->name);
+    htsmsg_add_s64(e, "sections", st->sections);
+    htsmsg_add_s64(e, "events", st->events);
+    htsmsg_add_s64(e, "parse_time", st->parse_time);
+    htsmsg_add_s64(e, "parse_time_last", st->parse_time_last);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  return l;
+}
+
 void
 epggrab_ota_complete
   ( epggrab_module_ota_t *mod, epggrab_ota_mux_t *ota )
@@ -369,11 +412,13 @@ epggrab_ota_complete
   int done = 1;
   epggrab_ota_map_t *map;
   lock_assert(&global_lock);
-  tvhdebug(mod->id, "grab complete");
 
   /* Test for completion */
   LIST_FOREACH(map, &ota->om_modules, om_link) {
     if (map->om_module == mod) {
+      tvhdebug(mod->id, "grab complete (%u sections, %u events, parse %"PRId64" ms)",
+               map->om_sections, map->om_events, map->om_parse_time / 1000);
+      mod->stats.parse_time_last = map->om_parse_time;
       map->om_complete = 1;
     } else if (!map->om_complete && !map->om_first) {
       done = 0;
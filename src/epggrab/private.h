@@ -150,6 +150,12 @@ epggrab_ota_mux_t *epggrab_ota_register
 void epggrab_ota_complete 
   ( epggrab_module_ota_t *mod, epggrab_ota_mux_t *ota );
 
+/*
+ * Parse stats (one section)
+ */
+void epggrab_ota_parsed
+  ( epggrab_ota_map_t *map, int events, int64_t parse_time );
+
 /*
  * Service list
  */
@@ -5757,106 +5757,153 @@ unsigned fsat_index_2[] = {
 		3160  /* 128 */
 };
 
+/*
+ * Per state lookup on the next 8 bits of the input
+ *
+ * bits is the code length for codes of up to 8 bits, FSAT_LUT_NONE when
+ * no code matches and FSAT_LUT_LONG when the code is longer; long codes
+ * are then searched in the table starting at idx.
+ */
+#define FSAT_STATES   128
+#define FSAT_LUT_NONE 0
+#define FSAT_LUT_LONG 0xff
+
+struct fsatlut {
+	uint8_t bits;
+	char next;
+	uint16_t idx;
+};
+
+static struct fsatlut *fsat_lut_1, *fsat_lut_2;
+static pthread_once_t fsat_lut_once = PTHREAD_ONCE_INIT;
+
+static struct fsatlut *
+fsat_lut_build(struct fsattab *table, unsigned int *index)
+{
+	struct fsatlut *lut = calloc(FSAT_STATES * 256, sizeof(*lut)), *l;
+	unsigned int state, j, v, n;
+
+	for (state = 0; state < FSAT_STATES; state++) {
+		l = lut + state * 256;
+		for (j = index[state]; j < index[state + 1]; j++) {
+			v = table[j].value >> 24;
+			if (table[j].bits > 8) {
+				if (l[v].bits == FSAT_LUT_NONE) {
+					l[v].bits = FSAT_LUT_LONG;
+					l[v].idx = j;
+				}
+				continue;
+			}
+			/* all entries sharing the code as prefix, first match wins */
+			for (n = 0; n < (1u << (8 - table[j].bits)); n++, v++) {
+				if (l[v].bits == FSAT_LUT_NONE) {
+					l[v].bits = table[j].bits;
+					l[v].next = table[j].next;
+				}
+			}
+		}
+	}
+	return lut;
+}
+
+static void
+fsat_lut_init(void)
+{
+	fsat_lut_1 = fsat_lut_build(fsat_table_1, fsat_index_1);
+	fsat_lut_2 = fsat_lut_build(fsat_table_2, fsat_index_2);
+}
+
+/*
+ * 32 bits of the encoded string (starting at src[2]) from bit position
+ * pos, zero padded past the end
+ */
+static inline unsigned int
+fsat_value(const uint8_t *src, size_t srclen, size_t pos)
+{
+	size_t byte = 2 + (pos >> 3);
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 5; i++, byte++)
+		v = (v << 8) | (byte < srclen ? src[byte] : 0);
+	return (unsigned int)(v >> (8 - (pos & 7)));
+}
+
 size_t freesat_huffman_decode
   (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen)
 {
 	struct fsattab *fsat_table;
 	unsigned int *fsat_index;
-  size_t p;
+	struct fsatlut *lut;
+	size_t p, pos, start;
 	unsigned int value;
-	unsigned int byte;
-	unsigned int bit;
 	char lastch;
-	int found;
 	unsigned int bitShift;
 	char nextCh;
-	unsigned int indx;
-	unsigned int j;
-	unsigned int mask;
-	unsigned int maskbit;
-	unsigned short kk;
-	unsigned int b;
+	unsigned int j, mask;
 
-  if (src[0] != 0x1f) return -1;
+	if (src[0] != 0x1f) return -1;
 
-	p = 0;
-	if (src[1] == 1 || src[1] == 2) {
-		if (src[1] == 1) {
-			fsat_table = fsat_table_1;
-			fsat_index = fsat_index_1;
-		} else {
-			fsat_table = fsat_table_2;
-			fsat_index = fsat_index_2;
-		}
-		value = 0;
-		byte = 2;
-		bit = 0;
-		while (byte < 6 && byte < srclen) {
-			value |= src[byte] << ((5 - byte) * 8);
-			byte++;
-		}
-		lastch = START;
+	if (src[1] != 1 && src[1] != 2)
+		return -1;
 
-		do {
-			found = 0;
-			bitShift = 0;
-			nextCh = STOP;
-			if (lastch == ESCAPE) {
-				found = 1;
-				// Encoded in the next 8 bits.
-				// Terminated by the first ASCII character.
-				nextCh = (value >> 24) & 0xff;
-				bitShift = 8;
-				if ((nextCh & 0x80) == 0) {
-					if (nextCh < ' ')
-						nextCh = STOP;
-					lastch = nextCh;
-				}
+	pthread_once(&fsat_lut_once, fsat_lut_init);
+	if (src[1] == 1) {
+		fsat_table = fsat_table_1;
+		fsat_index = fsat_index_1;
+		lut = fsat_lut_1;
+	} else {
+		fsat_table = fsat_table_2;
+		fsat_index = fsat_index_2;
+		lut = fsat_lut_2;
+	}
+
+	/* input byte following the 32 bit window, as in the bitwise decoder */
+	start = MAX(2, MIN(6, srclen));
+	p = pos = 0;
+	lastch = START;
+
+	do {
+		value = fsat_value(src, srclen, pos);
+		if (lastch == ESCAPE) {
+			// Encoded in the next 8 bits.
+			// Terminated by the first ASCII character.
+			nextCh = (value >> 24) & 0xff;
+			bitShift = 8;
+			if ((nextCh & 0x80) == 0) {
+				if (nextCh < ' ')
+					nextCh = STOP;
+				lastch = nextCh;
+			}
+		} else {
+			struct fsatlut *l = &lut[(unsigned int)lastch * 256 + (value >> 24)];
+			if (l->bits == FSAT_LUT_NONE)
+				return -1;
+			if (l->bits != FSAT_LUT_LONG) {
+				nextCh = l->next;
+				bitShift = l->bits;
 			} else {
-				indx = (unsigned int) lastch;
-				//if (src[1] == 2)
-				//    indx |= 0x80;
-				for (j = fsat_index[indx]; j < fsat_index[indx + 1]; j++) {
-					mask = 0;
-					maskbit = 0x80000000;
-					for (kk = 0; kk < fsat_table[j].bits; kk++) {
-						mask |= maskbit;
-						maskbit >>= 1;
-					}
-					if ((value & mask) == fsat_table[j].value) {
-						nextCh = fsat_table[j].next;
-						bitShift = fsat_table[j].bits;
-						found = 1;
-						lastch = nextCh;
+				for (j = l->idx; j < fsat_index[(unsigned int)lastch + 1]; j++) {
+					mask = ~(0xffffffffu >> fsat_table[j].bits);
+					if ((value & mask) == fsat_table[j].value)
 						break;
-					}
 				}
+				if (j == fsat_index[(unsigned int)lastch + 1])
+					return -1;
+				nextCh = fsat_table[j].next;
+				bitShift = fsat_table[j].bits;
 			}
-			if (found) {
-				if (nextCh != STOP && nextCh != ESCAPE) {
-					if (p >= *dstlen) return 0;
-					dst[p++] = nextCh;
-				}
-				// Shift up by the number of bits.
-				for (b = 0; b < bitShift; b++) {
-					value = (value << 1) & 0xfffffffe;
-					if (byte < srclen)
-						value |= (src[byte] >> (7 - bit)) & 1;
-					if (bit == 7) {
-						bit = 0;
-						byte++;
-					} else
-						bit++;
-				}
-			} else {
-        return -1;
-			}
-		} while (lastch != STOP && byte < srclen + 4);
+			lastch = nextCh;
+		}
+		if (nextCh != STOP && nextCh != ESCAPE) {
+			if (p >= *dstlen) return 0;
+			dst[p++] = nextCh;
+		}
+		// Shift up by the number of bits.
+		pos += bitShift;
+	} while (lastch != STOP && start + (pos >> 3) < srclen + 4);
 
-		dst[p] = '\0';
-    *dstlen = p;
-		return 0;
-	} else {
-    return -1;
-	}
+	dst[p] = '\0';
+	*dstlen = p;
+	return 0;
 }
@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "htsmsg_binary.h"
 
@@ -179,84 +180,220 @@ htsmsg_binary_count(htsmsg_t *msg)
 }
 
 
+static void htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr);
+
 /*
  *
  */
-static void
-htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
+static uint8_t *
+htsmsg_binary_write_field(htsmsg_field_t *f, uint8_t *ptr)
 {
-  htsmsg_field_t *f;
   uint64_t u64;
   int l, i, namelen;
 
-  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
-    namelen = f->hmf_name ? strlen(f->hmf_name) : 0;
-    *ptr++ = f->hmf_type;
-    *ptr++ = namelen;
+  namelen = f->hmf_name ? strlen(f->hmf_name) : 0;
+  *ptr++ = f->hmf_type;
+  *ptr++ = namelen;
 
-    switch(f->hmf_type) {
-    case HMF_MAP:
-    case HMF_LIST:
-      l = htsmsg_binary_count(&f->hmf_msg);
-      break;
+  switch(f->hmf_type) {
+  case HMF_MAP:
+  case HMF_LIST:
+    l = htsmsg_binary_count(&f->hmf_msg);
+    break;
 
-    case HMF_STR:
-      l = strlen(f->hmf_str);
-      break;
+  case HMF_STR:
+    l = strlen(f->hmf_str);
+    break;
 
-    case HMF_BIN:
-      l = f->hmf_binsize;
-      break;
+  case HMF_BIN:
+    l = f->hmf_binsize;
+    break;
 
-    case HMF_S64:
-      u64 = f->hmf_s64;
-      l = 0;
-      while(u64 != 0) {
+  case HMF_S64:
+    u64 = f->hmf_s64;
+    l = 0;
+    while(u64 != 0) {
 	l++;
 	u64 = u64 >> 8;
-      }
-      break;
-    default:
-      abort();
     }
+    break;
+  default:
+    abort();
+  }
 
 
-    *ptr++ = l >> 24;
-    *ptr++ = l >> 16;
-    *ptr++ = l >> 8;
-    *ptr++ = l;
+  *ptr++ = l >> 24;
+  *ptr++ = l >> 16;
+  *ptr++ = l >> 8;
+  *ptr++ = l;
 
-    if(namelen > 0) {
-      memcpy(ptr, f->hmf_name, namelen);
-      ptr += namelen;
-    }
+  if(namelen > 0) {
+    memcpy(ptr, f->hmf_name, namelen);
+    ptr += namelen;
+  }
 
-    switch(f->hmf_type) {
-    case HMF_MAP:
-    case HMF_LIST:
-      htsmsg_binary_write(&f->hmf_msg, ptr);
-      break;
+  switch(f->hmf_type) {
+  case HMF_MAP:
+  case HMF_LIST:
+    htsmsg_binary_write(&f->hmf_msg, ptr);
+    break;
 
-    case HMF_STR:
-      memcpy(ptr, f->hmf_str, l);
-      break;
+  case HMF_STR:
+    memcpy(ptr, f->hmf_str, l);
+    break;
 
-    case HMF_BIN:
-      memcpy(ptr, f->hmf_bin, l);
-      break;
+  case HMF_BIN:
+    memcpy(ptr, f->hmf_bin, l);
+    break;
 
-    case HMF_S64:
-      u64 = f->hmf_s64;
-      for(i = 0; i < l; i++) {
+  case HMF_S64:
+    u64 = f->hmf_s64;
+    for(i = 0; i < l; i++) {
 	ptr[i] = u64;
 	u64 = u64 >> 8;
+    }
+    break;
+  }
+  ptr += l;
+  return ptr;
+}
+
+/*
+ *
+ */
+static void
+htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
+{
+  htsmsg_field_t *f;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link)
+    ptr = htsmsg_binary_write_field(f, ptr);
+}
+
+
+/*
+ * Scatter-gather output
+ */
+typedef struct htsmsg_binary_iov {
+  struct iovec *iov;
+  int           iovcnt;
+  int           iovmax;   ///< Slots left for referenced fields
+  size_t        minref;
+  uint8_t      *ptr;      ///< Header buffer
+  uint8_t      *seg;      ///< Start of the current header segment
+} htsmsg_binary_iov_t;
+
+static inline int
+htsmsg_binary_ref(htsmsg_field_t *f, size_t minref, int *slots)
+{
+  if (f->hmf_type != HMF_BIN || f->hmf_binsize < minref || *slots < 2)
+    return 0;
+  *slots -= 2;
+  return 1;
+}
+
+static size_t
+htsmsg_binary_count_ref(htsmsg_t *msg, size_t minref, int *slots)
+{
+  htsmsg_field_t *f;
+  size_t len = 0;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    if (f->hmf_type == HMF_MAP || f->hmf_type == HMF_LIST)
+      len += htsmsg_binary_count_ref(&f->hmf_msg, minref, slots);
+    else if (htsmsg_binary_ref(f, minref, slots))
+      len += f->hmf_binsize;
+  }
+  return len;
+}
+
+static void
+htsmsg_binary_write_iov(htsmsg_t *msg, htsmsg_binary_iov_t *bi)
+{
+  htsmsg_field_t *f;
+  struct iovec *v;
+  int l, namelen;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    if (f->hmf_type == HMF_MAP || f->hmf_type == HMF_LIST) {
+      namelen = f->hmf_name ? strlen(f->hmf_name) : 0;
+      l = htsmsg_binary_count(&f->hmf_msg);
+      *bi->ptr++ = f->hmf_type;
+      *bi->ptr++ = namelen;
+      *bi->ptr++ = l >> 24;
+      *bi->ptr++ = l >> 16;
+      *bi->ptr++ = l >> 8;
+      *bi->ptr++ = l;
+      if (namelen > 0) {
+        memcpy(bi->ptr, f->hmf_name, namelen);
+        bi->ptr += namelen;
       }
-      break;
+      htsmsg_binary_write_iov(&f->hmf_msg, bi);
+    } else if (htsmsg_binary_ref(f, bi->minref, &bi->iovmax)) {
+      namelen = f->hmf_name ? strlen(f->hmf_name) : 0;
+      l = f->hmf_binsize;
+      *bi->ptr++ = HMF_BIN;
+      *bi->ptr++ = namelen;
+      *bi->ptr++ = l >> 24;
+      *bi->ptr++ = l >> 16;
+      *bi->ptr++ = l >> 8;
+      *bi->ptr++ = l;
+      if (namelen > 0) {
+        memcpy(bi->ptr, f->hmf_name, namelen);
+        bi->ptr += namelen;
+      }
+      v = &bi->iov[bi->iovcnt++];
+      v->iov_base = bi->seg;
+      v->iov_len  = bi->ptr - bi->seg;
+      v = &bi->iov[bi->iovcnt++];
+      v->iov_base = (void *)f->hmf_bin;
+      v->iov_len  = l;
+      bi->seg = bi->ptr;
+    } else {
+      bi->ptr = htsmsg_binary_write_field(f, bi->ptr);
     }
-    ptr += l;
   }
 }
 
+/*
+ *
+ */
+int
+htsmsg_binary_serialize_iov(htsmsg_t *msg, struct iovec *iov, int iovmax,
+                            void **bufp, int maxlen, size_t minref)
+{
+  htsmsg_binary_iov_t bi;
+  size_t len, ref;
+  uint8_t *data;
+  int slots = iovmax - 1;
+
+  len = htsmsg_binary_count(msg);
+  if(len + 4 > maxlen || iovmax < 1)
+    return -1;
+  ref = htsmsg_binary_count_ref(msg, minref, &slots);
+
+  data = malloc(len + 4 - ref);
+
+  data[0] = len >> 24;
+  data[1] = len >> 16;
+  data[2] = len >> 8;
+  data[3] = len;
+
+  bi.iov    = iov;
+  bi.iovcnt = 0;
+  bi.iovmax = iovmax - 1;
+  bi.minref = minref;
+  bi.seg    = data;
+  bi.ptr    = data + 4;
+  htsmsg_binary_write_iov(msg, &bi);
+  if (bi.ptr > bi.seg) {
+    iov[bi.iovcnt].iov_base = bi.seg;
+    iov[bi.iovcnt].iov_len  = bi.ptr - bi.seg;
+    bi.iovcnt++;
+  }
+  *bufp = data;
+  return bi.iovcnt;
+}
 
 /*
  *
@@ -30,4 +30,14 @@ htsmsg_t *htsmsg_binary_deserialize(const void *data, size_t len,
 int htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp,
 			    int maxlen);
 
+/**
+ * htsmsg_binary_serialize_iov
+ *
+ * Binary fields of minref bytes or more are not copied, the vector
+ * points to them (the message must be kept until it is written)
+ */
+struct iovec;
+int htsmsg_binary_serialize_iov(htsmsg_t *msg, struct iovec *iov, int iovmax,
+                                void **bufp, int maxlen, size_t minref);
+
 #endif /* HTSMSG_BINARY_H_ */
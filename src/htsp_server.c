@@ -51,6 +51,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #if ENABLE_ANDROID
 #include <sys/vfs.h>
 #define statvfs statfs
@@ -61,6 +62,9 @@
 #include "settings.h"
 #include <sys/time.h>
 #include <limits.h>
+#if defined(PLATFORM_LINUX)
+#include <sys/sendfile.h>
+#endif
 
 /* **************************************************************************
  * Datatypes and variables
@@ -91,6 +95,12 @@ TAILQ_HEAD(htsp_msg_queue, htsp_msg);
 TAILQ_HEAD(htsp_msg_q_queue, htsp_msg_q);
 
 static struct htsp_connection_list htsp_async_connections;
+
+#define HTSP_EVENT_VIEWS 8 // shared event serializations per update
+
+#define HTSP_WRITE_MSGS 64 // messages sent with one writev()
+#define HTSP_WRITE_IOV  (HTSP_WRITE_MSGS * 4)
+#define HTSP_WRITE_REF  1024 // smaller binary fields are copied
 static struct htsp_connection_list htsp_connections;
 
 static void htsp_streaming_input(void *opaque, streaming_message_t *sm);
@@ -101,7 +111,8 @@ static void htsp_streaming_input(void *opaque, streaming_message_t *sm);
 typedef struct htsp_msg {
   TAILQ_ENTRY(htsp_msg) hm_link;
 
-  htsmsg_t *hm_msg;
+  htsmsg_t *hm_msg;           /* NULL for pre-serialized (shared) messages,
+                                 the data are in hm_pb then */
   int hm_payloadsize;         /* For maintaining stats about streaming
 				 buffer depth */
 
@@ -109,6 +120,10 @@ typedef struct htsp_msg {
 			   hm_msg can contain messages that points
 			   to packet payload so to avoid copy we
 			   keep a reference here */
+
+  int hm_file_fd;       /* File region sent as the last "data" field */
+  off_t hm_file_off;    /* (fileRead replies, -1 = none) */
+  size_t hm_file_len;
 } htsp_msg_t;
 
 
@@ -226,6 +241,9 @@ typedef struct htsp_file {
 
 #define HTSP_DEFAULT_QUEUE_DEPTH 500000
 
+uint64_t htsp_file_read_bytes;
+uint64_t htsp_file_sendfile_bytes;
+
 /* **************************************************************************
  * Support routines
  * *************************************************************************/
@@ -282,6 +300,8 @@ htsp_msg_destroy(htsp_msg_t *hm)
   htsmsg_destroy(hm->hm_msg);
   if(hm->hm_pb != NULL)
     pktbuf_ref_dec(hm->hm_pb);
+  if(hm->hm_file_fd >= 0)
+    close(hm->hm_file_fd);
   free(hm);
 }
 
@@ -353,17 +373,8 @@ htsp_subscription_free(htsp_connection_t *htsp, htsp_subscription_t *hs)
  *
  */
 static void
-htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
-	  htsp_msg_q_t *hmq, int payloadsize)
+htsp_enqueue(htsp_connection_t *htsp, htsp_msg_t *hm, htsp_msg_q_t *hmq)
 {
-  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
-
-  hm->hm_msg = m;
-  hm->hm_pb = pb;
-  if(pb != NULL)
-    pktbuf_ref_inc(pb);
-  hm->hm_payloadsize = payloadsize;
-  
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   assert(!hmq->hmq_dead);
@@ -381,11 +392,30 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
   }
 
   hmq->hmq_length++;
-  hmq->hmq_payload += payloadsize;
+  hmq->hmq_payload += hm->hm_payloadsize;
   pthread_cond_signal(&htsp->htsp_out_cond);
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
+/**
+ *
+ */
+static void
+htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
+	  htsp_msg_q_t *hmq, int payloadsize)
+{
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+
+  hm->hm_msg = m;
+  hm->hm_pb = pb;
+  hm->hm_file_fd = -1;
+  if(pb != NULL)
+    pktbuf_ref_inc(pb);
+  hm->hm_payloadsize = payloadsize;
+
+  htsp_enqueue(htsp, hm, hmq);
+}
+
 /**
  *
  */
@@ -395,6 +425,37 @@ htsp_send_message(htsp_connection_t *htsp, htsmsg_t *m, htsp_msg_q_t *hmq)
   htsp_send(htsp, m, NULL, hmq ?: &htsp->htsp_hmq_ctrl, 0);
 }
 
+/**
+ * Serialize a message once for several connections (consumes m)
+ */
+static pktbuf_t *
+htsp_serialize(htsmsg_t *m)
+{
+  void *dptr;
+  size_t dlen;
+  int r;
+
+  if (m == NULL)
+    return NULL;
+  r = htsmsg_binary_serialize(m, &dptr, &dlen, INT32_MAX);
+  htsmsg_destroy(m);
+  if (r) {
+    tvhlog(LOG_WARNING, "htsp", "failed to serialize async data");
+    return NULL;
+  }
+  return pktbuf_make(dptr, dlen);
+}
+
+/**
+ * Queue a pre-serialized message, the buffer is referenced
+ */
+static void
+htsp_send_shared(htsp_connection_t *htsp, pktbuf_t *pb)
+{
+  if (pb)
+    htsp_send(htsp, NULL, pb, &htsp->htsp_hmq_ctrl, 0);
+}
+
 /** 
  * Simple function to respond with an error
  */
@@ -2272,6 +2333,51 @@ htsp_method_file_open(htsp_connection_t *htsp, htsmsg_t *in)
   }
 }
 
+/**
+ *
+ */
+#if defined(PLATFORM_LINUX)
+/**
+ * Queue the reply with the file region, the writer sends the data
+ * straight from the page cache (message order is kept)
+ */
+static int
+htsp_file_read_sendfile
+  (htsp_connection_t *htsp, htsmsg_t *in, int fd, off_t off, int64_t size)
+{
+  htsp_msg_t *hm;
+  htsmsg_t *rep;
+  struct stat st;
+  uint32_t seq;
+  int dfd;
+
+  if (size > INT32_MAX / 2 || fstat(fd, &st) || !S_ISREG(st.st_mode))
+    return -1;
+  if (off < 0 && (off = lseek(fd, 0, SEEK_CUR)) < 0)
+    return -1;
+  size = MAX(0, MIN(size, st.st_size - off));
+  if ((dfd = dup(fd)) < 0)
+    return -1;
+
+  /* Move the file position as read() would do */
+  lseek(fd, off + size, SEEK_SET);
+
+  rep = htsmsg_create_map();
+  if (!htsmsg_get_u32(in, "seq", &seq))
+    htsmsg_add_u32(rep, "seq", seq);
+
+  hm = malloc(sizeof(htsp_msg_t));
+  hm->hm_msg = rep;
+  hm->hm_pb = NULL;
+  hm->hm_payloadsize = 0;
+  hm->hm_file_fd = dfd;
+  hm->hm_file_off = off;
+  hm->hm_file_len = size;
+  htsp_enqueue(htsp, hm, &htsp->htsp_hmq_ctrl);
+  return 0;
+}
+#endif
+
 /**
  *
  */
@@ -2281,9 +2387,9 @@ htsp_method_file_read(htsp_connection_t *htsp, htsmsg_t *in)
   htsp_file_t *hf = htsp_file_find(htsp, in);
   htsmsg_t *rep = NULL;
   const char *e = NULL;
-  int64_t off;
+  int64_t off = 0;
   int64_t size;
-  int fd;
+  int fd, seek;
 
   if(hf == NULL)
     return htsp_error("Unknown file id");
@@ -2295,8 +2401,18 @@ htsp_method_file_read(htsp_connection_t *htsp, htsmsg_t *in)
 
   pthread_mutex_unlock(&global_lock);
 
+  seek = !htsmsg_get_s64(in, "offset", &off);
+
+#if defined(PLATFORM_LINUX)
+  if (size >= 0 && off >= 0 &&
+      !htsp_file_read_sendfile(htsp, in, fd, seek ? off : -1, size)) {
+    pthread_mutex_lock(&global_lock);
+    return NULL;
+  }
+#endif
+
   /* Seek (optional) */
-  if (!htsmsg_get_s64(in, "offset", &off))
+  if (seek)
     if(lseek(fd, off, SEEK_SET) != off) {
       e = "Seek error";
       goto error;
@@ -2319,6 +2435,7 @@ htsp_method_file_read(htsp_connection_t *htsp, htsmsg_t *in)
   rep = htsmsg_create_map();
   htsmsg_add_bin(rep, "data", m, r);
   free(m);
+  atomic_add_u64(&htsp_file_read_bytes, r);
 
 error:
   pthread_mutex_lock(&global_lock);
@@ -2677,18 +2794,92 @@ readmsg:
   return tvheadend_running ? r : 0;
 }
 
+#if defined(PLATFORM_LINUX)
+/**
+ * Write a serialized message followed by the file region as the
+ * last "data" field, the region goes straight from the page cache
+ */
+static int
+htsp_write_file(htsp_connection_t *htsp, htsp_msg_t *hm,
+                uint8_t *dptr, size_t dlen)
+{
+  size_t len = hm->hm_file_len, total = dlen - 4 + 6 + 4 + len;
+  off_t off = hm->hm_file_off;
+  uint8_t *d = dptr + dlen;
+  ssize_t r;
+
+  dptr[0] = total >> 24;
+  dptr[1] = total >> 16;
+  dptr[2] = total >> 8;
+  dptr[3] = total;
+  d[0] = HMF_BIN;
+  d[1] = 4;
+  d[2] = len >> 24;
+  d[3] = len >> 16;
+  d[4] = len >> 8;
+  d[5] = len;
+  memcpy(d + 6, "data", 4);
+  if (tvh_write(htsp->htsp_fd, dptr, dlen + 6 + 4))
+    return -1;
+
+  while (len > 0) {
+    r = sendfile(htsp->htsp_fd, hm->hm_file_fd, &off, len);
+    if (r < 0) {
+      if (ERRNO_AGAIN(errno)) {
+        usleep(100);
+        continue;
+      }
+      return -1;
+    }
+    if (r == 0) {
+      /* The file was truncated, the frame cannot be completed */
+      errno = EIO;
+      return -1;
+    }
+    len -= r;
+    atomic_add_u64(&htsp_file_sendfile_bytes, r);
+  }
+  return 0;
+}
+#endif
+
 /**
  *
  */
+static htsp_msg_t *
+htsp_dequeue(htsp_connection_t *htsp, htsp_msg_q_t *hmq)
+{
+  htsp_msg_t *hm = TAILQ_FIRST(&hmq->hmq_q);
+
+  TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+  hmq->hmq_length--;
+  hmq->hmq_payload -= hm->hm_payloadsize;
+
+  TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
+  if(hmq->hmq_length) {
+    /* Still messages to be sent, put back in active queues */
+    if(hmq->hmq_strict_prio) {
+      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    } else {
+      TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    }
+  }
+  return hm;
+}
+
+/**
+ * The queued messages are sent with one writev(), packet payloads
+ * are referenced (not copied) until the write completes
+ */
 static void *
 htsp_write_scheduler(void *aux)
 {
   htsp_connection_t *htsp = aux;
   htsp_msg_q_t *hmq;
-  htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
-  int r;
+  htsp_msg_t *hm, *batch[HTSP_WRITE_MSGS];
+  void *bufs[HTSP_WRITE_MSGS];
+  struct iovec iov[HTSP_WRITE_IOV];
+  int i, n, niov, r;
 
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
@@ -2700,35 +2891,71 @@ htsp_write_scheduler(void *aux)
       continue;
     }
 
-    hm = TAILQ_FIRST(&hmq->hmq_q);
-    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-    hmq->hmq_length--;
-    hmq->hmq_payload -= hm->hm_payloadsize;
-
-    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
-    if(hmq->hmq_length) {
-      /* Still messages to be sent, put back in active queues */
-      if(hmq->hmq_strict_prio) {
-        TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      } else {
-        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      }
-    }
+    /* Take the queued messages (a file region is sent alone) */
+    n = 0;
+    do {
+      hm = TAILQ_FIRST(&hmq->hmq_q);
+      if (n > 0 && hm->hm_file_fd >= 0)
+        break;
+      batch[n++] = htsp_dequeue(htsp, hmq);
+    } while (hm->hm_file_fd < 0 && n < HTSP_WRITE_MSGS &&
+             (hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) != NULL);
 
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
-             htsp->htsp_logname);
+#if defined(PLATFORM_LINUX)
+    if (batch[0]->hm_file_fd >= 0) {
+      void *dptr;
+      size_t dlen;
+
+      hm = batch[0];
+      r = 0;
+      if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
+        tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
+               htsp->htsp_logname);
+      } else {
+        dptr = realloc(dptr, dlen + 6 + 4);
+        r = htsp_write_file(htsp, hm, dptr, dlen);
+        free(dptr);
+      }
       htsp_msg_destroy(hm);
       pthread_mutex_lock(&htsp->htsp_out_mutex);
+      if (r) {
+        tvhlog(LOG_INFO, "htsp", "%s: Write error -- %s",
+               htsp->htsp_logname, strerror(errno));
+        break;
+      }
       continue;
     }
+#endif
 
-    htsp_msg_destroy(hm);
+    /* Build the vector */
+    for (i = niov = 0; i < n; i++) {
+      hm = batch[i];
+      bufs[i] = NULL;
+      if (hm->hm_msg == NULL) {
+        iov[niov].iov_base = pktbuf_ptr(hm->hm_pb);
+        iov[niov].iov_len  = pktbuf_len(hm->hm_pb);
+        niov++;
+        continue;
+      }
+      r = htsmsg_binary_serialize_iov(hm->hm_msg, iov + niov,
+                                      HTSP_WRITE_IOV - niov - (n - i - 1),
+                                      &bufs[i], INT32_MAX, HTSP_WRITE_REF);
+      if (r < 0) {
+        tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
+               htsp->htsp_logname);
+        continue;
+      }
+      niov += r;
+    }
+
+    r = tvh_writev(htsp->htsp_fd, iov, niov);
 
-    r = tvh_write(htsp->htsp_fd, dptr, dlen);
-    free(dptr);
+    for (i = 0; i < n; i++) {
+      htsp_msg_destroy(batch[i]);
+      free(bufs[i]);
+    }
     pthread_mutex_lock(&htsp->htsp_out_mutex);
     
     if (r) {
@@ -2909,6 +3136,7 @@ static void
 htsp_async_send(htsmsg_t *m, int mode, int aux_type, void *aux)
 {
   htsp_connection_t *htsp;
+  pktbuf_t *pb = NULL;
 
   lock_assert(&global_lock);
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link)
@@ -2916,9 +3144,14 @@ htsp_async_send(htsmsg_t *m, int mode, int aux_type, void *aux)
       if (aux_type == HTSP_ASYNC_AUX_CHTAG &&
           !channel_tag_access(aux, htsp->htsp_granted_access, 0))
         continue;
-      htsp_send_message(htsp, htsmsg_copy(m), NULL);
+      if (m) {
+        pb = htsp_serialize(m);
+        m = NULL;
+      }
+      htsp_send_shared(htsp, pb);
     }
   htsmsg_destroy(m);
+  pktbuf_ref_dec(pb);
 }
 
 /**
@@ -2928,15 +3161,24 @@ static void
 _htsp_channel_update(channel_t *ch, const char *method, htsmsg_t *msg)
 {
   htsp_connection_t *htsp;
+  pktbuf_t *pb = NULL;
+  int fixed = msg != NULL;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (htsp->htsp_async_mode & HTSP_ASYNC_ON)
       if (htsp_user_access_channel(htsp,ch)) {
-        htsmsg_t *m = msg ? htsmsg_copy(msg)
-                        : htsp_build_channel(ch, method, htsp);
-        htsp_send_message(htsp, m, NULL);
+        if (!fixed) {
+          htsp_send_message(htsp, htsp_build_channel(ch, method, htsp), NULL);
+          continue;
+        }
+        if (pb == NULL) {
+          pb = htsp_serialize(msg);
+          msg = NULL;
+        }
+        htsp_send_shared(htsp, pb);
       }
   }
   htsmsg_destroy(msg);
+  pktbuf_ref_dec(pb);
 }
 
 /**
@@ -3031,16 +3273,20 @@ static void
 _htsp_dvr_entry_update(dvr_entry_t *de, const char *method, htsmsg_t *msg)
 {
   htsp_connection_t *htsp;
+  pktbuf_t *pb = NULL;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (htsp->htsp_async_mode & HTSP_ASYNC_ON)
       if (!dvr_entry_verify(de, htsp->htsp_granted_access, 1) &&
           htsp_user_access_channel(htsp, de->de_channel)) {
-        htsmsg_t *m = msg ? htsmsg_copy(msg)
-                        : htsp_build_dvrentry(de, method);
-        htsp_send_message(htsp, m, NULL);
+        if (pb == NULL) {
+          pb = htsp_serialize(msg ?: htsp_build_dvrentry(de, method));
+          msg = NULL;
+        }
+        htsp_send_shared(htsp, pb);
       }
   }
   htsmsg_destroy(msg);
+  pktbuf_ref_dec(pb);
 }
 
 /**
@@ -3082,17 +3328,21 @@ static void
 _htsp_autorec_entry_update(dvr_autorec_entry_t *dae, const char *method, htsmsg_t *msg)
 {
   htsp_connection_t *htsp;
+  pktbuf_t *pb = NULL;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (htsp->htsp_async_mode & HTSP_ASYNC_ON) {
       if ((dae->dae_channel == NULL || htsp_user_access_channel(htsp, dae->dae_channel)) &&
           !dvr_autorec_entry_verify(dae, htsp->htsp_granted_access)) {
-        htsmsg_t *m = msg ? htsmsg_copy(msg)
-                          : htsp_build_autorecentry(dae, method);
-        htsp_send_message(htsp, m, NULL);
+        if (pb == NULL) {
+          pb = htsp_serialize(msg ?: htsp_build_autorecentry(dae, method));
+          msg = NULL;
+        }
+        htsp_send_shared(htsp, pb);
       }
     }
   }
   htsmsg_destroy(msg);
+  pktbuf_ref_dec(pb);
 }
 
 /**
@@ -3135,17 +3385,21 @@ static void
 _htsp_timerec_entry_update(dvr_timerec_entry_t *dte, const char *method, htsmsg_t *msg)
 {
   htsp_connection_t *htsp;
+  pktbuf_t *pb = NULL;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (htsp->htsp_async_mode & HTSP_ASYNC_ON) {
       if ((dte->dte_channel == NULL || htsp_user_access_channel(htsp, dte->dte_channel)) &&
           !dvr_timerec_entry_verify(dte, htsp->htsp_granted_access)) {
-        htsmsg_t *m = msg ? htsmsg_copy(msg)
-                          : htsp_build_timerecentry(dte, method);
-        htsp_send_message(htsp, m, NULL);
+        if (pb == NULL) {
+          pb = htsp_serialize(msg ?: htsp_build_timerecentry(dte, method));
+          msg = NULL;
+        }
+        htsp_send_shared(htsp, pb);
       }
     }
   }
   htsmsg_destroy(msg);
+  pktbuf_ref_dec(pb);
 }
 
 /**
@@ -3188,16 +3442,48 @@ static void
 _htsp_event_update(epg_broadcast_t *ebc, const char *method, htsmsg_t *msg)
 {
   htsp_connection_t *htsp;
+  dvr_entry_t *de = msg ? NULL : dvr_entry_find_by_event(ebc);
+  struct {
+    const char *lang;
+    int         old;    /* content type format (HTSP < 6) */
+    int         dvr;    /* DVR entry visible */
+    pktbuf_t   *pb;
+  } views[HTSP_EVENT_VIEWS], *v;
+  int i, nviews = 0, old, dvr, fixed = msg != NULL;
+
+  /* Connections sharing the language, the content type format and
+     the DVR entry access get the same serialized event */
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (htsp->htsp_async_mode & HTSP_ASYNC_EPG)
       if (htsp_user_access_channel(htsp,ebc->channel)) {
-        htsmsg_t *m = msg ? htsmsg_copy(msg)
-                        : htsp_build_event(ebc, method, htsp->htsp_language,
-                                           0, htsp);
-        htsp_send_message(htsp, m, NULL);
+        old = fixed ? 0 : htsp->htsp_version < 6;
+        dvr = de && !dvr_entry_verify(de, htsp->htsp_granted_access, 1);
+        for (i = 0, v = views; i < nviews; i++, v++)
+          if (v->old == old && v->dvr == dvr &&
+              (fixed || !strcmp(v->lang ?: "", htsp->htsp_language ?: "")))
+            break;
+        if (i == nviews) {
+          if (nviews == HTSP_EVENT_VIEWS) {
+            htsp_send_message(htsp, htsp_build_event(ebc, method,
+                                                     htsp->htsp_language,
+                                                     0, htsp), NULL);
+            continue;
+          }
+          v->lang = htsp->htsp_language;
+          v->old  = old;
+          v->dvr  = dvr;
+          v->pb   = htsp_serialize(msg ?: htsp_build_event(ebc, method,
+                                                           htsp->htsp_language,
+                                                           0, htsp));
+          msg = NULL;
+          nviews++;
+        }
+        htsp_send_shared(htsp, v->pb);
       }
   }
   htsmsg_destroy(msg);
+  for (i = 0; i < nviews; i++)
+    pktbuf_ref_dec(views[i].pb);
 }
 
 /**
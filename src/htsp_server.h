@@ -22,6 +22,9 @@
 #include "epg.h"
 #include "dvr/dvr.h"
 
+extern uint64_t htsp_file_read_bytes;
+extern uint64_t htsp_file_sendfile_bytes;
+
 void htsp_init(const char *bindaddr);
 void htsp_register(void);
 void htsp_done(void);
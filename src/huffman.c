@@ -23,15 +23,65 @@
 #include "htsmsg.h"
 #include "settings.h"
 
+/*
+ * Lookup table entry, indexed by the next 8 input bits
+ */
+#define HUFFMAN_END  0 ///< invalid code
+#define HUFFMAN_LEAF 1 ///< code complete after len bits
+#define HUFFMAN_NEXT 2 ///< code continues in the node's table
+
+typedef struct huffman_entry
+{
+  uint8_t               type;
+  uint8_t               len;
+  union {
+    const char         *data;
+    huffman_node_t     *node;
+  };
+} huffman_entry_t;
+
 void huffman_tree_destroy ( huffman_node_t *n )
 {
   if (!n) return;
   huffman_tree_destroy(n->b0);
   huffman_tree_destroy(n->b1);
   if (n->data) free(n->data);
+  free(n->table);
   free(n);
 }
 
+/*
+ * Compile the tree below node into 8-bit lookup tables
+ */
+static void huffman_table_build ( huffman_node_t *root )
+{
+  huffman_entry_t *e;
+  huffman_node_t *node;
+  int v, i;
+
+  root->table = e = calloc(256, sizeof(huffman_entry_t));
+  for (v = 0; v < 256; v++, e++) {
+    node = root;
+    for (i = 0; i < 8; i++) {
+      node = (v & (0x80 >> i)) ? node->b1 : node->b0;
+      if (!node) break;
+      if (node->data) {
+        e->type = HUFFMAN_LEAF;
+        e->len  = i + 1;
+        e->data = node->data;
+        break;
+      }
+    }
+    if (node && !node->data) {
+      if (!node->table)
+        huffman_table_build(node);
+      e->type = HUFFMAN_NEXT;
+      e->len  = 8;
+      e->node = node;
+    }
+  }
+}
+
 huffman_node_t *huffman_tree_load ( const char *path )
 {
   htsmsg_t *m;
@@ -70,6 +120,7 @@ huffman_node_t *huffman_tree_build ( htsmsg_t *m )
       node->data = strdup(data);
     }
   }
+  huffman_table_build(root);
   return root; 
 }
 
@@ -77,35 +128,39 @@ char *huffman_decode
   ( huffman_node_t *tree, const uint8_t *data, size_t len, uint8_t mask,
     char *outb, int outl )
 {
-  char           *ret  = outb;
-  huffman_node_t *node = tree;
+  char            *ret  = outb;
+  huffman_entry_t *table = tree->table, *e;
+  const char      *t;
+  size_t           pos, end;
+  unsigned int     bits;
   if (!len) return NULL;
 
+  /* bit position of the first code */
+  for (pos = 0; pos < 8 && !(mask & (0x80 >> pos)); pos++);
+  end = len * 8;
+
   outl--; // leave space for NULL
-  while (len) {
-    len--;
-    while (mask) {
-      if (*data & mask) {
-        node = node->b1;
-      } else {
-        node = node->b0;
-      }
-      mask >>= 1;
-      if (!node) goto end;
-      if (node->data) {
-        char *t = node->data;
-        while (*t && outl) {
-          *outb = *t;
-          outb++; t++; outl--;
-        }
-        if (!outl) goto end;
-        node = tree;
-      }
+  while (pos < end) {
+    bits = data[pos >> 3] << 8;
+    if ((pos >> 3) + 1 < len)
+      bits |= data[(pos >> 3) + 1];
+    bits = (bits >> (8 - (pos & 7))) & 0xff;
+    e = &table[bits];
+    if (e->type == HUFFMAN_END || pos + e->len > end)
+      break;
+    pos += e->len;
+    if (e->type == HUFFMAN_NEXT) {
+      table = e->node->table;
+      continue;
+    }
+    t = e->data;
+    while (*t && outl) {
+      *outb = *t;
+      outb++; t++; outl--;
     }
-    mask = 0x80;
-    data++;
+    if (!outl) break;
+    table = tree->table;
   }
-end:
   *outb = '\0';
   return ret;
 }
@@ -22,11 +22,14 @@
 #include <sys/types.h>
 #include "htsmsg.h"
 
+struct huffman_entry;
+
 typedef struct huffman_node
 {
-  struct huffman_node *b0;
-  struct huffman_node *b1;
-  char                *data;
+  struct huffman_node  *b0;
+  struct huffman_node  *b1;
+  char                 *data;
+  struct huffman_entry *table; ///< 8-bit lookup (root and every 8th level)
 } huffman_node_t;
 
 void huffman_tree_destroy ( huffman_node_t *tree );
@@ -46,9 +46,37 @@ static RB_HEAD(,idclass_link) idclasses;
 static RB_HEAD(,idclass_link) idrootclasses;
 static pthread_cond_t         idnode_cond;
 static pthread_mutex_t        idnode_mutex;
-static htsmsg_t              *idnode_queue;
 static void*                  idnode_thread(void* p);
 
+/*
+ * Delayed notification queue
+ *
+ * The entries are hashed by node and event (duplicates are dropped) and
+ * queued per event, each event is sent as one message with all UUIDs.
+ */
+#define IDNODE_NOTIFY_HASH 4096
+
+typedef struct idnode_notify_class
+{
+  const char                                *event;
+  TAILQ_HEAD(,idnode_notify_entry)           entries;
+  LIST_ENTRY(idnode_notify_class)            link;
+} idnode_notify_class_t;
+
+typedef struct idnode_notify_entry
+{
+  uint8_t                                    uuid[UUID_BIN_SIZE];
+  idnode_notify_class_t                     *cls;
+  LIST_ENTRY(idnode_notify_entry)            hlink;
+  TAILQ_ENTRY(idnode_notify_entry)           qlink;
+} idnode_notify_entry_t;
+
+typedef LIST_HEAD(,idnode_notify_entry) idnode_notify_bucket_t;
+
+static idnode_notify_bucket_t        idnode_queue[IDNODE_NOTIFY_HASH];
+static LIST_HEAD(,idnode_notify_class) idnode_queue_classes;
+static int                           idnode_queue_count;
+
 SKEL_DECLARE(idclasses_skel, idclass_link_t);
 
 /* **************************************************************************
@@ -84,7 +112,9 @@ pthread_t idnode_tid;
 void
 idnode_init(void)
 {
-  idnode_queue = NULL;
+  memset(idnode_queue, 0, sizeof(idnode_queue));
+  LIST_INIT(&idnode_queue_classes);
+  idnode_queue_count = 0;
   RB_INIT(&idnodes);
   RB_INIT(&idclasses);
   RB_INIT(&idrootclasses);
@@ -93,16 +123,23 @@ idnode_init(void)
   tvhthread_create(&idnode_tid, NULL, idnode_thread, NULL);
 }
 
+static void idnode_notify_free ( idnode_notify_class_t *nc );
+
 void
 idnode_done(void)
 {
   idclass_link_t *il;
+  idnode_notify_class_t *nc;
 
   pthread_cond_signal(&idnode_cond);
   pthread_join(idnode_tid, NULL);
   pthread_mutex_lock(&idnode_mutex);
-  htsmsg_destroy(idnode_queue);
-  idnode_queue = NULL;
+  while ((nc = LIST_FIRST(&idnode_queue_classes)) != NULL) {
+    LIST_REMOVE(nc, link);
+    idnode_notify_free(nc);
+  }
+  memset(idnode_queue, 0, sizeof(idnode_queue));
+  idnode_queue_count = 0;
   pthread_mutex_unlock(&idnode_mutex);  
   while ((il = RB_FIRST(&idclasses)) != NULL) {
     RB_REMOVE(&idclasses, il, link);
@@ -1339,16 +1376,55 @@ idnode_serialize0(idnode_t *self, htsmsg_t *list, int optmask)
  * Delayed notification
  */
 static void
-idnode_notify_delayed ( idnode_t *in, const char *uuid, const char *event )
+idnode_notify_delayed ( idnode_t *in, const char *event )
 {
+  idnode_notify_bucket_t *b;
+  idnode_notify_entry_t *ne;
+  idnode_notify_class_t *nc;
+  uint32_t h;
+
+  memcpy(&h, in->in_uuid, sizeof(h));
+  b = &idnode_queue[h & (IDNODE_NOTIFY_HASH - 1)];
+
   pthread_mutex_lock(&idnode_mutex);
-  if (!idnode_queue)
-    idnode_queue = htsmsg_create_map();
-  htsmsg_set_str(idnode_queue, uuid, event);
-  pthread_cond_signal(&idnode_cond);
+  LIST_FOREACH(ne, b, hlink)
+    if (!memcmp(ne->uuid, in->in_uuid, UUID_BIN_SIZE) &&
+        (ne->cls->event == event || !strcmp(ne->cls->event, event)))
+      goto done;
+
+  LIST_FOREACH(nc, &idnode_queue_classes, link)
+    if (nc->event == event || !strcmp(nc->event, event))
+      break;
+  if (nc == NULL) {
+    nc = calloc(1, sizeof(*nc));
+    nc->event = event;
+    TAILQ_INIT(&nc->entries);
+    LIST_INSERT_HEAD(&idnode_queue_classes, nc, link);
+  }
+
+  ne = malloc(sizeof(*ne));
+  memcpy(ne->uuid, in->in_uuid, UUID_BIN_SIZE);
+  ne->cls = nc;
+  LIST_INSERT_HEAD(b, ne, hlink);
+  TAILQ_INSERT_TAIL(&nc->entries, ne, qlink);
+  if (idnode_queue_count++ == 0)
+    pthread_cond_signal(&idnode_cond);
+done:
   pthread_mutex_unlock(&idnode_mutex);
 }
 
+static void
+idnode_notify_free ( idnode_notify_class_t *nc )
+{
+  idnode_notify_entry_t *ne;
+
+  while ((ne = TAILQ_FIRST(&nc->entries)) != NULL) {
+    TAILQ_REMOVE(&nc->entries, ne, qlink);
+    free(ne);
+  }
+  free(nc);
+}
+
 /**
  * Update internal event pipes
  */
@@ -1356,10 +1432,9 @@ static void
 idnode_notify_event ( idnode_t *in )
 {
   const idclass_t *ic = in->in_class;
-  const char *uuid = idnode_uuid_as_str(in);
   while (ic) {
     if (ic->ic_event)
-      idnode_notify_delayed(in, uuid, ic->ic_event);
+      idnode_notify_delayed(in, ic->ic_event);
     ic = ic->ic_super;
   }
 }
@@ -1418,42 +1493,58 @@ idnode_notify_title_changed (void *in)
 void*
 idnode_thread ( void *p )
 {
-  idnode_t *node;
-  htsmsg_t *m, *q = NULL;
-  htsmsg_field_t *f;
-  const char *event;
+  idnode_t skel, *node;
+  idnode_notify_class_t *nc;
+  idnode_notify_entry_t *ne;
+  LIST_HEAD(,idnode_notify_class) q;
+  htsmsg_t *m, *uuids, *removed;
+  char uuid[UUID_HEX_SIZE];
 
   pthread_mutex_lock(&idnode_mutex);
 
   while (tvheadend_running) {
 
     /* Get queue */
-    if (!idnode_queue) {
+    if (!idnode_queue_count) {
       pthread_cond_wait(&idnode_cond, &idnode_mutex);
       continue;
     }
-    q            = idnode_queue;
-    idnode_queue = NULL;
+    q.lh_first = LIST_FIRST(&idnode_queue_classes);
+    if (q.lh_first)
+      q.lh_first->link.le_prev = &q.lh_first;
+    LIST_INIT(&idnode_queue_classes);
+    memset(idnode_queue, 0, sizeof(idnode_queue));
+    idnode_queue_count = 0;
     pthread_mutex_unlock(&idnode_mutex);
 
-    /* Process */
+    /* Process (one message per event) */
     pthread_mutex_lock(&global_lock);
 
-    HTSMSG_FOREACH(f, q) {
-      node  = idnode_find(f->hmf_name, NULL, NULL);
-      event = htsmsg_field_get_str(f);
-      if (event) {
-        m     = htsmsg_create_map();
-        htsmsg_add_str(m, "uuid", f->hmf_name);
-        if (!node)
-          htsmsg_add_u32(m, "removed", 1);
-        notify_by_msg(event, m);
+    while ((nc = LIST_FIRST(&q)) != NULL) {
+      LIST_REMOVE(nc, link);
+      uuids   = htsmsg_create_list();
+      removed = NULL;
+      TAILQ_FOREACH(ne, &nc->entries, qlink) {
+        bin2hex(uuid, sizeof(uuid), ne->uuid, UUID_BIN_SIZE);
+        htsmsg_add_str(uuids, NULL, uuid);
+        memcpy(skel.in_uuid, ne->uuid, UUID_BIN_SIZE);
+        node = RB_FIND(&idnodes, &skel, in_link, in_cmp);
+        if (!node) {
+          if (!removed)
+            removed = htsmsg_create_list();
+          htsmsg_add_str(removed, NULL, uuid);
+        }
       }
+      m = htsmsg_create_map();
+      htsmsg_add_msg(m, "uuid", uuids);
+      if (removed)
+        htsmsg_add_msg(m, "removed", removed);
+      notify_by_msg(nc->event, m);
+      idnode_notify_free(nc);
     }
     
     /* Finished */
     pthread_mutex_unlock(&global_lock);
-    htsmsg_destroy(q);
 
     /* Wait */
     usleep(500000);
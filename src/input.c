@@ -75,6 +75,9 @@ tvh_input_stream_create_msg
     htsmsg_add_str(m, "stream", st->stream_name);
   htsmsg_add_u32(m, "subs", st->subs_count);
   htsmsg_add_u32(m, "weight", st->max_weight);
+  htsmsg_add_u32(m, "queue_fill", st->queue_fill);
+  htsmsg_add_u32(m, "queue_fill_max", st->queue_fill_max);
+  htsmsg_add_u32(m, "queue_drops", st->queue_drops);
   htsmsg_add_s32(m, "signal", st->stats.signal);
   htsmsg_add_u32(m, "signal_scale", st->stats.signal_scale);
   htsmsg_add_u32(m, "ber", st->stats.ber);
@@ -73,6 +73,10 @@ struct tvh_input_stream {
   int   subs_count;   ///< Number of subcscriptions
   int   max_weight;   ///< Current max weight
 
+  int   queue_fill;     ///< Input queue occupancy (%)
+  int   queue_fill_max; ///< Input queue occupancy high watermark (%)
+  int   queue_drops;    ///< Input queue overflows
+
   tvh_input_stream_stats_t stats;
 };
 
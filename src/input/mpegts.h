@@ -36,6 +36,12 @@
 #define MPEGTS_TABLES_PID       0x2001
 #define MPEGTS_PID_NONE         0xFFFF
 
+/* Direct PID lookup table (two level, pages allocated on demand) */
+#define MPEGTS_PID_PAGE_SHIFT   7
+#define MPEGTS_PID_PAGE_SIZE    (1 << MPEGTS_PID_PAGE_SHIFT)
+#define MPEGTS_PID_PAGE_MASK    (MPEGTS_PID_PAGE_SIZE - 1)
+#define MPEGTS_PID_PAGES        ((MPEGTS_TABLES_PID >> MPEGTS_PID_PAGE_SHIFT) + 1)
+
 /* Types */
 typedef int16_t                     mpegts_apid_t;
 typedef struct mpegts_apids         mpegts_apids_t;
@@ -106,14 +112,19 @@ int mpegts_pid_dump ( mpegts_apids_t *pids, char *buf, int len );
  * Data / SI processing
  * *************************************************************************/
 
+/*
+ * Input ring record, mp_len == 0 marks the wrap-around point
+ */
 struct mpegts_packet
 {
-  TAILQ_ENTRY(mpegts_packet)  mp_link;
   size_t                      mp_len;
   mpegts_mux_t               *mp_mux;
   uint8_t                     mp_data[0];
 };
 
+#define MPEGTS_INPUT_RING_SIZE  (2*1024*1024) /* must be a power of two */
+#define MPEGTS_INPUT_RING_CHUNK ((MPEGTS_INPUT_RING_SIZE / 8 / 188) * 188)
+
 typedef int (*mpegts_table_callback_t)
   ( mpegts_table_t*, const uint8_t *buf, int len, int tableid );
 
@@ -401,9 +412,8 @@ struct mpegts_mux
    */
 
   RB_HEAD(, mpegts_pid)       mm_pids;
+  mpegts_pid_t              **mm_pid_pages[MPEGTS_PID_PAGES];
   LIST_HEAD(, mpegts_pid_sub) mm_all_subs;
-  int                         mm_last_pid;
-  mpegts_pid_t               *mm_last_mp;
 
   int                         mm_num_tables;
   LIST_HEAD(, mpegts_table)   mm_tables;
@@ -613,11 +623,18 @@ struct mpegts_input
   time_t mi_last_dispatch;
 
   /* Data input */
-  // Note: this section is protected by mi_input_lock
+  // Note: producers (mpegts_input_recv_packets) serialise on mi_input_lock,
+  //       the input thread consumes the ring without taking the lock
+  //       and only uses mi_input_lock/mi_input_cond to sleep
   pthread_t                       mi_input_tid;
   pthread_mutex_t                 mi_input_lock;
   pthread_cond_t                  mi_input_cond;
-  TAILQ_HEAD(,mpegts_packet)      mi_input_queue;
+  uint8_t                        *mi_input_ring;
+  volatile size_t                 mi_input_head;  /* written by producer */
+  volatile size_t                 mi_input_tail;  /* written by consumer */
+  int                             mi_input_sleep;
+  size_t                          mi_input_fill_max;
+  uint32_t                        mi_input_overflow;
 
   /* Data processing/output */
   // Note: this lock (mi_output_lock) protects all the remaining
@@ -828,13 +845,18 @@ static inline int mpegts_mux_scan_state_set ( mpegts_mux_t *m, int state )
 
 mpegts_pid_t *mpegts_mux_find_pid_(mpegts_mux_t *mm, int pid, int create);
 
+void mpegts_mux_remove_pid(mpegts_mux_t *mm, mpegts_pid_t *mp);
+
 static inline mpegts_pid_t *
 mpegts_mux_find_pid(mpegts_mux_t *mm, int pid, int create)
 {
-  if (mm->mm_last_pid != pid)
+  mpegts_pid_t **page, *mp = NULL;
+  if (pid >= 0 && pid <= MPEGTS_TABLES_PID &&
+      (page = mm->mm_pid_pages[pid >> MPEGTS_PID_PAGE_SHIFT]) != NULL)
+    mp = page[pid & MPEGTS_PID_PAGE_MASK];
+  if (mp == NULL && create)
     return mpegts_mux_find_pid_(mm, pid, create);
-  else
-    return mm->mm_last_mp;
+  return mp;
 }
 
 void mpegts_input_recv_packets
@@ -510,10 +510,6 @@ mpegts_input_close_pid
     skel.mps_type  = type;
     skel.mps_owner = owner;
     mps = RB_FIND(&mp->mp_subs, &skel, mps_link, mpegts_mps_cmp);
-    if (pid == mm->mm_last_pid) {
-      mm->mm_last_pid = -1;
-      mm->mm_last_mp = NULL;
-    }
     if (mps) {
       mpegts_mux_nice_name(mm, buf, sizeof(buf));
       tvhdebug("mpegts", "%s - close PID %04X (%d) [%d/%p]",
@@ -525,7 +521,7 @@ mpegts_input_close_pid
     }
   }
   if (!RB_FIRST(&mp->mp_subs)) {
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
+    mpegts_mux_remove_pid(mm, mp);
     if (mp->mp_fd != -1)
       linuxdvb_filter_close(mp->mp_fd);
     free(mp);
@@ -720,6 +716,14 @@ mpegts_input_started_mux
     gtimer_arm(&mi->mi_status_timer, mpegts_input_status_timer,
                mi, 1);
 
+  /* Input ring (allocated on first use) */
+  if (mi->mi_input_ring == NULL) {
+    uint8_t *ring = malloc(MPEGTS_INPUT_RING_SIZE);
+    pthread_mutex_lock(&mi->mi_input_lock);
+    mi->mi_input_ring = ring;
+    pthread_mutex_unlock(&mi->mi_input_lock);
+  }
+
   /* Update */
   mmi->mmi_mux->mm_active = mmi;
 
@@ -826,27 +830,81 @@ mpegts_input_tuning_error ( mpegts_input_t *mi, mpegts_mux_t *mm )
  * Data processing
  * *************************************************************************/
 
-static int inline
-ts_sync_count ( const uint8_t *tsb, int len )
+/*
+ * Input ring
+ *
+ * Single consumer (mpegts_input_thread) byte ring of variable sized
+ * mpegts_packet_t records. Producers serialise on mi_input_lock, the
+ * consumer only reads the indexes. Both indexes run freely and are
+ * masked by the (power of two) ring size.
+ */
+#define MPEGTS_RING_MASK (MPEGTS_INPUT_RING_SIZE - 1)
+#define MPEGTS_RING_RECLEN(len) \
+  ((sizeof(mpegts_packet_t) + (len) + 7) & ~(size_t)7)
+
+static int
+mpegts_input_ring_put
+  ( mpegts_input_t *mi, mpegts_mux_t *mm, const uint8_t *tsb, size_t len )
 {
-  const uint8_t *start = tsb;
-  while (len >= 188) {
-    if (len >= 1880 &&
-        tsb[0*188] == 0x47 && tsb[1*188] == 0x47 &&
-        tsb[2*188] == 0x47 && tsb[3*188] == 0x47 &&
-        tsb[4*188] == 0x47 && tsb[5*188] == 0x47 &&
-        tsb[6*188] == 0x47 && tsb[7*188] == 0x47 &&
-        tsb[8*188] == 0x47 && tsb[9*188] == 0x47) {
-      len -= 1880;
-      tsb += 1880;
-    } else if (*tsb == 0x47) {
-      len -= 188;
-      tsb += 188;
-    } else {
-      break;
-    }
+  mpegts_packet_t *mp;
+  size_t head = mi->mi_input_head, fill;
+  size_t pos  = head & MPEGTS_RING_MASK;
+  size_t need = MPEGTS_RING_RECLEN(len), skip = 0;
+
+  if (pos + need > MPEGTS_INPUT_RING_SIZE)
+    skip = MPEGTS_INPUT_RING_SIZE - pos;
+  fill = head - mi->mi_input_tail;
+  if (MPEGTS_INPUT_RING_SIZE - fill < skip + need) {
+    mi->mi_input_overflow++;
+    return -1;
   }
-  return tsb - start;
+
+  /* Wrap */
+  if (skip) {
+    if (skip >= sizeof(mpegts_packet_t))
+      ((mpegts_packet_t *)(mi->mi_input_ring + pos))->mp_len = 0;
+    head += skip;
+    pos   = 0;
+  }
+
+  mp = (mpegts_packet_t *)(mi->mi_input_ring + pos);
+  mp->mp_len = len;
+  mp->mp_mux = mm;
+  memcpy(mp->mp_data, tsb, len);
+
+  /* Publish */
+  __sync_synchronize();
+  mi->mi_input_head = head + need;
+
+  fill += skip + need;
+  if (fill > mi->mi_input_fill_max)
+    mi->mi_input_fill_max = fill;
+  return 0;
+}
+
+static mpegts_packet_t *
+mpegts_input_ring_get ( mpegts_input_t *mi )
+{
+  mpegts_packet_t *mp;
+  size_t tail = mi->mi_input_tail, pos;
+
+  if (tail == mi->mi_input_head)
+    return NULL;
+  __sync_synchronize();
+  pos = tail & MPEGTS_RING_MASK;
+  mp  = (mpegts_packet_t *)(mi->mi_input_ring + pos);
+  if (MPEGTS_INPUT_RING_SIZE - pos < sizeof(mpegts_packet_t) || !mp->mp_len)
+    mp = (mpegts_packet_t *)mi->mi_input_ring;
+  return mp;
+}
+
+static void
+mpegts_input_ring_release ( mpegts_input_t *mi, mpegts_packet_t *mp )
+{
+  size_t tail = mi->mi_input_tail;
+  size_t skip = ((uint8_t *)mp - mi->mi_input_ring - tail) & MPEGTS_RING_MASK;
+  __sync_synchronize();
+  mi->mi_input_tail = tail + skip + MPEGTS_RING_RECLEN(mp->mp_len);
 }
 
 void
@@ -854,8 +912,7 @@ mpegts_input_recv_packets
   ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi, sbuf_t *sb,
     int64_t *pcr, uint16_t *pcr_pid )
 {
-  int len2 = 0, off = 0;
-  mpegts_packet_t *mp;
+  int len2 = 0, off = 0, l;
   uint8_t *tsb = sb->sb_data;
   int     len  = sb->sb_ptr;
 #define MIN_TS_PKT 100
@@ -870,7 +927,7 @@ mpegts_input_recv_packets
 
   /* Check for sync */
   while ( (len >= MIN_TS_SYN) &&
-          ((len2 = ts_sync_count(tsb, len)) < MIN_TS_SYN) ) {
+          ((len2 = mpegts_sync_count(tsb, len)) < MIN_TS_SYN) ) {
     mmi->mmi_stats.unc++;
     --len;
     ++tsb;
@@ -896,20 +953,18 @@ mpegts_input_recv_packets
 
   /* Pass */
   if (len2 >= MIN_TS_SYN) {
-    mp = malloc(sizeof(mpegts_packet_t) + len2);
-    mp->mp_mux  = mmi->mmi_mux;
-    mp->mp_len  = len2;
-    memcpy(mp->mp_data, tsb, len2);
-
     len -= len2;
     off += len2;
 
     pthread_mutex_lock(&mi->mi_input_lock);
-    if (mmi->mmi_mux->mm_active == mmi) {
-      TAILQ_INSERT_TAIL(&mi->mi_input_queue, mp, mp_link);
-      pthread_cond_signal(&mi->mi_input_cond);
-    } else {
-      free(mp);
+    if (mmi->mmi_mux->mm_active == mmi && mi->mi_input_ring) {
+      for ( ; len2 > 0; tsb += l, len2 -= l) {
+        l = MIN(len2, MPEGTS_INPUT_RING_CHUNK);
+        if (mpegts_input_ring_put(mi, mmi->mmi_mux, tsb, l))
+          break;
+      }
+      if (mi->mi_input_sleep)
+        pthread_cond_signal(&mi->mi_input_cond);
     }
     pthread_mutex_unlock(&mi->mi_input_lock);
   }
@@ -1223,43 +1278,36 @@ mpegts_input_thread ( void * p )
   mpegts_packet_t *mp;
   mpegts_input_t  *mi = p;
 
-  pthread_mutex_lock(&mi->mi_input_lock);
   while (mi->mi_running) {
 
     /* Wait for a packet */
-    if (!(mp = TAILQ_FIRST(&mi->mi_input_queue))) {
-      pthread_cond_wait(&mi->mi_input_cond, &mi->mi_input_lock);
+    if (!mi->mi_input_ring || !(mp = mpegts_input_ring_get(mi))) {
+      pthread_mutex_lock(&mi->mi_input_lock);
+      mi->mi_input_sleep = 1;
+      if (mi->mi_running && mi->mi_input_head == mi->mi_input_tail)
+        pthread_cond_wait(&mi->mi_input_cond, &mi->mi_input_lock);
+      mi->mi_input_sleep = 0;
+      pthread_mutex_unlock(&mi->mi_input_lock);
       continue;
     }
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
-    pthread_mutex_unlock(&mi->mi_input_lock);
-      
+
     /* Process */
+    // Note: the record is released with mi_output_lock held,
+    //       see mpegts_input_flush_mux()
     pthread_mutex_lock(&mi->mi_output_lock);
     mpegts_input_table_waiting(mi, mp->mp_mux);
     mpegts_input_process(mi, mp);
+    mpegts_input_ring_release(mi, mp);
     pthread_mutex_unlock(&mi->mi_output_lock);
 
-    /* Cleanup */
-    free(mp);
-
 #if ENABLE_TSDEBUG
     {
       extern void tsdebugcw_go(void);
       tsdebugcw_go();
     }
 #endif
-
-    pthread_mutex_lock(&mi->mi_input_lock);
   }
 
-  /* Flush */
-  while ((mp = TAILQ_FIRST(&mi->mi_input_queue))) {
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
-    free(mp);
-  }
-  pthread_mutex_unlock(&mi->mi_input_lock);
-
   return NULL;
 }
 
@@ -1307,6 +1355,7 @@ mpegts_input_flush_mux
 {
   mpegts_table_feed_t *mtf;
   mpegts_packet_t *mp;
+  size_t tail, head, pos;
 
   lock_assert(&global_lock);
 
@@ -1314,16 +1363,30 @@ mpegts_input_flush_mux
   //       remove things from the Q, we simply invalidate by clearing
   //       the mux pointer and allow the threads to deal with the deletion
 
+  pthread_mutex_lock(&mi->mi_output_lock);
+
   /* Flush input Q */
-  pthread_mutex_lock(&mi->mi_input_lock);
-  TAILQ_FOREACH(mp, &mi->mi_input_queue, mp_link) {
-    if (mp->mp_mux == mm)
-      mp->mp_mux = NULL;
+  // Note: the consumer only advances the tail with mi_output_lock held
+  //       and producers never touch published records
+  if (mi->mi_input_ring) {
+    tail = mi->mi_input_tail;
+    head = mi->mi_input_head;
+    __sync_synchronize();
+    while (tail != head) {
+      pos = tail & MPEGTS_RING_MASK;
+      mp  = (mpegts_packet_t *)(mi->mi_input_ring + pos);
+      if (MPEGTS_INPUT_RING_SIZE - pos < sizeof(mpegts_packet_t) ||
+          mp->mp_len == 0) {
+        tail += MPEGTS_INPUT_RING_SIZE - pos;
+        continue;
+      }
+      if (mp->mp_mux == mm)
+        mp->mp_mux = NULL;
+      tail += MPEGTS_RING_RECLEN(mp->mp_len);
+    }
   }
-  pthread_mutex_unlock(&mi->mi_input_lock);
 
   /* Flush table Q */
-  pthread_mutex_lock(&mi->mi_output_lock);
   TAILQ_FOREACH(mtf, &mi->mi_table_queue, mtf_link) {
     if (mtf->mtf_mux == mm)
       mtf->mtf_mux = NULL;
@@ -1359,6 +1422,11 @@ mpegts_input_stream_status
   st->stream_name = strdup(buf);
   st->subs_count  = s;
   st->max_weight  = w;
+  st->queue_fill  = (uint64_t)(mi->mi_input_head - mi->mi_input_tail) * 100 /
+                    MPEGTS_INPUT_RING_SIZE;
+  st->queue_fill_max = (uint64_t)mi->mi_input_fill_max * 100 /
+                       MPEGTS_INPUT_RING_SIZE;
+  st->queue_drops = mi->mi_input_overflow;
   st->stats       = mmi->mmi_stats;
   st->stats.bps   = atomic_exchange(&mmi->mmi_stats.bps, 0) * 8;
 }
@@ -1488,7 +1556,6 @@ mpegts_input_create0
   /* Init input/output structures */
   pthread_mutex_init(&mi->mi_input_lock, NULL);
   pthread_cond_init(&mi->mi_input_cond, NULL);
-  TAILQ_INIT(&mi->mi_input_queue);
 
   pthread_mutex_init(&mi->mi_output_lock, NULL);
   pthread_cond_init(&mi->mi_table_cond, NULL);
@@ -1549,6 +1616,7 @@ mpegts_input_delete ( mpegts_input_t *mi, int delconf )
 
   pthread_mutex_destroy(&mi->mi_output_lock);
   pthread_cond_destroy(&mi->mi_table_cond);
+  free(mi->mi_input_ring);
   free(mi->mi_name);
   free(mi->mi_linked);
   free(mi);
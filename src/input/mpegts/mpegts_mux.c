@@ -684,6 +684,7 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
   mpegts_input_t *mi = NULL, *mi2;
   mpegts_pid_t *mp;
   mpegts_pid_sub_t *mps;
+  int i;
 
   mpegts_mux_nice_name(mm, buf, sizeof(buf));
 
@@ -733,8 +734,6 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
 
   /* Ensure PIDs are cleared */
   pthread_mutex_lock(&mi->mi_output_lock);
-  mm->mm_last_pid = -1;
-  mm->mm_last_mp = NULL;
   while ((mp = RB_FIRST(&mm->mm_pids))) {
     assert(mi);
     if (mp->mp_pid == MPEGTS_FULLMUX_PID ||
@@ -756,11 +755,15 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
         free(mps);
       }
     }
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
+    mpegts_mux_remove_pid(mm, mp);
     if (mp->mp_fd != -1)
       linuxdvb_filter_close(mp->mp_fd);
     free(mp);
   }
+  for (i = 0; i < MPEGTS_PID_PAGES; i++) {
+    free(mm->mm_pid_pages[i]);
+    mm->mm_pid_pages[i] = NULL;
+  }
   pthread_mutex_unlock(&mi->mi_output_lock);
 
   /* Scanning */
@@ -1035,8 +1038,6 @@ mpegts_mux_create0
   TAILQ_INIT(&mm->mm_descrambler_emms);
   pthread_mutex_init(&mm->mm_descrambler_lock, NULL);
 
-  mm->mm_last_pid            = -1;
-
   /* Configuration */
   if (conf)
     idnode_load(&mm->mm_id, conf);
@@ -1228,7 +1229,7 @@ static int mp_cmp ( mpegts_pid_t *a, mpegts_pid_t *b )
 mpegts_pid_t *
 mpegts_mux_find_pid_ ( mpegts_mux_t *mm, int pid, int create )
 {
-  mpegts_pid_t skel, *mp;
+  mpegts_pid_t skel, *mp, ***page;
 
   if (pid < 0 || pid > MPEGTS_TABLES_PID) return NULL;
 
@@ -1241,19 +1242,29 @@ mpegts_mux_find_pid_ ( mpegts_mux_t *mm, int pid, int create )
       if (!RB_INSERT_SORTED(&mm->mm_pids, mp, mp_link, mp_cmp)) {
         mp->mp_fd = -1;
         mp->mp_cc = -1;
+        page = &mm->mm_pid_pages[pid >> MPEGTS_PID_PAGE_SHIFT];
+        if (*page == NULL)
+          *page = calloc(MPEGTS_PID_PAGE_SIZE, sizeof(mpegts_pid_t *));
+        (*page)[pid & MPEGTS_PID_PAGE_MASK] = mp;
       } else {
         free(mp);
         mp = NULL;
       }
     }
   }
-  if (mp) {
-    mm->mm_last_pid = pid;
-    mm->mm_last_mp = mp;
-  }
   return mp;
 }
 
+void
+mpegts_mux_remove_pid ( mpegts_mux_t *mm, mpegts_pid_t *mp )
+{
+  mpegts_pid_t **page = mm->mm_pid_pages[mp->mp_pid >> MPEGTS_PID_PAGE_SHIFT];
+
+  RB_REMOVE(&mm->mm_pids, mp, mp_link);
+  if (page)
+    page[mp->mp_pid & MPEGTS_PID_PAGE_MASK] = NULL;
+}
+
 /******************************************************************************
  * Editor Configuration
  *
@@ -71,6 +71,7 @@
 #endif
 #include "profile.h"
 #include "bouquet.h"
+#include "tvhpool.h"
 
 #ifdef PLATFORM_LINUX
 #include <sys/prctl.h>
@@ -166,8 +167,10 @@ pthread_mutex_t atomic_lock;
 /*
  * Locals
  */
-static LIST_HEAD(, gtimer) gtimers;
+static RB_HEAD(, gtimer) gtimers;
 static pthread_cond_t gtimer_cond;
+static uint64_t gtimer_seq;
+static gtimer_stats_t gtimer_stats;
 
 static void
 handle_sigpipe(int x)
@@ -227,7 +230,10 @@ gtimercmp(gtimer_t *a, gtimer_t *b)
     return -1;
   if(a->gti_expire.tv_nsec > b->gti_expire.tv_nsec)
     return 1;
- return 0;
+  /* Equal expiry, keep the arm order */
+  if(a->gti_seq < b->gti_seq)
+    return -1;
+  return a->gti_seq > b->gti_seq;
 }
 
 /**
@@ -240,17 +246,18 @@ gtimer_arm_abs2
   lock_assert(&global_lock);
 
   if (gti->gti_callback != NULL)
-    LIST_REMOVE(gti, gti_link);
+    RB_REMOVE(&gtimers, gti, gti_link);
 
   gti->gti_callback = callback;
   gti->gti_opaque   = opaque;
   gti->gti_expire   = *when;
+  gti->gti_seq      = ++gtimer_seq;
 
-  LIST_INSERT_SORTED(&gtimers, gti, gti_link, gtimercmp);
+  RB_INSERT_SORTED(&gtimers, gti, gti_link, gtimercmp);
 
   //tvhdebug("gtimer", "%p @ %ld.%09ld", gti, when->tv_sec, when->tv_nsec);
 
-  if (LIST_FIRST(&gtimers) == gti)
+  if (RB_FIRST(&gtimers) == gti)
     pthread_cond_signal(&gtimer_cond); // force timer re-check
 }
 
@@ -299,11 +306,23 @@ gtimer_disarm(gtimer_t *gti)
 {
   if(gti->gti_callback) {
     //tvhdebug("gtimer", "%p disarm", gti);
-    LIST_REMOVE(gti, gti_link);
+    RB_REMOVE(&gtimers, gti, gti_link);
     gti->gti_callback = NULL;
   }
 }
 
+/**
+ *
+ */
+void
+gtimer_get_stats(gtimer_stats_t *stats)
+{
+  lock_assert(&global_lock);
+
+  *stats = gtimer_stats;
+  stats->gts_armed = gtimers.entries;
+}
+
 /**
  * Show version info
  */
@@ -372,6 +391,7 @@ mainloop(void)
   gtimer_t *gti;
   gti_callback_t *cb;
   struct timespec ts;
+  int64_t late;
 
   while(tvheadend_running) {
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -391,12 +411,12 @@ mainloop(void)
     
 #if 0
     tvhdebug("gtimer", "now %ld.%09ld", ts.tv_sec, ts.tv_nsec);
-    LIST_FOREACH(gti, &gtimers, gti_link)
+    RB_FOREACH(gti, &gtimers, gti_link)
       tvhdebug("gtimer", "  gti %p expire %ld.%08ld",
                gti, gti->gti_expire.tv_sec, gti->gti_expire.tv_nsec);
 #endif
 
-    while((gti = LIST_FIRST(&gtimers)) != NULL) {
+    while((gti = RB_FIRST(&gtimers)) != NULL) {
       
       if ((gti->gti_expire.tv_sec > ts.tv_sec) ||
           ((gti->gti_expire.tv_sec == ts.tv_sec) &&
@@ -408,14 +428,21 @@ mainloop(void)
       cb = gti->gti_callback;
       //tvhdebug("gtimer", "%p callback", gti);
 
-      LIST_REMOVE(gti, gti_link);
+      RB_REMOVE(&gtimers, gti, gti_link);
       gti->gti_callback = NULL;
 
+      late = (ts.tv_sec - gti->gti_expire.tv_sec) * 1000000LL +
+             (ts.tv_nsec - gti->gti_expire.tv_nsec) / 1000;
+      gtimer_stats.gts_fired++;
+      gtimer_stats.gts_late_us += late;
+      if (late > gtimer_stats.gts_late_max)
+        gtimer_stats.gts_late_max = late;
+
       cb(gti->gti_opaque);
     }
 
     /* Bound wait */
-    if ((LIST_FIRST(&gtimers) == NULL) || (ts.tv_sec > (dispatch_clock + 1))) {
+    if ((RB_FIRST(&gtimers) == NULL) || (ts.tv_sec > (dispatch_clock + 1))) {
       ts.tv_sec  = dispatch_clock + 1;
       ts.tv_nsec = 0;
     }
@@ -815,6 +842,7 @@ main(int argc, char **argv)
   SSL_library_init();
 
   /* Initialise configuration */
+  mpegts_word_init();
   idnode_init();
   spawn_init();
   config_init(opt_nobackup == 0);
@@ -972,6 +1000,7 @@ main(int argc, char **argv)
   tvhftrace("main", urlparse_done);
   tvhftrace("main", idnode_done);
   tvhftrace("main", spawn_done);
+  tvhftrace("main", tvhpool_done);
 
   tvhlog(LOG_NOTICE, "STOP", "Exiting HTS Tvheadend");
   tvhlog_end();
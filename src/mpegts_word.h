@@ -0,0 +1,66 @@
+/*
+ *  MPEG-TS packet header scanning
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_MPEGTS_WORD_H__
+#define __TVH_MPEGTS_WORD_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Scanning kernels
+ *
+ * Return the number of bytes (in 188 byte steps) from the start of tsb
+ * where each packet header word satisfies (word & mask) == val. Mask
+ * and value are in memory (big endian) byte order.
+ */
+typedef int (*mpegts_word_fcn_t)
+  (const uint8_t *tsb, int len, uint32_t mask, uint32_t val);
+
+static inline uint32_t mpegts_word32( const uint8_t *tsb )
+{
+  uint32_t r;
+  memcpy(&r, tsb, sizeof(r));
+  return r;
+}
+
+static inline int
+mpegts_word_count_tail
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  int r = 0;
+
+  while (len >= 188 && (mpegts_word32(tsb) & mask) == val) {
+    r   += 188;
+    len -= 188;
+    tsb += 188;
+  }
+  return r;
+}
+
+#if ENABLE_SSE2
+int mpegts_word_count_sse2
+  (const uint8_t *tsb, int len, uint32_t mask, uint32_t val);
+#endif
+
+#if ENABLE_AVX2
+int mpegts_word_count_avx2
+  (const uint8_t *tsb, int len, uint32_t mask, uint32_t val);
+#endif
+
+#endif /* __TVH_MPEGTS_WORD_H__ */
@@ -0,0 +1,46 @@
+/*
+ *  MPEG-TS packet header scanning - AVX2
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "build.h"
+#include "mpegts_word.h"
+#include <immintrin.h>
+
+int
+mpegts_word_count_avx2
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  const __m256i voff  = _mm256_setr_epi32(0*188, 1*188, 2*188, 3*188,
+                                          4*188, 5*188, 6*188, 7*188);
+  const __m256i vmask = _mm256_set1_epi32(mask);
+  const __m256i vval  = _mm256_set1_epi32(val);
+  __m256i w;
+  int r = 0, m;
+
+  while (len >= 8*188) {
+    w = _mm256_i32gather_epi32((const int *)tsb, voff, 1);
+    w = _mm256_cmpeq_epi32(_mm256_and_si256(w, vmask), vval);
+    m = _mm256_movemask_ps(_mm256_castsi256_ps(w));
+    if (m != 0xff)
+      return r + __builtin_ctz(~m) * 188;
+    r   += 8*188;
+    len -= 8*188;
+    tsb += 8*188;
+  }
+
+  return r + mpegts_word_count_tail(tsb, len, mask, val);
+}
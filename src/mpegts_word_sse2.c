@@ -0,0 +1,47 @@
+/*
+ *  MPEG-TS packet header scanning - SSE2
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "build.h"
+#include "mpegts_word.h"
+#include <emmintrin.h>
+
+int
+mpegts_word_count_sse2
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  const __m128i vmask = _mm_set1_epi32(mask);
+  const __m128i vval  = _mm_set1_epi32(val);
+  __m128i w;
+  int r = 0, m;
+
+  while (len >= 4*188) {
+    w = _mm_setr_epi32(mpegts_word32(tsb + 0*188),
+                       mpegts_word32(tsb + 1*188),
+                       mpegts_word32(tsb + 2*188),
+                       mpegts_word32(tsb + 3*188));
+    w = _mm_cmpeq_epi32(_mm_and_si128(w, vmask), vval);
+    m = _mm_movemask_ps(_mm_castsi128_ps(w));
+    if (m != 0xf)
+      return r + __builtin_ctz(~m) * 188;
+    r   += 4*188;
+    len -= 4*188;
+    tsb += 4*188;
+  }
+
+  return r + mpegts_word_count_tail(tsb, len, mask, val);
+}
@@ -21,11 +21,16 @@
 #include "packet.h"
 #include "string.h"
 #include "atomic.h"
+#include "tvhpool.h"
 
 #ifndef PKTBUF_DATA_ALIGN
 #define PKTBUF_DATA_ALIGN 64
 #endif
 
+static tvhpool_t pkt_pool    = TVHPOOL_INITIALIZER("pkt", sizeof(th_pkt_t));
+static tvhpool_t pktbuf_pool = TVHPOOL_INITIALIZER("pktbuf", sizeof(pktbuf_t));
+static tvhpool_t pktref_pool = TVHPOOL_INITIALIZER("pktref", sizeof(th_pktref_t));
+
 /*
  *
  */
@@ -35,7 +40,7 @@ pkt_destroy(th_pkt_t *pkt)
   pktbuf_ref_dec(pkt->pkt_payload);
   pktbuf_ref_dec(pkt->pkt_meta);
 
-  free(pkt);
+  tvhpool_free(&pkt_pool, pkt);
 }
 
 
@@ -48,7 +53,8 @@ pkt_alloc(const void *data, size_t datalen, int64_t pts, int64_t dts)
 {
   th_pkt_t *pkt;
 
-  pkt = calloc(1, sizeof(th_pkt_t));
+  pkt = tvhpool_alloc(&pkt_pool);
+  memset(pkt, 0, sizeof(th_pkt_t));
   if(datalen)
     pkt->pkt_payload = pktbuf_alloc(data, datalen);
   pkt->pkt_dts = dts;
@@ -98,7 +104,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
   while((pr = TAILQ_FIRST(q)) != NULL) {
     TAILQ_REMOVE(q, pr, pr_link);
     pkt_ref_dec(pr->pr_pkt);
-    free(pr);
+    pktref_free(pr);
   }
 }
 
@@ -109,8 +115,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
 void
 pktref_enqueue(struct th_pktref_queue *q, th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
-  pr->pr_pkt = pkt;
+  th_pktref_t *pr = pktref_create(pkt);
   TAILQ_INSERT_TAIL(q, pr, pr_link);
 }
 
@@ -123,7 +128,7 @@ pktref_remove(struct th_pktref_queue *q, th_pktref_t *pr)
 {
   TAILQ_REMOVE(q, pr, pr_link);
   pkt_ref_dec(pr->pr_pkt);
-  free(pr);
+  pktref_free(pr);
 }
 
 
@@ -133,7 +138,7 @@ pktref_remove(struct th_pktref_queue *q, th_pktref_t *pr)
 th_pkt_t *
 pkt_copy_shallow(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = tvhpool_alloc(&pkt_pool);
   *n = *pkt;
 
   n->pkt_refcount = 1;
@@ -151,11 +156,20 @@ pkt_copy_shallow(th_pkt_t *pkt)
 th_pktref_t *
 pktref_create(th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = tvhpool_alloc(&pktref_pool);
   pr->pr_pkt = pkt;
   return pr;
 }
 
+/**
+ * Free the reference only (the packet reference is kept by the caller)
+ */
+void
+pktref_free(th_pktref_t *pr)
+{
+  tvhpool_free(&pktref_pool, pr);
+}
+
 /*
  *
  */
@@ -165,8 +179,8 @@ pktbuf_ref_dec(pktbuf_t *pb)
 {
   if (pb) {
     if((atomic_add(&pb->pb_refcount, -1)) == 1) {
-      free(pb->pb_data);
-      free(pb);
+      tvhpool_data_free(pb->pb_data, pb->pb_pool);
+      tvhpool_free(&pktbuf_pool, pb);
     }
   }
 }
@@ -184,12 +198,15 @@ pktbuf_ref_inc(pktbuf_t *pb)
 pktbuf_t *
 pktbuf_alloc(const void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = tvhpool_alloc(&pktbuf_pool);
   pb->pb_refcount = 1;
+  pb->pb_err = 0;
   pb->pb_size = size;
+  pb->pb_pool = 0;
+  pb->pb_data = NULL;
 
   if(size > 0) {
-    pb->pb_data = malloc(size);
+    pb->pb_data = tvhpool_data_alloc(size, &pb->pb_pool);
     if(data != NULL)
       memcpy(pb->pb_data, data, size);
   }
@@ -199,9 +216,11 @@ pktbuf_alloc(const void *data, size_t size)
 pktbuf_t *
 pktbuf_make(void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = tvhpool_alloc(&pktbuf_pool);
   pb->pb_refcount = 1;
+  pb->pb_err = 0;
   pb->pb_size = size;
+  pb->pb_pool = 0;
   pb->pb_data = data;
   return pb;
 }
@@ -209,9 +228,20 @@ pktbuf_make(void *data, size_t size)
 pktbuf_t *
 pktbuf_append(pktbuf_t *pb, const void *data, size_t size)
 {
+  uint8_t *n;
+  int cls;
+
   if (pb == NULL)
     return pktbuf_alloc(data, size);
-  pb->pb_data = realloc(pb->pb_data, pb->pb_size + size);
+  if (pb->pb_pool) {
+    n = tvhpool_data_alloc(pb->pb_size + size, &cls);
+    memcpy(n, pb->pb_data, pb->pb_size);
+    tvhpool_data_free(pb->pb_data, pb->pb_pool);
+    pb->pb_data = n;
+    pb->pb_pool = cls;
+  } else {
+    pb->pb_data = realloc(pb->pb_data, pb->pb_size + size);
+  }
   memcpy(pb->pb_data + pb->pb_size, data, size);
   pb->pb_size += size;
   return pb;
@@ -26,6 +26,7 @@
 typedef struct pktbuf {
   int pb_refcount;
   int pb_err;
+  int pb_pool;    // data size class (0 = malloc)
   uint8_t *pb_data;
   size_t pb_size;
 } pktbuf_t;
@@ -103,6 +104,8 @@ th_pkt_t *pkt_copy_shallow(th_pkt_t *pkt);
 
 th_pktref_t *pktref_create(th_pkt_t *pkt);
 
+void pktref_free(th_pktref_t *pr);
+
 /*
  *
  */
@@ -313,21 +313,72 @@ parse_aac(service_t *t, elementary_stream_t *st, const uint8_t *data,
 }
 
 
+/**
+ * Find the index of the first byte at or after 'i' which completes
+ * a 0x000001xx startcode (the 'xx' byte), taking the bytes already
+ * shifted into 'sc' into account. Returns 'len' if there is none.
+ */
+static inline int
+parse_sc_find(const uint8_t *data, int i, int len, uint32_t sc)
+{
+  const uint8_t *p, *end = data + len;
+
+  if((sc & 0xffffff) == 0x000001)
+    return i;
+  if((sc & 0xffff) == 0 && data[i] == 0x01)
+    return i + 1;
+  if(i + 1 < len && (sc & 0xff) == 0 && data[i] == 0 && data[i+1] == 0x01)
+    return i + 2;
+
+  p = data + i + 2;
+  while(p < end) {
+    p = memchr(p, 0x01, end - p);
+    if(p == NULL)
+      break;
+    if(p[-1] == 0 && p[-2] == 0)
+      return p - data + 1;
+    /* p[0] != 0, so the next possible 0x01 is three bytes ahead */
+    p += 3;
+  }
+  return len;
+}
+
 /**
  * Generic video parser
  *
  * We scan for startcodes a'la 0x000001xx and let a specific parser
- * derive further information.
+ * derive further information. Spans between startcodes are located
+ * with memchr() and copied to es_buf in one go.
  */
 static void
 parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
          packet_parser_t *vp)
 {
   uint32_t sc = st->es_startcond;
-  int i, r;
+  int i, j, r;
   sbuf_alloc(&st->es_buf, len);
 
   for(i = 0; i < len; i++) {
+    if(st->es_ssc_intercept != 1) {
+      j = parse_sc_find(data, i, len, sc);
+      if(j > i) {
+        r = j - i;
+        sbuf_alloc(&st->es_buf, r);
+        memcpy(st->es_buf.sb_data + st->es_buf.sb_ptr, data + i, r);
+        st->es_buf.sb_ptr += r;
+        if(r >= 4) {
+          sc = (uint32_t)data[j-4] << 24 | data[j-3] << 16 |
+               data[j-2] << 8 | data[j-1];
+        } else {
+          for( ; i < j; i++)
+            sc = sc << 8 | data[i];
+        }
+        i = j;
+        if(i >= len)
+          break;
+      }
+    }
+
     if(st->es_ssc_intercept == 1) {
       if(st->es_ssc_ptr < sizeof(st->es_ssc_buf))
         st->es_ssc_buf[st->es_ssc_ptr] = data[i];
@@ -307,7 +307,7 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
         streaming_target_deliver2(gh->gh_output, sm);
       }
       pkt_ref_dec(pkt);
-      free(pr);
+      pktref_free(pr);
     }
     gh->gh_passthru = 1;
     break;
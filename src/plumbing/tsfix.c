@@ -293,7 +293,7 @@ tsfix_backlog(tsfix_t *tf)
   while((pr = TAILQ_FIRST(&tf->tf_backlog)) != NULL) {
     pkt = pr->pr_pkt;
     TAILQ_REMOVE(&tf->tf_backlog, pr, pr_link);
-    free(pr);
+    pktref_free(pr);
     tfs = tfs_find(tf, pkt);
     normalize_ts(tf, tfs, pkt, 0);
   }
@@ -380,7 +380,7 @@ recover_pts(tsfix_t *tf, tfstream_t *tfs, th_pkt_t *pkt)
       break;
     }
 
-    free(pr);
+    pktref_free(pr);
     normalize_ts(tf, tfs, pkt, 1);
   }
 }
@@ -329,6 +329,7 @@ service_stream_destroy(service_t *t, elementary_stream_t *es)
   }
 
   TAILQ_REMOVE(&t->s_components, es, es_link);
+  service_stream_index(t);
 
   while ((c = LIST_FIRST(&es->es_caids)) != NULL) {
     LIST_REMOVE(c, link);
@@ -796,6 +797,7 @@ void
 service_unref(service_t *t)
 {
   if((atomic_add(&t->s_refcount, -1)) == 1) {
+    free(t->s_pid_index);
     free(t->s_nicename);
     free(t);
   }
@@ -1034,6 +1036,7 @@ service_stream_create(service_t *t, int pid,
   st->es_service = t;
 
   st->es_pid = pid;
+  service_stream_index(t);
 
   avgstat_init(&st->es_rate, 10);
   avgstat_init(&st->es_cc_errors, 10);
@@ -1054,22 +1057,64 @@ service_stream_create(service_t *t, int pid,
 
 
 
+/**
+ * Rebuild the PID index after the component list changed
+ */
+void
+service_stream_index(service_t *t)
+{
+  elementary_stream_t *st, **e;
+  int num = 0, size = 8;
+
+  TAILQ_FOREACH(st, &t->s_components, es_link)
+    num++;
+
+  free(t->s_pid_index);
+  t->s_pid_index = NULL;
+  t->s_pid_index_mask = 0;
+  if (num == 0)
+    return;
+
+  /* keep the load factor at or below one half */
+  while (size < num * 2)
+    size <<= 1;
+  t->s_pid_index = calloc(size, sizeof(elementary_stream_t *));
+  t->s_pid_index_mask = size - 1;
+
+  /* the first component wins for duplicate PIDs, as in a list walk */
+  TAILQ_FOREACH(st, &t->s_components, es_link) {
+    e = &t->s_pid_index[st->es_pid & t->s_pid_index_mask];
+    while (*e && (*e)->es_pid != st->es_pid)
+      if (++e == t->s_pid_index + size)
+        e = t->s_pid_index;
+    if (*e == NULL)
+      *e = st;
+  }
+}
+
 /**
  * Find an elementary stream in a service
  */
 elementary_stream_t *
 service_stream_find_(service_t *t, int pid)
 {
-  elementary_stream_t *st;
+  elementary_stream_t *st, **e, **end;
  
   lock_assert(&t->s_stream_mutex);
 
-  TAILQ_FOREACH(st, &t->s_components, es_link) {
-    if(st->es_pid == pid) {
+  if ((e = t->s_pid_index) == NULL)
+    return NULL;
+
+  end = e + t->s_pid_index_mask + 1;
+  e += pid & t->s_pid_index_mask;
+  while ((st = *e) != NULL) {
+    if (st->es_pid == pid) {
       t->s_last_es = st;
       t->s_last_pid = pid;
       return st;
     }
+    if (++e == end)
+      e = t->s_pid_index;
   }
   return NULL;
 }
@@ -1847,6 +1892,7 @@ sort_elementary_streams(service_t *t)
   TAILQ_INIT(&t->s_components);
   for(i = 0; i < num; i++)
     TAILQ_INSERT_TAIL(&t->s_components, v[i], es_link);
+  service_stream_index(t);
 }
 
 /**
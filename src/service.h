@@ -455,6 +455,12 @@ typedef struct service {
   int s_last_pid;
   elementary_stream_t *s_last_es;
 
+  /**
+   * PID to component index (open addressed, size is a power of two)
+   */
+  elementary_stream_t **s_pid_index;
+  int s_pid_index_mask;
+
   /**
    * Delivery pad, this is were we finally deliver all streaming output
    */
@@ -505,6 +511,8 @@ service_instance_t *service_find_instance(struct service *s,
                                           int flags, int timeout,
                                           int postpone);
 
+void service_stream_index(service_t *t);
+
 elementary_stream_t *service_stream_find_(service_t *t, int pid);
 
 static inline elementary_stream_t *
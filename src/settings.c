@@ -16,6 +16,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -26,6 +27,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <libgen.h>
+#include <time.h>
 
 #include "htsmsg.h"
 #include "htsmsg_json.h"
@@ -35,6 +38,293 @@
 
 static char *settingspath = NULL;
 
+/*
+ * Write-back queue
+ *
+ * Saves are queued (a newer save of the same path replaces the queued
+ * record) and written by the settings thread in batches. The readers
+ * and hts_settings_remove() wait for the queued writes of their path.
+ */
+#define SETTINGS_DELAY_MS  100  // coalescing delay after the first save
+#define SETTINGS_BATCH     256  // files per batch (synced together)
+
+typedef struct settings_entry {
+  RB_ENTRY(settings_entry)   se_link;
+  TAILQ_ENTRY(settings_entry) se_q;
+  char                      *se_path;
+  htsmsg_t                  *se_msg;
+} settings_entry_t;
+
+static RB_HEAD(,settings_entry)    settings_pending;
+static TAILQ_HEAD(,settings_entry) settings_queue;
+static TAILQ_HEAD(,settings_entry) settings_inflight;
+static pthread_mutex_t             settings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t              settings_cond;
+static pthread_cond_t              settings_done_cond;
+static pthread_t                   settings_tid;
+static int                         settings_running;
+static int                         settings_flush;
+
+/* Statistics */
+static int                         settings_depth;
+static int                         settings_depth_max;
+static int64_t                     settings_saves;
+static int64_t                     settings_coalesced;
+static int64_t                     settings_writes;
+static int64_t                     settings_batches;
+static int64_t                     settings_errors;
+
+static int
+settings_entry_cmp ( settings_entry_t *a, settings_entry_t *b )
+{
+  return strcmp(a->se_path, b->se_path);
+}
+
+static inline int
+settings_path_match ( const char *path, const char *prefix, size_t len )
+{
+  return !strncmp(path, prefix, len) && (path[len] == '\0' || path[len] == '/');
+}
+
+static int
+settings_busy ( const char *prefix )
+{
+  settings_entry_t *se;
+  size_t len = prefix ? strlen(prefix) : 0;
+
+  TAILQ_FOREACH(se, &settings_inflight, se_q)
+    if (!prefix || settings_path_match(se->se_path, prefix, len))
+      return 1;
+  TAILQ_FOREACH(se, &settings_queue, se_q)
+    if (!prefix || settings_path_match(se->se_path, prefix, len))
+      return 1;
+  return 0;
+}
+
+/*
+ * Wait for the queued writes of the path (NULL = all), settings_lock held
+ */
+static void
+settings_wait ( const char *prefix )
+{
+  while (settings_busy(prefix)) {
+    settings_flush = 1;
+    pthread_cond_signal(&settings_cond);
+    pthread_cond_wait(&settings_done_cond, &settings_lock);
+  }
+}
+
+static void
+settings_entry_free ( settings_entry_t *se )
+{
+  htsmsg_destroy(se->se_msg);
+  free(se->se_path);
+  free(se);
+}
+
+/*
+ * Write one file (to path.tmp), returns the open file (synced by the
+ * caller) or -1
+ */
+static int
+settings_write_tmp ( settings_entry_t *se )
+{
+  char tmppath[PATH_MAX];
+  htsbuf_queue_t hq;
+  htsbuf_data_t *hd;
+  int fd;
+
+  /* Create directories */
+  if (hts_settings_makedirs(se->se_path)) return -1;
+
+  tvhdebug("settings", "saving to %s", se->se_path);
+
+  /* Create tmp file */
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", se->se_path);
+  if((fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_RDWR, 0700)) < 0) {
+    tvhlog(LOG_ALERT, "settings", "Unable to create \"%s\" - %s",
+	    tmppath, strerror(errno));
+    return -1;
+  }
+
+  /* Store data */
+  htsbuf_queue_init(&hq, 0);
+  htsmsg_json_serialize(se->se_msg, &hq, 1);
+  TAILQ_FOREACH(hd, &hq.hq_q, hd_link)
+    if(tvh_write(fd, hd->hd_data + hd->hd_data_off, hd->hd_data_len)) {
+      tvhlog(LOG_ALERT, "settings", "Failed to write file \"%s\" - %s",
+	      tmppath, strerror(errno));
+      close(fd);
+      unlink(tmppath);
+      htsbuf_queue_flush(&hq);
+      return -1;
+    }
+  htsbuf_queue_flush(&hq);
+  return fd;
+}
+
+/*
+ * Write a batch: all tmp files, start the writeback of all of them, wait
+ * for each one, then the renames and one fsync per distinct directory
+ */
+static void
+settings_write_batch ( void )
+{
+  settings_entry_t *se;
+  char tmppath[PATH_MAX], dir[PATH_MAX], *dirs[SETTINGS_BATCH];
+  int fds[SETTINGS_BATCH], i = 0, j, n, ndirs = 0, fd, errors = 0;
+
+  TAILQ_FOREACH(se, &settings_inflight, se_q)
+    fds[i++] = settings_write_tmp(se);
+  n = i;
+
+#if defined(PLATFORM_LINUX)
+  for (i = 0; i < n; i++)
+    if (fds[i] >= 0)
+      sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+
+  /* Make the data durable before the renames */
+  i = 0;
+  TAILQ_FOREACH(se, &settings_inflight, se_q) {
+    if ((fd = fds[i++]) < 0)
+      continue;
+#if defined(PLATFORM_LINUX)
+    if (fdatasync(fd)) {
+#else
+    if (fsync(fd)) {
+#endif
+      snprintf(tmppath, sizeof(tmppath), "%s.tmp", se->se_path);
+      tvhlog(LOG_ALERT, "settings", "Failed to sync file \"%s\" - %s",
+             tmppath, strerror(errno));
+      unlink(tmppath);
+      fds[i - 1] = -1;
+    }
+    close(fd);
+  }
+
+  i = 0;
+  TAILQ_FOREACH(se, &settings_inflight, se_q) {
+    if (fds[i++] < 0) {
+      errors++;
+      continue;
+    }
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", se->se_path);
+    if (rename(tmppath, se->se_path)) {
+      unlink(tmppath);
+      errors++;
+      continue;
+    }
+    strcpy(dir, se->se_path);
+    dirname(dir);
+    for (j = 0; j < ndirs; j++)
+      if (!strcmp(dirs[j], dir))
+        break;
+    if (j < ndirs)
+      continue;
+    if ((dirs[ndirs] = strdup(dir)) != NULL) {
+      ndirs++;
+    } else if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) >= 0) {
+      fsync(fd);
+      close(fd);
+    }
+  }
+
+  for (j = 0; j < ndirs; j++) {
+    if ((fd = open(dirs[j], O_RDONLY | O_DIRECTORY)) >= 0) {
+      fsync(fd);
+      close(fd);
+    }
+    free(dirs[j]);
+  }
+
+  pthread_mutex_lock(&settings_lock);
+  settings_writes  += n - errors;
+  settings_errors  += errors;
+  settings_batches++;
+  pthread_mutex_unlock(&settings_lock);
+}
+
+static void *
+settings_thread ( void *aux )
+{
+  settings_entry_t *se;
+  struct timespec ts;
+  int i;
+
+  pthread_mutex_lock(&settings_lock);
+  while (settings_running || !TAILQ_EMPTY(&settings_queue)) {
+    if (TAILQ_EMPTY(&settings_queue)) {
+      settings_flush = 0;
+      pthread_cond_wait(&settings_cond, &settings_lock);
+      continue;
+    }
+
+    /* Give the repeated saves a chance to coalesce */
+    if (settings_running && !settings_flush) {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += SETTINGS_DELAY_MS * 1000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&settings_cond, &settings_lock, &ts);
+    }
+
+    for (i = 0; i < SETTINGS_BATCH; i++) {
+      if ((se = TAILQ_FIRST(&settings_queue)) == NULL)
+        break;
+      TAILQ_REMOVE(&settings_queue, se, se_q);
+      RB_REMOVE(&settings_pending, se, se_link);
+      TAILQ_INSERT_TAIL(&settings_inflight, se, se_q);
+      settings_depth--;
+    }
+    pthread_mutex_unlock(&settings_lock);
+
+    settings_write_batch();
+
+    pthread_mutex_lock(&settings_lock);
+    while ((se = TAILQ_FIRST(&settings_inflight)) != NULL) {
+      TAILQ_REMOVE(&settings_inflight, se, se_q);
+      settings_entry_free(se);
+    }
+    pthread_cond_broadcast(&settings_done_cond);
+  }
+  pthread_mutex_unlock(&settings_lock);
+  return NULL;
+}
+
+/**
+ * Write all queued settings (barrier)
+ */
+void
+hts_settings_flush(void)
+{
+  pthread_mutex_lock(&settings_lock);
+  settings_wait(NULL);
+  pthread_mutex_unlock(&settings_lock);
+}
+
+/**
+ *
+ */
+htsmsg_t *
+hts_settings_stats(void)
+{
+  htsmsg_t *m = htsmsg_create_map();
+
+  pthread_mutex_lock(&settings_lock);
+  htsmsg_add_u32(m, "queue_depth", settings_depth);
+  htsmsg_add_u32(m, "queue_depth_max", settings_depth_max);
+  htsmsg_add_s64(m, "saves", settings_saves);
+  htsmsg_add_s64(m, "coalesced", settings_coalesced);
+  htsmsg_add_s64(m, "writes", settings_writes);
+  htsmsg_add_s64(m, "batches", settings_batches);
+  htsmsg_add_s64(m, "errors", settings_errors);
+  pthread_mutex_unlock(&settings_lock);
+  return m;
+}
+
 /**
  *
  */
@@ -60,7 +350,17 @@ hts_settings_init(const char *confpath)
 void
 hts_settings_done(void)
 {
+  pthread_mutex_lock(&settings_lock);
+  if (settings_running) {
+    settings_running = 0;
+    pthread_cond_signal(&settings_cond);
+    pthread_mutex_unlock(&settings_lock);
+    pthread_join(settings_tid, NULL);
+    pthread_mutex_lock(&settings_lock);
+  }
   free(settingspath);
+  settingspath = NULL;
+  pthread_mutex_unlock(&settings_lock);
 }
 
 /**
@@ -128,12 +428,8 @@ void
 hts_settings_save(htsmsg_t *record, const char *pathfmt, ...)
 {
   char path[PATH_MAX];
-  char tmppath[PATH_MAX];
-  int fd;
   va_list ap;
-  htsbuf_queue_t hq;
-  htsbuf_data_t *hd;
-  int ok;
+  settings_entry_t *se, *old;
 
   if(settingspath == NULL)
     return;
@@ -143,40 +439,39 @@ hts_settings_save(htsmsg_t *record, const char *pathfmt, ...)
   _hts_settings_buildpath(path, sizeof(path), pathfmt, ap, settingspath);
   va_end(ap);
 
-  /* Create directories */
-  if (hts_settings_makedirs(path)) return;
-
-  tvhdebug("settings", "saving to %s", path);
-
-  /* Create tmp file */
-  snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
-  if((fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_RDWR, 0700)) < 0) {
-    tvhlog(LOG_ALERT, "settings", "Unable to create \"%s\" - %s",
-	    tmppath, strerror(errno));
-    return;
+  se = calloc(1, sizeof(*se));
+  se->se_path = strdup(path);
+  se->se_msg  = htsmsg_copy(record);
+
+  pthread_mutex_lock(&settings_lock);
+  if (!settings_running) {
+    settings_running = 1;
+    RB_INIT(&settings_pending);
+    TAILQ_INIT(&settings_queue);
+    TAILQ_INIT(&settings_inflight);
+    pthread_cond_init(&settings_cond, NULL);
+    pthread_cond_init(&settings_done_cond, NULL);
+    tvhthread_create(&settings_tid, NULL, settings_thread, NULL);
   }
+  settings_saves++;
+  old = RB_INSERT_SORTED(&settings_pending, se, se_link, settings_entry_cmp);
+  if (old) {
+    /* Replace the queued record, keep the queue position */
+    htsmsg_destroy(old->se_msg);
+    old->se_msg = se->se_msg;
+    se->se_msg  = NULL;
+    settings_coalesced++;
+  } else {
+    TAILQ_INSERT_TAIL(&settings_queue, se, se_q);
+    if (++settings_depth > settings_depth_max)
+      settings_depth_max = settings_depth;
+    se = NULL;
+    pthread_cond_signal(&settings_cond);
+  }
+  pthread_mutex_unlock(&settings_lock);
 
-  /* Store data */
-  ok = 1;
-  htsbuf_queue_init(&hq, 0);
-  htsmsg_json_serialize(record, &hq, 1);
-  TAILQ_FOREACH(hd, &hq.hq_q, hd_link)
-    if(tvh_write(fd, hd->hd_data + hd->hd_data_off, hd->hd_data_len)) {
-      tvhlog(LOG_ALERT, "settings", "Failed to write file \"%s\" - %s",
-	      tmppath, strerror(errno));
-      ok = 0;
-      break;
-    }
-  close(fd);
-  htsbuf_queue_flush(&hq);
-
-  /* Move */
-  if(ok) {
-    rename(tmppath, path);
-  
-  /* Delete tmp */
-  } else
-    unlink(tmppath);
+  if (se)
+    settings_entry_free(se);
 }
 
 /**
@@ -274,6 +569,9 @@ hts_settings_vload(const char *pathfmt, va_list ap, int depth)
   /* Try normal path */
   _hts_settings_buildpath(fullpath, sizeof(fullpath), 
                           pathfmt, ap, settingspath);
+  pthread_mutex_lock(&settings_lock);
+  settings_wait(fullpath);
+  pthread_mutex_unlock(&settings_lock);
   ret = hts_settings_load_path(fullpath, depth);
 
   /* Try bundle path */
@@ -326,10 +624,29 @@ hts_settings_remove(const char *pathfmt, ...)
   va_list ap;
   struct stat st;
 
+  settings_entry_t *se, *next;
+  size_t len;
+
   va_start(ap, pathfmt);
   _hts_settings_buildpath(fullpath, sizeof(fullpath),
                           pathfmt, ap, settingspath);
   va_end(ap);
+
+  /* Drop the queued saves, wait for the ones being written */
+  pthread_mutex_lock(&settings_lock);
+  if (settings_running) {
+    len = strlen(fullpath);
+    for (se = TAILQ_FIRST(&settings_queue); se; se = next) {
+      next = TAILQ_NEXT(se, se_q);
+      if (!settings_path_match(se->se_path, fullpath, len))
+        continue;
+      TAILQ_REMOVE(&settings_queue, se, se_q);
+      RB_REMOVE(&settings_pending, se, se_link);
+      settings_depth--;
+      settings_entry_free(se);
+    }
+    settings_wait(fullpath);
+  }
   if (stat(fullpath, &st) == 0) {
     if (S_ISDIR(st.st_mode))
       rmtree(fullpath);
@@ -338,6 +655,7 @@ hts_settings_remove(const char *pathfmt, ...)
       while (rmdir(dirname(fullpath)) == 0);
     }
   }
+  pthread_mutex_unlock(&settings_lock);
 }
 
 /**
@@ -354,6 +672,10 @@ hts_settings_open_file(int for_write, const char *pathfmt, ...)
   _hts_settings_buildpath(path, sizeof(path), pathfmt, ap, settingspath);
   va_end(ap);
 
+  pthread_mutex_lock(&settings_lock);
+  settings_wait(path);
+  pthread_mutex_unlock(&settings_lock);
+
   /* Create directories */
   if (for_write)
     if (hts_settings_makedirs(path)) return -1;
@@ -379,5 +701,9 @@ hts_settings_exists ( const char *pathfmt, ... )
   _hts_settings_buildpath(path, sizeof(path), pathfmt, ap, settingspath);
   va_end(ap);
 
+  pthread_mutex_lock(&settings_lock);
+  settings_wait(path);
+  pthread_mutex_unlock(&settings_lock);
+
   return (stat(path, &st) == 0);
 }
@@ -28,6 +28,10 @@ void hts_settings_done(void);
 
 void hts_settings_save(htsmsg_t *record, const char *pathfmt, ...);
 
+void hts_settings_flush(void);
+
+htsmsg_t *hts_settings_stats(void);
+
 htsmsg_t *hts_settings_load(const char *pathfmt, ...);
 
 htsmsg_t *hts_settings_load_r(int depth, const char *pathfmt, ...);
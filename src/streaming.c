@@ -25,6 +25,10 @@
 #include "atomic.h"
 #include "service.h"
 #include "timeshift.h"
+#include "tvhpool.h"
+
+static tvhpool_t streaming_msg_pool =
+  TVHPOOL_INITIALIZER("streaming_msg", sizeof(streaming_message_t));
 
 void
 streaming_pad_init(streaming_pad_t *sp)
@@ -47,6 +51,24 @@ streaming_target_init(streaming_target_t *st, st_callback_t *cb, void *opaque,
 }
 
 
+/**
+ * Payload size of a message (as accounted by the queue size limit)
+ */
+static inline size_t
+streaming_message_data_size(streaming_message_t *sm)
+{
+  if (sm->sm_type == SMT_PACKET) {
+    th_pkt_t *pkt = sm->sm_data;
+    if (pkt && pkt->pkt_payload)
+      return pkt->pkt_payload->pb_size;
+  } else if (sm->sm_type == SMT_MPEGTS) {
+    pktbuf_t *pkt_payload = sm->sm_data;
+    if (pkt_payload)
+      return pkt_payload->pb_size;
+  }
+  return 0;
+}
+
 /**
  *
  */
@@ -58,18 +80,34 @@ streaming_queue_deliver(void *opauqe, streaming_message_t *sm)
   pthread_mutex_lock(&sq->sq_mutex);
 
   /* queue size protection */
-  // TODO: would be better to update size as we go, but this would
-  //       require updates elsewhere to ensure all removals from the queue
-  //       are covered (new function)
-  if (sq->sq_maxsize && streaming_queue_size(&sq->sq_queue) >= sq->sq_maxsize)
+  if (sq->sq_maxsize && sq->sq_size >= sq->sq_maxsize) {
+    sq->sq_dropped++;
     streaming_msg_free(sm);
-  else
+  } else {
     TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
+    sq->sq_size += streaming_message_data_size(sm);
+    sq->sq_packets++;
+    if (sq->sq_size > sq->sq_size_max)
+      sq->sq_size_max = sq->sq_size;
+    if (sq->sq_packets > sq->sq_packets_max)
+      sq->sq_packets_max = sq->sq_packets;
+  }
 
   pthread_cond_signal(&sq->sq_cond);
   pthread_mutex_unlock(&sq->sq_mutex);
 }
 
+/**
+ * Remove a message from the queue, sq_mutex must be held
+ */
+void
+streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm)
+{
+  TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+  sq->sq_size -= streaming_message_data_size(sm);
+  sq->sq_packets--;
+}
+
 
 /**
  *
@@ -84,6 +122,9 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
   TAILQ_INIT(&sq->sq_queue);
 
   sq->sq_maxsize = maxsize;
+  sq->sq_size = sq->sq_size_max = 0;
+  sq->sq_packets = sq->sq_packets_max = 0;
+  sq->sq_dropped = 0;
 }
 
 /**
@@ -92,7 +133,7 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
 void
 streaming_queue_deinit(streaming_queue_t *sq)
 {
-  streaming_queue_clear(&sq->sq_queue);
+  streaming_queue_clear(sq);
   pthread_mutex_destroy(&sq->sq_mutex);
   pthread_cond_destroy(&sq->sq_cond);
 }
@@ -137,7 +178,7 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
 streaming_message_t *
 streaming_msg_create(streaming_message_type_t type)
 {
-  streaming_message_t *sm = malloc(sizeof(streaming_message_t));
+  streaming_message_t *sm = tvhpool_alloc(&streaming_msg_pool);
   sm->sm_type = type;
 #if ENABLE_TIMESHIFT
   sm->sm_time      = 0;
@@ -190,7 +231,7 @@ streaming_msg_create_code(streaming_message_type_t type, int code)
 streaming_message_t *
 streaming_msg_clone(streaming_message_t *src)
 {
-  streaming_message_t *dst = malloc(sizeof(streaming_message_t));
+  streaming_message_t *dst = tvhpool_alloc(&streaming_msg_pool);
   streaming_start_t *ss;
 
   dst->sm_type      = src->sm_type;
@@ -310,7 +351,7 @@ streaming_msg_free(streaming_message_t *sm)
   default:
     abort();
   }
-  free(sm);
+  tvhpool_free(&streaming_msg_pool, sm);
 }
 
 /**
@@ -352,14 +393,16 @@ streaming_pad_deliver(streaming_pad_t *sp, streaming_message_t *sm)
  *
  */
 void
-streaming_queue_clear(struct streaming_message_queue *q)
+streaming_queue_clear(streaming_queue_t *sq)
 {
   streaming_message_t *sm;
 
-  while((sm = TAILQ_FIRST(q)) != NULL) {
-    TAILQ_REMOVE(q, sm, sm_link);
+  while((sm = TAILQ_FIRST(&sq->sq_queue)) != NULL) {
+    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
     streaming_msg_free(sm);
   }
+  sq->sq_size = 0;
+  sq->sq_packets = 0;
 }
 
 
@@ -369,30 +412,30 @@ streaming_queue_clear(struct streaming_message_queue *q)
 size_t streaming_queue_size(struct streaming_message_queue *q)
 {
   streaming_message_t *sm;
-  int size = 0;
-
-  TAILQ_FOREACH(sm, q, sm_link) {
-    if (sm->sm_type == SMT_PACKET)
-    {
-      th_pkt_t *pkt = sm->sm_data;
-      if (pkt && pkt->pkt_payload)
-      {
-        size += pkt->pkt_payload->pb_size;
-      }
-    }
-    else if (sm->sm_type == SMT_MPEGTS)
-    {
-      pktbuf_t *pkt_payload = sm->sm_data;
-      if (pkt_payload)
-      {
-        size += pkt_payload->pb_size;
-      }
-    }
-  }
+  size_t size = 0;
+
+  TAILQ_FOREACH(sm, q, sm_link)
+    size += streaming_message_data_size(sm);
   return size;
 }
 
 
+/**
+ *
+ */
+void
+streaming_queue_add_stats(streaming_queue_t *sq, htsmsg_t *m)
+{
+  pthread_mutex_lock(&sq->sq_mutex);
+  htsmsg_add_s64(m, "queue_bytes", sq->sq_size);
+  htsmsg_add_s64(m, "queue_bytes_max", sq->sq_size_max);
+  htsmsg_add_u32(m, "queue_packets", sq->sq_packets);
+  htsmsg_add_u32(m, "queue_packets_max", sq->sq_packets_max);
+  htsmsg_add_u32(m, "queue_dropped", sq->sq_dropped);
+  pthread_mutex_unlock(&sq->sq_mutex);
+}
+
+
 /**
  *
  */
@@ -76,10 +76,14 @@ void streaming_target_init(streaming_target_t *st,
 void streaming_queue_init
   (streaming_queue_t *sq, int reject_filter, size_t maxsize);
 
-void streaming_queue_clear(struct streaming_message_queue *q);
+void streaming_queue_clear(streaming_queue_t *sq);
+
+void streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm);
 
 size_t streaming_queue_size(struct streaming_message_queue *q);
 
+void streaming_queue_add_stats(streaming_queue_t *sq, htsmsg_t *m);
+
 void streaming_queue_deinit(streaming_queue_t *sq);
 
 void streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st);
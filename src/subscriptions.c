@@ -854,12 +854,17 @@ subscription_create_msg(th_subscription_t *s)
   if(s->ths_channel != NULL)
     htsmsg_add_str(m, "channel", channel_get_name(s->ths_channel));
   
-  if(s->ths_service != NULL)
+  if(s->ths_service != NULL) {
     htsmsg_add_str(m, "service", s->ths_service->s_nicename ?: "");
+    if(s->ths_service->s_descramble != NULL)
+      tvhcsa_add_stats(&s->ths_service->s_descramble->dr_csa, m);
 
-  else if(s->ths_dvrfile != NULL)
+  } else if(s->ths_dvrfile != NULL)
     htsmsg_add_str(m, "service", s->ths_dvrfile ?: "");
 
+  if(s->ths_prch != NULL && s->ths_prch->prch_sq_used)
+    streaming_queue_add_stats(&s->ths_prch->prch_sq, m);
+
   return m;
 }
 
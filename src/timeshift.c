@@ -34,6 +34,9 @@
 
 static int timeshift_index = 0;
 
+static LIST_HEAD(,timeshift_store) timeshift_stores;
+static pthread_mutex_t             timeshift_stores_mutex;
+
 uint32_t  timeshift_enabled;
 int       timeshift_ondemand;
 char     *timeshift_path;
@@ -64,6 +67,7 @@ void timeshift_init ( void )
   uint32_t u32;
 
   timeshift_filemgr_init();
+  pthread_mutex_init(&timeshift_stores_mutex, NULL);
 
   /* Defaults */
   timeshift_enabled          = 0;                       // Disabled
@@ -167,6 +171,246 @@ timeshift_set_pts_delta ( timeshift_t *ts, int64_t pts )
     ts->pts_delta = getmonoclock() - ts_rescale(smallest, 1000000);
 }
 
+/*
+ * Change play state (keeps the shared buffer writing while needed)
+ */
+void timeshift_set_state ( timeshift_t *ts, int state )
+{
+  if ((ts->state > TS_LIVE) != (state > TS_LIVE))
+    atomic_add(&ts->store->shifted, state > TS_LIVE ? 1 : -1);
+  ts->state = state;
+}
+
+
+/*
+ * Write to the shared buffer
+ */
+static void timeshift_store_input
+  ( timeshift_store_t *tss, streaming_message_t *sm )
+{
+  if (sm->sm_type != SMT_START &&
+      tss->ondemand && atomic_add(&tss->shifted, 0) == 0) {
+    streaming_msg_free(sm);
+    return;
+  }
+  sm->sm_time = getmonoclock();
+  streaming_target_deliver2(&tss->wr_queue.sq_st, sm);
+}
+
+/*
+ * Find (or create) the shared buffer
+ *
+ * Instances with the same share_id and share_pro read from one buffer,
+ * a NULL share_id creates a private buffer.
+ */
+static timeshift_store_t *timeshift_store_get
+  ( void *share_id, void *share_pro, time_t max_time )
+{
+  timeshift_store_t *tss = NULL;
+
+  pthread_mutex_lock(&timeshift_stores_mutex);
+  if (share_id)
+    LIST_FOREACH(tss, &timeshift_stores, link)
+      if (tss->share_id == share_id && tss->share_pro == share_pro)
+        break;
+  if (!tss) {
+    tss = calloc(1, sizeof(timeshift_store_t));
+    TAILQ_INIT(&tss->files);
+    tss->share_id  = share_id;
+    tss->share_pro = share_pro;
+    tss->id        = atomic_add(&timeshift_index, 1);
+    tss->ondemand  = timeshift_ondemand;
+    tss->vididx    = -1;
+    pthread_mutex_init(&tss->rdwr_mutex, NULL);
+    pthread_mutex_init(&tss->feed_mutex, NULL);
+    streaming_queue_init(&tss->wr_queue, 0, 0);
+    tvhthread_create(&tss->wr_thread, NULL, timeshift_writer, tss);
+    if (share_id)
+      LIST_INSERT_HEAD(&timeshift_stores, tss, link);
+  }
+  tss->refcount++;
+  pthread_mutex_unlock(&timeshift_stores_mutex);
+
+  pthread_mutex_lock(&tss->rdwr_mutex);
+  if (!tss->max_time || (max_time && max_time > tss->max_time))
+    tss->max_time = max_time;
+  pthread_mutex_unlock(&tss->rdwr_mutex);
+
+  return tss;
+}
+
+/*
+ * Release the shared buffer
+ */
+static void timeshift_store_release ( timeshift_store_t *tss )
+{
+  timeshift_file_t *tsf;
+  int i;
+
+  pthread_mutex_lock(&timeshift_stores_mutex);
+  if (--tss->refcount > 0) {
+    pthread_mutex_unlock(&timeshift_stores_mutex);
+    return;
+  }
+  if (tss->share_id)
+    LIST_REMOVE(tss, link);
+  pthread_mutex_unlock(&timeshift_stores_mutex);
+
+  /* Wait for the writer */
+  streaming_target_deliver2(&tss->wr_queue.sq_st,
+                            streaming_msg_create(SMT_EXIT));
+  pthread_join(tss->wr_thread, NULL);
+  streaming_queue_deinit(&tss->wr_queue);
+
+  /* Remove files */
+  while ((tsf = TAILQ_FIRST(&tss->files)))
+    timeshift_filemgr_remove(tss, tsf, 1);
+
+  for (i = 0; i < ARRAY_SIZE(tss->sync); i++)
+    if (tss->sync[i].payload)
+      pktbuf_ref_dec(tss->sync[i].payload);
+  if (tss->smt_start)
+    streaming_msg_free(tss->smt_start);
+  free(tss->path);
+  free(tss);
+}
+
+/*
+ * Leave the shared buffer (instance state must be locked)
+ */
+static void timeshift_store_detach ( timeshift_t *ts )
+{
+  timeshift_store_t *tss = ts->store;
+
+  pthread_mutex_lock(&tss->feed_mutex);
+  if (tss->feeder == ts)
+    tss->feeder = NULL;
+  pthread_mutex_unlock(&tss->feed_mutex);
+  if (ts->ondemand) {
+    pthread_mutex_lock(&tss->rdwr_mutex);
+    timeshift_filemgr_flush(tss, NULL);
+    pthread_mutex_unlock(&tss->rdwr_mutex);
+  }
+  timeshift_store_release(tss);
+}
+
+/*
+ * Move an instance which has not synced to the shared buffer yet to
+ * a private buffer, so its own packets are buffered from the pause on
+ * (instance state must be locked, only while live)
+ */
+void timeshift_store_unshare ( timeshift_t *ts )
+{
+  timeshift_store_t *tss = ts->store;
+
+  if (ts->ts_synced || !tss->share_id)
+    return;
+  tvhdebug("timeshift", "ts %d paused before sync to buffer %d",
+           ts->id, tss->id);
+  timeshift_store_release(tss);
+  ts->store   = timeshift_store_get(NULL, NULL, ts->max_time);
+  ts->ts_miss = 0;
+}
+
+/*
+ * Feed the shared buffer
+ *
+ * All instances receive the same stream, but each has its own timebase
+ * (tsfix is per subscription). One instance (the feeder) writes the buffer
+ * in its timebase, the others learn their offset by matching their packet
+ * payloads (shared by all subscriptions of a service) against the recently
+ * written ones. An instance which never matches (e.g. it runs on another
+ * service) moves to a private buffer.
+ */
+static void timeshift_store_feed
+  ( timeshift_t *ts, streaming_message_t *sm )
+{
+  timeshift_store_t *tss = ts->store;
+  timeshift_sync_t *tsy;
+  th_pkt_t *pkt = NULL, *pkt2;
+  int i, feeder;
+
+  if (sm->sm_type == SMT_PACKET)
+    pkt = sm->sm_data;
+  else if (sm->sm_type != SMT_START &&
+           sm->sm_type != SMT_SIGNAL_STATUS &&
+           sm->sm_type != SMT_MPEGTS)
+    return;
+
+  pthread_mutex_lock(&tss->feed_mutex);
+
+  /* Elect the feeder */
+  if (!tss->feeder && (ts->ts_synced || !tss->fed)) {
+    tss->feeder = ts;
+    tss->fed    = 1;
+    if (!ts->ts_synced) {
+      ts->ts_delta  = 0;
+      ts->ts_synced = 1;
+    }
+    if (ts->smt_start && sm->sm_type != SMT_START) {
+      atomic_add(&ts->smt_start->ss_refcount, 1);
+      timeshift_store_input(tss,
+        streaming_msg_create_data(SMT_START, ts->smt_start));
+    }
+    tvhdebug("timeshift", "ts %d feeds buffer %d", ts->id, tss->id);
+  }
+  feeder = tss->feeder == ts;
+
+  /* Remember stored payloads / learn the offset */
+  if (pkt && pkt->pkt_payload && pkt->pkt_pts != PTS_UNSET) {
+    if (feeder) {
+      tsy = &tss->sync[tss->sync_idx];
+      if (tsy->payload)
+        pktbuf_ref_dec(tsy->payload);
+      tsy->payload = pktbuf_ref_inc(pkt->pkt_payload);
+      tsy->pts     = pkt->pkt_pts + ts->ts_delta;
+      tss->sync_idx = (tss->sync_idx + 1) % ARRAY_SIZE(tss->sync);
+    } else if (!ts->ts_synced) {
+      for (i = 0; i < ARRAY_SIZE(tss->sync); i++) {
+        tsy = &tss->sync[i];
+        if (tsy->payload == pkt->pkt_payload) {
+          ts->ts_delta  = tsy->pts - pkt->pkt_pts;
+          ts->ts_synced = 1;
+          tvhdebug("timeshift", "ts %d synced to buffer %d (delta %"PRId64")",
+                   ts->id, tss->id, ts->ts_delta);
+          break;
+        }
+      }
+    }
+  }
+
+  i = !ts->ts_synced && (!tss->feeder || ++ts->ts_miss > TIMESHIFT_SYNC_MISS);
+
+  pthread_mutex_unlock(&tss->feed_mutex);
+
+  /* No match, use a private buffer (only while live, nothing is read) */
+  if (i && ts->state <= TS_LIVE) {
+    tvhdebug("timeshift", "ts %d cannot share buffer %d", ts->id, tss->id);
+    timeshift_store_detach(ts);
+    ts->store = tss = timeshift_store_get(NULL, NULL, ts->max_time);
+    ts->ts_miss = 0;
+    timeshift_store_feed(ts, sm);
+    return;
+  }
+
+  if (!feeder)
+    return;
+
+  /* Write in the buffer timebase */
+  if (pkt && ts->ts_delta) {
+    pkt2 = pkt_copy_shallow(pkt);
+    if (pkt2->pkt_pts != PTS_UNSET)
+      pkt2->pkt_pts += ts->ts_delta;
+    if (pkt2->pkt_dts != PTS_UNSET)
+      pkt2->pkt_dts += ts->ts_delta;
+    sm = streaming_msg_create_pkt(pkt2);
+    pkt_ref_dec(pkt2);
+  } else {
+    sm = streaming_msg_clone(sm);
+  }
+  timeshift_store_input(tss, sm);
+}
+
 /*
  * Receive data
  */
@@ -183,16 +427,18 @@ static void timeshift_input
   if (sm->sm_type == SMT_SKIP) {
     if (ts->state >= TS_LIVE)
       timeshift_write_skip(ts->rd_pipe.wr, sm->sm_data);
+    streaming_msg_free(sm);
   } else if (sm->sm_type == SMT_SPEED) {
     if (ts->state >= TS_LIVE)
       timeshift_write_speed(ts->rd_pipe.wr, sm->sm_code);
+    streaming_msg_free(sm);
   }
 
   else {
 
     /* Start */
     if (sm->sm_type == SMT_START && ts->state == TS_INIT) {
-      ts->state  = TS_LIVE;
+      timeshift_set_state(ts, TS_LIVE);
     }
 
     if (sm->sm_type == SMT_PACKET) {
@@ -208,17 +454,6 @@ static void timeshift_input
                pktbuf_len(pkt->pkt_payload));
     }
 
-    /* Pass-thru */
-    if (ts->state <= TS_LIVE) {
-      if (sm->sm_type == SMT_START) {
-        if (ts->smt_start)
-          streaming_start_unref(ts->smt_start);
-        ts->smt_start = sm->sm_data;
-        atomic_add(&ts->smt_start->ss_refcount, 1);
-      }
-      streaming_target_deliver2(ts->output, streaming_msg_clone(sm));
-    }
-
     /* Check for exit */
     if (sm->sm_type == SMT_EXIT ||
         (sm->sm_type == SMT_STOP && sm->sm_code == 0))
@@ -228,29 +463,27 @@ static void timeshift_input
     if (sm->sm_type == SMT_PACKET && ts->pts_delta == PTS_UNSET)
       timeshift_set_pts_delta(ts, pkt->pkt_pts);
 
-    /* Buffer to disk */
-    if ((ts->state > TS_LIVE) || (!ts->ondemand && (ts->state == TS_LIVE))) {
-      sm->sm_time = getmonoclock();
-      if (sm->sm_type == SMT_PACKET) {
-        tvhtrace("timeshift",
-                 "ts %d pkt buf - stream %d type %c pts %10"PRId64
-                 " dts %10"PRId64" dur %10d len %zu",
-                 ts->id,
-                 pkt->pkt_componentindex,
-                 pkt_frametype_to_char(pkt->pkt_frametype),
-                 ts_rescale(pkt->pkt_pts, 1000000),
-                 ts_rescale(pkt->pkt_dts, 1000000),
-                 pkt->pkt_duration,
-                 pktbuf_len(pkt->pkt_payload));
+    /* Shared buffer */
+    if (!exit && ts->state != TS_EXIT) {
+      if (sm->sm_type == SMT_START) {
+        if (ts->smt_start)
+          streaming_start_unref(ts->smt_start);
+        ts->smt_start = sm->sm_data;
+        atomic_add(&ts->smt_start->ss_refcount, 1);
       }
-      streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
-    } else
+      timeshift_store_feed(ts, sm);
+    }
+
+    /* Pass-thru */
+    if (ts->state <= TS_LIVE)
+      streaming_target_deliver2(ts->output, sm);
+    else
       streaming_msg_free(sm);
 
     /* Exit/Stop */
     if (exit) {
       timeshift_write_exit(ts->rd_pipe.wr);
-      ts->state = TS_EXIT;
+      timeshift_set_state(ts, TS_EXIT);
     }
   }
 
@@ -264,39 +497,29 @@ void
 timeshift_destroy(streaming_target_t *pad)
 {
   timeshift_t *ts = (timeshift_t*)pad;
-  streaming_message_t *sm;
 
   /* Must hold global lock */
   lock_assert(&global_lock);
 
-  /* Ensure the threads exits */
-  // Note: this is a workaround for the fact the Q might have been flushed
-  //       in reader thread (VERY unlikely)
+  /* Ensure the thread exits */
   pthread_mutex_lock(&ts->state_mutex);
-  sm = streaming_msg_create(SMT_EXIT);
-  streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
   timeshift_write_exit(ts->rd_pipe.wr);
   pthread_mutex_unlock(&ts->state_mutex);
 
-  /* Wait for all threads */
+  /* Wait for the reader */
   pthread_join(ts->rd_thread, NULL);
-  pthread_join(ts->wr_thread, NULL);
-
-  /* Shut stuff down */
-  streaming_queue_deinit(&ts->wr_queue);
 
   close(ts->rd_pipe.rd);
   close(ts->rd_pipe.wr);
 
-  /* Flush files */
-  timeshift_filemgr_flush(ts, NULL);
+  /* Detach */
+  timeshift_set_state(ts, TS_EXIT);
+  timeshift_store_detach(ts);
 
   /* Release SMT_START index */
   if (ts->smt_start)
     streaming_start_unref(ts->smt_start);
 
-  if (ts->path)
-    free(ts->path);
   free(ts);
 }
 
@@ -304,10 +527,11 @@ timeshift_destroy(streaming_target_t *pad)
  * Create timeshift buffer
  *
  * max_period of buffer in seconds (0 = unlimited)
- * max_size   of buffer in bytes   (0 = unlimited)
+ * share_id   instances with the same share_id/share_pro (channel and
+ *            profile) share one buffer, NULL = private buffer
  */
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_time)
+  (streaming_target_t *out, time_t max_time, void *share_id, void *share_pro)
 {
   timeshift_t *ts = calloc(1, sizeof(timeshift_t));
   int i;
@@ -316,32 +540,24 @@ streaming_target_t *timeshift_create
   lock_assert(&global_lock);
 
   /* Setup structure */
-  TAILQ_INIT(&ts->files);
   ts->output     = out;
-  ts->path       = NULL;
-  ts->max_time   = max_time;
+  ts->store      = timeshift_store_get(share_id, share_pro, max_time);
   ts->state      = TS_INIT;
-  ts->full       = 0;
-  ts->vididx     = -1;
-  ts->id         = timeshift_index;
-  ts->ondemand   = timeshift_ondemand;
+  ts->id         = atomic_add(&timeshift_index, 1);
+  ts->ondemand   = ts->store->ondemand;
+  ts->max_time   = max_time;
   ts->pts_delta  = PTS_UNSET;
+  ts->rfd        = -1;
   for (i = 0; i < ARRAY_SIZE(ts->pts_val); i++)
     ts->pts_val[i] = PTS_UNSET;
-  pthread_mutex_init(&ts->rdwr_mutex, NULL);
   pthread_mutex_init(&ts->state_mutex, NULL);
 
   /* Initialise output */
   tvh_pipe(O_NONBLOCK, &ts->rd_pipe);
 
   /* Initialise input */
-  streaming_queue_init(&ts->wr_queue, 0, 0);
   streaming_target_init(&ts->input, timeshift_input, ts, 0);
-  tvhthread_create(&ts->wr_thread, NULL, timeshift_writer, ts);
   tvhthread_create(&ts->rd_thread, NULL, timeshift_reader, ts);
 
-  /* Update index */
-  timeshift_index++;
-
   return &ts->input;
 }
@@ -31,6 +31,8 @@ extern uint64_t  timeshift_ram_size;
 extern uint64_t  timeshift_ram_segment_size;
 extern uint64_t  timeshift_total_ram_size;
 extern int       timeshift_ram_only;
+extern uint64_t  timeshift_write_syscalls;
+extern uint64_t  timeshift_write_bytes;
 
 typedef struct timeshift_status
 {
@@ -45,7 +47,7 @@ void timeshift_term ( void );
 void timeshift_save ( void );
 
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_period);
+  (streaming_target_t *out, time_t max_period, void *share_id, void *share_pro);
 
 void timeshift_destroy(streaming_target_t *pad);
 
@@ -21,6 +21,8 @@
 
 #define TIMESHIFT_PLAY_BUF     200000 // us to buffer in TX
 #define TIMESHIFT_FILE_PERIOD      60 // number of secs in each buffer file
+#define TIMESHIFT_WBUF_SIZE    (256*1024) // bytes of coalesced file writes
+#define TIMESHIFT_WBUF_PERIOD  100000 // us data may stay in the write buffer
 
 /**
  * Indexes of import data in the stream
@@ -52,18 +54,20 @@ typedef TAILQ_HEAD(timeshift_index_data_list,timeshift_index_data) timeshift_ind
 typedef struct timeshift_file
 {
   int                           wfd;      ///< Write descriptor
-  int                           rfd;      ///< Read descriptor
   char                          *path;    ///< Full path to file
 
   time_t                        time;     ///< Files coarse timestamp
   size_t                        size;     ///< Current file size;
   int64_t                       last;     ///< Latest timestamp
   off_t                         woff;     ///< Write offset
-  off_t                         roff;     ///< Read offset
 
   uint8_t                      *ram;      ///< RAM area
   int64_t                       ram_size; ///< RAM area size in bytes
 
+  uint8_t                      *wbuf;      ///< Pending file writes
+  size_t                        wbuf_used; ///< Bytes pending in wbuf
+  int64_t                       wbuf_time; ///< Time of oldest pending byte
+
   uint8_t                       bad;      ///< File is broken
 
   int                           refcount; ///< Reader ref count
@@ -78,6 +82,53 @@ typedef struct timeshift_file
 
 typedef TAILQ_HEAD(timeshift_file_list,timeshift_file) timeshift_file_list_t;
 
+/**
+ * Recently stored payloads, used to learn the PTS offset of the
+ * instances attached to a shared buffer
+ */
+#define TIMESHIFT_SYNC_SIZE        64 // number of payloads remembered
+#define TIMESHIFT_SYNC_MISS       500 // packets before giving up sharing
+
+typedef struct timeshift_sync
+{
+  pktbuf_t                   *payload;    ///< Referenced payload
+  int64_t                     pts;        ///< Stored PTS
+} timeshift_sync_t;
+
+/**
+ * Shared buffer, one writer for all timeshift instances of a channel
+ */
+typedef struct timeshift_store {
+  LIST_ENTRY(timeshift_store) link;       ///< Shared buffer list
+  void                        *share_id;  ///< Channel (NULL = private)
+  void                        *share_pro; ///< Profile
+
+  int                         id;         ///< Reference number
+  int                         refcount;   ///< Attached instances
+  int                         shifted;    ///< Attached instances not live
+  char                        *path;      ///< Directory containing buffer
+  time_t                      max_time;   ///< Maximum period to shift
+  int                         ondemand;   ///< Whether this is an on-demand timeshift
+  uint8_t                     full;       ///< Buffer is full
+
+  pthread_mutex_t             feed_mutex; ///< Protect feeder and sync
+  struct timeshift            *feeder;    ///< Instance writing the buffer
+  int                         fed;        ///< Buffer has been written
+  timeshift_sync_t            sync[TIMESHIFT_SYNC_SIZE];
+  int                         sync_idx;   ///< Next sync slot
+
+  streaming_message_t        *smt_start;  ///< Latest stream start message
+
+  streaming_queue_t           wr_queue;   ///< Writer queue
+  pthread_t                   wr_thread;  ///< Writer thread
+
+  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
+  timeshift_file_list_t       files;      ///< List of files
+
+  int                         vididx;     ///< Index of (current) video stream
+
+} timeshift_store_t;
+
 /**
  *
  */
@@ -86,12 +137,16 @@ typedef struct timeshift {
   streaming_target_t          input;      ///< Input source
   streaming_target_t          *output;    ///< Output dest
 
+  timeshift_store_t           *store;     ///< Shared buffer
+
   int                         id;         ///< Reference number
-  char                        *path;      ///< Directory containing buffer
-  time_t                      max_time;   ///< Maximum period to shift
   int                         ondemand;   ///< Whether this is an on-demand timeshift
+  time_t                      max_time;   ///< Maximum period to shift
   int64_t                     pts_delta;  ///< Delta between system clock and PTS
   int64_t                     pts_val[6]; ///< Decision PTS values for multiple packets
+  int64_t                     ts_delta;   ///< Shared buffer PTS minus own PTS
+  int                         ts_synced;  ///< ts_delta is known
+  int                         ts_miss;    ///< Packets not matched in the buffer
 
   enum {
     TS_INIT,
@@ -101,23 +156,23 @@ typedef struct timeshift {
     TS_PLAY,
   }                           state;       ///< Play state
   pthread_mutex_t             state_mutex; ///< Protect state changes
-  uint8_t                     full;        ///< Buffer is full
   
   streaming_start_t          *smt_start;   ///< Current stream makeup
 
-  streaming_queue_t           wr_queue;   ///< Writer queue
-  pthread_t                   wr_thread;  ///< Writer thread
-
   pthread_t                   rd_thread;  ///< Reader thread
   th_pipe_t                   rd_pipe;    ///< Message passing to reader
 
-  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
-  timeshift_file_list_t       files;      ///< List of files
-
-  int                         vididx;     ///< Index of (current) video stream
+  int                         rfd;        ///< Read descriptor (current file)
+  off_t                       roff;       ///< Read offset (current file)
 
 } timeshift_t;
 
+/*
+ * State
+ */
+void timeshift_set_state ( timeshift_t *ts, int state );
+void timeshift_store_unshare ( timeshift_t *ts );
+
 /*
  * Write functions
  */
@@ -130,8 +185,9 @@ ssize_t timeshift_write_speed   ( int fd, int speed );
 ssize_t timeshift_write_stop    ( int fd, int code );
 ssize_t timeshift_write_exit    ( int fd );
 ssize_t timeshift_write_eof     ( timeshift_file_t *tsf );
+int     timeshift_write_flush   ( timeshift_file_t *tsf );
 
-void timeshift_writer_flush ( timeshift_t *ts );
+void timeshift_writer_flush ( timeshift_store_t *tss );
 
 /*
  * Threads
@@ -147,18 +203,18 @@ void timeshift_filemgr_term     ( void );
 int  timeshift_filemgr_makedirs ( int ts_index, char *buf, size_t len );
 
 timeshift_file_t *timeshift_filemgr_get
-  ( timeshift_t *ts, int create );
+  ( timeshift_store_t *tss, int create );
 timeshift_file_t *timeshift_filemgr_oldest
-  ( timeshift_t *ts );
+  ( timeshift_store_t *tss );
 timeshift_file_t *timeshift_filemgr_newest
-  ( timeshift_t *ts );
+  ( timeshift_store_t *tss );
 timeshift_file_t *timeshift_filemgr_prev
   ( timeshift_file_t *ts, int *end, int keep );
 timeshift_file_t *timeshift_filemgr_next
   ( timeshift_file_t *ts, int *end, int keep );
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force );
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end );
+  ( timeshift_store_t *tss, timeshift_file_t *tsf, int force );
+void timeshift_filemgr_flush ( timeshift_store_t *tss, timeshift_file_t *end );
 void timeshift_filemgr_close ( timeshift_file_t *tsf );
 
 #endif /* __TVH_TIMESHIFT_PRIVATE_H__ */
@@ -40,6 +40,8 @@ static pthread_cond_t        timeshift_reaper_cond;
 
 uint64_t                     timeshift_total_size;
 uint64_t                     timeshift_total_ram_size;
+uint64_t                     timeshift_write_syscalls;
+uint64_t                     timeshift_write_bytes;
 
 /* **************************************************************************
  * File reaper thread
@@ -91,6 +93,7 @@ static void* timeshift_reaper_callback ( void *p )
     }
     free(tsf->path);
     free(tsf->ram);
+    free(tsf->wbuf);
     free(tsf);
 
     pthread_mutex_lock(&timeshift_reaper_lock);
@@ -159,27 +162,29 @@ void timeshift_filemgr_close ( timeshift_file_t *tsf )
     if (tsf->ram)
       atomic_add_u64(&timeshift_total_ram_size, r);
   }
+  timeshift_write_flush(tsf);
   if (tsf->wfd >= 0)
     close(tsf->wfd);
   tsf->wfd = -1;
+  free(tsf->wbuf);
+  tsf->wbuf = NULL;
 }
 
 /*
  * Remove file
  */
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force )
+  ( timeshift_store_t *tss, timeshift_file_t *tsf, int force )
 {
   if (tsf->wfd >= 0)
     close(tsf->wfd);
-  assert(tsf->rfd < 0);
 #if ENABLE_TRACE
   if (tsf->path)
-    tvhdebug("timeshift", "ts %d remove %s", ts->id, tsf->path);
+    tvhdebug("timeshift", "ts %d remove %s", tss->id, tsf->path);
   else
-    tvhdebug("timeshift", "ts %d RAM segment remove time %li", ts->id, (long)tsf->time);
+    tvhdebug("timeshift", "ts %d RAM segment remove time %li", tss->id, (long)tsf->time);
 #endif
-  TAILQ_REMOVE(&ts->files, tsf, link);
+  TAILQ_REMOVE(&tss->files, tsf, link);
   atomic_add_u64(&timeshift_total_size, -tsf->size);
   if (tsf->ram)
     atomic_add_u64(&timeshift_total_ram_size, -tsf->size);
@@ -187,14 +192,14 @@ void timeshift_filemgr_remove
 }
 
 /*
- * Flush all files
+ * Flush all files (up to the first one still in use by a reader)
  */
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
+void timeshift_filemgr_flush ( timeshift_store_t *tss, timeshift_file_t *end )
 {
   timeshift_file_t *tsf;
-  while ((tsf = TAILQ_FIRST(&ts->files))) {
-    if (tsf == end) break;
-    timeshift_filemgr_remove(ts, tsf, 1);
+  while ((tsf = TAILQ_FIRST(&tss->files))) {
+    if (tsf == end || tsf->refcount) break;
+    timeshift_filemgr_remove(tss, tsf, 1);
   }
 }
 
@@ -202,7 +207,7 @@ void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
  *
  */
 static timeshift_file_t * timeshift_filemgr_file_init
-  ( timeshift_t *ts, time_t time )
+  ( timeshift_store_t *tss, time_t time )
 {
   timeshift_file_t *tsf;
 
@@ -210,10 +215,9 @@ static timeshift_file_t * timeshift_filemgr_file_init
   tsf->time     = time;
   tsf->last     = getmonoclock();
   tsf->wfd      = -1;
-  tsf->rfd      = -1;
   TAILQ_INIT(&tsf->iframes);
   TAILQ_INIT(&tsf->sstart);
-  TAILQ_INSERT_TAIL(&ts->files, tsf, link);
+  TAILQ_INSERT_TAIL(&tss->files, tsf, link);
   pthread_mutex_init(&tsf->ram_lock, NULL);
   return tsf;
 }
@@ -221,30 +225,29 @@ static timeshift_file_t * timeshift_filemgr_file_init
 /*
  * Get current / new file
  */
-timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
+timeshift_file_t *timeshift_filemgr_get ( timeshift_store_t *tss, int create )
 {
   int fd;
   struct timespec tp;
   timeshift_file_t *tsf_tl, *tsf_hd, *tsf_tmp;
-  timeshift_index_data_t *ti;
   char path[PATH_MAX];
   time_t time;
 
   /* Return last file */
   if (!create)
-    return timeshift_filemgr_newest(ts);
+    return timeshift_filemgr_newest(tss);
 
   /* No space */
-  if (ts->full)
+  if (tss->full)
     return NULL;
 
   /* Store to file */
   clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
   time   = tp.tv_sec / TIMESHIFT_FILE_PERIOD;
-  tsf_tl = TAILQ_LAST(&ts->files, timeshift_file_list);
+  tsf_tl = TAILQ_LAST(&tss->files, timeshift_file_list);
   if (!tsf_tl || tsf_tl->time != time ||
       (tsf_tl->ram && tsf_tl->woff >= timeshift_ram_segment_size)) {
-    tsf_hd = TAILQ_FIRST(&ts->files);
+    tsf_hd = TAILQ_FIRST(&tss->files);
 
     /* Close existing */
     if (tsf_tl)
@@ -252,15 +255,15 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
 
     /* Check period */
     if (!timeshift_unlimited_period &&
-        ts->max_time && tsf_hd && tsf_tl) {
+        tss->max_time && tsf_hd && tsf_tl) {
       time_t d = (tsf_tl->time - tsf_hd->time) * TIMESHIFT_FILE_PERIOD;
-      if (d > (ts->max_time+5)) {
+      if (d > (tss->max_time+5)) {
         if (!tsf_hd->refcount) {
-          timeshift_filemgr_remove(ts, tsf_hd, 0);
+          timeshift_filemgr_remove(tss, tsf_hd, 0);
           tsf_hd = NULL;
         } else {
-          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-          ts->full = 1;
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tss->id);
+          tss->full = 1;
         }
       }
     }
@@ -271,26 +274,26 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
 
       /* Remove the last file (if we can) */
       if (tsf_hd && !tsf_hd->refcount) {
-        timeshift_filemgr_remove(ts, tsf_hd, 0);
+        timeshift_filemgr_remove(tss, tsf_hd, 0);
 
       /* Full */
       } else {
-        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-        ts->full = 1;
+        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tss->id);
+        tss->full = 1;
       }
     }
 
     /* Create new file */
     tsf_tmp = NULL;
-    if (!ts->full) {
+    if (!tss->full) {
 
       tvhtrace("timeshift", "ts %d RAM total %"PRId64" requested %"PRId64" segment %"PRId64,
-                   ts->id, atomic_pre_add_u64(&timeshift_total_ram_size, 0),
+                   tss->id, atomic_pre_add_u64(&timeshift_total_ram_size, 0),
                    timeshift_ram_size, timeshift_ram_segment_size);
       if (timeshift_ram_size >= 8*1024*1024 &&
           atomic_pre_add_u64(&timeshift_total_ram_size, 0) <
             timeshift_ram_size + (timeshift_ram_segment_size / 2)) {
-        tsf_tmp = timeshift_filemgr_file_init(ts, time);
+        tsf_tmp = timeshift_filemgr_file_init(tss, time);
         tsf_tmp->ram_size = MIN(16*1024*1024, timeshift_ram_segment_size);
         tsf_tmp->ram = malloc(tsf_tmp->ram_size);
         if (!tsf_tmp->ram) {
@@ -298,23 +301,23 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
           tsf_tmp = NULL;
         } else {
           tvhtrace("timeshift", "ts %d create RAM segment with %"PRId64" bytes (time %li)",
-                   ts->id, tsf_tmp->ram_size, (long)time);
+                   tss->id, tsf_tmp->ram_size, (long)time);
         }
       }
       
       if (!tsf_tmp && !timeshift_ram_only) {
         /* Create directories */
-        if (!ts->path) {
-          if (timeshift_filemgr_makedirs(ts->id, path, sizeof(path)))
+        if (!tss->path) {
+          if (timeshift_filemgr_makedirs(tss->id, path, sizeof(path)))
             return NULL;
-          ts->path = strdup(path);
+          tss->path = strdup(path);
         }
 
         /* Create File */
-        snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, ts->path, time);
-        tvhtrace("timeshift", "ts %d create file %s", ts->id, path);
+        snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, tss->path, time);
+        tvhtrace("timeshift", "ts %d create file %s", tss->id, path);
         if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
-          tsf_tmp = timeshift_filemgr_file_init(ts, time);
+          tsf_tmp = timeshift_filemgr_file_init(tss, time);
           tsf_tmp->wfd = fd;
           tsf_tmp->path = strdup(path);
         }
@@ -322,11 +325,11 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
 
       if (tsf_tmp) {
         /* Copy across last start message */
-        if (tsf_tl && (ti = TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list))) {
+        if (tss->smt_start) {
           tvhtrace("timeshift", "ts %d copy smt_start to new file",
-                   ts->id);
+                   tss->id);
           timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
-          ti2->data = streaming_msg_clone(ti->data);
+          ti2->data = streaming_msg_clone(tss->smt_start);
           TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
         }
       }
@@ -366,9 +369,9 @@ timeshift_file_t *timeshift_filemgr_prev
 /*
  * Get the oldest file
  */
-timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_oldest ( timeshift_store_t *tss )
 {
-  timeshift_file_t *tsf = TAILQ_FIRST(&ts->files);
+  timeshift_file_t *tsf = TAILQ_FIRST(&tss->files);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -377,9 +380,9 @@ timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
 /*
  * Get the newest file
  */
-timeshift_file_t *timeshift_filemgr_newest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_newest ( timeshift_store_t *tss )
 {
-  timeshift_file_t *tsf = TAILQ_LAST(&ts->files, timeshift_file_list);
+  timeshift_file_t *tsf = TAILQ_LAST(&tss->files, timeshift_file_list);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -41,30 +41,32 @@
  * File Reading
  * *************************************************************************/
 
-static ssize_t _read_buf ( timeshift_file_t *tsf, int fd, void *buf, size_t size )
+static ssize_t _read_buf
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, void *buf, size_t size )
 {
   if (tsf && tsf->ram) {
-    if (tsf->roff + size > tsf->woff) return -1;
+    if (ts->roff + size > tsf->woff) return -1;
     pthread_mutex_lock(&tsf->ram_lock);
-    memcpy(buf, tsf->ram + tsf->roff, size);
-    tsf->roff += size;
+    memcpy(buf, tsf->ram + ts->roff, size);
+    ts->roff += size;
     pthread_mutex_unlock(&tsf->ram_lock);
     return size;
   } else {
-    size = read(tsf ? tsf->rfd : fd, buf, size);
+    size = read(tsf ? ts->rfd : fd, buf, size);
     if (size > 0 && tsf)
-      tsf->roff += size;
+      ts->roff += size;
     return size;
   }
 }
 
-static ssize_t _read_pktbuf ( timeshift_file_t *tsf, int fd, pktbuf_t **pktbuf )
+static ssize_t _read_pktbuf
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, pktbuf_t **pktbuf )
 {
   ssize_t r, cnt = 0;
   size_t sz;
 
   /* Size */
-  r = _read_buf(tsf, fd, &sz, sizeof(sz));
+  r = _read_buf(ts, tsf, fd, &sz, sizeof(sz));
   if (r < 0) return -1;
   if (r != sizeof(sz)) return 0;
   cnt += r;
@@ -77,10 +79,10 @@ static ssize_t _read_pktbuf ( timeshift_file_t *tsf, int fd, pktbuf_t **pktbuf )
 
   /* Data */
   *pktbuf = pktbuf_alloc(NULL, sz);
-  r = _read_buf(tsf, fd, (*pktbuf)->pb_data, sz);
+  r = _read_buf(ts, tsf, fd, (*pktbuf)->pb_data, sz);
   if (r != sz) {
-    free((*pktbuf)->pb_data);
-    free(*pktbuf);
+    pktbuf_ref_dec(*pktbuf);
+    *pktbuf = NULL;
     return r < 0 ? -1 : 0;
   }
   cnt += r;
@@ -89,7 +91,8 @@ static ssize_t _read_pktbuf ( timeshift_file_t *tsf, int fd, pktbuf_t **pktbuf )
 }
 
 
-static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **sm )
+static ssize_t _read_msg
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, streaming_message_t **sm )
 {
   ssize_t r, cnt = 0;
   size_t sz;
@@ -102,7 +105,7 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   *sm = NULL;
 
   /* Size */
-  r = _read_buf(tsf, fd, &sz, sizeof(sz));
+  r = _read_buf(ts, tsf, fd, &sz, sizeof(sz));
   if (r < 0) return -1;
   if (r != sizeof(sz)) return 0;
   cnt += r;
@@ -114,13 +117,13 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   if (sz > 1024 * 1024) return -1;
 
   /* Type */
-  r = _read_buf(tsf, fd, &type, sizeof(type));
+  r = _read_buf(ts, tsf, fd, &type, sizeof(type));
   if (r < 0) return -1;
   if (r != sizeof(type)) return 0;
   cnt += r;
 
   /* Time */
-  r = _read_buf(tsf, fd, &time, sizeof(time));
+  r = _read_buf(ts, tsf, fd, &time, sizeof(time));
   if (r < 0) return -1;
   if (r != sizeof(time)) return 0;
   cnt += r;
@@ -144,7 +147,7 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
     case SMT_EXIT:
     case SMT_SPEED:
       if (sz != sizeof(code)) return -1;
-      r = _read_buf(tsf, fd, &code, sz);
+      r = _read_buf(ts, tsf, fd, &code, sz);
       if (r != sz) {
         if (r < 0) return -1;
         return 0;
@@ -157,25 +160,37 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
     case SMT_SIGNAL_STATUS:
     case SMT_MPEGTS:
     case SMT_PACKET:
-      data = malloc(sz);
-      r = _read_buf(tsf, fd, data, sz);
+      if (type == SMT_PACKET) {
+        if (sz != sizeof(th_pkt_t)) return -1;
+        data = pkt_alloc(NULL, 0, PTS_UNSET, PTS_UNSET);
+      } else {
+        data = malloc(sz);
+      }
+      r = _read_buf(ts, tsf, fd, data, sz);
+      if (type == SMT_PACKET) {
+        th_pkt_t *pkt = data;
+        pkt->pkt_payload  = pkt->pkt_meta = NULL;
+        pkt->pkt_refcount = 1;
+      }
       if (r != sz) {
-        free(data);
+        if (type == SMT_PACKET)
+          pkt_ref_dec(data);
+        else
+          free(data);
         if (r < 0) return -1;
         return 0;
       }
       if (type == SMT_PACKET) {
         th_pkt_t *pkt = data;
-        pkt->pkt_payload  = pkt->pkt_meta = NULL;
         pkt->pkt_refcount = 0;
         *sm = streaming_msg_create_pkt(pkt);
-        r   = _read_pktbuf(tsf, fd, &pkt->pkt_meta);
+        r   = _read_pktbuf(ts, tsf, fd, &pkt->pkt_meta);
         if (r < 0) {
           streaming_msg_free(*sm);
           return r;
         }
         cnt += r;
-        r   = _read_pktbuf(tsf, fd, &pkt->pkt_payload);
+        r   = _read_pktbuf(ts, tsf, fd, &pkt->pkt_payload);
         if (r < 0) {
           streaming_msg_free(*sm);
           return r;
@@ -212,12 +227,55 @@ static streaming_message_t *_timeshift_find_sstart
   return ti ? ti->data : NULL;
 }
 
+/*
+ * The shared buffer holds its own copy of the stream start, only
+ * forward it when the stream makeup really changed
+ */
+static int _timeshift_start_changed
+  ( streaming_start_t *ss, streaming_start_t *cur )
+{
+  int i;
+
+  if (ss == cur)
+    return 0;
+  if (cur == NULL || ss->ss_num_components != cur->ss_num_components)
+    return 1;
+  for (i = 0; i < ss->ss_num_components; i++)
+    if (ss->ss_components[i].ssc_index != cur->ss_components[i].ssc_index ||
+        ss->ss_components[i].ssc_type  != cur->ss_components[i].ssc_type  ||
+        ss->ss_components[i].ssc_pid   != cur->ss_components[i].ssc_pid)
+      return 1;
+  return 0;
+}
+
+/*
+ * Move a buffered packet to the timeline of this instance
+ */
+static int _timeshift_pkt_shift ( timeshift_t *ts, th_pkt_t *pkt )
+{
+  int64_t delta = ts->ts_delta;
+
+  if (!ts->ts_synced)
+    return 0;
+  if (pkt->pkt_pts != PTS_UNSET) {
+    if (pkt->pkt_pts < delta)
+      return 0;
+    pkt->pkt_pts -= delta;
+  }
+  if (pkt->pkt_dts != PTS_UNSET) {
+    if (pkt->pkt_dts < delta)
+      return 0;
+    pkt->pkt_dts -= delta;
+  }
+  return 1;
+}
+
 static timeshift_index_iframe_t *_timeshift_first_frame
-  ( timeshift_t *ts )
+  ( timeshift_store_t *tss )
 { 
   int end;
   timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_oldest(ts);
+  timeshift_file_t *tsf = timeshift_filemgr_oldest(tss);
   while (tsf && !tsi) {
     if (!(tsi = TAILQ_FIRST(&tsf->iframes))) {
       tsf = timeshift_filemgr_next(tsf, &end, 0);
@@ -229,11 +287,11 @@ static timeshift_index_iframe_t *_timeshift_first_frame
 }
 
 static timeshift_index_iframe_t *_timeshift_last_frame
-  ( timeshift_t *ts )
+  ( timeshift_store_t *tss )
 {
   int end;
   timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_get(ts, 0);
+  timeshift_file_t *tsf = timeshift_filemgr_get(tss, 0);
   while (tsf && !tsi) {
     if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list))) {
       tsf = timeshift_filemgr_prev(tsf, &end, 0);
@@ -245,7 +303,7 @@ static timeshift_index_iframe_t *_timeshift_last_frame
 }
 
 static int _timeshift_skip
-  ( timeshift_t *ts, int64_t req_time, int64_t cur_time,
+  ( timeshift_store_t *tss, int64_t req_time, int64_t cur_time,
     timeshift_file_t *cur_file, timeshift_file_t **new_file,
     timeshift_index_iframe_t **iframe )
 {
@@ -303,7 +361,7 @@ static int _timeshift_skip
   /* Find start/end of buffer */
   if (end) {
     if (back) {
-      tsf = timeshift_filemgr_oldest(ts);
+      tsf = timeshift_filemgr_oldest(tss);
       tsi = NULL;
       while (tsf && !tsi) {
         if (!(tsi = TAILQ_FIRST(&tsf->iframes)))
@@ -311,7 +369,7 @@ static int _timeshift_skip
       }
       end = -1;
     } else {
-      tsf = timeshift_filemgr_get(ts, 0);
+      tsf = timeshift_filemgr_get(tss, 0);
       tsi = NULL;
       while (tsf && !tsi) {
         if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
@@ -330,6 +388,22 @@ static int _timeshift_skip
   return end;
 }
 
+/*
+ * Drop the current file (the store lock must be held)
+ */
+static void _timeshift_release
+  ( timeshift_t *ts, timeshift_file_t **cur_file )
+{
+  if (ts->rfd >= 0) {
+    close(ts->rfd);
+    ts->rfd = -1;
+  }
+  if (*cur_file) {
+    (*cur_file)->refcount--;
+    *cur_file = NULL;
+  }
+}
+
 /*
  * Output packet
  */
@@ -337,6 +411,7 @@ static int _timeshift_read
   ( timeshift_t *ts, timeshift_file_t **cur_file,
     streaming_message_t **sm, int *wait )
 {
+  timeshift_store_t *tss = ts->store;
   timeshift_file_t *tsf = *cur_file;
   ssize_t r;
   off_t off, ooff;
@@ -344,21 +419,22 @@ static int _timeshift_read
   if (tsf) {
 
     /* Open file */
-    if (tsf->rfd < 0 && !tsf->ram) {
-      tsf->rfd = open(tsf->path, O_RDONLY);
-      tvhtrace("timeshift", "ts %d open file %s (fd %i)", ts->id, tsf->path, tsf->rfd);
-      if (tsf->rfd < 0)
+    if (ts->rfd < 0 && !tsf->ram) {
+      ts->rfd = open(tsf->path, O_RDONLY);
+      tvhtrace("timeshift", "ts %d open file %s (fd %i)", ts->id, tsf->path, ts->rfd);
+      if (ts->rfd < 0)
         return -1;
     }
-    tvhtrace("timeshift", "ts %d seek to %jd (fd %i)", ts->id, tsf->roff, tsf->rfd);
-    if (tsf->rfd >= 0)
-      if ((off = lseek(tsf->rfd, tsf->roff, SEEK_SET)) != tsf->roff)
+    tvhtrace("timeshift", "ts %d seek to %jd (fd %i)", ts->id, ts->roff, ts->rfd);
+    if (ts->rfd >= 0)
+      if ((off = lseek(ts->rfd, ts->roff, SEEK_SET)) != ts->roff)
         tvherror("timeshift", "seek to %s failed (off %"PRId64" != %"PRId64"): %s",
-                 tsf->path, (int64_t)tsf->roff, (int64_t)off, strerror(errno));
+                 tsf->path, (int64_t)ts->roff, (int64_t)off, strerror(errno));
 
+again:
     /* Read msg */
-    ooff = tsf->roff;
-    r = _read_msg(tsf, -1, sm);
+    ooff = ts->roff;
+    r = _read_msg(ts, tsf, -1, sm);
     if (r < 0) {
       streaming_message_t *e = streaming_msg_create_code(SMT_STOP, SM_CODE_UNDEFINED_ERROR);
       streaming_target_deliver2(ts->output, e);
@@ -373,37 +449,46 @@ static int _timeshift_read
 
     /* Incomplete */
     if (r == 0) {
-      if (tsf->rfd >= 0) {
-        tvhtrace("timeshift", "ts %d seek to %jd (fd %i) (incomplete)", ts->id, tsf->roff, tsf->rfd);
-        if ((off = lseek(tsf->rfd, ooff, SEEK_SET)) != ooff)
+      if (ts->rfd >= 0) {
+        tvhtrace("timeshift", "ts %d seek to %jd (fd %i) (incomplete)", ts->id, ts->roff, ts->rfd);
+        if ((off = lseek(ts->rfd, ooff, SEEK_SET)) != ooff)
           tvherror("timeshift", "seek to %s failed (off %"PRId64" != %"PRId64"): %s",
                    tsf->path, (int64_t)ooff, (int64_t)off, strerror(errno));
       }
-      tsf->roff = ooff;
+      ts->roff = ooff;
       return 0;
     }
 
     /* Special case - EOF */
-    if (r == sizeof(size_t) || tsf->roff > tsf->size) {
-      if (tsf->rfd >= 0)
-        close(tsf->rfd);
-      tsf->rfd  = -1;
-      pthread_mutex_lock(&ts->rdwr_mutex);
+    if (r == sizeof(size_t) || ts->roff > tsf->size) {
+      if (ts->rfd >= 0)
+        close(ts->rfd);
+      ts->rfd   = -1;
+      pthread_mutex_lock(&tss->rdwr_mutex);
       *cur_file = timeshift_filemgr_next(tsf, NULL, 0);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
-      tsf->roff = 0; // reset
+      pthread_mutex_unlock(&tss->rdwr_mutex);
+      ts->roff  = 0; // reset
       *wait     = 0;
 
     /* Check SMT_START index */
     } else {
       streaming_message_t *ssm = _timeshift_find_sstart(*cur_file, (*sm)->sm_time);
       if (ssm && ssm->sm_data != ts->smt_start) {
-        streaming_target_deliver2(ts->output, streaming_msg_clone(ssm));
+        if (_timeshift_start_changed(ssm->sm_data, ts->smt_start))
+          streaming_target_deliver2(ts->output, streaming_msg_clone(ssm));
         if (ts->smt_start)
           streaming_start_unref(ts->smt_start);
         ts->smt_start = ssm->sm_data;
         atomic_add(&ts->smt_start->ss_refcount, 1);
       }
+
+      /* Shift to the timeline of this instance */
+      if ((*sm)->sm_type == SMT_PACKET &&
+          !_timeshift_pkt_shift(ts, (*sm)->sm_data)) {
+        streaming_msg_free(*sm);
+        *sm = NULL;
+        goto again;
+      }
     }
   }
   return 0;
@@ -444,6 +529,7 @@ static int _timeshift_flush_to_live
 void *timeshift_reader ( void *p )
 {
   timeshift_t *ts = p;
+  timeshift_store_t *tss;
   int nfds, end, run = 1, wait = -1;
   timeshift_file_t *cur_file = NULL;
   int cur_speed = 100, keyframe_mode = 0;
@@ -479,10 +565,11 @@ void *timeshift_reader ( void *p )
     skip      = NULL;
     now       = getmonoclock();
 
-    /* Control */
+    /* Control (the buffer may only change while live) */
     pthread_mutex_lock(&ts->state_mutex);
+    tss = ts->store;
     if (nfds == 1) {
-      if (_read_msg(NULL, ts->rd_pipe.rd, &ctrl) > 0) {
+      if (_read_msg(NULL, NULL, ts->rd_pipe.rd, &ctrl) > 0) {
 
         /* Exit */
         if (ctrl->sm_type == SMT_EXIT) {
@@ -520,14 +607,17 @@ void *timeshift_reader ( void *p )
               } else {
                 tvhlog(LOG_DEBUG, "timeshift", "ts %d enter timeshift mode",
                        ts->id);
-                timeshift_writer_flush(ts);
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file    = timeshift_filemgr_get(ts, 1))) {
-                  cur_file->roff = cur_file->size;
+                timeshift_store_unshare(ts);
+                tss = ts->store;
+                timeshift_writer_flush(tss);
+                pthread_mutex_lock(&tss->rdwr_mutex);
+                _timeshift_release(ts, &cur_file);
+                if ((cur_file    = timeshift_filemgr_get(tss, 1))) {
+                  ts->roff       = cur_file->size;
                   pause_time     = cur_file->last;
                   last_time      = pause_time;
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
+                pthread_mutex_unlock(&tss->rdwr_mutex);
               }
 
             /* Buffer playback */
@@ -553,7 +643,7 @@ void *timeshift_reader ( void *p )
             play_time  = getmonoclock();
             cur_speed  = speed;
             if (speed != 100 || ts->state != TS_LIVE)
-              ts->state = speed == 0 ? TS_PAUSE : TS_PLAY;
+              timeshift_set_state(ts, speed == 0 ? TS_PAUSE : TS_PLAY);
             tvhlog(LOG_DEBUG, "timeshift", "ts %d change speed %d",
                    ts->id, speed);
           }
@@ -571,11 +661,11 @@ void *timeshift_reader ( void *p )
               if (ts->state != TS_LIVE) {
 
                 /* Reset */
-                if (ts->full) {
-                  pthread_mutex_lock(&ts->rdwr_mutex);
-                  timeshift_filemgr_flush(ts, NULL);
-                  ts->full = 0;
-                  pthread_mutex_unlock(&ts->rdwr_mutex);
+                if (tss->full) {
+                  pthread_mutex_lock(&tss->rdwr_mutex);
+                  timeshift_filemgr_flush(tss, NULL);
+                  tss->full = 0;
+                  pthread_mutex_unlock(&tss->rdwr_mutex);
                 }
 
                 /* Release */
@@ -603,15 +693,17 @@ void *timeshift_reader ( void *p )
 
               /* Live playback (stage1) */
               if (ts->state == TS_LIVE) {
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file    = timeshift_filemgr_get(ts, !ts->ondemand))) {
-                  cur_file->roff = cur_file->size;
+                timeshift_writer_flush(tss);
+                pthread_mutex_lock(&tss->rdwr_mutex);
+                _timeshift_release(ts, &cur_file);
+                if ((cur_file    = timeshift_filemgr_get(tss, !ts->ondemand))) {
+                  ts->roff       = cur_file->size;
                   last_time      = cur_file->last;
                 } else {
                   tvhlog(LOG_ERR, "timeshift", "ts %d failed to get current file", ts->id);
                   skip = NULL;
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
+                pthread_mutex_unlock(&tss->rdwr_mutex);
               }
 
               /* May have failed */
@@ -626,7 +718,7 @@ void *timeshift_reader ( void *p )
                     tvhlog(LOG_DEBUG, "timeshift", "ts %d skip ignored, already live", ts->id);
                     skip = NULL;
                   } else {
-                    ts->state = TS_PLAY;
+                    timeshift_set_state(ts, TS_PLAY);
                   }
                 }
               }
@@ -672,9 +764,10 @@ void *timeshift_reader ( void *p )
       timeshift_status_t *status;
       timeshift_index_iframe_t *fst, *lst;
       status = calloc(1, sizeof(timeshift_status_t));
-      fst    = _timeshift_first_frame(ts);
-      lst    = _timeshift_last_frame(ts);
-      status->full  = ts->full;
+      pthread_mutex_lock(&tss->rdwr_mutex);
+      fst    = _timeshift_first_frame(tss);
+      lst    = _timeshift_last_frame(tss);
+      status->full  = tss->full;
       status->shift = ts->state <= TS_LIVE ? 0 : ts_rescale_i(now - last_time, 1000000);
       if (lst && fst && lst != fst && ts->pts_delta != PTS_UNSET) {
         status->pts_start = ts_rescale_i(fst->time - ts->pts_delta, 1000000);
@@ -683,6 +776,7 @@ void *timeshift_reader ( void *p )
         status->pts_start = PTS_UNSET;
         status->pts_end   = PTS_UNSET;
       }
+      pthread_mutex_unlock(&tss->rdwr_mutex);
       tsm = streaming_msg_create_data(SMT_TIMESHIFT_STATUS, status);
       streaming_target_deliver2(ts->output, tsm);
       last_status = now;
@@ -715,27 +809,30 @@ void *timeshift_reader ( void *p )
         tvhlog(LOG_DEBUG, "timeshift", "ts %d skip to %"PRId64" from %"PRId64, ts->id, req_time, last_time);
 
         /* Find */
-        pthread_mutex_lock(&ts->rdwr_mutex);
-        end = _timeshift_skip(ts, req_time, last_time,
+        pthread_mutex_lock(&tss->rdwr_mutex);
+        end = _timeshift_skip(tss, req_time, last_time,
                               cur_file, &tsf, &tsi);
-        pthread_mutex_unlock(&ts->rdwr_mutex);
+        pthread_mutex_unlock(&tss->rdwr_mutex);
         if (tsi)
           tvhlog(LOG_DEBUG, "timeshift", "ts %d skip found pkt @ %"PRId64, ts->id, tsi->time);
 
         /* File changed (close) */
-        if ((tsf != cur_file) && cur_file && cur_file->rfd >= 0) {
-          close(cur_file->rfd);
-          cur_file->rfd = -1;
+        if ((tsf != cur_file) && ts->rfd >= 0) {
+          close(ts->rfd);
+          ts->rfd = -1;
         }
 
         /* Position */
-        if (cur_file)
+        if (cur_file) {
+          pthread_mutex_lock(&tss->rdwr_mutex);
           cur_file->refcount--;
+          pthread_mutex_unlock(&tss->rdwr_mutex);
+        }
         if ((cur_file = tsf) != NULL) {
           if (tsi)
-            cur_file->roff = tsi->pos;
+            ts->roff = tsi->pos;
           else
-            cur_file->roff = 0;
+            ts->roff = 0;
         }
       }
 
@@ -803,35 +900,35 @@ void *timeshift_reader ( void *p )
         end = (cur_speed > 0) ? 1 : -1;
 
       /* Back to live (unless buffer is full) */
-      if (end == 1 && !ts->full) {
+      if (end == 1 && !tss->full) {
         tvhlog(LOG_DEBUG, "timeshift", "ts %d eob revert to live mode", ts->id);
-        ts->state = TS_LIVE;
+        timeshift_set_state(ts, TS_LIVE);
         cur_speed = 100;
         ctrl      = streaming_msg_create_code(SMT_SPEED, cur_speed);
         streaming_target_deliver2(ts->output, ctrl);
         ctrl      = NULL;
 
         /* Flush timeshift buffer to live */
+        timeshift_writer_flush(tss);
         if (_timeshift_flush_to_live(ts, &cur_file, &sm, &wait) == -1)
           break;
 
         /* Close file (if open) */
-        if (cur_file && cur_file->rfd >= 0) {
-          close(cur_file->rfd);
-          cur_file->rfd = -1;
-        }
+        pthread_mutex_lock(&tss->rdwr_mutex);
+        _timeshift_release(ts, &cur_file);
 
-        /* Flush ALL files */
+        /* Flush ALL files (not used by other readers) */
         if (ts->ondemand)
-          timeshift_filemgr_flush(ts, NULL);
+          timeshift_filemgr_flush(tss, NULL);
+        pthread_mutex_unlock(&tss->rdwr_mutex);
 
       /* Pause */
       } else {
         if (cur_speed <= 0) {
           cur_speed = 0;
-          ts->state = TS_PAUSE;
+          timeshift_set_state(ts, TS_PAUSE);
         } else {
-          ts->state = TS_PLAY;
+          timeshift_set_state(ts, TS_PLAY);
           play_time = now;
         }
         tvhlog(LOG_DEBUG, "timeshift", "ts %d sob speed %d", ts->id, cur_speed);
@@ -843,9 +940,9 @@ void *timeshift_reader ( void *p )
 
     /* Flush unwanted */
     } else if (ts->ondemand && cur_file) {
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      timeshift_filemgr_flush(ts, cur_file);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_lock(&tss->rdwr_mutex);
+      timeshift_filemgr_flush(tss, cur_file);
+      pthread_mutex_unlock(&tss->rdwr_mutex);
     }
 
     pthread_mutex_unlock(&ts->state_mutex);
@@ -853,10 +950,9 @@ void *timeshift_reader ( void *p )
 
   /* Cleanup */
   tvhpoll_destroy(pd);
-  if (cur_file && cur_file->rfd >= 0) {
-    close(cur_file->rfd);
-    cur_file->rfd = -1;
-  }
+  pthread_mutex_lock(&ts->store->rdwr_mutex);
+  _timeshift_release(ts, &cur_file);
+  pthread_mutex_unlock(&ts->store->rdwr_mutex);
   if (sm)       streaming_msg_free(sm);
   if (ctrl)     streaming_msg_free(ctrl);
   tvhtrace("timeshift", "ts %d exit reader thread", ts->id);
@@ -24,6 +24,8 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
@@ -34,15 +36,18 @@
  * *************************************************************************/
 
 /*
- * Write data (retry on EAGAIN)
+ * Write data (retry on EAGAIN), only the file data path ('data' set)
+ * is accounted, not the messages to the reader control pipe
  */
 static ssize_t _write_fd
-  ( int fd, const void *buf, size_t count )
+  ( int fd, const void *buf, size_t count, int data )
 {
   ssize_t r;
   size_t  n = 0;
   while ( n < count ) {
     r = write(fd, buf+n, count-n);
+    if (data)
+      atomic_add_u64(&timeshift_write_syscalls, 1);
     if (r == -1) {
       if (ERRNO_AGAIN(errno))
         continue;
@@ -51,9 +56,89 @@ static ssize_t _write_fd
     }
     n += r;
   }
+  if (data)
+    atomic_add_u64(&timeshift_write_bytes, n);
   return count == n ? n : -1;
 }
 
+/*
+ * Write two buffers with one syscall (retry on EAGAIN / short write)
+ */
+static ssize_t _writev_fd
+  ( int fd, const void *buf1, size_t count1, const void *buf2, size_t count2 )
+{
+  struct iovec iov[2], *v = iov;
+  int cnt = 2;
+  ssize_t r;
+  size_t  n = 0;
+
+  iov[0].iov_base = (void *)buf1;
+  iov[0].iov_len  = count1;
+  iov[1].iov_base = (void *)buf2;
+  iov[1].iov_len  = count2;
+  while (cnt > 0) {
+    r = writev(fd, v, cnt);
+    atomic_add_u64(&timeshift_write_syscalls, 1);
+    if (r == -1) {
+      if (ERRNO_AGAIN(errno))
+        continue;
+      else
+        return -1;
+    }
+    n += r;
+    while (cnt > 0 && r >= v->iov_len) {
+      r -= v->iov_len;
+      v++, cnt--;
+    }
+    if (cnt > 0) {
+      v->iov_base += r;
+      v->iov_len  -= r;
+    }
+  }
+  atomic_add_u64(&timeshift_write_bytes, n);
+  return n;
+}
+
+/*
+ * Flush the coalesced writes to the file
+ */
+int timeshift_write_flush ( timeshift_file_t *tsf )
+{
+  size_t used = tsf->wbuf_used;
+  if (!used)
+    return 0;
+  tsf->wbuf_used = 0;
+  if (tsf->wfd < 0)
+    return 0;
+  return _write_fd(tsf->wfd, tsf->wbuf, used, 1) < 0 ? -1 : 0;
+}
+
+/*
+ * Coalesce small writes, a buffer overflow goes out as one writev()
+ */
+static ssize_t _write_buf
+  ( timeshift_file_t *tsf, const void *buf, size_t count )
+{
+  size_t used = tsf->wbuf_used;
+
+  if (!tsf->wbuf) {
+    tsf->wbuf = malloc(TIMESHIFT_WBUF_SIZE);
+    if (!tsf->wbuf)
+      return _write_fd(tsf->wfd, buf, count, 1);
+  }
+  if (used + count <= TIMESHIFT_WBUF_SIZE) {
+    if (!used)
+      tsf->wbuf_time = getmonoclock();
+    memcpy(tsf->wbuf + used, buf, count);
+    tsf->wbuf_used = used + count;
+    return count;
+  }
+  tsf->wbuf_used = 0;
+  if (_writev_fd(tsf->wfd, tsf->wbuf, used, buf, count) < 0)
+    return -1;
+  return count;
+}
+
 static ssize_t _write
   ( timeshift_file_t *tsf, const void *buf, size_t count )
 {
@@ -80,7 +165,7 @@ static ssize_t _write
     pthread_mutex_unlock(&tsf->ram_lock);
     return count;
   }
-  return _write_fd(tsf->wfd, buf, count);
+  return _write_buf(tsf, buf, count);
 }
 
 /*
@@ -114,16 +199,16 @@ static ssize_t _write_msg_fd
 {
   size_t len2 = len + sizeof(type) + sizeof(time);
   ssize_t err, ret;
-  ret = err = _write_fd(fd, &len2, sizeof(len2));
+  ret = err = _write_fd(fd, &len2, sizeof(len2), 0);
   if (err < 0) return err;
-  err = _write_fd(fd, &type, sizeof(type));
+  err = _write_fd(fd, &type, sizeof(type), 0);
   if (err < 0) return err;
   ret += err;
-  err = _write_fd(fd, &time, sizeof(time));
+  err = _write_fd(fd, &time, sizeof(time), 0);
   if (err < 0) return err;
   ret += err;
   if (len) {
-    err = _write_fd(fd, buf, len);
+    err = _write_fd(fd, buf, len, 0);
     if (err < 0) return err;
     ret += err;
   }
@@ -230,27 +315,41 @@ ssize_t timeshift_write_eof ( timeshift_file_t *tsf )
  * Thread
  * *************************************************************************/
 
-static inline ssize_t _process_msg0
-  ( timeshift_t *ts, timeshift_file_t *tsf, streaming_message_t **smp )
+static void _process_start
+  ( timeshift_store_t *tss, streaming_message_t *sm )
 {
   int i;
-  ssize_t err;
-  streaming_start_t *ss;
-  streaming_message_t *sm = *smp;
-  if (sm->sm_type == SMT_START) {
-    err = 0;
-    timeshift_index_data_t *ti = calloc(1, sizeof(timeshift_index_data_t));
+  streaming_start_t *ss = sm->sm_data;
+  timeshift_file_t *tsf;
+  timeshift_index_data_t *ti;
+
+  /* Update video index */
+  for (i = 0; i < ss->ss_num_components; i++)
+    if (SCT_ISVIDEO(ss->ss_components[i].ssc_type))
+      tss->vididx = ss->ss_components[i].ssc_index;
+
+  /* Remember for the next file */
+  if (tss->smt_start)
+    streaming_msg_free(tss->smt_start);
+  tss->smt_start = streaming_msg_clone(sm);
+
+  /* Index in the file being written (new files copy tss->smt_start) */
+  tsf = TAILQ_LAST(&tss->files, timeshift_file_list);
+  if (tsf && !tss->full && (tsf->wfd >= 0 || tsf->ram)) {
+    ti = calloc(1, sizeof(timeshift_index_data_t));
     ti->pos  = tsf->size;
     ti->data = sm;
-    *smp = NULL;
     TAILQ_INSERT_TAIL(&tsf->sstart, ti, link);
+  } else {
+    streaming_msg_free(sm);
+  }
+}
 
-    /* Update video index */
-    ss = sm->sm_data;
-    for (i = 0; i < ss->ss_num_components; i++)
-      if (SCT_ISVIDEO(ss->ss_components[i].ssc_type))
-        ts->vididx = ss->ss_components[i].ssc_index;
-  } else if (sm->sm_type == SMT_SIGNAL_STATUS)
+static inline ssize_t _process_msg0
+  ( timeshift_store_t *tss, timeshift_file_t *tsf, streaming_message_t *sm )
+{
+  ssize_t err;
+  if (sm->sm_type == SMT_SIGNAL_STATUS)
     err = timeshift_write_sigstat(tsf, sm->sm_time, sm->sm_data);
   else if (sm->sm_type == SMT_PACKET) {
     err = timeshift_write_packet(tsf, sm->sm_time, sm->sm_data);
@@ -258,7 +357,7 @@ static inline ssize_t _process_msg0
       th_pkt_t *pkt = sm->sm_data;
 
       /* Index video iframes */
-      if (pkt->pkt_componentindex == ts->vididx &&
+      if (pkt->pkt_componentindex == tss->vididx &&
           pkt->pkt_frametype      == PKT_I_FRAME) {
         timeshift_index_iframe_t *ti = calloc(1, sizeof(timeshift_index_iframe_t));
         ti->pos  = tsf->size;
@@ -283,7 +382,7 @@ static inline ssize_t _process_msg0
 }
 
 static void _process_msg
-  ( timeshift_t *ts, streaming_message_t *sm, int *run )
+  ( timeshift_store_t *tss, streaming_message_t *sm, int *run )
 {
   int err;
   timeshift_file_t *tsf;
@@ -312,21 +411,32 @@ static void _process_msg
     case SMT_TIMESHIFT_STATUS:
       break;
 
+    /* Stream makeup */
+    case SMT_START:
+      pthread_mutex_lock(&tss->rdwr_mutex);
+      _process_start(tss, sm);
+      pthread_mutex_unlock(&tss->rdwr_mutex);
+      sm = NULL;
+      break;
+
     /* Store */
     case SMT_SIGNAL_STATUS:
-    case SMT_START:
     case SMT_MPEGTS:
     case SMT_PACKET:
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      if ((tsf = timeshift_filemgr_get(ts, 1)) && (tsf->wfd >= 0 || tsf->ram)) {
-        if ((err = _process_msg0(ts, tsf, &sm)) < 0) {
+      pthread_mutex_lock(&tss->rdwr_mutex);
+      if ((tsf = timeshift_filemgr_get(tss, 1)) && (tsf->wfd >= 0 || tsf->ram)) {
+        err = _process_msg0(tss, tsf, sm);
+        if (err >= 0 && tsf->wbuf_used &&
+            getmonoclock() - tsf->wbuf_time >= TIMESHIFT_WBUF_PERIOD)
+          err = timeshift_write_flush(tsf);
+        if (err < 0) {
           timeshift_filemgr_close(tsf);
           tsf->bad = 1;
-          ts->full = 1; ///< Stop any more writing
+          tss->full = 1; ///< Stop any more writing
         }
         tsf->refcount--;
       }
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_unlock(&tss->rdwr_mutex);
       break;
   }
 
@@ -335,12 +445,43 @@ static void _process_msg
     streaming_msg_free(sm);
 }
 
+/*
+ * Flush the newest file write buffer
+ *
+ * Returns the delay (us) before the pending data must be flushed,
+ * or zero if nothing is pending.
+ */
+static int64_t _process_flush ( timeshift_store_t *tss, int force )
+{
+  timeshift_file_t *tsf;
+  int64_t delay = 0;
+
+  pthread_mutex_lock(&tss->rdwr_mutex);
+  tsf = TAILQ_LAST(&tss->files, timeshift_file_list);
+  if (tsf && tsf->wbuf_used) {
+    delay = tsf->wbuf_time + TIMESHIFT_WBUF_PERIOD - getmonoclock();
+    if (force || delay <= 0) {
+      if (timeshift_write_flush(tsf) < 0) {
+        timeshift_filemgr_close(tsf);
+        tsf->bad = 1;
+        tss->full = 1;
+      }
+      delay = 0;
+    }
+  }
+  pthread_mutex_unlock(&tss->rdwr_mutex);
+  return delay;
+}
+
 void *timeshift_writer ( void *aux )
 {
   int run = 1;
-  timeshift_t *ts = aux;
-  streaming_queue_t *sq = &ts->wr_queue;
+  int64_t delay;
+  timeshift_store_t *tss = aux;
+  streaming_queue_t *sq = &tss->wr_queue;
   streaming_message_t *sm;
+  struct timeval tp;
+  struct timespec abstime;
 
   pthread_mutex_lock(&sq->sq_mutex);
 
@@ -349,13 +490,27 @@ void *timeshift_writer ( void *aux )
     /* Get message */
     sm = TAILQ_FIRST(&sq->sq_queue);
     if (sm == NULL) {
-      pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      /* Idle - bound the age of the buffered data */
+      pthread_mutex_unlock(&sq->sq_mutex);
+      delay = _process_flush(tss, 0);
+      pthread_mutex_lock(&sq->sq_mutex);
+      if (TAILQ_FIRST(&sq->sq_queue))
+        continue;
+      if (delay > 0) {
+        gettimeofday(&tp, NULL);
+        delay += tp.tv_usec;
+        abstime.tv_sec  = tp.tv_sec + delay / 1000000;
+        abstime.tv_nsec = (delay % 1000000) * 1000;
+        pthread_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, &abstime);
+      } else {
+        pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      }
       continue;
     }
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
     pthread_mutex_unlock(&sq->sq_mutex);
 
-    _process_msg(ts, sm, &run);
+    _process_msg(tss, sm, &run);
 
     pthread_mutex_lock(&sq->sq_mutex);
   }
@@ -368,17 +523,18 @@ void *timeshift_writer ( void *aux )
  * Utilities
  * *************************************************************************/
 
-void timeshift_writer_flush ( timeshift_t *ts )
+void timeshift_writer_flush ( timeshift_store_t *tss )
 
 {
   streaming_message_t *sm;
-  streaming_queue_t *sq = &ts->wr_queue;
+  streaming_queue_t *sq = &tss->wr_queue;
 
   pthread_mutex_lock(&sq->sq_mutex);
   while ((sm = TAILQ_FIRST(&sq->sq_queue))) {
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-    _process_msg(ts, sm, NULL);
+    streaming_queue_remove(sq, sm);
+    _process_msg(tss, sm, NULL);
   }
   pthread_mutex_unlock(&sq->sq_mutex);
+  _process_flush(tss, 1);
 }
 
@@ -153,10 +153,11 @@ typedef enum {
 typedef void (gti_callback_t)(void *opaque);
 
 typedef struct gtimer {
-  LIST_ENTRY(gtimer) gti_link;
+  RB_ENTRY(gtimer) gti_link;
   gti_callback_t *gti_callback;
   void *gti_opaque;
   struct timespec gti_expire;
+  uint64_t gti_seq;
 } gtimer_t;
 
 void gtimer_arm(gtimer_t *gti, gti_callback_t *callback, void *opaque,
@@ -173,6 +174,15 @@ void gtimer_arm_abs2(gtimer_t *gti, gti_callback_t *callback, void *opaque,
 
 void gtimer_disarm(gtimer_t *gti);
 
+typedef struct gtimer_stats {
+  uint32_t gts_armed;     ///< Currently armed timers
+  uint64_t gts_fired;     ///< Total callbacks dispatched
+  uint64_t gts_late_us;   ///< Accumulated dispatch lateness (usec)
+  uint64_t gts_late_max;  ///< Worst dispatch lateness (usec)
+} gtimer_stats_t;
+
+void gtimer_get_stats(gtimer_stats_t *stats);
+
 
 /*
  * List / Queue header declarations
@@ -494,6 +504,11 @@ typedef struct streaming_queue {
   pthread_cond_t  sq_cond;     /* Condvar for signalling new packets */
 
   size_t          sq_maxsize;  /* Max queue size (bytes) */
+  size_t          sq_size;     /* Current queue size (bytes) */
+  size_t          sq_size_max; /* Queue size high watermark (bytes) */
+  uint32_t        sq_packets;  /* Current number of queued messages */
+  uint32_t        sq_packets_max; /* Queued messages high watermark */
+  uint32_t        sq_dropped;  /* Messages dropped due to sq_maxsize */
   
   struct streaming_message_queue sq_queue;
 
@@ -623,6 +638,9 @@ void tvh_pipe_close(th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt);
+
 FILE *tvh_fopen(const char *filename, const char *mode);
 
 void hexdump(const char *pfx, const uint8_t *data, int len);
@@ -718,8 +736,14 @@ char *regexp_escape ( const char *str );
 char to_hex(char code);
 char *url_encode(char *str);
 
+void mpegts_word_init(void);
+
+int mpegts_word_select(const char *name);
+
 int mpegts_word_count(const uint8_t *tsb, int len, uint32_t mask);
 
+int mpegts_sync_count(const uint8_t *tsb, int len);
+
 static inline int32_t deltaI32(int32_t a, int32_t b) { return (a > b) ? (a - b) : (b - a); }
 static inline uint32_t deltaU32(uint32_t a, uint32_t b) { return (a > b) ? (a - b) : (b - a); }
   
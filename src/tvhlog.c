@@ -24,10 +24,13 @@
 #include <sys/time.h>
 
 #include "webui/webui.h"
+#include "atomic.h"
 
 time_t                   dispatch_clock;
+tvhlog_mask_t            tvhlog_mask[2];
 
 int                      tvhlog_run;
+int                      tvhlog_stopped;
 int                      tvhlog_level;
 int                      tvhlog_options;
 char                    *tvhlog_path;
@@ -36,22 +39,54 @@ htsmsg_t                *tvhlog_trace;
 pthread_t                tvhlog_tid;
 pthread_mutex_t          tvhlog_mutex;
 pthread_cond_t           tvhlog_cond;
-TAILQ_HEAD(,tvhlog_msg)  tvhlog_queue;
-int                      tvhlog_queue_size;
-int                      tvhlog_queue_full;
-
-#define TVHLOG_QUEUE_MAXSIZE 10000
+LIST_HEAD(,tvhlog_ring)  tvhlog_rings;
+LIST_HEAD(,tvhlog_old)   tvhlog_olds;
+pthread_key_t            tvhlog_ring_key;
+volatile int             tvhlog_idle;
+volatile int             tvhlog_seq;
+volatile int             tvhlog_conf_gen = 1;
+
+#define TVHLOG_RING_SIZE 2048 /* messages, power of 2 */
 #define TVHLOG_THREAD 1
 
 typedef struct tvhlog_msg
 {
-  TAILQ_ENTRY(tvhlog_msg)  link;
   char                    *msg;
   int                      severity;
   int                      notify;
+  int                      seq;
   struct timeval           time;
 } tvhlog_msg_t;
 
+/*
+ * Per-thread message ring (single producer, drained by tvhlog_thread)
+ */
+typedef struct tvhlog_ring
+{
+  LIST_ENTRY(tvhlog_ring)  link;
+  volatile unsigned int    head;    /* written by the owner thread */
+  volatile unsigned int    tail;    /* written by tvhlog_thread */
+  volatile int             dropped; /* ring full */
+  volatile int             dead;    /* owner thread exited */
+  volatile int             conf;    /* config gen being read, or 0 */
+  tvhlog_msg_t            *msgs[TVHLOG_RING_SIZE];
+} tvhlog_ring_t;
+
+static __thread tvhlog_ring_t *tvhlog_ring;
+
+/*
+ * Replaced subsystem configs (readers don't lock, freed once no thread
+ * is still reading a config generation older than retired)
+ */
+typedef struct tvhlog_old
+{
+  LIST_ENTRY(tvhlog_old)   link;
+  htsmsg_t                *conf;
+  int                      retired;
+} tvhlog_old_t;
+
+static tvhlog_ring_t *tvhlog_ring_get ( void );
+
 static const char *logtxtmeta[9][2] = {
   {"EMERGENCY", "\033[31m"},
   {"ALERT",     "\033[31m"},
@@ -83,19 +118,105 @@ tvhlog_get_subsys ( htsmsg_t *ss, char *subsys, size_t len )
   }
 }
 
+/* Build the inline check masks */
+static void
+tvhlog_mask_add ( uint32_t *bits, htsmsg_t *ss )
+{
+  htsmsg_field_t *f;
+  uint32_t h;
+  int i;
+
+  if (!ss)
+    return;
+  HTSMSG_FOREACH(f, ss) {
+    if (f->hmf_type != HMF_S64 || !f->hmf_s64) continue;
+    if (!strcmp(f->hmf_name, "all")) {
+      for (i = 0; i < TVHLOG_MASK_BITS / 32; i++)
+        bits[i] = ~0;
+      return;
+    }
+    h = tvhlog_hash(f->hmf_name);
+    bits[h / 32] |= 1 << (h % 32);
+  }
+}
+
+static void
+tvhlog_mask_set ( tvhlog_mask_t *m, htsmsg_t *ss1, htsmsg_t *ss2, int on )
+{
+  uint32_t bits[TVHLOG_MASK_BITS / 32] = { 0 }, any = 0;
+  int i;
+
+  if (on) {
+    tvhlog_mask_add(bits, ss1);
+    tvhlog_mask_add(bits, ss2);
+  }
+  for (i = 0; i < TVHLOG_MASK_BITS / 32; i++) {
+    m->bits[i] = bits[i];
+    any |= bits[i];
+  }
+  m->on = any != 0;
+}
+
+/*
+ * Lock-free config readers, the ring records the config generation
+ * seen at entry
+ */
+static tvhlog_ring_t *
+tvhlog_conf_enter ( void )
+{
+  tvhlog_ring_t *ring = tvhlog_ring_get();
+  ring->conf = tvhlog_conf_gen;
+  __sync_synchronize();
+  return ring;
+}
+
+static void
+tvhlog_conf_leave ( tvhlog_ring_t *ring )
+{
+  __sync_synchronize();
+  ring->conf = 0;
+}
+
+/*
+ * Free the replaced configs no reader can still see, must hold
+ * tvhlog_mutex
+ */
+static void
+tvhlog_conf_reclaim ( void )
+{
+  tvhlog_old_t *old, *old_next;
+  tvhlog_ring_t *ring;
+  int oldest = 0, g;
+
+  if (LIST_EMPTY(&tvhlog_olds))
+    return;
+  __sync_synchronize();
+  LIST_FOREACH(ring, &tvhlog_rings, link) {
+    g = ring->conf;
+    if (g && (!oldest || g - oldest < 0))
+      oldest = g;
+  }
+  for (old = LIST_FIRST(&tvhlog_olds); old; old = old_next) {
+    old_next = LIST_NEXT(old, link);
+    if (oldest && oldest - old->retired < 0)
+      continue;
+    LIST_REMOVE(old, link);
+    htsmsg_destroy(old->conf);
+    free(old);
+  }
+}
+
 /* Set subsys */
 static void
 tvhlog_set_subsys ( htsmsg_t **c, const char *subsys )
 {
   uint32_t a;
   char *s, *t, *r = NULL;
-
-  if (*c)
-    htsmsg_destroy(*c);
-  *c = NULL;
+  htsmsg_t *n = NULL, *prev = *c;
+  tvhlog_old_t *old;
 
   if (!subsys)
-    return;
+    goto publish;
 
   s = strdup(subsys);
   t = strtok_r(s, ",", &r);
@@ -109,17 +230,37 @@ tvhlog_set_subsys ( htsmsg_t **c, const char *subsys )
     }
     if (!*t) goto next;
     if (!strcmp(t, "all")) {
-      if (*c)
-        htsmsg_destroy(*c);
-      *c = NULL;
+      if (n)
+        htsmsg_destroy(n);
+      n = NULL;
     }
-    if (!*c)
-      *c = htsmsg_create_map();
-    htsmsg_set_u32(*c, t, a);
+    if (!n)
+      n = htsmsg_create_map();
+    htsmsg_set_u32(n, t, a);
 next:
     t = strtok_r(NULL, ",", &r);
   }
   free(s);
+
+publish:
+  pthread_mutex_lock(&tvhlog_mutex);
+  __sync_synchronize();
+  *c = n;
+  tvhlog_mask_set(&tvhlog_mask[0], tvhlog_trace, tvhlog_debug,
+                  tvhlog_level >= LOG_DEBUG);
+  tvhlog_mask_set(&tvhlog_mask[1], tvhlog_trace, NULL,
+                  tvhlog_level >= LOG_TRACE);
+
+  /* Readers entering from the next generation on see the new config */
+  __sync_synchronize();
+  if (prev) {
+    old = malloc(sizeof(*old));
+    old->conf    = prev;
+    old->retired = atomic_add(&tvhlog_conf_gen, 1) + 1;
+    LIST_INSERT_HEAD(&tvhlog_olds, old, link);
+  }
+  tvhlog_conf_reclaim();
+  pthread_mutex_unlock(&tvhlog_mutex);
 }
 
 void
@@ -137,13 +278,17 @@ tvhlog_set_trace ( const char *subsys )
 void
 tvhlog_get_debug ( char *subsys, size_t len )
 {
+  tvhlog_ring_t *ring = tvhlog_conf_enter();
   tvhlog_get_subsys(tvhlog_debug, subsys, len);
+  tvhlog_conf_leave(ring);
 }
 
 void
 tvhlog_get_trace ( char *subsys, size_t len )
 {
+  tvhlog_ring_t *ring = tvhlog_conf_enter();
   tvhlog_get_subsys(tvhlog_trace, subsys, len);
+  tvhlog_conf_leave(ring);
 }
 
 static void
@@ -213,32 +358,123 @@ tvhlog_process
   free(msg);
 }
 
+/* Per-thread ring */
+static void
+tvhlog_ring_exit ( void *p )
+{
+  tvhlog_ring_t *ring = p;
+  /* A later log call on this thread gets a fresh ring, not this one */
+  tvhlog_ring = NULL;
+  __sync_synchronize();
+  ring->dead = 1;
+}
+
+static tvhlog_ring_t *
+tvhlog_ring_get ( void )
+{
+  tvhlog_ring_t *ring = tvhlog_ring;
+
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(*ring));
+    pthread_setspecific(tvhlog_ring_key, ring);
+    pthread_mutex_lock(&tvhlog_mutex);
+    LIST_INSERT_HEAD(&tvhlog_rings, ring, link);
+    pthread_mutex_unlock(&tvhlog_mutex);
+    tvhlog_ring = ring;
+  }
+  return ring;
+}
+
+static void
+tvhlog_ring_put ( tvhlog_msg_t *msg )
+{
+  tvhlog_ring_t *ring = tvhlog_ring_get();
+  unsigned int head = ring->head;
+
+  if (head - ring->tail >= TVHLOG_RING_SIZE) {
+    atomic_add(&ring->dropped, 1);
+    free(msg->msg);
+    free(msg);
+    return;
+  }
+  ring->msgs[head % TVHLOG_RING_SIZE] = msg;
+  __sync_synchronize();
+  ring->head = head + 1;
+  __sync_synchronize();
+
+  /* Only wake the log thread when it sleeps */
+  if (tvhlog_idle) {
+    pthread_mutex_lock(&tvhlog_mutex);
+    pthread_cond_signal(&tvhlog_cond);
+    pthread_mutex_unlock(&tvhlog_mutex);
+  }
+}
+
+/*
+ * Oldest queued message (all rings), must hold tvhlog_mutex
+ */
+static tvhlog_msg_t *
+tvhlog_ring_next ( tvhlog_ring_t **rp, int *dropped )
+{
+  tvhlog_ring_t *ring, *next, *best = NULL;
+  tvhlog_msg_t *msg = NULL, *m;
+  int d = 0;
+
+  __sync_synchronize();
+  for (ring = LIST_FIRST(&tvhlog_rings); ring; ring = next) {
+    next = LIST_NEXT(ring, link);
+    if (ring->dropped)
+      d += atomic_exchange(&ring->dropped, 0);
+    if (ring->tail == ring->head) {
+      if (ring->dead) {
+        LIST_REMOVE(ring, link);
+        free(ring);
+      }
+      continue;
+    }
+    m = ring->msgs[ring->tail % TVHLOG_RING_SIZE];
+    if (msg == NULL || m->seq - msg->seq < 0) {
+      msg  = m;
+      best = ring;
+    }
+  }
+  *rp = best;
+  *dropped += d;
+  return msg;
+}
+
 /* Log */
 static void *
 tvhlog_thread ( void *p )
 {
-  int options;
+  int options, dropped = 0;
   char *path = NULL, buf[512];
   FILE *fp = NULL;
   tvhlog_msg_t *msg;
+  tvhlog_ring_t *ring;
 
   pthread_mutex_lock(&tvhlog_mutex);
-  while (tvhlog_run) {
+  while (1) {
 
     /* Wait */
-    if (!(msg = TAILQ_FIRST(&tvhlog_queue))) {
+    if (!(msg = tvhlog_ring_next(&ring, &dropped))) {
+      if (!tvhlog_run)
+        break;
       if (fp) {
         fclose(fp); // only issue here is we close with mutex!
                     // but overall performance will be higher
         fp = NULL;
       }
-      pthread_cond_wait(&tvhlog_cond, &tvhlog_mutex);
+      tvhlog_conf_reclaim();
+      tvhlog_idle = 1;
+      __sync_synchronize();
+      if (!(msg = tvhlog_ring_next(&ring, &dropped)))
+        pthread_cond_wait(&tvhlog_cond, &tvhlog_mutex);
+      tvhlog_idle = 0;
       continue;
     }
-    TAILQ_REMOVE(&tvhlog_queue, msg, link);
-    tvhlog_queue_size--;
-    if (tvhlog_queue_size < (TVHLOG_QUEUE_MAXSIZE / 2))
-      tvhlog_queue_full = 0;
+    __sync_synchronize();
+    ring->tail++;
 
     /* Copy options and path */
     if (!fp) {
@@ -251,6 +487,15 @@ tvhlog_thread ( void *p )
     }
     options  = tvhlog_options; 
     pthread_mutex_unlock(&tvhlog_mutex);
+    if (dropped) {
+      tvhlog_msg_t *full = calloc(1, sizeof(tvhlog_msg_t));
+      full->time     = msg->time;
+      full->severity = LOG_ERR;
+      full->msg      = malloc(64);
+      snprintf(full->msg, 64, "log buffer full (%d messages lost)", dropped);
+      tvhlog_process(full, options, &fp, path);
+      dropped = 0;
+    }
     tvhlog_process(msg, options, &fp, path);
     pthread_mutex_lock(&tvhlog_mutex);
   }
@@ -267,46 +512,32 @@ void tvhlogv ( const char *file, int line,
   int ok, options;
   size_t l;
   char buf[1024];
+  htsmsg_t *ss;
+  tvhlog_ring_t *ring;
 
-  pthread_mutex_lock(&tvhlog_mutex);
-
-  /* Check for full */
-  if (tvhlog_queue_full) {
-    pthread_mutex_unlock(&tvhlog_mutex);
-    return;
-  }
-
-  /* Check debug enabled (and cache config) */
+  /* Check debug enabled (the inline check may hit a hash collision) */
   options = tvhlog_options;
   if (severity >= LOG_DEBUG) {
     ok = 0;
-    if (severity <= tvhlog_level) {
-      if (tvhlog_trace) {
-        ok = htsmsg_get_u32_or_default(tvhlog_trace, "all", 0);
-        ok = htsmsg_get_u32_or_default(tvhlog_trace, subsys, ok);
+    if (severity <= tvhlog_level && !tvhlog_stopped) {
+      ring = tvhlog_conf_enter();
+      if ((ss = tvhlog_trace) != NULL) {
+        ok = htsmsg_get_u32_or_default(ss, "all", 0);
+        ok = htsmsg_get_u32_or_default(ss, subsys, ok);
       }
-      if (!ok && severity == LOG_DEBUG && tvhlog_debug) {
-        ok = htsmsg_get_u32_or_default(tvhlog_debug, "all", 0);
-        ok = htsmsg_get_u32_or_default(tvhlog_debug, subsys, ok);
+      if (!ok && severity == LOG_DEBUG && (ss = tvhlog_debug) != NULL) {
+        ok = htsmsg_get_u32_or_default(ss, "all", 0);
+        ok = htsmsg_get_u32_or_default(ss, subsys, ok);
       }
+      tvhlog_conf_leave(ring);
     }
   } else {
     ok = 1;
   }
 
   /* Ignore */
-  if (!ok) {
-    pthread_mutex_unlock(&tvhlog_mutex);
+  if (!ok || tvhlog_stopped)
     return;
-  }
-
-  /* FULL */
-  if (tvhlog_queue_size == TVHLOG_QUEUE_MAXSIZE) {
-    tvhlog_queue_full = 1;
-    fmt      = "log buffer full";
-    args     = NULL;
-    severity = LOG_ERR;
-  }
 
   /* Basic message */
   l = 0;
@@ -327,20 +558,20 @@ void tvhlogv ( const char *file, int line,
   msg->msg      = strdup(buf);
   msg->severity = severity;
   msg->notify   = notify;
+  msg->seq      = atomic_add(&tvhlog_seq, 1);
 #if TVHLOG_THREAD
   if (tvhlog_run) {
-    TAILQ_INSERT_TAIL(&tvhlog_queue, msg, link);
-    tvhlog_queue_size++;
-    pthread_cond_signal(&tvhlog_cond);
+    tvhlog_ring_put(msg);
   } else {
 #endif
     FILE *fp = NULL;
+    pthread_mutex_lock(&tvhlog_mutex);
     tvhlog_process(msg, tvhlog_options, &fp, tvhlog_path);
+    pthread_mutex_unlock(&tvhlog_mutex);
     if (fp) fclose(fp);
 #if TVHLOG_THREAD
   }
 #endif
-  pthread_mutex_unlock(&tvhlog_mutex);
 }
 
 
@@ -367,14 +598,11 @@ _tvhlog_hexdump(const char *file, int line,
                 const char *subsys,
                 const uint8_t *data, ssize_t len )
 {
-  int i, c, skip;
+  int i, c;
   char str[1024];
 
   /* Don't process if trace is OFF */
-  pthread_mutex_lock(&tvhlog_mutex);
-  skip = (severity > tvhlog_level);
-  pthread_mutex_unlock(&tvhlog_mutex);
-  if (skip) return;
+  if (!tvhlog_check_(severity, subsys, NULL)) return;
  
   /* Build and log output */
   while (len > 0) {
@@ -417,7 +645,9 @@ tvhlog_init ( int level, int options, const char *path )
   openlog("tvheadend", LOG_PID, LOG_DAEMON);
   pthread_mutex_init(&tvhlog_mutex, NULL);
   pthread_cond_init(&tvhlog_cond, NULL);
-  TAILQ_INIT(&tvhlog_queue);
+  pthread_key_create(&tvhlog_ring_key, tvhlog_ring_exit);
+  LIST_INIT(&tvhlog_rings);
+  LIST_INIT(&tvhlog_olds);
 }
 
 void
@@ -431,22 +661,32 @@ tvhlog_end ( void )
 {
   FILE *fp = NULL;
   tvhlog_msg_t *msg;
+  tvhlog_ring_t *ring;
+  tvhlog_old_t *old;
+  int dropped = 0;
   pthread_mutex_lock(&tvhlog_mutex);
   tvhlog_run = 0;
   pthread_cond_signal(&tvhlog_cond);
   pthread_mutex_unlock(&tvhlog_mutex);
   pthread_join(tvhlog_tid, NULL);
   pthread_mutex_lock(&tvhlog_mutex);
-  while ((msg = TAILQ_FIRST(&tvhlog_queue)) != NULL) {
-    TAILQ_REMOVE(&tvhlog_queue, msg, link);
+  while ((msg = tvhlog_ring_next(&ring, &dropped)) != NULL) {
+    ring->tail++;
     tvhlog_process(msg, tvhlog_options, &fp, tvhlog_path);
   }
-  tvhlog_queue_full = 1;
+  tvhlog_mask[0].on = tvhlog_mask[1].on = 0;
+  tvhlog_stopped = 1;
   pthread_mutex_unlock(&tvhlog_mutex);
   if (fp)
     fclose(fp);
   free(tvhlog_path);
   htsmsg_destroy(tvhlog_debug);
   htsmsg_destroy(tvhlog_trace);
+  tvhlog_debug = tvhlog_trace = NULL;
+  while ((old = LIST_FIRST(&tvhlog_olds)) != NULL) {
+    LIST_REMOVE(old, link);
+    htsmsg_destroy(old->conf);
+    free(old);
+  }
   closelog();
 }
@@ -35,8 +35,23 @@ typedef struct {
   size_t count;
 } tvhlog_limit_t;
 
+/*
+ * Enabled debug/trace subsystems
+ *
+ * Each name sets one bit (hashed) in the mask of the matching level, so
+ * disabled messages are dropped inline without a lock or a call. Hash
+ * collisions are resolved by the exact check in tvhlogv().
+ */
+#define TVHLOG_MASK_BITS 256
+
+typedef struct {
+  volatile int      on;
+  volatile uint32_t bits[TVHLOG_MASK_BITS / 32];
+} tvhlog_mask_t;
+
 /* Globals */
 extern time_t           dispatch_clock;
+extern tvhlog_mask_t    tvhlog_mask[2]; /* LOG_DEBUG, LOG_TRACE */
 
 /* Config */
 extern int              tvhlog_level;
@@ -65,6 +80,24 @@ void _tvhlog_hexdump   ( const char *file, int line,
                          int notify, int severity,
                          const char *subsys,
                          const uint8_t *data, ssize_t len );
+static inline uint32_t tvhlog_hash ( const char *subsys )
+  { uint32_t h = 0;
+    while (*subsys) h = h * 31 + (uint8_t)*subsys++;
+    return h % TVHLOG_MASK_BITS; }
+/* cache: per call site hash of a literal subsys (or NULL) */
+static inline int tvhlog_check_
+  ( int severity, const char *subsys, volatile uint32_t *cache )
+  { tvhlog_mask_t *m; uint32_t h;
+    if (severity < LOG_DEBUG) return 1;
+    m = &tvhlog_mask[severity > LOG_DEBUG];
+    if (!m->on) return 0;
+    if (cache == NULL) h = tvhlog_hash(subsys);
+    else if ((h = *cache) >= TVHLOG_MASK_BITS) *cache = h = tvhlog_hash(subsys);
+    return (m->bits[h / 32] >> (h % 32)) & 1; }
+#define tvhlog_check(severity, subsys)\
+  ({ static volatile uint32_t __tvhlog_h = ~0;\
+     tvhlog_check_(severity, subsys,\
+                   __builtin_constant_p(subsys) ? &__tvhlog_h : NULL); })
 static inline void tvhlog_limit_reset ( tvhlog_limit_t *limit )
   { limit->last = 0; limit->count = 0; }
 static inline int tvhlog_limit ( tvhlog_limit_t *limit, uint32_t delay )
@@ -92,14 +125,22 @@ static inline int tvhlog_limit ( tvhlog_limit_t *limit, uint32_t delay )
 
 /* Macros */
 #define tvhlog(severity, subsys, fmt, ...)\
-  _tvhlog(__FILE__, __LINE__, 1, severity, subsys, fmt, ##__VA_ARGS__)
+  (tvhlog_check(severity, subsys) ?\
+   _tvhlog(__FILE__, __LINE__, 1, severity, subsys, fmt, ##__VA_ARGS__) :\
+   (void)0)
 #define tvhlog_spawn(severity, subsys, fmt, ...)\
-  _tvhlog(__FILE__, __LINE__, 0, severity, subsys, fmt, ##__VA_ARGS__)
+  (tvhlog_check(severity, subsys) ?\
+   _tvhlog(__FILE__, __LINE__, 0, severity, subsys, fmt, ##__VA_ARGS__) :\
+   (void)0)
 #if ENABLE_TRACE
 #define tvhtrace(subsys, fmt, ...)\
-  _tvhlog(__FILE__, __LINE__, 0, LOG_TRACE, subsys, fmt, ##__VA_ARGS__)
+  (tvhlog_check(LOG_TRACE, subsys) ?\
+   _tvhlog(__FILE__, __LINE__, 0, LOG_TRACE, subsys, fmt, ##__VA_ARGS__) :\
+   (void)0)
 #define tvhlog_hexdump(subsys, data, len)\
-  _tvhlog_hexdump(__FILE__, __LINE__, 0, LOG_TRACE, subsys, (uint8_t*)data, len)
+  (tvhlog_check(LOG_TRACE, subsys) ?\
+   _tvhlog_hexdump(__FILE__, __LINE__, 0, LOG_TRACE, subsys, (uint8_t*)data, len) :\
+   (void)0)
 #else
 #define tvhtrace(...) (void)0
 #define tvhlog_hexdump(...) (void)0
@@ -0,0 +1,319 @@
+/*
+ *  Tvheadend - thread caching object pools
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "tvhpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TVHPOOL_BATCH_BYTES (64*1024) // bytes moved to/from a thread at once
+#define TVHPOOL_SHARED_BYTES (4*1024*1024) // bytes kept in a shared list
+
+/*
+ * Thread caches
+ */
+typedef struct tvhpool_cache {
+  tvhpool_obj_t *free;
+  int            count;
+  int64_t        allocs;  ///< Not yet folded into the pool
+  int64_t        frees;
+  int64_t        mallocs;
+} tvhpool_cache_t;
+
+typedef struct tvhpool_thread {
+  LIST_ENTRY(tvhpool_thread) link;
+  tvhpool_cache_t            caches[TVHPOOL_MAX];
+} tvhpool_thread_t;
+
+static pthread_mutex_t             tvhpool_lock = PTHREAD_MUTEX_INITIALIZER;
+static tvhpool_t                  *tvhpool_pools[TVHPOOL_MAX];
+static int                         tvhpool_count;
+static LIST_HEAD(,tvhpool_thread)  tvhpool_threads;
+static pthread_key_t               tvhpool_key;
+static __thread tvhpool_thread_t  *tvhpool_self;
+
+#define TVHPOOL_DATA(n) TVHPOOL_INITIALIZER("data" #n, n)
+
+static tvhpool_t tvhpool_data[] = {
+  TVHPOOL_DATA(256),
+  TVHPOOL_DATA(512),
+  TVHPOOL_DATA(1024),
+  TVHPOOL_DATA(2048),
+  TVHPOOL_DATA(4096),
+  TVHPOOL_DATA(8192),
+  TVHPOOL_DATA(16384),
+  TVHPOOL_DATA(32768),
+  TVHPOOL_DATA(65536),
+};
+
+/*
+ * Move objects between a thread cache and the shared list
+ */
+static void
+tvhpool_fold ( tvhpool_t *pool, tvhpool_cache_t *c )
+{
+  pool->allocs  += c->allocs;
+  pool->frees   += c->frees;
+  pool->mallocs += c->mallocs;
+  c->allocs = c->frees = c->mallocs = 0;
+}
+
+static void
+tvhpool_flush ( tvhpool_t *pool, tvhpool_cache_t *c, int n )
+{
+  tvhpool_obj_t *first = c->free, *last = first, *o;
+  int i;
+
+  if (n <= 0 || first == NULL)
+    return;
+  for (i = 1; i < n && last->next; i++)
+    last = last->next;
+  c->free  = last->next;
+  c->count -= i;
+  last->next = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  tvhpool_fold(pool, c);
+  if (pool->count + i <= pool->max) {
+    last->next  = pool->free;
+    pool->free  = first;
+    pool->count += i;
+    first = NULL;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  while ((o = first) != NULL) {
+    first = o->next;
+    free(o);
+  }
+}
+
+static void
+tvhpool_refill ( tvhpool_t *pool, tvhpool_cache_t *c )
+{
+  tvhpool_obj_t *o;
+  int i;
+
+  pthread_mutex_lock(&pool->lock);
+  tvhpool_fold(pool, c);
+  for (i = 0; i < pool->batch && (o = pool->free) != NULL; i++) {
+    pool->free = o->next;
+    o->next    = c->free;
+    c->free    = o;
+  }
+  pool->count -= i;
+  c->count    += i;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Return all cached objects of an exiting thread
+ */
+static void
+tvhpool_thread_exit ( void *p )
+{
+  tvhpool_thread_t *t = p;
+  int i;
+
+  /* Later TLS destructors may still use the pools (new cache) */
+  if (tvhpool_self == t)
+    tvhpool_self = NULL;
+  pthread_mutex_lock(&tvhpool_lock);
+  LIST_REMOVE(t, link);
+  pthread_mutex_unlock(&tvhpool_lock);
+  for (i = 0; i < tvhpool_count; i++) {
+    tvhpool_flush(tvhpool_pools[i], &t->caches[i], t->caches[i].count);
+    pthread_mutex_lock(&tvhpool_pools[i]->lock);
+    tvhpool_fold(tvhpool_pools[i], &t->caches[i]);
+    pthread_mutex_unlock(&tvhpool_pools[i]->lock);
+  }
+  free(t);
+}
+
+/*
+ * Register the pool on first use
+ */
+static void
+tvhpool_register ( tvhpool_t *pool )
+{
+  pthread_mutex_lock(&tvhpool_lock);
+  if (pool->id < 0) {
+    if (tvhpool_count == 0)
+      pthread_key_create(&tvhpool_key, tvhpool_thread_exit);
+    assert(tvhpool_count < TVHPOOL_MAX);
+    pool->batch = MAX(MIN(TVHPOOL_BATCH_BYTES / pool->size, 64), 4);
+    pool->max   = MAX(TVHPOOL_SHARED_BYTES / pool->size, 4 * pool->batch);
+    tvhpool_pools[tvhpool_count] = pool;
+    __sync_synchronize();
+    pool->id = tvhpool_count++;
+  }
+  pthread_mutex_unlock(&tvhpool_lock);
+}
+
+static inline tvhpool_cache_t *
+tvhpool_cache ( tvhpool_t *pool )
+{
+  tvhpool_thread_t *t = tvhpool_self;
+
+  if (pool->id < 0)
+    tvhpool_register(pool);
+  if (t == NULL) {
+    t = calloc(1, sizeof(*t));
+    pthread_setspecific(tvhpool_key, t);
+    pthread_mutex_lock(&tvhpool_lock);
+    LIST_INSERT_HEAD(&tvhpool_threads, t, link);
+    pthread_mutex_unlock(&tvhpool_lock);
+    tvhpool_self = t;
+  }
+  return &t->caches[pool->id];
+}
+
+/*
+ * Fixed size objects
+ */
+void *
+tvhpool_alloc ( tvhpool_t *pool )
+{
+  tvhpool_cache_t *c = tvhpool_cache(pool);
+  tvhpool_obj_t *o;
+
+  c->allocs++;
+  if (c->free == NULL)
+    tvhpool_refill(pool, c);
+  if ((o = c->free) != NULL) {
+    c->free = o->next;
+    c->count--;
+    return o;
+  }
+  c->mallocs++;
+  return malloc(pool->size);
+}
+
+void
+tvhpool_free ( tvhpool_t *pool, void *obj )
+{
+  tvhpool_cache_t *c = tvhpool_cache(pool);
+  tvhpool_obj_t *o = obj;
+
+  c->frees++;
+  o->next = c->free;
+  c->free = o;
+  if (++c->count >= 2 * pool->batch)
+    tvhpool_flush(pool, c, pool->batch);
+}
+
+/*
+ * Data buffers
+ */
+void *
+tvhpool_data_alloc ( size_t size, int *cls )
+{
+  int i = 0;
+
+  if (size > TVHPOOL_DATA_MAX) {
+    *cls = 0;
+    return malloc(size);
+  }
+  while (tvhpool_data[i].size < size)
+    i++;
+  *cls = i + 1;
+  return tvhpool_alloc(&tvhpool_data[i]);
+}
+
+void
+tvhpool_data_free ( void *data, int cls )
+{
+  if (cls == 0)
+    free(data);
+  else if (data)
+    tvhpool_free(&tvhpool_data[cls - 1], data);
+}
+
+/*
+ * Statistics (approximate, thread caches are read without a lock)
+ */
+htsmsg_t *
+tvhpool_stats ( void )
+{
+  htsmsg_t *l = htsmsg_create_list(), *e;
+  tvhpool_thread_t *t;
+  tvhpool_cache_t *c;
+  tvhpool_t *pool;
+  int64_t allocs, frees, mallocs, cached;
+  int i;
+
+  pthread_mutex_lock(&tvhpool_lock);
+  for (i = 0; i < tvhpool_count; i++) {
+    pool = tvhpool_pools[i];
+    pthread_mutex_lock(&pool->lock);
+    allocs  = pool->allocs;
+    frees   = pool->frees;
+    mallocs = pool->mallocs;
+    cached  = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    LIST_FOREACH(t, &tvhpool_threads, link) {
+      c = &t->caches[i];
+      allocs  += c->allocs;
+      frees   += c->frees;
+      mallocs += c->mallocs;
+      cached  += c->count;
+    }
+    e = htsmsg_create_map();
+    htsmsg_add_str(e, "name", pool->name);
+    htsmsg_add_u32(e, "size", pool->size);
+    htsmsg_add_s64(e, "live", allocs - frees);
+    htsmsg_add_s64(e, "allocs", allocs);
+    htsmsg_add_s64(e, "hits", allocs - mallocs);
+    htsmsg_add_u32(e, "hit_rate", allocs ? (allocs - mallocs) * 100 / allocs : 0);
+    htsmsg_add_s64(e, "cached_bytes", cached * pool->size);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  pthread_mutex_unlock(&tvhpool_lock);
+  return l;
+}
+
+/*
+ * Release the shared lists (at exit)
+ */
+void
+tvhpool_done ( void )
+{
+  tvhpool_thread_t *t = tvhpool_self;
+  tvhpool_obj_t *o;
+  tvhpool_t *pool;
+  int i;
+
+  if (t) {
+    pthread_setspecific(tvhpool_key, NULL);
+    tvhpool_self = NULL;
+    tvhpool_thread_exit(t);
+  }
+  pthread_mutex_lock(&tvhpool_lock);
+  for (i = 0; i < tvhpool_count; i++) {
+    pool = tvhpool_pools[i];
+    pthread_mutex_lock(&pool->lock);
+    while ((o = pool->free) != NULL) {
+      pool->free = o->next;
+      free(o);
+    }
+    pool->count = 0;
+    pthread_mutex_unlock(&pool->lock);
+  }
+  pthread_mutex_unlock(&tvhpool_lock);
+}
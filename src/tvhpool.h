@@ -0,0 +1,74 @@
+/*
+ *  Tvheadend - thread caching object pools
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_POOL_H__
+#define __TVH_POOL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "htsmsg.h"
+
+/*
+ * Pool of fixed size objects
+ *
+ * Each thread keeps a small cache of free objects, batches move between
+ * the thread caches and the shared free list. Objects may be freed by
+ * another thread than the one which allocated them.
+ */
+#define TVHPOOL_MAX 16
+
+typedef struct tvhpool_obj {
+  struct tvhpool_obj *next;
+} tvhpool_obj_t;
+
+typedef struct tvhpool {
+  const char      *name;
+  size_t           size;      ///< Object size
+  int              id;        ///< Thread cache slot
+  int              batch;     ///< Objects moved at once
+  int              max;       ///< Maximum objects in the shared list
+
+  pthread_mutex_t  lock;      ///< Protects below
+  tvhpool_obj_t   *free;      ///< Shared free list
+  int              count;     ///< Objects in the shared list
+
+  /* Statistics (thread counts are folded in on batch moves) */
+  int64_t          allocs;
+  int64_t          frees;
+  int64_t          mallocs;
+} tvhpool_t;
+
+#define TVHPOOL_INITIALIZER(n, s) \
+  { .name = n, .size = s, .id = -1, .lock = PTHREAD_MUTEX_INITIALIZER }
+
+void  tvhpool_done   ( void );
+void *tvhpool_alloc  ( tvhpool_t *pool );
+void  tvhpool_free   ( tvhpool_t *pool, void *obj );
+
+/*
+ * Size classed data buffers (powers of two, TVHPOOL_DATA_MIN..MAX)
+ */
+#define TVHPOOL_DATA_MIN 256
+#define TVHPOOL_DATA_MAX 65536
+
+void *tvhpool_data_alloc ( size_t size, int *cls );
+void  tvhpool_data_free  ( void *data, int cls );
+
+htsmsg_t *tvhpool_stats ( void );
+
+#endif /* __TVH_POOL_H__ */
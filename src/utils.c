@@ -28,6 +28,10 @@
 #include <ctype.h>
 #include "tvheadend.h"
 #include "tvh_endian.h"
+#include "mpegts_word.h"
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /**
  * CRC32 
@@ -600,24 +604,12 @@ char *url_encode(char *str) {
  *
  */
 
-static inline uint32_t mpegts_word32( const uint8_t *tsb )
-{
-  //assert(((intptr_t)tsb & 3) == 0);
-  return *(uint32_t *)tsb;
-}
-
-int
-mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
+static int
+mpegts_word_count_scalar
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
 {
-  uint32_t val;
   int r = 0;
 
-#if BYTE_ORDER == LITTLE_ENDIAN
-  mask = bswap_32(mask);
-#endif
-
-  val  = mpegts_word32(tsb) & mask;
-
   while (len >= 188) {
     if (len >= 4*188 &&
         (mpegts_word32(tsb+0*188) & mask) == val &&
@@ -638,3 +630,119 @@ mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
 
   return r;
 }
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+static int
+mpegts_word_count_neon
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  const uint32x4_t vmask = vdupq_n_u32(mask);
+  const uint32x4_t vval  = vdupq_n_u32(val);
+  uint32x4_t w;
+  int r = 0;
+
+  while (len >= 4*188) {
+    w = vdupq_n_u32(mpegts_word32(tsb + 0*188));
+    w = vsetq_lane_u32(mpegts_word32(tsb + 1*188), w, 1);
+    w = vsetq_lane_u32(mpegts_word32(tsb + 2*188), w, 2);
+    w = vsetq_lane_u32(mpegts_word32(tsb + 3*188), w, 3);
+    w = vceqq_u32(vandq_u32(w, vmask), vval);
+    if (vminvq_u32(w) != 0xffffffff)
+      break;
+    r   += 4*188;
+    len -= 4*188;
+    tsb += 4*188;
+  }
+
+  return r + mpegts_word_count_tail(tsb, len, mask, val);
+}
+#endif
+
+/*
+ * mpegts_word_count() stops at the first packet with other header bits,
+ * typically after a few packets, the scalar loop is faster there than the
+ * vector setup (see tests/bench_mpegts_word.c). The SIMD kernels are used
+ * for the sync check, which scans the whole input.
+ */
+static mpegts_word_fcn_t mpegts_word_fcn = mpegts_word_count_scalar;
+static mpegts_word_fcn_t mpegts_sync_fcn = mpegts_word_count_scalar;
+static const char *mpegts_sync_name = "scalar";
+
+static mpegts_word_fcn_t
+mpegts_word_kernel ( const char *name )
+{
+  mpegts_word_fcn_t fcn = NULL;
+
+  if (!strcmp(name, "scalar"))
+    fcn = mpegts_word_count_scalar;
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+#if ENABLE_SSE2
+  if (!strcmp(name, "SSE2") && __builtin_cpu_supports("sse2"))
+    fcn = mpegts_word_count_sse2;
+#endif
+#if ENABLE_AVX2
+  if (!strcmp(name, "AVX2") && __builtin_cpu_supports("avx2"))
+    fcn = mpegts_word_count_avx2;
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  if (!strcmp(name, "NEON"))
+    fcn = mpegts_word_count_neon;
+#endif
+  return fcn;
+}
+
+/*
+ * Select a kernel by name for both functions (tests), fails if it is
+ * not supported by this CPU
+ */
+int
+mpegts_word_select ( const char *name )
+{
+  mpegts_word_fcn_t fcn = mpegts_word_kernel(name);
+
+  if (fcn == NULL)
+    return -1;
+  mpegts_word_fcn  = fcn;
+  mpegts_sync_fcn  = fcn;
+  mpegts_sync_name = name;
+  return 0;
+}
+
+void
+mpegts_word_init ( void )
+{
+  static const char *names[] = { "AVX2", "SSE2", "NEON", "scalar" };
+  mpegts_word_fcn_t fcn;
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(names); i++)
+    if ((fcn = mpegts_word_kernel(names[i])) != NULL) {
+      mpegts_sync_fcn  = fcn;
+      mpegts_sync_name = names[i];
+      break;
+    }
+  mpegts_word_fcn = mpegts_word_count_scalar;
+
+  tvhinfo("mpegts", "Using %s TS sync scanning", mpegts_sync_name);
+}
+
+int
+mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
+{
+#if BYTE_ORDER == LITTLE_ENDIAN
+  mask = bswap_32(mask);
+#endif
+
+  return mpegts_word_fcn(tsb, len, mask, mpegts_word32(tsb) & mask);
+}
+
+int
+mpegts_sync_count ( const uint8_t *tsb, int len )
+{
+#if BYTE_ORDER == LITTLE_ENDIAN
+  return mpegts_sync_fcn(tsb, len, 0x000000FF, 0x00000047);
+#else
+  return mpegts_sync_fcn(tsb, len, 0xFF000000, 0x47000000);
+#endif
+}
@@ -52,12 +52,70 @@ int comet_running;
 
 typedef struct comet_mailbox {
   char *cmb_boxid; /* SHA-1 hash */
-  htsmsg_t *cmb_messages; /* A vector */
+  htsmsg_t *cmb_messages; /* A vector (messages for this mailbox only) */
+  uint64_t cmb_seq; /* Last delivered event */
   time_t cmb_last_used;
   LIST_ENTRY(comet_mailbox) cmb_link;
   int cmb_debug;
 } comet_mailbox_t;
 
+/*
+ * Event log, the broadcast messages are serialized once and
+ * kept until all mailboxes have fetched them
+ */
+typedef struct comet_event {
+  TAILQ_ENTRY(comet_event) ce_link;
+  uint64_t ce_seq;
+  int ce_debug;
+  char *ce_json;
+  size_t ce_len;
+} comet_event_t;
+
+static TAILQ_HEAD(comet_event_queue, comet_event) comet_events =
+  TAILQ_HEAD_INITIALIZER(comet_events);
+static uint64_t comet_seq;
+
+
+/**
+ * Drop the events fetched by all mailboxes
+ */
+static void
+comet_events_trim(void)
+{
+  comet_mailbox_t *cmb;
+  comet_event_t *ce;
+  uint64_t seq = comet_seq;
+
+  LIST_FOREACH(cmb, &mailboxes, cmb_link)
+    if (cmb->cmb_seq < seq)
+      seq = cmb->cmb_seq;
+
+  while ((ce = TAILQ_FIRST(&comet_events)) != NULL && ce->ce_seq <= seq) {
+    TAILQ_REMOVE(&comet_events, ce, ce_link);
+    free(ce->ce_json);
+    free(ce);
+  }
+}
+
+/**
+ *
+ */
+static int
+comet_mailbox_pending(comet_mailbox_t *cmb)
+{
+  comet_event_t *ce;
+
+  if (cmb->cmb_messages)
+    return 1;
+  TAILQ_FOREACH_REVERSE(ce, &comet_events, comet_event_queue, ce_link) {
+    if (ce->ce_seq <= cmb->cmb_seq)
+      break;
+    if (!ce->ce_debug || cmb->cmb_debug)
+      return 1;
+  }
+  return 0;
+}
+
 
 /**
  *
@@ -74,6 +132,8 @@ cmb_destroy(comet_mailbox_t *cmb)
 
   free(cmb->cmb_boxid);
   free(cmb);
+
+  comet_events_trim();
 }
 
 
@@ -125,6 +185,7 @@ comet_mailbox_create(void)
   id[40] = 0;
 
   cmb->cmb_boxid = strdup(id);
+  cmb->cmb_seq = comet_seq;
   time(&cmb->cmb_last_used);
   mailbox_tally++;
 
@@ -200,7 +261,10 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
   int im = immediate ? atoi(immediate) : 0;
   time_t reqtime;
   struct timespec ts;
+  htsmsg_field_t *f;
   htsmsg_t *m;
+  comet_event_t *ce;
+  int first = 1;
 
   if(!im)
     usleep(100000); /* Always sleep 0.1 sec to avoid comet storms */
@@ -228,7 +292,7 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
 
   cmb->cmb_last_used = 0; /* Make sure we're not flushed out */
 
-  if(!im && cmb->cmb_messages == NULL) {
+  if(!im && !comet_mailbox_pending(cmb)) {
     pthread_cond_timedwait(&comet_cond, &comet_mutex, &ts);
     if (!comet_running) {
       pthread_mutex_unlock(&comet_mutex);
@@ -236,17 +300,37 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
     }
   }
 
-  m = htsmsg_create_map();
-  htsmsg_add_str(m, "boxid", cmb->cmb_boxid);
-  htsmsg_add_msg(m, "messages", cmb->cmb_messages ?: htsmsg_create_list());
-  cmb->cmb_messages = NULL;
-  
+  htsbuf_append(&hc->hc_reply, "{\"boxid\": ", 10);
+  htsbuf_append_and_escape_jsonstr(&hc->hc_reply, cmb->cmb_boxid);
+  htsbuf_append(&hc->hc_reply, ",\"messages\": [", 14);
+
+  if ((m = cmb->cmb_messages) != NULL) {
+    HTSMSG_FOREACH(f, m) {
+      if (!first)
+        htsbuf_append(&hc->hc_reply, ",", 1);
+      htsmsg_json_serialize(htsmsg_field_get_map(f), &hc->hc_reply, 0);
+      first = 0;
+    }
+    htsmsg_destroy(m);
+    cmb->cmb_messages = NULL;
+  }
+
+  TAILQ_FOREACH(ce, &comet_events, ce_link) {
+    if (ce->ce_seq <= cmb->cmb_seq || (ce->ce_debug && !cmb->cmb_debug))
+      continue;
+    if (!first)
+      htsbuf_append(&hc->hc_reply, ",", 1);
+    htsbuf_append(&hc->hc_reply, ce->ce_json, ce->ce_len);
+    first = 0;
+  }
+  htsbuf_append(&hc->hc_reply, "]}", 2);
+  cmb->cmb_seq = comet_seq;
+  comet_events_trim();
+
   cmb->cmb_last_used = dispatch_clock;
 
   pthread_mutex_unlock(&comet_mutex);
 
-  htsmsg_json_serialize(m, &hc->hc_reply, 0);
-  htsmsg_destroy(m);
   http_output_content(hc, "text/x-json; charset=UTF-8");
   return 0;
 }
@@ -312,6 +396,7 @@ comet_done(void)
   comet_running = 0;
   while ((cmb = LIST_FIRST(&mailboxes)) != NULL)
     cmb_destroy(cmb);
+  comet_events_trim();
   pthread_mutex_unlock(&comet_mutex);
 }
 
@@ -322,18 +407,27 @@ void
 comet_mailbox_add_message(htsmsg_t *m, int isdebug)
 {
   comet_mailbox_t *cmb;
+  comet_event_t *ce;
+  htsbuf_queue_t hq;
 
   pthread_mutex_lock(&comet_mutex);
 
   if (comet_running) {
-    LIST_FOREACH(cmb, &mailboxes, cmb_link) {
-
-      if(isdebug && !cmb->cmb_debug)
-        continue;
-
-      if(cmb->cmb_messages == NULL)
-        cmb->cmb_messages = htsmsg_create_list();
-      htsmsg_add_msg(cmb->cmb_messages, NULL, htsmsg_copy(m));
+    LIST_FOREACH(cmb, &mailboxes, cmb_link)
+      if(!isdebug || cmb->cmb_debug)
+        break;
+
+    /* Serialize once, the mailboxes keep a position in the log */
+    if (cmb) {
+      htsbuf_queue_init(&hq, 0);
+      htsmsg_json_serialize(m, &hq, 0);
+      ce = malloc(sizeof(*ce));
+      ce->ce_seq   = ++comet_seq;
+      ce->ce_debug = isdebug;
+      ce->ce_len   = hq.hq_size;
+      ce->ce_json  = htsbuf_to_string(&hq);
+      htsbuf_queue_flush(&hq);
+      TAILQ_INSERT_TAIL(&comet_events, ce, ce_link);
     }
   }
 
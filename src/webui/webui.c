@@ -281,7 +281,7 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
     }
 
     timeouts = 0; /* Reset timeout counter */
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
     pthread_mutex_unlock(&sq->sq_mutex);
 
     switch(sm->sm_type) {
@@ -0,0 +1,139 @@
+/*
+ *  Tvheadend - CSA descrambling benchmark
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvhtest.h"
+
+#define FFDECSA (!ENABLE_DVBCSA && (ENABLE_CWC || ENABLE_CAPMT || ENABLE_CONSTCW))
+
+#if FFDECSA
+#include "descrambler/ffdecsa/FFdecsa.h"
+#endif
+
+/*
+ * Usage: bench_csa <fixture dir>
+ *
+ * The packets of the test stream are marked as scrambled (the even
+ * and the odd key in turns, like at a key change) and repeated to 32MB.
+ * Every FFdecsa backend built and supported by the CPU descrambles the
+ * same packets with the same keys, in clusters like tvhcsa does, and
+ * must produce the same output.
+ */
+
+#define BENCH_SIZE (32 * 1024 * 1024)
+#define BENCH_KEY  (4096 * 188)         // bytes per key parity
+
+#if FFDECSA
+
+static const char *backends[] = { "32int", "MMX", "SSE2", "AVX2", "AVX-512" };
+
+static const uint8_t even[8] = { 0x11, 0x22, 0x33, 0x66, 0x44, 0x55, 0x66, 0xff };
+static const uint8_t odd[8]  = { 0xa1, 0xb2, 0xc3, 0x16, 0xd4, 0xe5, 0xf6, 0xcf };
+
+static uint32_t
+bench_hash ( const uint8_t *data, size_t len )
+{
+  uint32_t h = 2166136261U;
+  while (len--)
+    h = (h ^ *data++) * 16777619U;
+  return h;
+}
+
+static void
+bench_decrypt ( void *keys, uint8_t *buf, size_t len, int cluster )
+{
+  unsigned char *vec[3];
+  uint8_t *end = buf + len;
+
+  for ( ; buf < end; buf += cluster * 188) {
+    vec[0] = buf;
+    vec[1] = buf + MIN(cluster * 188, end - buf);
+    vec[2] = NULL;
+    while (vec[0] != NULL)
+      if (decrypt_packets(keys, vec) <= 0)
+        break;
+  }
+}
+
+int
+main ( int argc, char **argv )
+{
+  uint8_t *cap = NULL, *src, *buf;
+  size_t caplen, len, i;
+  uint32_t hash, hash0 = 0;
+  int64_t t;
+  void *keys;
+  int k, cluster, first = 1;
+
+  cap = tvhtest_load(argc > 1 ? argv[1] : NULL, "mpeg2video.ts", &caplen);
+  caplen -= caplen % 188;
+  len = BENCH_SIZE / caplen * caplen;
+  src = malloc(len);
+  buf = malloc(len);
+  for (i = 0; i < len; i += caplen)
+    memcpy(src + i, cap, caplen);
+  for (i = 0; i < len; i += 188)
+    if (src[i+3] & 0x10)
+      src[i+3] = (src[i+3] & 0x3f) | ((i / BENCH_KEY) & 1 ? 0xc0 : 0x80);
+
+  printf("CSA descrambling, %zu bytes\n", len);
+  for (k = 0; k < ARRAY_SIZE(backends); k++) {
+    if (ffdecsa_select(backends[k]))
+      continue;
+    keys = get_key_struct();
+    set_even_control_word(keys, even);
+    set_odd_control_word(keys, odd);
+    cluster = get_suggested_cluster_size();
+
+    memcpy(buf, src, len);
+    t = tvhtest_clock();
+    bench_decrypt(keys, buf, len, cluster);
+    t = tvhtest_clock() - t;
+    printf("%s (parallelism %d, cluster %d):\n", backends[k],
+           get_internal_parallelism(), cluster);
+    tvhtest_rate("decrypt_packets", t, len);
+
+    hash = bench_hash(buf, len);
+    if (first) {
+      hash0 = hash;
+      first = 0;
+    }
+    TVHTEST_CHECK(hash == hash0, "%s: output differs", backends[k]);
+    for (i = 0; i < len; i += 188)
+      if (buf[i+3] & 0xc0)
+        break;
+    TVHTEST_CHECK(i >= len, "%s: packet %zd left scrambled",
+                  backends[k], i / 188);
+    free_key_struct(keys);
+  }
+
+  free(buf);
+  free(src);
+  free(cap);
+  return tvhtest_result("bench_csa");
+}
+
+#else
+
+int
+main ( int argc, char **argv )
+{
+  printf("FFdecsa is not built (libdvbcsa or no CA clients)\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ *  Tvheadend - DVR entry lookup benchmark
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dvr/dvr_db.c" // first, for _GNU_SOURCE
+#include "tvhtest.h"
+
+/*
+ * Usage: bench_dvr_db <fixture dir>
+ *
+ * 50k DVR entries (mostly recording history) are linked to broadcasts
+ * of 200 channels, then 1M EPG updates do the lookups of an update
+ * (dvr_entry_find_by_event() and the autorec duplicate check
+ * dvr_entry_find_identical()) and an HTSP lookup by id. The linear scans
+ * which the hashes replaced run on a part of the updates only, the rates
+ * are per update. Both must find the same entries.
+ */
+
+#define BENCH_CHANNELS   200
+#define BENCH_EPISODES   100000
+#define BENCH_BCASTS     400000
+#define BENCH_ENTRIES    50000
+#define BENCH_UPDATES    1000000
+#define BENCH_LINEAR     500
+
+static channel_t        bench_channels[BENCH_CHANNELS];
+static epg_broadcast_t *bcasts[BENCH_BCASTS];
+static int              ids[BENCH_ENTRIES];
+
+/* The previous linear lookups */
+static dvr_entry_t *
+bench_find_by_event_ref ( epg_broadcast_t *e )
+{
+  dvr_entry_t *de;
+
+  if(!e->channel) return NULL;
+
+  LIST_FOREACH(de, &e->channel->ch_dvrs, de_channel_link)
+    if(de->de_bcast == e) return de;
+  return NULL;
+}
+
+static dvr_entry_t *
+bench_find_identical_ref ( epg_broadcast_t *e )
+{
+  dvr_entry_t *de;
+
+  LIST_FOREACH(de, &dvrentries, de_global_link)
+    if (de->de_bcast == e || (de->de_bcast && de->de_bcast->episode == e->episode))
+      return de;
+  return NULL;
+}
+
+static dvr_entry_t *
+bench_find_by_id_ref ( int id )
+{
+  dvr_entry_t *de;
+
+  LIST_FOREACH(de, &dvrentries, de_global_link)
+    if(idnode_get_short_uuid(&de->de_id) == id)
+      break;
+  return de;
+}
+
+static void
+bench_setup ( void )
+{
+  epg_episode_t *ep, *episodes[BENCH_EPISODES];
+  epg_broadcast_t *e;
+  dvr_entry_t *de;
+  uint32_t u32;
+  int i;
+
+  LIST_INIT(&dvrentries);
+  for (i = 0; i < BENCH_CHANNELS; i++)
+    LIST_INIT(&bench_channels[i].ch_dvrs);
+  for (i = 0; i < BENCH_EPISODES; i++) {
+    episodes[i] = calloc(1, sizeof(epg_episode_t));
+    LIST_INIT(&episodes[i]->broadcasts);
+  }
+  for (i = 0; i < BENCH_BCASTS; i++) {
+    e = bcasts[i] = calloc(1, sizeof(*e));
+    ep = episodes[tvhtest_random() % BENCH_EPISODES];
+    e->id = i + 1;
+    e->channel = &bench_channels[tvhtest_random() % BENCH_CHANNELS];
+    e->episode = ep;
+    LIST_INSERT_HEAD(&ep->broadcasts, e, ep_link);
+  }
+
+  for (i = 0; i < BENCH_ENTRIES; i++) {
+    de = calloc(1, sizeof(*de));
+    u32 = tvhtest_random();
+    memcpy(de->de_id.in_uuid, &u32, sizeof(u32));
+    ids[i] = idnode_get_short_uuid(&de->de_id);
+    de->de_sched_state = (i % 50) ? DVR_COMPLETED : DVR_SCHEDULED;
+    if ((i % 10) != 0) {
+      de->de_bcast = bcasts[i * (BENCH_BCASTS / BENCH_ENTRIES)];
+      de->de_channel = de->de_bcast->channel;
+    } else {
+      de->de_channel = &bench_channels[tvhtest_random() % BENCH_CHANNELS];
+    }
+    LIST_INSERT_HEAD(&de->de_channel->ch_dvrs, de, de_channel_link);
+    LIST_INSERT_HEAD(&dvrentries, de, de_global_link);
+    dvr_entry_index(de);
+  }
+}
+
+/*
+ * Run the lookups of n updates, returns a checksum of the entries found
+ */
+static uintptr_t
+bench_run ( int ref, int n, int64_t *ns )
+{
+  epg_broadcast_t *e;
+  uintptr_t r = 0;
+  uint32_t seed = tvhtest_seed;
+  int64_t t = tvhtest_clock();
+  int i, id;
+
+  for (i = 0; i < n; i++) {
+    e  = bcasts[tvhtest_random() % BENCH_BCASTS];
+    id = (tvhtest_random() & 1) ? ids[tvhtest_random() % BENCH_ENTRIES]
+                                : (int)(tvhtest_random() & 0x7FFFFFFF);
+    if (ref) {
+      r += (uintptr_t)bench_find_by_event_ref(e);
+      r += (uintptr_t)bench_find_identical_ref(e) ? 1 : 0;
+      r += (uintptr_t)bench_find_by_id_ref(id);
+    } else {
+      r += (uintptr_t)dvr_entry_find_by_event(e);
+      r += (uintptr_t)dvr_entry_find_identical(e) ? 1 : 0;
+      r += (uintptr_t)dvr_entry_find_by_id(id);
+    }
+  }
+  *ns = tvhtest_clock() - t;
+  tvhtest_seed = seed;
+  return r;
+}
+
+static void
+bench_print ( const char *name, int64_t ns, int n )
+{
+  printf("  %-24s %10.3f ms %10.1f updates/s\n", name, ns / 1e6,
+         ns > 0 ? n * 1e9 / ns : 0.0);
+}
+
+int
+main ( int argc, char **argv )
+{
+  int64_t ns;
+  uintptr_t r1, r2;
+
+  bench_setup();
+  printf("%d entries, %d broadcasts:\n", BENCH_ENTRIES, BENCH_BCASTS);
+
+  r1 = bench_run(1, BENCH_LINEAR, &ns);
+  bench_print("linear", ns, BENCH_LINEAR);
+  r2 = bench_run(0, BENCH_LINEAR, &ns);
+  TVHTEST_CHECK(r1 == r2, "lookups differ");
+  bench_run(0, BENCH_UPDATES, &ns);
+  bench_print("hashed", ns, BENCH_UPDATES);
+
+  return tvhtest_result("bench_dvr_db");
+}
@@ -0,0 +1,144 @@
+/*
+ *  Tvheadend - huffman decoder (OpenTV, Freesat) benchmark
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "huffman_ref.h"
+
+/*
+ * Usage: bench_huffman <fixture dir>
+ *
+ * The EPG text fixture is encoded with every dictionary and table, the
+ * strings are decoded repeatedly (about 4MB of encoded input) by the
+ * bitwise decoders and by the lookup table decoders, the rates are per
+ * encoded byte. Both must produce the same output.
+ */
+
+#define BENCH_SIZE  (4 * 1024 * 1024)
+#define BENCH_LINES 256
+#define BENCH_OUT   1024
+
+typedef struct bench_str {
+  uint8_t enc[BENCH_OUT];
+  size_t  len;
+} bench_str_t;
+
+static bench_str_t strs[BENCH_LINES];
+static int         nstrs;
+static size_t      nbytes;
+
+static uint32_t
+bench_hash ( uint32_t h, const char *s )
+{
+  while (*s)
+    h = (h ^ (uint8_t)*s++) * 16777619U;
+  return h;
+}
+
+/*
+ * Decode all strings until BENCH_SIZE bytes are done (dict is NULL for
+ * Freesat), returns the output hash
+ */
+static uint32_t
+bench_run ( huffman_dict_t *d, int ref, int64_t *ns, size_t *bytes )
+{
+  char out[BENCH_OUT];
+  uint32_t h = 2166136261U;
+  size_t done = 0, l;
+  int64_t t = tvhtest_clock();
+  int i;
+
+  while (done < BENCH_SIZE) {
+    for (i = 0; i < nstrs; i++) {
+      if (d) {
+        if (ref)
+          huffman_decode_ref(d->tree, strs[i].enc, strs[i].len, 0x20,
+                             out, sizeof(out));
+        else
+          huffman_decode(d->tree, strs[i].enc, strs[i].len, 0x20,
+                         out, sizeof(out));
+      } else {
+        l = sizeof(out) - 1;
+        if (ref)
+          freesat_huffman_decode_ref(out, &l, strs[i].enc, strs[i].len);
+        else
+          freesat_huffman_decode(out, &l, strs[i].enc, strs[i].len);
+      }
+      h = bench_hash(h, out);
+    }
+    done += nbytes;
+  }
+  *ns = tvhtest_clock() - t;
+  *bytes = done;
+  return h;
+}
+
+static void
+bench_decoders ( const char *name, huffman_dict_t *d )
+{
+  int64_t ns;
+  size_t bytes;
+  uint32_t h1, h2;
+
+  printf("%s (%d strings, %zu bytes):\n", name, nstrs, nbytes);
+  h1 = bench_run(d, 1, &ns, &bytes);
+  tvhtest_rate("bitwise", ns, bytes);
+  h2 = bench_run(d, 0, &ns, &bytes);
+  tvhtest_rate("lookup table", ns, bytes);
+  TVHTEST_CHECK(h1 == h2, "%s: output differs", name);
+}
+
+int
+main ( int argc, char **argv )
+{
+  static const char *dicts[] = { "skyeng", "skyit" };
+  huffman_dict_t *d;
+  char *text, *r = NULL, *lines[BENCH_LINES], plain[BENCH_OUT], name[32];
+  size_t len;
+  int i, k, n = 0;
+
+  text = (char *)tvhtest_load(argc > 1 ? argv[1] : NULL, "epg_text.txt", &len);
+  for (lines[0] = strtok_r(text, "\n", &r); lines[n] && n < BENCH_LINES - 1;
+       lines[++n] = strtok_r(NULL, "\n", &r));
+
+  for (k = 0; k < ARRAY_SIZE(dicts) + 2; k++) {
+    nstrs  = n;
+    nbytes = 0;
+    d = k < ARRAY_SIZE(dicts) ?
+        huffman_dict_load(argc > 1 ? argv[1] : NULL, dicts[k]) : NULL;
+    for (i = 0; i < n; i++) {
+      if (d)
+        strs[i].len = huffman_encode_opentv(d, lines[i], strs[i].enc,
+                                            sizeof(strs[i].enc), plain);
+      else
+        strs[i].len = huffman_encode_freesat(k - ARRAY_SIZE(dicts) + 1,
+                                             lines[i], strs[i].enc,
+                                             sizeof(strs[i].enc));
+      nbytes += strs[i].len;
+    }
+    if (d)
+      snprintf(name, sizeof(name), "OpenTV %s", dicts[k]);
+    else
+      snprintf(name, sizeof(name), "Freesat table %d",
+               k - (int)ARRAY_SIZE(dicts) + 1);
+    bench_decoders(name, d);
+    if (d)
+      huffman_dict_free(d);
+  }
+
+  free(text);
+  return tvhtest_result("bench_huffman");
+}
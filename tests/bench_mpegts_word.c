@@ -0,0 +1,122 @@
+/*
+ *  Tvheadend - TS header scanning kernels benchmark
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvhtest.h"
+
+/*
+ * Usage: bench_mpegts_word <fixture dir> [capture.ts]
+ *
+ * The capture (the synthetic tests/data/mpeg2video.ts by default) is
+ * repeated to 64MB, every kernel supported by the CPU is run on the same
+ * data.
+ */
+
+#define BENCH_SIZE  (64 * 1024 * 1024)
+#define BENCH_CHUNK (188 * 7 * 48)   // typical input read
+
+static const char *kernels[] = { "scalar", "SSE2", "AVX2", "NEON" };
+
+/* Input sync check, on every chunk */
+static int64_t
+bench_sync ( const uint8_t *buf, int len )
+{
+  int64_t r = 0;
+  int off, l;
+
+  for (off = 0; off < len; off += BENCH_CHUNK) {
+    l = MIN(BENCH_CHUNK, len - off);
+    r += mpegts_sync_count(buf + off, l);
+  }
+  return r;
+}
+
+/* Runs of packets with the same PID and flags (mpegts_input_process) */
+static int64_t
+bench_word ( const uint8_t *buf, int len )
+{
+  int64_t r = 0;
+  int off, l;
+
+  for (off = 0; off + 188 <= len; off += l) {
+    l = mpegts_word_count(buf + off, len - off, 0xFF9FFFD0);
+    l = MAX(l, 188);
+    r++;
+  }
+  return r;
+}
+
+int
+main ( int argc, char **argv )
+{
+  const char *dir = argc > 1 ? argv[1] : NULL;
+  uint8_t *cap, *buf;
+  size_t caplen, len;
+  int64_t t, sync, runs, sync0 = -1, runs0 = -1;
+  FILE *f;
+  int i, k;
+
+  if (argc > 2) {
+    if ((f = fopen(argv[2], "rb")) == NULL) {
+      perror(argv[2]);
+      return 2;
+    }
+    cap = malloc(BENCH_SIZE);
+    caplen = fread(cap, 1, BENCH_SIZE, f);
+    fclose(f);
+  } else {
+    cap = tvhtest_load(dir, "mpeg2video.ts", &caplen);
+  }
+  for (i = 0; i + 188 <= caplen && cap[i] != 0x47; i++);
+  caplen = (caplen - i) / 188 * 188;
+  if (caplen == 0) {
+    fprintf(stderr, "no TS packets in the capture\n");
+    return 2;
+  }
+
+  len = BENCH_SIZE / caplen * caplen;
+  buf = malloc(len);
+  for (k = 0; k < len; k += caplen)
+    memcpy(buf + k, cap + i, caplen);
+
+  printf("TS header scanning, %zu bytes (capture %zu bytes)\n", len, caplen);
+  for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+    if (mpegts_word_select(kernels[k]))
+      continue;
+    bench_sync(buf, len);                   // warm up
+    t = tvhtest_clock();
+    sync = bench_sync(buf, len);
+    t = tvhtest_clock() - t;
+    printf("%s:\n", kernels[k]);
+    tvhtest_rate("mpegts_sync_count", t, len);
+    t = tvhtest_clock();
+    runs = bench_word(buf, len);
+    t = tvhtest_clock() - t;
+    tvhtest_rate("mpegts_word_count", t, len);
+    if (sync0 < 0) {
+      sync0 = sync;
+      runs0 = runs;
+    }
+    TVHTEST_CHECK(sync == sync0 && runs == runs0,
+                  "%s: sync %"PRId64"/%"PRId64" runs %"PRId64"/%"PRId64,
+                  kernels[k], sync, sync0, runs, runs0);
+  }
+
+  free(buf);
+  free(cap);
+  return tvhtest_result("bench_mpegts_word");
+}
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+#
+# Generate the synthetic MPEG-TS test streams in tests/data
+#
+#   mpeg2video.ts  MPEG-2 video on PID 257
+#   h264.ts        H.264 video on PID 257
+#
+# Both have four more PIDs (272-275) with random payloads. Only the
+# headers the parsers look at are real (PES headers with PTS/DTS,
+# sequence/GOP/picture headers, H.264 AUD/SPS/PPS/slice headers and
+# filler NALs), the picture data is random, the streams don't decode.
+# The output is reproducible (own PRNG), run it after changing it and
+# commit the streams together with the script:
+#
+#   tests/data/gen_ts.py tests/data
+#
+
+import os, sys
+
+VIDEO_PID  = 257
+OTHER_PIDS = [ 272, 273, 274, 275 ]
+
+# Reproducible pseudo random numbers (xorshift32, like tests/tvhtest.h)
+class Random:
+  def __init__ ( self, seed ):
+    self.s = seed
+  def next ( self ):
+    s = self.s
+    s ^= (s << 13) & 0xffffffff
+    s ^= s >> 17
+    s ^= (s << 5) & 0xffffffff
+    self.s = s
+    return s
+  def range ( self, a, b ):
+    return a + self.next() % (b - a + 1)
+  def data ( self, n ):
+    # Never a startcode prefix (no zero bytes)
+    return bytes(1 + self.next() % 255 for i in range(n))
+
+# Bit writer (H.264 exp-golomb)
+class Bits:
+  def __init__ ( self ):
+    self.bits = []
+  def u ( self, n, v ):
+    for i in range(n - 1, -1, -1):
+      self.bits.append((v >> i) & 1)
+  def ue ( self, v ):
+    v += 1
+    n = v.bit_length()
+    self.u(n - 1, 0)
+    self.u(n, v)
+  def trailing ( self ):
+    self.bits.append(1)
+    while len(self.bits) % 8:
+      self.bits.append(0)
+  def data ( self ):
+    b = bytearray()
+    for i in range(0, len(self.bits) - 7, 8):
+      v = 0
+      for bit in self.bits[i:i+8]:
+        v = v << 1 | bit
+      b.append(v)
+    return bytes(b)
+
+# PES header (video, unbounded length)
+def pes ( pts, dts ):
+  def ts ( pre, t ):
+    return bytes([ pre << 4 | (t >> 29) & 0x0e | 1,
+                   (t >> 22) & 0xff, (t >> 14) & 0xfe | 1,
+                   (t >> 7) & 0xff, (t << 1) & 0xfe | 1 ])
+  if dts is None or dts == pts:
+    return b'\x00\x00\x01\xe0\x00\x00\x80\x80\x05' + ts(2, pts)
+  return b'\x00\x00\x01\xe0\x00\x00\x80\xc0\x0a' + ts(3, pts) + ts(1, dts)
+
+# Frames in coding order (type, display offset), GOPs of 12
+def gop ( n ):
+  r = []
+  while len(r) < n:
+    r += [ ('I', 2) ] + [ ('P', 3), ('B', 0), ('B', 0) ] * 3 + \
+         [ ('P', 2), ('B', 0) ]
+  return r[:n]
+
+def mpeg2_es ( rnd, frames ):
+  es = []
+  dts = 90000
+  for i, (t, off) in enumerate(gop(frames)):
+    f = pes(dts + off * 3600, dts)
+    if t == 'I':
+      # sequence header 720x576 4:3 25fps, extension, GOP
+      f += b'\x00\x00\x01\xb3' + bytes([ 0x2d, 0x02, 0x40, 0x23,
+                                         0x27, 0x10, 0x23, 0x98 ])
+      f += b'\x00\x00\x01\xb5\x14\x8a\x00\x01\x00\x00'
+      f += b'\x00\x00\x01\xb8' + bytes([ 0x00, 0x08, 0x00, 0x40 ])
+    ptype = { 'I': 1, 'P': 2, 'B': 3 }[t]
+    f += b'\x00\x00\x01\x00' + bytes([ (i >> 2) & 0xff,
+                                       (i & 3) << 6 | ptype << 3 | 7,
+                                       0xff, 0xf8 ])
+    f += b'\x00\x00\x01\xb5\x8f\xff\xf3\x41\x80'
+    for s in range(1, rnd.range(2, 9) + 1):
+      f += bytes([ 0, 0, 1, s ]) + rnd.data(rnd.range(40, 800))
+    es.append(f)
+    dts += 3600
+  return es
+
+def nal ( ref, typ, rbsp ):
+  # Emulation prevention
+  b = bytearray()
+  z = 0
+  for c in rbsp:
+    if z >= 2 and c <= 3:
+      b.append(3)
+      z = 0
+    b.append(c)
+    z = z + 1 if c == 0 else 0
+  return b'\x00\x00\x00\x01' + bytes([ ref << 5 | typ ]) + bytes(b)
+
+def h264_sps ( ):
+  b = Bits()
+  b.u(8, 77)                # profile_idc (main)
+  b.u(8, 0)                 # constraint flags
+  b.u(8, 30)                # level_idc
+  b.ue(0)                   # seq_parameter_set_id
+  b.ue(0)                   # log2_max_frame_num_minus4
+  b.ue(2)                   # pic_order_cnt_type
+  b.ue(2)                   # max_num_ref_frames
+  b.u(1, 0)                 # gaps_in_frame_num_value_allowed_flag
+  b.ue(44)                  # pic_width_in_mbs_minus1 (720)
+  b.ue(35)                  # pic_height_in_map_units_minus1 (576)
+  b.u(1, 1)                 # frame_mbs_only_flag
+  b.u(1, 1)                 # direct_8x8_inference_flag
+  b.u(1, 0)                 # frame_cropping_flag
+  b.u(1, 1)                 # vui_parameters_present_flag
+  b.u(1, 1)                 # aspect_ratio_info_present_flag
+  b.u(8, 2)                 # aspect_ratio_idc (12:11)
+  b.u(1, 0)                 # overscan_info_present_flag
+  b.u(1, 0)                 # video_signal_type_present_flag
+  b.u(1, 0)                 # chroma_loc_info_present_flag
+  b.u(1, 1)                 # timing_info_present_flag
+  b.u(32, 1)                # num_units_in_tick
+  b.u(32, 50)               # time_scale (25fps)
+  b.u(1, 1)                 # fixed_frame_rate_flag
+  b.u(1, 0)                 # nal_hrd_parameters_present_flag
+  b.u(1, 0)                 # vcl_hrd_parameters_present_flag
+  b.u(1, 0)                 # pic_struct_present_flag
+  b.u(1, 0)                 # bitstream_restriction_flag
+  b.trailing()
+  return nal(3, 7, b.data())
+
+def h264_pps ( ):
+  b = Bits()
+  b.ue(0)                   # pic_parameter_set_id
+  b.ue(0)                   # seq_parameter_set_id
+  b.u(1, 0)                 # entropy_coding_mode_flag
+  b.u(1, 0)                 # bottom_field_pic_order_in_frame_present_flag
+  b.ue(0)                   # num_slice_groups_minus1
+  b.ue(0)                   # num_ref_idx_l0_default_active_minus1
+  b.ue(0)                   # num_ref_idx_l1_default_active_minus1
+  b.u(1, 0)                 # weighted_pred_flag
+  b.u(2, 0)                 # weighted_bipred_idc
+  b.ue(0)                   # pic_init_qp_minus26 (se 0)
+  b.ue(0)                   # pic_init_qs_minus26 (se 0)
+  b.ue(0)                   # chroma_qp_index_offset (se 0)
+  b.u(1, 1)                 # deblocking_filter_control_present_flag
+  b.u(1, 0)                 # constrained_intra_pred_flag
+  b.u(1, 0)                 # redundant_pic_cnt_present_flag
+  b.trailing()
+  return nal(3, 8, b.data())
+
+def h264_slice ( rnd, t, frame_num, first_mb ):
+  b = Bits()
+  b.ue(first_mb)            # first_mb_in_slice
+  b.ue({ 'P': 5, 'B': 6, 'I': 7 }[t]) # slice_type
+  b.ue(0)                   # pic_parameter_set_id
+  b.u(4, frame_num & 15)    # frame_num
+  if t == 'I':
+    b.ue(0)                 # idr_pic_id
+  b.trailing()
+  return nal(3 if t != 'B' else 0, 5 if t == 'I' else 1,
+             b.data() + rnd.data(rnd.range(200, 1500)))
+
+def h264_es ( rnd, frames ):
+  es = []
+  dts = 90000
+  frame_num = 0
+  for i, (t, off) in enumerate(gop(frames)):
+    f = pes(dts + off * 3600, dts)
+    f += nal(0, 9, bytes([ { 'I': 0x10, 'P': 0x30, 'B': 0x50 }[t] ]))
+    if t == 'I':
+      f += h264_sps() + h264_pps()
+      frame_num = 0
+    if rnd.range(0, 3) == 0:
+      f += nal(0, 6, b'\x05\x10' + rnd.data(16) + b'\x80')  # SEI
+    for s in range(rnd.range(1, 3)):
+      f += h264_slice(rnd, t, frame_num, s * 540)
+    if rnd.range(0, 4) == 0:
+      f += nal(0, 12, b'\xff' * rnd.range(10, 200) + b'\x80')  # filler
+    if t != 'B':
+      frame_num += 1
+    es.append(f)
+    dts += 3600
+  return es
+
+# TS packets, a PES per frame, other PIDs interleaved
+def mux ( rnd, es ):
+  out = bytearray()
+  cc = {}
+
+  def packet ( pid, pusi, payload ):
+    c = cc.get(pid, 0)
+    cc[pid] = (c + 1) & 15
+    hdr = bytes([ 0x47, (0x40 if pusi else 0) | pid >> 8, pid & 0xff ])
+    if len(payload) < 184:
+      # adaptation field stuffing
+      n = 183 - len(payload)
+      af = bytes([ n ]) + (b'\x00' + b'\xff' * (n - 1) if n else b'')
+      return hdr + bytes([ 0x30 | c ]) + af + payload
+    return hdr + bytes([ 0x10 | c ]) + payload
+
+  for f in es:
+    for i in range(0, len(f), 184):
+      out += packet(VIDEO_PID, i == 0, f[i:i+184])
+      while rnd.range(0, 1):
+        pid = OTHER_PIDS[rnd.next() % len(OTHER_PIDS)]
+        out += packet(pid, rnd.range(0, 7) == 0, rnd.data(184))
+  return bytes(out)
+
+def main ( ):
+  d = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(sys.argv[0])
+  streams = [
+    ( 'mpeg2video.ts', 0x2f6b3d19, mpeg2_es, 36 ),
+    ( 'h264.ts',       0x6a09e667, h264_es,  48 ),
+  ]
+  for name, seed, gen, frames in streams:
+    rnd = Random(seed)
+    ts  = mux(rnd, gen(rnd, frames))
+    with open(os.path.join(d, name), 'wb') as f:
+      f.write(ts)
+    print('%s: %d packets' % (name, len(ts) // 188))
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,348 @@
+/*
+ *  Tvheadend - huffman decoder references and encoders
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_TEST_HUFFMAN_REF_H__
+#define __TVH_TEST_HUFFMAN_REF_H__
+
+#include "tvhtest.h"
+#include "huffman.h"
+#include "htsmsg_json.h"
+#include "channels.h"
+#include "epggrab.h"
+#include "epggrab/private.h"
+
+/*
+ * The bitwise decoders which the lookup table decoders replaced (copies
+ * of the previous src/huffman.c and freesat_huffman.c code), encoders
+ * building the input from plain text and the dictionaries.
+ */
+
+/* src/epggrab/support/freesat_huffman.c */
+struct fsattab {
+	unsigned int value;
+	short bits;
+	char next;
+};
+
+extern struct fsattab fsat_table_1[], fsat_table_2[];
+extern unsigned int fsat_index_1[], fsat_index_2[];
+
+#define START   '\0'
+#define STOP    '\0'
+#define ESCAPE  '\1'
+
+static char *
+huffman_decode_ref
+  ( huffman_node_t *tree, const uint8_t *data, size_t len, uint8_t mask,
+    char *outb, int outl )
+{
+  char           *ret  = outb;
+  huffman_node_t *node = tree;
+  if (!len) return NULL;
+
+  outl--; // leave space for NULL
+  while (len) {
+    len--;
+    while (mask) {
+      if (*data & mask) {
+        node = node->b1;
+      } else {
+        node = node->b0;
+      }
+      mask >>= 1;
+      if (!node) goto end;
+      if (node->data) {
+        char *t = node->data;
+        while (*t && outl) {
+          *outb = *t;
+          outb++; t++; outl--;
+        }
+        if (!outl) goto end;
+        node = tree;
+      }
+    }
+    mask = 0x80;
+    data++;
+  }
+end:
+  *outb = '\0';
+  return ret;
+}
+
+static size_t
+freesat_huffman_decode_ref
+  (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen)
+{
+	struct fsattab *fsat_table;
+	unsigned int *fsat_index;
+	size_t p;
+	unsigned int value;
+	unsigned int byte;
+	unsigned int bit;
+	char lastch;
+	int found;
+	unsigned int bitShift;
+	char nextCh;
+	unsigned int indx;
+	unsigned int j;
+	unsigned int mask;
+	unsigned int maskbit;
+	unsigned short kk;
+	unsigned int b;
+
+	if (src[0] != 0x1f) return -1;
+
+	p = 0;
+	if (src[1] == 1 || src[1] == 2) {
+		if (src[1] == 1) {
+			fsat_table = fsat_table_1;
+			fsat_index = fsat_index_1;
+		} else {
+			fsat_table = fsat_table_2;
+			fsat_index = fsat_index_2;
+		}
+		value = 0;
+		byte = 2;
+		bit = 0;
+		while (byte < 6 && byte < srclen) {
+			value |= src[byte] << ((5 - byte) * 8);
+			byte++;
+		}
+		lastch = START;
+
+		do {
+			found = 0;
+			bitShift = 0;
+			nextCh = STOP;
+			if (lastch == ESCAPE) {
+				found = 1;
+				nextCh = (value >> 24) & 0xff;
+				bitShift = 8;
+				if ((nextCh & 0x80) == 0) {
+					if (nextCh < ' ')
+						nextCh = STOP;
+					lastch = nextCh;
+				}
+			} else {
+				indx = (unsigned int) lastch;
+				for (j = fsat_index[indx]; j < fsat_index[indx + 1]; j++) {
+					mask = 0;
+					maskbit = 0x80000000;
+					for (kk = 0; kk < fsat_table[j].bits; kk++) {
+						mask |= maskbit;
+						maskbit >>= 1;
+					}
+					if ((value & mask) == fsat_table[j].value) {
+						nextCh = fsat_table[j].next;
+						bitShift = fsat_table[j].bits;
+						found = 1;
+						lastch = nextCh;
+						break;
+					}
+				}
+			}
+			if (found) {
+				if (nextCh != STOP && nextCh != ESCAPE) {
+					if (p >= *dstlen) return 0;
+					dst[p++] = nextCh;
+				}
+				for (b = 0; b < bitShift; b++) {
+					value = (value << 1) & 0xfffffffe;
+					if (byte < srclen)
+						value |= (src[byte] >> (7 - bit)) & 1;
+					if (bit == 7) {
+						bit = 0;
+						byte++;
+					} else
+						bit++;
+				}
+			} else {
+				return -1;
+			}
+		} while (lastch != STOP && byte < srclen + 4);
+
+		dst[p] = '\0';
+		*dstlen = p;
+		return 0;
+	} else {
+		return -1;
+	}
+}
+
+/*
+ * Bit writer (MSB first)
+ */
+typedef struct huffman_bits {
+  uint8_t *buf;
+  size_t   size;
+  size_t   pos;   // bits
+} huffman_bits_t;
+
+static inline void
+huffman_bits_put ( huffman_bits_t *b, uint32_t value, int bits )
+{
+  for ( ; bits > 0; bits--, b->pos++) {
+    if ((b->pos >> 3) >= b->size)
+      return;
+    if ((value >> (bits - 1)) & 1)
+      b->buf[b->pos >> 3] |= 0x80 >> (b->pos & 7);
+  }
+}
+
+/*
+ * OpenTV dictionary (decoder tree and the code list for the encoder)
+ */
+typedef struct huffman_dict {
+  huffman_node_t *tree;
+  int             count;
+  char           *data[1024];
+  char           *code[1024];
+} huffman_dict_t;
+
+static inline huffman_dict_t *
+huffman_dict_load ( const char *dir, const char *name )
+{
+  huffman_dict_t *d = calloc(1, sizeof(*d));
+  char path[64];
+  const char *code, *data;
+  uint8_t *json;
+  htsmsg_field_t *f;
+  htsmsg_t *m, *e;
+  size_t len;
+
+  snprintf(path, sizeof(path), "../../data/conf/epggrab/opentv/dict/%s", name);
+  json = tvhtest_load(dir, path, &len);
+  m = htsmsg_json_deserialize((char *)json);
+  free(json);
+  if (m == NULL) {
+    fprintf(stderr, "unable to parse dictionary %s\n", name);
+    exit(2);
+  }
+  d->tree = huffman_tree_build(m);
+  HTSMSG_FOREACH(f, m) {
+    if ((e = htsmsg_get_map_by_field(f)) == NULL)
+      continue;
+    code = htsmsg_get_str(e, "code");
+    data = htsmsg_get_str(e, "data");
+    if (code && data && *data && d->count < ARRAY_SIZE(d->data)) {
+      d->data[d->count] = strdup(data);
+      d->code[d->count] = strdup(code);
+      d->count++;
+    }
+  }
+  htsmsg_destroy(m);
+  return d;
+}
+
+static inline void
+huffman_dict_free ( huffman_dict_t *d )
+{
+  int i;
+
+  for (i = 0; i < d->count; i++) {
+    free(d->data[i]);
+    free(d->code[i]);
+  }
+  huffman_tree_destroy(d->tree);
+  free(d);
+}
+
+/*
+ * Encode text like OpenTV (longest dictionary match first, the code
+ * starts at bit 2 like in the EPG descriptors, characters which are not
+ * in the dictionary are skipped, the encoded ones are copied to plain),
+ * returns the length in bytes
+ */
+static inline size_t
+huffman_encode_opentv ( huffman_dict_t *d, const char *text,
+                        uint8_t *out, size_t size, char *plain )
+{
+  huffman_bits_t b = { out, size, 2 };
+  const char *c;
+  int i, best, bestlen, l;
+
+  memset(out, 0, size);
+  for (c = text; *c; ) {
+    best = -1;
+    bestlen = 0;
+    for (i = 0; i < d->count; i++) {
+      l = strlen(d->data[i]);
+      if (l > bestlen && !strncmp(c, d->data[i], l)) {
+        best = i;
+        bestlen = l;
+      }
+    }
+    if (best < 0) {
+      c++;
+      continue;
+    }
+    for (l = 0; d->code[best][l]; l++)
+      huffman_bits_put(&b, d->code[best][l] == '1', 1);
+    memcpy(plain, c, bestlen);
+    plain += bestlen;
+    c += bestlen;
+  }
+  *plain = '\0';
+  return MIN(size, (b.pos + 7) >> 3);
+}
+
+/*
+ * Encode text like Freesat (table 1 or 2, escaped when a character has
+ * no code in the current state), returns the length in bytes
+ */
+static inline int
+fsat_encode_char ( huffman_bits_t *b, struct fsattab *table,
+                   unsigned int *index, unsigned int state, char c )
+{
+  unsigned int j;
+
+  for (j = index[state]; j < index[state + 1]; j++)
+    if (table[j].next == c) {
+      huffman_bits_put(b, table[j].value >> (32 - table[j].bits),
+                       table[j].bits);
+      return 1;
+    }
+  return 0;
+}
+
+static inline size_t
+huffman_encode_freesat ( int tab, const char *text,
+                         uint8_t *out, size_t size )
+{
+  struct fsattab *table = tab == 1 ? fsat_table_1 : fsat_table_2;
+  unsigned int *index = tab == 1 ? fsat_index_1 : fsat_index_2;
+  huffman_bits_t b = { out, size, 16 };
+  unsigned int state = START;
+  const char *c;
+
+  memset(out, 0, size);
+  out[0] = 0x1f;
+  out[1] = tab;
+  for (c = text; ; c++) {
+    if (!fsat_encode_char(&b, table, index, state, *c)) {
+      fsat_encode_char(&b, table, index, state, ESCAPE);
+      huffman_bits_put(&b, (uint8_t)*c, 8);
+    }
+    if (!*c)
+      break;
+    state = (uint8_t)*c;
+  }
+  return MIN(size, (b.pos + 7) >> 3);
+}
+
+#endif /* __TVH_TEST_HUFFMAN_REF_H__ */
@@ -0,0 +1,258 @@
+/*
+ *  Tvheadend - autorec title prefilter test
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dvr/dvr_autorec.c" // first, for _GNU_SOURCE
+#include "tvhtest.h"
+
+/*
+ * 1. autorec_regex_literal() must return a literal which every title
+ *    matched by the regular expression contains (or NULL), the prefilter
+ *    must never reject a title the regex accepts.
+ * 2. The inverted index must find the same entries, in the same order,
+ *    as trying every entry (autorec_cmp) on random rules and events.
+ */
+
+#define TEST_CHANNELS 20
+#define TEST_TAGS     5
+#define TEST_RULES    3000
+#define TEST_EVENTS   20000
+
+static const struct {
+  const char *re;
+  const char *lit;
+} literals[] = {
+  { "News",                 "News" },
+  { "^The Simpsons$",       "The Simpsons" },
+  { "Doctor Who",           "Doctor Who" },
+  { "Ab{12}",               NULL },
+  { "x{2,4}y",              NULL },
+  { "Match{0,1} of the Day", " of the Day" },
+  { "Top Gear{2}",          "Top Gea" },
+  { "Film{1,}: .*",         "Fil" },
+  { "Film {1,}: .*",        "Film" },
+  { "abc{",                 NULL },
+  { "abc{2",                NULL },
+  { "Colou?r Blind",        "r Blind" },
+  { "Star (Trek|Wars)",     "Star " },
+  { "Trek|Wars",            NULL },
+  { "[Tt]he Office",        "he Office" },
+  { "[]x]abcdef",           "abcdef" },
+  { "[abc",                 NULL },
+  { "Formula 1\\.*Grand",   "Formula 1" },
+  { "\\",                   NULL },
+  { ".*",                   NULL },
+  { "a",                    NULL },
+};
+
+static const char *titles[] = {
+  "News", "The Simpsons", "Doctor Who", "Abbbbbbbbbbbb", "Ab12", "xxy",
+  "xxxxy", "x2,4y", "Match of the Day", "Matc of the Day", "Top Gearr",
+  "Film: Alien", "Filmmm: Alien", "Film : Alien", "Color Blind",
+  "Colour Blind", "Star Trek", "Star Wars", "The Office", "the office",
+  "]abcdef", "Formula 1...Grand", "Formula 1Grand Prix",
+};
+
+static const char *words[] = {
+  "news", "Doctor", "Who", "the", "Simpsons", "match", "of", "day",
+  "Film", "Star", "Trek", "Top", "Gear", "Office", "a", "Colour", "Blind",
+};
+
+static const char *patterns[] = {
+  "%s", "^%s", "%s %s", "%s.*%s", "%s|%s", "(%s)", "[a-z]%s", "%s$",
+  "%s{0,1}", "%s?",
+};
+
+static char *
+test_words ( char *buf, size_t len, int n )
+{
+  size_t l = 0;
+  int i;
+
+  buf[0] = '\0';
+  for (i = 0; i < n; i++)
+    tvh_strlcatf(buf, len, l, "%s%s", i ? " " : "",
+                 words[tvhtest_random() % ARRAY_SIZE(words)]);
+  return buf;
+}
+
+static lang_str_t *
+test_lang_str ( int n )
+{
+  lang_str_t *ls = lang_str_create();
+  char buf[256];
+
+  lang_str_add(ls, test_words(buf, sizeof(buf), n), "eng", 0);
+  return ls;
+}
+
+static void
+test_index ( void )
+{
+  static channel_t channels[TEST_CHANNELS];
+  static channel_tag_t tags[TEST_TAGS];
+  static dvr_config_t cfgs[2];
+  channel_tag_mapping_t *ctm;
+  dvr_autorec_entry_t *dae, *lin[TEST_RULES];
+  epg_broadcast_t *e;
+  epg_episode_t *ep;
+  epg_genre_t *g;
+  autorec_event_t ev;
+  char buf[256], w1[64], w2[64];
+  int i, j, n, matches = 0;
+  time_t t0 = 1420070400; // 2015-01-01
+
+  setenv("TZ", "Europe/London", 1);
+  tzset();
+  TAILQ_INIT(&autorec_entries);
+  cfgs[1].dvr_sl_quality_lock = 1;
+  for (i = 0; i < TEST_TAGS; i++) {
+    LIST_INIT(&tags[i].ct_autorecs);
+    LIST_INIT(&tags[i].ct_ctms);
+  }
+  for (i = 0; i < TEST_CHANNELS; i++) {
+    channels[i].ch_enabled = (i % 7) != 0;
+    LIST_INIT(&channels[i].ch_autorecs);
+    LIST_INIT(&channels[i].ch_ctms);
+    for (j = 0; j < TEST_TAGS; j++)
+      if ((tvhtest_random() % 3) == 0) {
+        ctm = calloc(1, sizeof(*ctm));
+        ctm->ctm_channel = &channels[i];
+        ctm->ctm_tag = &tags[j];
+        LIST_INSERT_HEAD(&channels[i].ch_ctms, ctm, ctm_channel_link);
+        LIST_INSERT_HEAD(&tags[j].ct_ctms, ctm, ctm_tag_link);
+      }
+  }
+
+  /* Rules, each limit with some probability */
+  for (i = 0; i < TEST_RULES; i++) {
+    dae = calloc(1, sizeof(*dae));
+    dae->dae_enabled = (tvhtest_random() % 20) != 0;
+    dae->dae_config = &cfgs[tvhtest_random() % 2];
+    dae->dae_weekdays = 0x7f;
+    dae->dae_start = dae->dae_start_window = -1;
+    if ((tvhtest_random() % 4) == 0) {
+      dae->dae_channel = &channels[tvhtest_random() % TEST_CHANNELS];
+      LIST_INSERT_HEAD(&dae->dae_channel->ch_autorecs, dae, dae_channel_link);
+    }
+    if ((tvhtest_random() % 5) == 0) {
+      dae->dae_channel_tag = &tags[tvhtest_random() % TEST_TAGS];
+      LIST_INSERT_HEAD(&dae->dae_channel_tag->ct_autorecs, dae,
+                       dae_channel_tag_link);
+    }
+    if ((tvhtest_random() % 3) != 0) {
+      test_words(w1, sizeof(w1), 1 + tvhtest_random() % 2);
+      test_words(w2, sizeof(w2), 1);
+      snprintf(buf, sizeof(buf),
+               patterns[tvhtest_random() % ARRAY_SIZE(patterns)], w1, w2);
+      if (!regcomp(&dae->dae_title_preg, buf,
+                   REG_ICASE | REG_EXTENDED | REG_NOSUB)) {
+        dae->dae_title = strdup(buf);
+        dae->dae_title_lit = autorec_regex_literal(buf);
+      }
+      dae->dae_fulltext = (tvhtest_random() % 4) == 0;
+    }
+    if ((tvhtest_random() % 4) == 0)
+      dae->dae_content_type = (tvhtest_random() % 4) << 4 |
+                              ((tvhtest_random() % 2) ? tvhtest_random() % 4 : 0);
+    if ((tvhtest_random() % 4) == 0)
+      dae->dae_weekdays = tvhtest_random() & 0x7f;
+    if ((tvhtest_random() % 4) == 0) {
+      dae->dae_start = tvhtest_random() % (24 * 60);
+      dae->dae_start_window = tvhtest_random() % (24 * 60);
+    }
+    if ((tvhtest_random() % 8) == 0)
+      dae->dae_minduration = 60 * (tvhtest_random() % 90);
+    TAILQ_INSERT_TAIL(&autorec_entries, dae, dae_link);
+  }
+  dvr_autorec_index_invalidate();
+
+  /* Events, across the DST changes */
+  for (i = 0; i < TEST_EVENTS; i++) {
+    e  = calloc(1, sizeof(*e));
+    ep = calloc(1, sizeof(*ep));
+    e->channel = &channels[tvhtest_random() % TEST_CHANNELS];
+    e->episode = ep;
+    e->start = t0 + (tvhtest_random() % (366 * 24 * 12)) * 300;
+    e->stop  = e->start + 300 * (1 + tvhtest_random() % 30);
+    ep->title = test_lang_str(1 + tvhtest_random() % 4);
+    if ((tvhtest_random() % 2) == 0)
+      ep->subtitle = test_lang_str(2);
+    if ((tvhtest_random() % 2) == 0)
+      e->description = test_lang_str(8);
+    for (j = tvhtest_random() % 3; j > 0; j--) {
+      g = calloc(1, sizeof(*g));
+      g->code = (tvhtest_random() % 4) << 4 | tvhtest_random() % 4;
+      LIST_INSERT_HEAD(&ep->genre, g, link);
+    }
+
+    n = 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.e = e;
+    TAILQ_FOREACH(dae, &autorec_entries, dae_link)
+      if (autorec_cmp(dae, &ev))
+        lin[n++] = dae;
+    autorec_index_match(e);
+    TVHTEST_CHECK(n == autorec_index.matches.count &&
+                  !memcmp(lin, autorec_index.matches.dae, n * sizeof(*lin)),
+                  "event %d: %d matches, index %d", i, n,
+                  autorec_index.matches.count);
+    matches += n;
+
+    while ((g = LIST_FIRST(&ep->genre)) != NULL) {
+      LIST_REMOVE(g, link);
+      free(g);
+    }
+    lang_str_destroy(ep->title);
+    if (ep->subtitle)
+      lang_str_destroy(ep->subtitle);
+    if (e->description)
+      lang_str_destroy(e->description);
+    free(ep);
+    free(e);
+  }
+  TVHTEST_CHECK(matches > 0, "no matches");
+}
+
+int
+main ( int argc, char **argv )
+{
+  regex_t re;
+  char *lit;
+  int i, j;
+
+  for (i = 0; i < ARRAY_SIZE(literals); i++) {
+    lit = autorec_regex_literal(literals[i].re);
+    TVHTEST_CHECK(lit ? literals[i].lit && !strcmp(lit, literals[i].lit)
+                      : !literals[i].lit,
+                  "'%s': literal '%s' != '%s'", literals[i].re,
+                  lit ?: "NULL", literals[i].lit ?: "NULL");
+    if (lit && !regcomp(&re, literals[i].re, REG_ICASE | REG_EXTENDED | REG_NOSUB)) {
+      for (j = 0; j < ARRAY_SIZE(titles); j++)
+        TVHTEST_CHECK(regexec(&re, titles[j], 0, NULL, 0) ||
+                      strcasestr(titles[j], lit),
+                      "'%s': literal '%s' rejects '%s'", literals[i].re,
+                      lit, titles[j]);
+      regfree(&re);
+    }
+    free(lit);
+  }
+
+  test_index();
+
+  return tvhtest_result("test_dvr_autorec");
+}
@@ -0,0 +1,548 @@
+/*
+ *  Tvheadend - EPG database (v3) test
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "epgdb.c" // for the static loader functions
+#include "tvhtest.h"
+#include "uuid.h"
+#include "idnode.h"
+#include <sys/wait.h>
+
+/*
+ * 1. A random EPG is saved, loaded and saved again, both saves must be
+ *    byte identical.
+ * 2. The same EPG written in the v2 format (the htsmsg stream) must load
+ *    into the same EPG, i.e. give the same v3 save.
+ * 3. Truncated and corrupted object blocks and string tables, string
+ *    references out of range and oversized varints must be rejected by
+ *    the decoder; corrupted files must load without crashing.
+ *
+ * Every load runs in a child process on an empty EPG (the channels are
+ * created before the fork).
+ */
+
+#define TEST_CHANNELS   8
+#define TEST_BRANDS     50
+#define TEST_SEASONS    150
+#define TEST_EPISODES   3000
+#define TEST_BROADCASTS 6000
+#define TEST_CORRUPT    300
+
+static const char *langs[] = { "eng", "ger", "fre" };
+
+static const char *words[] = {
+  "news", "doctor", "who", "the", "simpsons", "match", "of", "day",
+  "film", "star", "trek", "top", "gear", "office", "a", "colour", "blind",
+  "Grüße", "Ça va",
+};
+
+static char test_root[PATH_MAX];
+
+static const char *
+test_words ( char *buf, size_t len, int n )
+{
+  size_t l = 0;
+  int i;
+
+  buf[0] = '\0';
+  for (i = 0; i < n; i++)
+    tvh_strlcatf(buf, len, l, "%s%s", i ? " " : "",
+                 words[tvhtest_random() % ARRAY_SIZE(words)]);
+  return buf;
+}
+
+static const char *
+test_lang ( void )
+{
+  return langs[tvhtest_random() % ARRAY_SIZE(langs)];
+}
+
+static void
+test_dir ( char *buf, size_t len, const char *name )
+{
+  snprintf(buf, len, "%s/%s", test_root, name);
+  mkdir(buf, 0700);
+}
+
+/*
+ * Random EPG (all setters, several languages, shared strings)
+ */
+static void
+test_populate ( void )
+{
+  epg_brand_t *brands[TEST_BRANDS];
+  epg_season_t *seasons[TEST_SEASONS];
+  epg_episode_t *episodes[TEST_EPISODES];
+  epg_serieslink_t *esl;
+  epg_broadcast_t *ebc;
+  epg_episode_num_t num;
+  epg_genre_list_t *genre;
+  channel_t *ch, *chs[TEST_CHANNELS];
+  char uri[64], buf[256];
+  time_t start, stop, next[TEST_CHANNELS];
+  int i, j, c, n = 0, save = 0;
+
+  CHANNEL_FOREACH(ch) {
+    next[n] = dispatch_clock;
+    chs[n++] = ch;
+  }
+
+  for (i = 0; i < TEST_BRANDS; i++) {
+    snprintf(uri, sizeof(uri), "brand/%d", i);
+    brands[i] = epg_brand_find_by_uri(uri, 1, &save);
+    save |= epg_brand_set_title(brands[i], test_words(buf, sizeof(buf), 2),
+                                "eng", NULL);
+    if (tvhtest_random() % 2)
+      save |= epg_brand_set_summary(brands[i], test_words(buf, sizeof(buf), 8),
+                                    test_lang(), NULL);
+    save |= epg_brand_set_season_count(brands[i], tvhtest_random() % 10, NULL);
+    if (tvhtest_random() % 4 == 0)
+      save |= epg_brand_set_image(brands[i], "http://img/brand.png", NULL);
+  }
+
+  for (i = 0; i < TEST_SEASONS; i++) {
+    snprintf(uri, sizeof(uri), "season/%d", i);
+    seasons[i] = epg_season_find_by_uri(uri, 1, &save);
+    if (tvhtest_random() % 2)
+      save |= epg_season_set_summary(seasons[i], test_words(buf, sizeof(buf), 6),
+                                     test_lang(), NULL);
+    save |= epg_season_set_number(seasons[i], 1 + tvhtest_random() % 20, NULL);
+    save |= epg_season_set_episode_count(seasons[i], tvhtest_random() % 30, NULL);
+    save |= epg_season_set_brand(seasons[i],
+                                 brands[tvhtest_random() % TEST_BRANDS], NULL);
+  }
+
+  for (i = 0; i < TEST_EPISODES; i++) {
+    snprintf(uri, sizeof(uri), "episode/%d", i);
+    episodes[i] = epg_episode_find_by_uri(uri, 1, &save);
+    for (j = 0; j < 1 + tvhtest_random() % 3; j++)
+      save |= epg_episode_set_title(episodes[i], test_words(buf, sizeof(buf), 3),
+                                    langs[j], NULL);
+    if (tvhtest_random() % 2)
+      save |= epg_episode_set_subtitle(episodes[i], test_words(buf, sizeof(buf), 4),
+                                       test_lang(), NULL);
+    if (tvhtest_random() % 2)
+      save |= epg_episode_set_summary(episodes[i], test_words(buf, sizeof(buf), 10),
+                                      test_lang(), NULL);
+    if (tvhtest_random() % 3 == 0)
+      save |= epg_episode_set_description(episodes[i],
+                                          test_words(buf, sizeof(buf), 30),
+                                          test_lang(), NULL);
+    memset(&num, 0, sizeof(num));
+    num.e_num = tvhtest_random() % 30;
+    num.e_cnt = tvhtest_random() % 30;
+    num.s_num = tvhtest_random() % 5;
+    num.p_num = tvhtest_random() % 3;
+    num.p_cnt = num.p_num ? 3 : 0;
+    if (tvhtest_random() % 4 == 0)
+      num.text = (char *)"S01E02";
+    save |= epg_episode_set_epnum(episodes[i], &num, NULL);
+    genre = calloc(1, sizeof(*genre));
+    for (j = tvhtest_random() % 3; j > 0; j--)
+      epg_genre_list_add_by_eit(genre, (tvhtest_random() % 12) << 4 |
+                                       tvhtest_random() % 4);
+    save |= epg_episode_set_genre(episodes[i], genre, NULL);
+    epg_genre_list_destroy(genre);
+    if (tvhtest_random() % 2)
+      save |= epg_episode_set_season(episodes[i],
+                                     seasons[tvhtest_random() % TEST_SEASONS],
+                                     NULL);
+    else if (tvhtest_random() % 2)
+      save |= epg_episode_set_brand(episodes[i],
+                                    brands[tvhtest_random() % TEST_BRANDS], NULL);
+    save |= epg_episode_set_is_bw(episodes[i], tvhtest_random() % 10 == 0, NULL);
+    save |= epg_episode_set_star_rating(episodes[i], tvhtest_random() % 6, NULL);
+    save |= epg_episode_set_age_rating(episodes[i], tvhtest_random() % 19, NULL);
+    if (tvhtest_random() % 4 == 0)
+      save |= epg_episode_set_first_aired(episodes[i],
+                                          900000000 + tvhtest_random() % 500000000,
+                                          NULL);
+  }
+
+  /* Back to back, an overlap would destroy the broadcast (and episode) */
+  for (i = 0; i < TEST_BROADCASTS; i++) {
+    c     = tvhtest_random() % n;
+    start = next[c] + 300 * (tvhtest_random() % 3);
+    stop  = next[c] = start + 300 * (1 + tvhtest_random() % 24);
+    ebc   = epg_broadcast_find_by_time(chs[c], start, stop,
+                                       tvhtest_random() % 0x10000, 1, &save);
+    if (ebc == NULL)
+      continue;
+    save |= epg_broadcast_set_episode(ebc,
+                                      episodes[tvhtest_random() % TEST_EPISODES],
+                                      NULL);
+    save |= epg_broadcast_set_is_widescreen(ebc, tvhtest_random() % 2, NULL);
+    save |= epg_broadcast_set_is_hd(ebc, tvhtest_random() % 2, NULL);
+    save |= epg_broadcast_set_lines(ebc, tvhtest_random() % 2 ? 1080 : 576, NULL);
+    save |= epg_broadcast_set_aspect(ebc, tvhtest_random() % 2 ? 169 : 43, NULL);
+    save |= epg_broadcast_set_is_deafsigned(ebc, tvhtest_random() % 8 == 0, NULL);
+    save |= epg_broadcast_set_is_subtitled(ebc, tvhtest_random() % 3 == 0, NULL);
+    save |= epg_broadcast_set_is_audio_desc(ebc, tvhtest_random() % 8 == 0, NULL);
+    save |= epg_broadcast_set_is_new(ebc, tvhtest_random() % 4 == 0, NULL);
+    save |= epg_broadcast_set_is_repeat(ebc, tvhtest_random() % 4 == 0, NULL);
+    if (tvhtest_random() % 3 == 0)
+      save |= epg_broadcast_set_summary(ebc, test_words(buf, sizeof(buf), 10),
+                                        test_lang(), NULL);
+    if (tvhtest_random() % 3 == 0)
+      save |= epg_broadcast_set_description(ebc, test_words(buf, sizeof(buf), 20),
+                                            test_lang(), NULL);
+    if (tvhtest_random() % 5 == 0) {
+      snprintf(uri, sizeof(uri), "crid://series/%d", (int)(tvhtest_random() % 100));
+      if ((esl = epg_serieslink_find_by_uri(uri, 1, &save)))
+        save |= epg_broadcast_set_serieslink(ebc, esl, NULL);
+    }
+  }
+}
+
+/*
+ * v2 database (as written before v3)
+ */
+static void
+test_v2_msg ( int fd, htsmsg_t *m )
+{
+  void *data;
+  size_t len;
+
+  if (m == NULL)
+    return;
+  if (!htsmsg_binary_serialize(m, &data, &len, 0x10000)) {
+    TVHTEST_CHECK(!tvh_write(fd, data, len), "v2 write");
+    free(data);
+  }
+  htsmsg_destroy(m);
+}
+
+static void
+test_v2_sect ( int fd, const char *sect )
+{
+  htsmsg_t *m = htsmsg_create_map();
+  htsmsg_add_str(m, "__section__", sect);
+  test_v2_msg(fd, m);
+}
+
+static void
+test_v2_save ( const char *dir )
+{
+  char path[PATH_MAX];
+  epg_object_t *eo;
+  epg_broadcast_t *ebc;
+  channel_t *ch;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/epgdb.v2", dir);
+  fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+  TVHTEST_CHECK(fd >= 0, "%s", path);
+  test_v2_sect(fd, "config");
+  test_v2_msg(fd, epg_config_serialize());
+  test_v2_sect(fd, "brands");
+  RB_FOREACH(eo, &epg_brands, uri_link)
+    test_v2_msg(fd, epg_brand_serialize((epg_brand_t*)eo));
+  test_v2_sect(fd, "seasons");
+  RB_FOREACH(eo, &epg_seasons, uri_link)
+    test_v2_msg(fd, epg_season_serialize((epg_season_t*)eo));
+  test_v2_sect(fd, "episodes");
+  RB_FOREACH(eo, &epg_episodes, uri_link)
+    test_v2_msg(fd, epg_episode_serialize((epg_episode_t*)eo));
+  test_v2_sect(fd, "serieslinks");
+  RB_FOREACH(eo, &epg_serieslinks, uri_link)
+    test_v2_msg(fd, epg_serieslink_serialize((epg_serieslink_t*)eo));
+  test_v2_sect(fd, "broadcasts");
+  CHANNEL_FOREACH(ch)
+    RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link)
+      test_v2_msg(fd, epg_broadcast_serialize(ebc));
+  close(fd);
+}
+
+/*
+ * Save the EPG to dir/epgdb.v3 (waits for the save thread)
+ */
+static void
+test_save ( const char *dir )
+{
+  hts_settings_init(dir);
+  epg_save();
+  _epgdb_save_done();
+}
+
+static uint8_t *
+test_read ( const char *dir, size_t *len )
+{
+  char name[PATH_MAX];
+  snprintf(name, sizeof(name), "epgdb.v%d", EPG_DB_VERSION);
+  return tvhtest_load(dir, name, len);
+}
+
+/*
+ * Run fn in a child process (on an empty EPG)
+ */
+static int
+test_child ( void (*fn)(const char *dir), const char *dir )
+{
+  int status;
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    fn(dir);
+    _exit(tvhtest_failed ? 1 : 0);
+  }
+  if (pid < 0 || waitpid(pid, &status, 0) != pid)
+    return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void
+test_child_create ( const char *dir )
+{
+  char v2[PATH_MAX];
+
+  test_populate();
+  test_save(dir);
+  test_dir(v2, sizeof(v2), "v2");
+  test_v2_save(v2);
+}
+
+/* Load from dir (the highest version there) and save back to dir */
+static void
+test_child_reload ( const char *dir )
+{
+  hts_settings_init(dir);
+  epg_init();
+  test_save(dir);
+}
+
+/*
+ * Decoder checks
+ */
+static void
+test_block_free ( epgdb_block_t *b )
+{
+  epgdb_langs_t *ls;
+
+  free(b->recs);
+  while ((ls = b->langs) != NULL) {
+    b->langs = ls->next;
+    free(ls);
+  }
+  memset(b, 0, sizeof(*b));
+}
+
+static int
+test_decode ( epgdb_loader_t *l, const uint8_t *data, uint32_t len )
+{
+  epgdb_block_t b;
+  int r;
+
+  memset(&b, 0, sizeof(b));
+  b.data = data;
+  b.len  = len;
+  r = _epgdb_v3_decode_block(l, &b);
+  test_block_free(&b);
+  return r;
+}
+
+static int
+test_varint ( const uint8_t *data, int len )
+{
+  const uint8_t *p = data;
+  uint64_t u;
+  return _epgdb_get_varint(&p, data + len, &u);
+}
+
+static void
+test_decoder ( const uint8_t *db, size_t dblen )
+{
+  static const uint8_t v_max[] =
+    { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 };
+  static const uint8_t v_big[] =
+    { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 };
+  static const uint8_t v_long[] =
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+  static const uint8_t v_trunc[] = { 0x80, 0x80 };
+  epgdb_loader_t l;
+  const uint8_t *rp = db + EPGDB_MAGIC_LEN, *end = db + dblen;
+  const uint8_t *blocks[256], *strs = NULL;
+  uint32_t lens[256], len, strs_len = 0, cut;
+  uint8_t buf[64], *copy;
+  int i, n = 0, nblocks = 0, pos;
+
+  /* Varints */
+  TVHTEST_CHECK(!test_varint(v_max, sizeof(v_max)), "max varint rejected");
+  TVHTEST_CHECK(test_varint(v_big, sizeof(v_big)), "65 bit varint accepted");
+  TVHTEST_CHECK(test_varint(v_long, sizeof(v_long)), "11 byte varint accepted");
+  TVHTEST_CHECK(test_varint(v_trunc, sizeof(v_trunc)), "truncated varint accepted");
+
+  /* Index the file */
+  memset(&l, 0, sizeof(l));
+  while (end - rp > 4) {
+    len = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    if (rp[4] == EPGDB_BLK_STRINGS) {
+      strs     = rp + 5;
+      strs_len = len - 1;
+    } else if (rp[4] == EPGDB_BLK_OBJECTS && nblocks < ARRAY_SIZE(blocks)) {
+      blocks[nblocks]  = rp + 4;
+      lens[nblocks++]  = len;
+    }
+    rp += 4 + len;
+  }
+  TVHTEST_CHECK(rp == end, "block lengths");
+  TVHTEST_CHECK(strs && nblocks > 0, "no strings or objects");
+  if (!strs || !nblocks)
+    return;
+
+  /* String table */
+  for (cut = 0; cut < strs_len; cut += 1 + strs_len / 200) {
+    TVHTEST_CHECK(_epgdb_v3_strings(&l, strs, strs + cut),
+                  "string table truncated at %u accepted", cut);
+    free(l.strs);
+  }
+  copy = malloc(strs_len);
+  memcpy(copy, strs, strs_len);
+  copy[strs_len - 1] = 'x';
+  TVHTEST_CHECK(_epgdb_v3_strings(&l, copy, copy + strs_len),
+                "unterminated string accepted");
+  free(l.strs);
+  free(copy);
+  TVHTEST_CHECK(!_epgdb_v3_strings(&l, strs, strs + strs_len), "strings");
+
+  for (i = 0; i < nblocks; i++) {
+    TVHTEST_CHECK(!test_decode(&l, blocks[i], lens[i]), "block %d", i);
+
+    /* Truncated */
+    for (cut = 1; cut < lens[i]; cut += 1 + lens[i] / 300, n++)
+      TVHTEST_CHECK(test_decode(&l, blocks[i], cut),
+                    "block %d truncated at %u accepted", i, cut);
+  }
+  TVHTEST_CHECK(n > 0, "no truncated blocks");
+
+  /* String references out of range (only the first string left) */
+  len = l.nstrs;
+  l.nstrs = 1;
+  for (i = n = 0; i < nblocks; i++)
+    n += test_decode(&l, blocks[i], lens[i]) != 0;
+  TVHTEST_CHECK(n == nblocks, "%d of %d blocks with bad strings accepted",
+                nblocks - n, nblocks);
+  l.nstrs = len;
+
+  /* Hand made blocks: kind, type, channel, count, record */
+#define BLOCK(...) do { \
+    static const uint8_t b[] = { EPGDB_BLK_OBJECTS, __VA_ARGS__ }; \
+    memcpy(buf, b, sizeof(b)); pos = sizeof(b); \
+  } while (0)
+  BLOCK(EPG_BRAND, 0, 1, EPGDB_T_ID, 5, EPGDB_T_END);
+  TVHTEST_CHECK(!test_decode(&l, buf, pos), "valid block rejected");
+  BLOCK(EPG_TYPEMAX + 1, 0, 1, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad type accepted");
+  BLOCK(EPG_BRAND, 0, 200, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad count accepted");
+  BLOCK(EPG_BRAND, 0, 1, EPGDB_T_URI, 0xff, 0xff, 0xff, 0x7f, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad string index accepted");
+  BLOCK(EPG_BRAND, 0xff, 0xff, 0xff, 0x7f, 1, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad channel index accepted");
+  BLOCK(EPG_BRAND, 0, 1, EPGDB_T_ID,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "oversized varint accepted");
+  BLOCK(EPG_BRAND, 0, 1, EPGDB_T_TITLE, 100, 1, 1, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad language count accepted");
+  BLOCK(EPG_EPISODE, 0, 1, EPGDB_T_GENRE, 50, 1, 2, EPGDB_T_END);
+  TVHTEST_CHECK(test_decode(&l, buf, pos), "bad bytes length accepted");
+  BLOCK(EPG_BRAND, 0, 1, 0x80 | (EPGDB_TAG(60, EPGDB_K_UINT) & 0x7f),
+        EPGDB_TAG(60, EPGDB_K_UINT) >> 7, 7, EPGDB_T_ID, 5, EPGDB_T_END);
+  TVHTEST_CHECK(!test_decode(&l, buf, pos), "unknown field not skipped");
+#undef BLOCK
+
+  free(l.strs);
+}
+
+/* Corrupted and truncated files must not crash the loader */
+static const uint8_t *test_corrupt_db;
+static size_t test_corrupt_len;
+
+static void
+test_child_corrupt ( const char *dir )
+{
+  epggrab_stats_t stats;
+  uint8_t *copy = malloc(test_corrupt_len);
+  size_t len;
+  int i, j;
+
+  for (i = 0; i < TEST_CORRUPT; i++) {
+    memcpy(copy, test_corrupt_db, test_corrupt_len);
+    len = test_corrupt_len;
+    if (i % 3 == 0)
+      len = EPGDB_MAGIC_LEN + tvhtest_random() % (len - EPGDB_MAGIC_LEN);
+    else
+      for (j = 1 + tvhtest_random() % 8; j > 0; j--)
+        copy[EPGDB_MAGIC_LEN + tvhtest_random() % (len - EPGDB_MAGIC_LEN)] =
+          tvhtest_random();
+    memset(&stats, 0, sizeof(stats));
+    _epgdb_v3_load(copy, len, &stats);
+  }
+  free(copy);
+}
+
+int
+main ( int argc, char **argv )
+{
+  char dir[PATH_MAX], v2[PATH_MAX];
+  uint8_t *s1, *s2, *s3;
+  size_t l1, l2, l3;
+  int i;
+
+  snprintf(test_root, sizeof(test_root), "/tmp/tvhtest-epgdb-XXXXXX");
+  if (mkdtemp(test_root) == NULL) {
+    perror("mkdtemp");
+    return 2;
+  }
+  tvhlog_init(LOG_ALERT, 0, NULL);
+  uuid_init();
+  idnode_init();
+  dispatch_clock = 1420070400; // 2015-01-01
+  pthread_mutex_lock(&global_lock);
+  for (i = 0; i < TEST_CHANNELS; i++)
+    TVHTEST_CHECK(channel_create(NULL, NULL, "test") != NULL, "channel");
+
+  /* Round trip */
+  test_dir(dir, sizeof(dir), "v3");
+  TVHTEST_CHECK(!test_child(test_child_create, dir), "create");
+  s1 = test_read(dir, &l1);
+  TVHTEST_CHECK(!test_child(test_child_reload, dir), "reload v3");
+  s2 = test_read(dir, &l2);
+  TVHTEST_CHECK(l1 > 100000, "saved only %zu bytes", l1);
+  TVHTEST_CHECK(l1 == l2 && !memcmp(s1, s2, l1),
+                "save/load/save differs (%zu, %zu bytes)", l1, l2);
+
+  /* v2 */
+  test_dir(v2, sizeof(v2), "v2");
+  TVHTEST_CHECK(!test_child(test_child_reload, v2), "reload v2");
+  s3 = test_read(v2, &l3);
+  TVHTEST_CHECK(l1 == l3 && !memcmp(s1, s3, l1),
+                "v2 load differs (%zu, %zu bytes)", l1, l3);
+
+  /* Corruption */
+  test_decoder(s1, l1);
+  test_corrupt_db  = s1;
+  test_corrupt_len = l1;
+  TVHTEST_CHECK(!test_child(test_child_corrupt, dir), "corrupted load crashed");
+
+  pthread_mutex_unlock(&global_lock);
+  free(s1);
+  free(s2);
+  free(s3);
+  snprintf(dir, sizeof(dir), "rm -rf %s", test_root);
+  if (system(dir)) {}
+  return tvhtest_result("test_epgdb_v3");
+}
@@ -0,0 +1,162 @@
+/*
+ *  Tvheadend - huffman decoder (OpenTV, Freesat) test
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "huffman_ref.h"
+
+/*
+ * The lookup table decoders must produce the same output (byte for byte,
+ * including the return values and the truncation at the output size) as
+ * the bitwise decoders they replaced. The EPG text fixture is encoded
+ * with both sky dictionaries and both Freesat tables; the encoded strings
+ * are also decoded truncated, into short buffers and corrupted, followed
+ * by random input.
+ */
+
+#define TEST_OUT 1024
+
+static const char *dicts[] = { "skyeng", "skyit" };
+
+static void
+test_opentv ( huffman_dict_t *d, const char *name,
+              const uint8_t *enc, size_t len, int outl )
+{
+  char a[TEST_OUT], b[TEST_OUT], *ra, *rb;
+
+  memset(a, 0x55, sizeof(a));
+  memset(b, 0x55, sizeof(b));
+  ra = huffman_decode_ref(d->tree, enc, len, 0x20, a, outl);
+  rb = huffman_decode(d->tree, enc, len, 0x20, b, outl);
+  TVHTEST_CHECK(!ra == !rb && !memcmp(a, b, outl),
+                "%s: len %zd outl %d: '%s' != '%s'",
+                name, len, outl, ra ? a : "NULL", rb ? b : "NULL");
+}
+
+static void
+test_freesat ( const uint8_t *enc, size_t len, size_t dstlen )
+{
+  char a[TEST_OUT], b[TEST_OUT];
+  size_t la = dstlen, lb = dstlen, ra, rb;
+
+  memset(a, 0x55, sizeof(a));
+  memset(b, 0x55, sizeof(b));
+  ra = freesat_huffman_decode_ref(a, &la, enc, len);
+  rb = freesat_huffman_decode(b, &lb, enc, len);
+  TVHTEST_CHECK(ra == rb && la == lb && !memcmp(a, b, dstlen + 1),
+                "freesat %d: len %zd dstlen %zd: %zd/%zd '%.*s' != '%.*s'",
+                enc[1], len, dstlen, ra, rb, (int)la, a, (int)lb, b);
+}
+
+/* The encoded string, every prefix of it and short output buffers */
+static void
+test_encoded ( huffman_dict_t *d, const char *name,
+               const uint8_t *enc, size_t len )
+{
+  size_t l;
+  int o;
+
+  for (l = d ? 1 : 2; l <= len; l++) {
+    if (d)
+      test_opentv(d, name, enc, l, 2 * l);
+    else
+      test_freesat(enc, l, TEST_OUT - 1);
+  }
+  for (o = 1; o < 24; o++) {
+    if (d)
+      test_opentv(d, name, enc, len, o);
+    else
+      test_freesat(enc, len, o);
+  }
+}
+
+/* Random bit errors */
+static void
+test_corrupt ( huffman_dict_t *d, const char *name,
+               const uint8_t *enc, size_t len )
+{
+  uint8_t buf[TEST_OUT];
+  int i;
+
+  for (i = 0; i < 16; i++) {
+    memcpy(buf, enc, len);
+    buf[(d ? 0 : 2) + tvhtest_random() % (len - (d ? 0 : 2))] ^=
+      1 << (tvhtest_random() % 8);
+    if (d)
+      test_opentv(d, name, buf, len, 2 * len);
+    else
+      test_freesat(buf, len, TEST_OUT - 1);
+  }
+}
+
+int
+main ( int argc, char **argv )
+{
+  huffman_dict_t *d[ARRAY_SIZE(dicts)];
+  uint8_t enc[TEST_OUT];
+  char *text, *line, *r = NULL, plain[TEST_OUT], out[TEST_OUT];
+  size_t len, l;
+  int i, k, lines = 0;
+
+  for (k = 0; k < ARRAY_SIZE(dicts); k++)
+    d[k] = huffman_dict_load(argc > 1 ? argv[1] : NULL, dicts[k]);
+  text = (char *)tvhtest_load(argc > 1 ? argv[1] : NULL, "epg_text.txt", &len);
+
+  for (line = strtok_r(text, "\n", &r); line; line = strtok_r(NULL, "\n", &r)) {
+    lines++;
+
+    /* OpenTV */
+    for (k = 0; k < ARRAY_SIZE(dicts); k++) {
+      len = huffman_encode_opentv(d[k], line, enc, sizeof(enc), plain);
+      huffman_decode(d[k]->tree, enc, len, 0x20, out, sizeof(out));
+      TVHTEST_CHECK(!strncmp(out, plain, strlen(plain)),
+                    "%s: '%s' decoded as '%s'", dicts[k], plain, out);
+      test_encoded(d[k], dicts[k], enc, len);
+      test_corrupt(d[k], dicts[k], enc, len);
+    }
+
+    /* Freesat */
+    for (k = 1; k <= 2; k++) {
+      len = huffman_encode_freesat(k, line, enc, sizeof(enc));
+      l = sizeof(out) - 1;
+      TVHTEST_CHECK(freesat_huffman_decode(out, &l, enc, len) == 0 &&
+                    l == strlen(line) && !strcmp(out, line),
+                    "freesat %d: '%s' decoded as '%s'", k, line, out);
+      test_encoded(NULL, NULL, enc, len);
+      test_corrupt(NULL, NULL, enc, len);
+    }
+  }
+  TVHTEST_CHECK(lines > 0, "empty fixture");
+
+  /* Random input */
+  for (i = 0; i < 20000; i++) {
+    len = 1 + tvhtest_random() % 64;
+    for (l = 0; l < len; l++)
+      enc[l] = tvhtest_random();
+    k = tvhtest_random() % ARRAY_SIZE(dicts);
+    test_opentv(d[k], dicts[k], enc, len, 2 * len);
+    if (len > 2) {
+      enc[0] = 0x1f;
+      enc[1] = 1 + (i & 1);
+      test_freesat(enc, len, TEST_OUT - 1);
+    }
+  }
+
+  for (k = 0; k < ARRAY_SIZE(dicts); k++)
+    huffman_dict_free(d[k]);
+  free(text);
+  return tvhtest_result("test_huffman");
+}
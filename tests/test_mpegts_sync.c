@@ -0,0 +1,244 @@
+/*
+ *  Tvheadend - TS sync and resync test
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvhtest.h"
+#include "input.h"
+
+/*
+ * 1. Every scanning kernel must match a plain per packet loop on the
+ *    test stream (tests/data/mpeg2video.ts), with garbage inserted at
+ *    random offsets.
+ * 2. mpegts_input_recv_packets() must resync after garbage and must
+ *    pass the packets to the input ring in order, when the stream
+ *    arrives in random sized reads (packets split between reads).
+ */
+
+static const char *kernels[] = { "scalar", "SSE2", "AVX2", "NEON" };
+
+static int
+test_word_ref ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val )
+{
+  int r = 0;
+
+  for ( ; len >= 188; tsb += 188, len -= 188, r += 188)
+    if (((tsb[0] << 24 | tsb[1] << 16 | tsb[2] << 8 | tsb[3]) & mask) != val)
+      break;
+  return r;
+}
+
+static uint8_t
+test_junk ( void )
+{
+  uint8_t c;
+  while ((c = tvhtest_random()) == 0x47);
+  return c;
+}
+
+/*
+ * Stream with garbage runs (no sync bytes) in front of some packets,
+ * returns the length
+ */
+static size_t
+test_garbage ( const uint8_t *cap, size_t caplen, uint8_t *out,
+               int every, int maxjunk, int *runs )
+{
+  size_t i, n = 0;
+  int j, l;
+
+  *runs = 0;
+  for (i = 0; i + 188 <= caplen; i += 188) {
+    if (i >= 188 * 5 && (tvhtest_random() % every) == 0) {
+      (*runs)++;
+      l = 1 + tvhtest_random() % maxjunk;
+      for (j = 0; j < l; j++)
+        out[n++] = test_junk();
+    }
+    memcpy(out + n, cap + i, 188);
+    n += 188;
+  }
+  return n;
+}
+
+static void
+test_kernels ( const uint8_t *cap, size_t caplen )
+{
+  static const uint32_t masks[] = { 0xFF000000, 0xFF9FFFD0, 0x001FFF00,
+                                    0xFFFFFFFF };
+  uint8_t *buf = malloc(caplen * 2 + 4);
+  int runs, k, m, off, l, r, ref;
+  size_t len = test_garbage(cap, caplen, buf, 8, 300, &runs);
+  uint32_t mask, val;
+
+  for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+    if (mpegts_word_select(kernels[k]))
+      continue;
+    for (off = 0; off < len; off += 1 + tvhtest_random() % 97) {
+      l = tvhtest_random() % (188 * 40);
+      l = MIN(len - off, l);
+      for (m = 0; m < ARRAY_SIZE(masks); m++) {
+        mask = masks[m];
+        val  = (buf[off] << 24 | buf[off+1] << 16 |
+                buf[off+2] << 8 | buf[off+3]) & mask;
+        r    = mpegts_word_count(buf + off, l, mask);
+        ref  = test_word_ref(buf + off, l, mask, val);
+        TVHTEST_CHECK(r == ref, "%s: offset %d len %d mask %08x: %d != %d",
+                      kernels[k], off, l, mask, r, ref);
+      }
+      r   = mpegts_sync_count(buf + off, l);
+      ref = test_word_ref(buf + off, l, 0xFF000000, 0x47000000);
+      TVHTEST_CHECK(r == ref, "%s: sync at offset %d len %d: %d != %d",
+                    kernels[k], off, l, r, ref);
+    }
+  }
+  free(buf);
+}
+
+/*
+ * Count the input packets missing from the output and the output
+ * packets which are not in the input (or are out of order)
+ */
+static int
+test_missing ( const uint8_t *cap, size_t caplen,
+               const uint8_t *out, size_t outlen, int *bogus )
+{
+  size_t i = 0, j, k;
+  int missing = 0;
+
+  *bogus = 0;
+  for (j = 0; j + 188 <= outlen; j += 188) {
+    for (k = i; k + 188 <= caplen; k += 188)
+      if (!memcmp(cap + k, out + j, 188))
+        break;
+    if (k + 188 > caplen) {
+      (*bogus)++;
+      continue;
+    }
+    missing += (k - i) / 188;
+    i = k + 188;
+  }
+  return missing + (caplen - i) / 188;
+}
+
+/*
+ * Input ring consumer (the ring is drained after every call, so the
+ * records are always stored from the start of the ring)
+ */
+static size_t
+test_drain ( mpegts_input_t *mi, uint8_t *out )
+{
+  size_t pos = 0, n = 0;
+  mpegts_packet_t *mp;
+
+  while (pos < mi->mi_input_head) {
+    mp = (mpegts_packet_t *)(mi->mi_input_ring + pos);
+    memcpy(out + n, mp->mp_data, mp->mp_len);
+    n += mp->mp_len;
+    pos += (sizeof(mpegts_packet_t) + mp->mp_len + 7) & ~(size_t)7;
+  }
+  mi->mi_input_head = mi->mi_input_tail = 0;
+  return n;
+}
+
+static void
+test_resync ( const uint8_t *cap, size_t caplen, int every, int maxread )
+{
+  mpegts_input_t *mi = calloc(1, sizeof(*mi));
+  mpegts_mux_instance_t *mmi = calloc(1, sizeof(*mmi));
+  mpegts_mux_t *mm = calloc(1, sizeof(*mm));
+  uint8_t *in = malloc(caplen * 2), *out = malloc(caplen * 2);
+  size_t inlen, outlen = 0, off;
+  sbuf_t sb;
+  int l, runs, missing, bogus;
+
+  pthread_mutex_init(&mi->mi_input_lock, NULL);
+  pthread_cond_init(&mi->mi_input_cond, NULL);
+  mi->mi_input_ring = malloc(MPEGTS_INPUT_RING_SIZE);
+  mmi->mmi_mux = mm;
+  mm->mm_active = mmi;
+  sbuf_init(&sb);
+
+  inlen = test_garbage(cap, caplen, in, every, 2 * 188, &runs);
+  for (off = 0; off < inlen; off += l) {
+    l = 1 + tvhtest_random() % maxread;
+    l = MIN(inlen - off, l);
+    sbuf_append(&sb, in + off, l);
+    mi->mi_last_dispatch = -1;
+    mpegts_input_recv_packets(mi, mmi, &sb, NULL, NULL);
+    outlen += test_drain(mi, out + outlen);
+  }
+
+  /* One garbage run is skipped per call, process the backlog */
+  do {
+    l = sb.sb_ptr;
+    mi->mi_last_dispatch = -1;
+    mpegts_input_recv_packets(mi, mmi, &sb, NULL, NULL);
+    outlen += test_drain(mi, out + outlen);
+  } while (sb.sb_ptr < l);
+
+  /*
+   * Up to 4 packets are lost in front of a garbage run (when they are
+   * at the start of a read, less than 5 packets are not a sync) and
+   * the last 4 packets stay buffered until more data arrives. While
+   * skipping those, a 0x47 payload byte 188 bytes before the next
+   * packet passes as sync, so one bogus packet per run is possible.
+   */
+  missing = test_missing(cap, caplen, out, outlen, &bogus);
+  TVHTEST_CHECK(outlen % 188 == 0, "every %d read %d: partial packet",
+                every, maxread);
+  TVHTEST_CHECK(bogus <= runs, "every %d read %d: %d bogus packets",
+                every, maxread, bogus);
+  TVHTEST_CHECK(missing <= 4 * (runs + 1),
+                "every %d read %d: %d packets lost, %d garbage runs",
+                every, maxread, missing, runs);
+  TVHTEST_CHECK(runs == 0 || mmi->mmi_stats.unc > 0,
+                "every %d read %d: no garbage skipped", every, maxread);
+
+  sbuf_free(&sb);
+  free(mi->mi_input_ring);
+  free(mi);
+  free(mmi);
+  free(mm);
+  free(in);
+  free(out);
+}
+
+int
+main ( int argc, char **argv )
+{
+  size_t caplen;
+  uint8_t *cap = tvhtest_load(argv[1], "mpeg2video.ts", &caplen);
+  int k;
+
+  caplen -= caplen % 188;
+  TVHTEST_CHECK(mpegts_sync_count(cap, caplen) == caplen,
+                "test stream is not in sync");
+
+  test_kernels(cap, caplen);
+
+  for (k = 0; k < ARRAY_SIZE(kernels); k++) {
+    if (mpegts_word_select(kernels[k]))
+      continue;
+    test_resync(cap, caplen, 1000000, 188 * 7);
+    test_resync(cap, caplen, 6, 188 * 7);
+    test_resync(cap, caplen, 20, 100);
+    test_resync(cap, caplen, 20, 188 * 200);
+  }
+
+  free(cap);
+  return tvhtest_result("test_mpegts_sync");
+}
@@ -0,0 +1,478 @@
+/*
+ *  Tvheadend - startcode scanner (parse_sc) test
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvhtest.h"
+#include "parsers/parsers.c"
+
+/*
+ * The memchr() based parse_sc() must feed the packet parsers exactly
+ * like the original byte loop (parse_sc_ref below). The video PID of
+ * the synthetic test streams (tests/data/gen_ts.py) is replayed through
+ * both, split at TS packet boundaries and at random offsets, with
+ * garbage inserted. Like from parse_mpeg_ts(), at most one TS payload
+ * (184 bytes) is fed at a time, es_buf is shrunk to 256 bytes when a
+ * parser asks for a reset.
+ *
+ * 1. mpeg2video.ts, into a parser returning every result (call trace).
+ * 2. h264.ts, into parse_h264() (delivered packets).
+ */
+
+#define TEST_PID   257
+#define TEST_TRACE 65536
+#define TEST_PKTS  4096
+
+static void
+parse_sc_ref(service_t *t, elementary_stream_t *st, const uint8_t *data,
+             int len, packet_parser_t *vp)
+{
+  uint32_t sc = st->es_startcond;
+  int i, r;
+  sbuf_alloc(&st->es_buf, len);
+
+  for(i = 0; i < len; i++) {
+    if(st->es_ssc_intercept == 1) {
+      if(st->es_ssc_ptr < sizeof(st->es_ssc_buf))
+        st->es_ssc_buf[st->es_ssc_ptr] = data[i];
+
+      st->es_ssc_ptr++;
+
+      if(st->es_ssc_ptr < 5)
+        continue;
+
+      uint16_t plen = st->es_ssc_buf[0] << 8 | st->es_ssc_buf[1];
+      st->es_incomplete = plen >= 0xffdf;
+      int hlen = st->es_ssc_buf[4];
+
+      if(st->es_ssc_ptr < hlen + 5)
+        continue;
+
+      parse_pes_header(t, st, st->es_ssc_buf + 2, hlen + 3);
+      st->es_ssc_intercept = 0;
+
+      if(st->es_buf.sb_ptr > 2)
+        sc = st->es_buf.sb_data[st->es_buf.sb_ptr-3] << 16 |
+             st->es_buf.sb_data[st->es_buf.sb_ptr-2] << 8 |
+             st->es_buf.sb_data[st->es_buf.sb_ptr-1];
+
+      continue;
+    }
+
+    st->es_buf.sb_data[st->es_buf.sb_ptr++] = data[i];
+    sc = sc << 8 | data[i];
+    if((sc & 0xffffff00) != 0x00000100)
+      continue;
+
+    if(sc == 0x100 && (len-i)>3) {
+      uint32_t tempsc = data[i+1] << 16 | data[i+2] << 8 | data[i+3];
+
+      if(tempsc == 0x1e0)
+        continue;
+    }
+
+    r = st->es_buf.sb_ptr - st->es_startcode_offset - 4;
+    if(r > 0 && st->es_startcode != 0) {
+      r = vp(t, st, r, sc, st->es_startcode_offset);
+
+      if(r == 3)
+        continue;
+
+      if(r == 4) {
+        st->es_buf.sb_ptr -= 4;
+        st->es_ssc_intercept = 1;
+        st->es_ssc_ptr = 0;
+        sc = -1;
+        continue;
+      }
+    } else
+      r = 1;
+
+    if(r == 2) {
+      assert(st->es_buf.sb_data != NULL);
+
+      // Drop packet
+      st->es_buf.sb_ptr = st->es_startcode_offset;
+
+      st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 24;
+      st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 16;
+      st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 8;
+      st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc;
+      st->es_startcode = sc;
+
+    } else {
+      if(r == 1) {
+        /* Reset packet parser upon length error or if parser
+           tells us so */
+        parser_deliver_error(t, st);
+        sbuf_reset_and_alloc(&st->es_buf, 256);
+        st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 24;
+        st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 16;
+        st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc >> 8;
+        st->es_buf.sb_data[st->es_buf.sb_ptr++] = sc;
+      }
+      assert(st->es_buf.sb_data != NULL);
+      st->es_startcode = sc;
+      st->es_startcode_offset = st->es_buf.sb_ptr - 4;
+    }
+  }
+  st->es_startcond = sc;
+}
+
+/*
+ * Tracing packet parser
+ */
+typedef struct test_call {
+  uint32_t sc;
+  size_t   len;
+  int      off;
+  uint32_t hash;
+  int64_t  pts;
+} test_call_t;
+
+typedef struct test_trace {
+  elementary_stream_t st;
+  test_call_t calls[TEST_TRACE];
+  int         count;
+} test_trace_t;
+
+static test_trace_t *test_current;
+
+static uint32_t
+test_hash ( const uint8_t *data, size_t len )
+{
+  uint32_t h = 2166136261U;
+  while (len--)
+    h = (h ^ *data++) * 16777619U;
+  return h;
+}
+
+static int
+test_vp(service_t *t, elementary_stream_t *st, size_t len,
+        uint32_t sc, int off)
+{
+  test_trace_t *tt = test_current;
+  test_call_t *c;
+  uint32_t h = test_hash(st->es_buf.sb_data + off, len);
+
+  if (tt->count < TEST_TRACE) {
+    c = &tt->calls[tt->count];
+    c->sc   = sc;
+    c->len  = len;
+    c->off  = off;
+    c->hash = h;
+    c->pts  = st->es_curpts;
+  }
+  tt->count++;
+
+  /* Intercept PES headers, like parse_mpeg2video() */
+  if (sc >= 0x1e0 && sc <= 0x1ef)
+    return 4;
+  /* All other results, depending on the content */
+  switch (h % 8) {
+  case 0: return 1;
+  case 1: return 2;
+  case 2: return 3;
+  default: return 0;
+  }
+}
+
+static void
+test_feed ( test_trace_t *tt, const uint8_t *data, int len, int ref )
+{
+  test_current = tt;
+  if (ref)
+    parse_sc_ref(NULL, &tt->st, data, len, test_vp);
+  else
+    parse_sc(NULL, &tt->st, data, len, test_vp);
+}
+
+static void
+test_compare ( const char *what, test_trace_t *a, test_trace_t *b )
+{
+  int i, n = MIN(a->count, TEST_TRACE);
+
+  TVHTEST_CHECK(a->count == b->count, "%s: calls %d != %d",
+                what, a->count, b->count);
+  for (i = 0; i < n && i < b->count; i++)
+    if (memcmp(&a->calls[i], &b->calls[i], sizeof(test_call_t))) {
+      TVHTEST_CHECK(0, "%s: call %d differs (sc %08x/%08x len %zd/%zd)",
+                    what, i, a->calls[i].sc, b->calls[i].sc,
+                    a->calls[i].len, b->calls[i].len);
+      break;
+    }
+  TVHTEST_CHECK(a->st.es_startcond == b->st.es_startcond &&
+                a->st.es_buf.sb_ptr == b->st.es_buf.sb_ptr &&
+                !memcmp(a->st.es_buf.sb_data, b->st.es_buf.sb_data,
+                        a->st.es_buf.sb_ptr),
+                "%s: parser state differs", what);
+  TVHTEST_CHECK(a->count > 0, "%s: no startcodes found", what);
+}
+
+static void
+test_reset ( test_trace_t *tt )
+{
+  sbuf_free(&tt->st.es_buf);
+  memset(tt, 0, sizeof(*tt));
+  tt->st.es_curpts = tt->st.es_curdts = PTS_UNSET;
+}
+
+/*
+ * Collect the payload of the video PID, one TS packet per chunk
+ */
+static int
+test_payloads ( const uint8_t *ts, size_t len, uint8_t *out, int *chunks )
+{
+  int n = 0, c = 0, off;
+
+  for ( ; len >= 188; ts += 188, len -= 188) {
+    if (ts[0] != 0x47 || (((ts[1] & 0x1f) << 8) | ts[2]) != TEST_PID)
+      continue;
+    off = 4;
+    if (ts[3] & 0x20)
+      off += 1 + ts[4];
+    if (off >= 188 || !(ts[3] & 0x10))
+      continue;
+    memcpy(out + n, ts + off, 188 - off);
+    n += 188 - off;
+    chunks[c++] = 188 - off;
+  }
+  chunks[c] = 0;
+  return n;
+}
+
+/*
+ * parse_h264(), the packets are delivered to the service streaming pad
+ */
+typedef struct test_pkt {
+  int64_t  pts;
+  int64_t  dts;
+  int      duration;
+  int      frametype;
+  int      field;
+  int      err;
+  size_t   len;
+  size_t   metalen;
+  uint32_t hash;
+} test_pkt_t;
+
+typedef struct test_h264 {
+  service_t           svc;
+  streaming_target_t  tgt;
+  elementary_stream_t st;
+  test_pkt_t          pkts[TEST_PKTS];
+  int                 count;
+} test_h264_t;
+
+static void
+test_h264_deliver ( void *opaque, streaming_message_t *sm )
+{
+  test_h264_t *th = opaque;
+  th_pkt_t *pkt = sm->sm_data;
+  test_pkt_t *p;
+
+  if (sm->sm_type == SMT_PACKET && th->count++ < TEST_PKTS) {
+    p = &th->pkts[th->count - 1];
+    memset(p, 0, sizeof(*p));
+    p->pts       = pkt->pkt_pts;
+    p->dts       = pkt->pkt_dts;
+    p->duration  = pkt->pkt_duration;
+    p->frametype = pkt->pkt_frametype;
+    p->field     = pkt->pkt_field;
+    p->err       = pkt->pkt_err;
+    if (pkt->pkt_payload) {
+      p->len  = pktbuf_len(pkt->pkt_payload);
+      p->hash = test_hash(pktbuf_ptr(pkt->pkt_payload), p->len);
+    }
+    if (pkt->pkt_meta)
+      p->metalen = pktbuf_len(pkt->pkt_meta);
+  }
+  streaming_msg_free(sm);
+}
+
+static void
+test_h264_reset ( test_h264_t *th )
+{
+  if (th->st.es_curpkt)
+    pkt_ref_dec(th->st.es_curpkt);
+  free(th->st.es_global_data);
+  free(th->st.es_priv);
+  sbuf_free(&th->st.es_buf);
+  memset(th, 0, sizeof(*th));
+  th->svc.s_streaming_status = TSS_PACKETS;
+  th->svc.s_ps_onqueue = 1; // no config saves
+  streaming_pad_init(&th->svc.s_streaming_pad);
+  streaming_target_init(&th->tgt, test_h264_deliver, th, 0);
+  streaming_target_connect(&th->svc.s_streaming_pad, &th->tgt);
+  th->st.es_type    = SCT_H264;
+  th->st.es_service = &th->svc;
+  th->st.es_curpts  = th->st.es_curdts = PTS_UNSET;
+}
+
+static void
+test_h264_feed ( test_h264_t *a, test_h264_t *b, const uint8_t *data, int len )
+{
+  parse_sc_ref(&a->svc, &a->st, data, len, parse_h264);
+  parse_sc(&b->svc, &b->st, data, len, parse_h264);
+}
+
+static void
+test_h264_compare ( const char *what, test_h264_t *a, test_h264_t *b )
+{
+  int i, n = MIN(a->count, TEST_PKTS);
+
+  TVHTEST_CHECK(a->count == b->count, "h264 %s: packets %d != %d",
+                what, a->count, b->count);
+  for (i = 0; i < n && i < b->count; i++)
+    if (memcmp(&a->pkts[i], &b->pkts[i], sizeof(test_pkt_t))) {
+      TVHTEST_CHECK(0, "h264 %s: packet %d differs (len %zd/%zd)",
+                    what, i, a->pkts[i].len, b->pkts[i].len);
+      break;
+    }
+  TVHTEST_CHECK(a->st.es_startcond == b->st.es_startcond &&
+                a->st.es_buf.sb_ptr == b->st.es_buf.sb_ptr &&
+                !memcmp(a->st.es_buf.sb_data, b->st.es_buf.sb_data,
+                        a->st.es_buf.sb_ptr),
+                "h264 %s: parser state differs", what);
+}
+
+static void
+test_h264 ( const char *dir )
+{
+  static test_h264_t a, b;
+  size_t caplen;
+  uint8_t *cap = tvhtest_load(dir, "h264.ts", &caplen);
+  uint8_t *es = malloc(caplen), *p, junk[64];
+  int *chunks = malloc(sizeof(int) * (caplen / 188 + 1));
+  int eslen, i, j, l, round, iframes = 0;
+
+  eslen = test_payloads(cap, caplen, es, chunks);
+  TVHTEST_CHECK(eslen > 0, "h264: no payload for PID %d", TEST_PID);
+
+  /* TS packet sized chunks */
+  test_h264_reset(&a);
+  test_h264_reset(&b);
+  for (p = es, i = 0; chunks[i]; p += chunks[i], i++)
+    test_h264_feed(&a, &b, p, chunks[i]);
+  test_h264_compare("packets", &a, &b);
+  for (i = 0; i < MIN(a.count, TEST_PKTS); i++)
+    iframes += a.pkts[i].frametype == PKT_I_FRAME;
+  TVHTEST_CHECK(a.count >= 40 && iframes >= 3,
+                "h264: %d packets, %d I frames delivered", a.count, iframes);
+
+  /* Random splits */
+  for (round = 0; round < 20; round++) {
+    test_h264_reset(&a);
+    test_h264_reset(&b);
+    for (p = es, j = eslen; j > 0; p += l, j -= l) {
+      l = 1 + tvhtest_random() % (round < 10 ? 8 : 184);
+      l = MIN(j, l);
+      test_h264_feed(&a, &b, p, l);
+    }
+    test_h264_compare("splits", &a, &b);
+  }
+
+  /* Garbage between the payloads */
+  for (round = 0; round < 20; round++) {
+    test_h264_reset(&a);
+    test_h264_reset(&b);
+    for (p = es, i = 0; chunks[i]; p += chunks[i], i++) {
+      if ((tvhtest_random() % 16) == 0) {
+        l = 1 + tvhtest_random() % sizeof(junk);
+        for (j = 0; j < l; j++)
+          junk[j] = (tvhtest_random() % 3) ? 0 : tvhtest_random();
+        if (l > 3 && (tvhtest_random() % 2))
+          junk[l - 2] = 1;
+        test_h264_feed(&a, &b, junk, l);
+      }
+      test_h264_feed(&a, &b, p, chunks[i]);
+    }
+    test_h264_compare("garbage", &a, &b);
+  }
+
+  test_h264_reset(&a);
+  test_h264_reset(&b);
+  free(chunks);
+  free(es);
+  free(cap);
+}
+
+int
+main ( int argc, char **argv )
+{
+  static test_trace_t a, b;
+  size_t caplen;
+  uint8_t *cap = tvhtest_load(argv[1], "mpeg2video.ts", &caplen);
+  uint8_t *es = malloc(caplen * 2), *p;
+  int *chunks = malloc(sizeof(int) * (caplen / 188 + 1));
+  int eslen, i, j, l, round;
+
+  eslen = test_payloads(cap, caplen, es, chunks);
+  TVHTEST_CHECK(eslen > 0, "no payload for PID %d", TEST_PID);
+
+  /* TS packet sized chunks */
+  test_reset(&a);
+  test_reset(&b);
+  for (p = es, i = 0; chunks[i]; p += chunks[i], i++) {
+    test_feed(&a, p, chunks[i], 1);
+    test_feed(&b, p, chunks[i], 0);
+  }
+  test_compare("packets", &a, &b);
+
+  /* Random splits (startcodes straddling the chunks) */
+  for (round = 0; round < 50; round++) {
+    test_reset(&a);
+    test_reset(&b);
+    for (p = es, j = eslen; j > 0; p += l, j -= l) {
+      l = 1 + tvhtest_random() % (round < 25 ? 8 : 184);
+      l = MIN(j, l);
+      test_feed(&a, p, l, 1);
+      test_feed(&b, p, l, 0);
+    }
+    test_compare("splits", &a, &b);
+  }
+
+  /* Garbage (random bytes and zero runs) between the payloads */
+  for (round = 0; round < 50; round++) {
+    test_reset(&a);
+    test_reset(&b);
+    for (p = es, i = 0; chunks[i]; p += chunks[i], i++) {
+      uint8_t junk[64];
+      if ((tvhtest_random() % 16) == 0) {
+        l = 1 + tvhtest_random() % sizeof(junk);
+        for (j = 0; j < l; j++)
+          junk[j] = (tvhtest_random() % 3) ? 0 : tvhtest_random();
+        if (l > 3 && (tvhtest_random() % 2))
+          junk[l - 2] = 1;
+        test_feed(&a, junk, l, 1);
+        test_feed(&b, junk, l, 0);
+      }
+      test_feed(&a, p, chunks[i], 1);
+      test_feed(&b, p, chunks[i], 0);
+    }
+    test_compare("garbage", &a, &b);
+  }
+
+  test_reset(&a);
+  test_reset(&b);
+  free(chunks);
+  free(es);
+  free(cap);
+
+  test_h264(argv[1]);
+
+  return tvhtest_result("test_parse_sc");
+}
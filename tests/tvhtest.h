@@ -0,0 +1,112 @@
+/*
+ *  Tvheadend - test and benchmark helpers
+ *  Copyright (C) 2015 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_TEST_H__
+#define __TVH_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tvheadend.h"
+
+/*
+ * The programs get the fixture directory (tests/data) as the first
+ * argument, "make check" runs the tests and "make bench" the benchmarks
+ */
+
+static int tvhtest_failed;
+
+#define TVHTEST_CHECK(c, fmt, ...) do { \
+  if (!(c)) { \
+    fprintf(stderr, "%s:%d: FAILED (%s) " fmt "\n", \
+            __FILE__, __LINE__, #c, ##__VA_ARGS__); \
+    tvhtest_failed++; \
+  } \
+} while (0)
+
+static inline int
+tvhtest_result ( const char *name )
+{
+  printf("%s: %s\n", name, tvhtest_failed ? "FAILED" : "ok");
+  return tvhtest_failed ? 1 : 0;
+}
+
+/*
+ * Load a fixture file (exits when missing)
+ */
+static inline uint8_t *
+tvhtest_load ( const char *dir, const char *name, size_t *len )
+{
+  char path[PATH_MAX];
+  uint8_t *data;
+  FILE *f;
+  long l;
+
+  snprintf(path, sizeof(path), "%s/%s", dir ?: "tests/data", name);
+  if ((f = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, "unable to open fixture %s\n", path);
+    exit(2);
+  }
+  fseek(f, 0, SEEK_END);
+  l = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = malloc(l + 1);
+  if (fread(data, 1, l, f) != l) {
+    fprintf(stderr, "unable to read fixture %s\n", path);
+    exit(2);
+  }
+  fclose(f);
+  data[l] = '\0'; // text fixtures
+  *len = l;
+  return data;
+}
+
+/*
+ * Reproducible pseudo random numbers (xorshift32)
+ */
+static uint32_t tvhtest_seed = 2463534242U;
+
+static inline uint32_t
+tvhtest_random ( void )
+{
+  tvhtest_seed ^= tvhtest_seed << 13;
+  tvhtest_seed ^= tvhtest_seed >> 17;
+  tvhtest_seed ^= tvhtest_seed << 5;
+  return tvhtest_seed;
+}
+
+/*
+ * Benchmark clock (ns)
+ */
+static inline int64_t
+tvhtest_clock ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void
+tvhtest_rate ( const char *name, int64_t ns, double bytes )
+{
+  printf("  %-24s %10.3f ms %10.1f MB/s\n", name, ns / 1e6,
+         ns > 0 ? bytes * 1000.0 / ns : 0.0);
+}
+
+#endif /* __TVH_TEST_H__ */